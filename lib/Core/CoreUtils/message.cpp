@@ -15,6 +15,8 @@
 #include <sys/types.h>
 
 #include <boost/date_time/posix_time/posix_time.hpp> //we need the to_string functions for the automatic conversion
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 
 #ifndef WIN32
 #include <signal.h>
@@ -30,6 +32,12 @@ struct IsEqualMsg {
 	std::string newMsg;
 	bool operator()( const std::pair<boost::posix_time::ptime, std::string>& ms ) {return ms.second == newMsg;}
 };
+/// guards the output stream and the lists of the last messages (messages can be committed from several threads, e.g. while loading files in parallel)
+static boost::mutex &printLock()
+{
+	static boost::mutex lock;
+	return lock;
+}
 }
 const char *logLevelName( LogLevel level )
 {
@@ -147,6 +155,8 @@ LogLevel MessageHandlerBase::m_stop_below = error;
 std::ostream *DefaultMsgPrint::o = &::std::cerr;
 void DefaultMsgPrint::commit( const Message &mesg )
 {
+	boost::lock_guard<boost::mutex> lock( _internal::printLock() );
+
 	//first remove everything which is to old anyway
 	std::list< std::pair<boost::posix_time::ptime, std::string> >::iterator begin = last.begin();
 	static const boost::posix_time::millisec dist( max_age );
@@ -178,6 +188,7 @@ void DefaultMsgPrint::commit( const Message &mesg )
 
 void DefaultMsgPrint::setStream( ::std::ostream &_o )
 {
+	boost::lock_guard<boost::mutex> lock( _internal::printLock() );
 	o->flush();
 	o = &_o;
 }
@@ -89,6 +89,7 @@ public:
  * Will print any issued message to the given output stream in the format:  "LOG_MODULE_NAME:LOG_LEVEL_NAME[LOCATION] MESSAGE"
  * The default output stream is std::cout. But can be set using setStream.
  * Location is the calling Object/Method if compiled without debug infos (NDEBUG is set) or FILENAME:LINE_NUMER if compiled with debug infos.
+ * Messages can be committed from several threads, the output is serialised by one lock.
  */
 class DefaultMsgPrint : public MessageHandlerBase
 {
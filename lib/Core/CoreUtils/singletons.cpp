@@ -1,5 +1,7 @@
 #include "singletons.hpp"
 #include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 
 namespace isis
 {
@@ -11,6 +13,13 @@ Singletons &Singletons::getMaster()
 	static Singletons me;
 	return me;
 }
+void Singletons::registerDestructer( int prio, destructer destruct )
+{
+	static boost::mutex lock; // singletons of different types might be created at the same time
+	boost::lock_guard<boost::mutex> guard( lock );
+	prioMap &map = getMaster().map;
+	map.insert( map.find( prio ), std::make_pair( prio, destruct ) );
+}
 Singletons::~Singletons()
 {
 	while ( !map.empty() ) {
@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 #include <typeinfo>
+#include <boost/thread/once.hpp>
 
 namespace isis
 {
@@ -27,7 +28,8 @@ namespace util
  * Singletons::get < MyClass, INT_MAX - 1 >
  * \endcode
  * This generates a Singleton of MyClass with highest priority.
- * \note This is (currently) not thread save.
+ * The creation of the singletons is thread save (each type is created once by boost::call_once, so getting an existing
+ * singleton does not lock anything). The singletons themself are not.
  */
 class Singletons
 {
@@ -39,6 +41,7 @@ class Singletons
 			_instance = 0;
 		}
 		static C *_instance;
+		static boost::once_flag _once;
 		Singleton () { }
 	public:
 		friend class Singletons;
@@ -51,6 +54,12 @@ class Singletons
 	Singletons();
 	virtual ~Singletons();
 	static Singletons &getMaster();
+	static void registerDestructer( int prio, destructer destruct );
+	template<typename T, int PRIO> static void create() {
+		// the constructor of T might ask for other singletons (e.g. for logging), so T is created without any lock held
+		Singleton<T>::_instance = new T();
+		registerDestructer( PRIO, Singleton<T>::destruct );
+	}
 public:
 	/**
 	 * The first call creates a singleton of type T with the priority PRIO (ascending order),
@@ -58,16 +67,12 @@ public:
 	 * \return a reference to the same object of type T.
 	 */
 	template<typename T, int PRIO> static T &get() {
-		if ( !Singleton<T>::_instance ) {
-			Singleton<T>::_instance = new T();
-			prioMap &map = getMaster().map;
-			map.insert( map.find( PRIO ), std::make_pair( PRIO, Singleton<T>::destruct ) );
-		}
-
+		boost::call_once( Singleton<T>::_once, &Singletons::create<T, PRIO> );
 		return *Singleton<T>::_instance;
 	}
 };
 template <typename C> C *Singletons::Singleton<C>::_instance = 0;
+template <typename C> boost::once_flag Singletons::Singleton<C>::_once = BOOST_ONCE_INIT;
 
 }
 }
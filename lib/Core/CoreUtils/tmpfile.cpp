@@ -22,7 +22,14 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
+#include <string.h>
 #include <fstream>
+#include <sstream>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 #define BOOST_FILESYSTEM_VERSION 3 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -53,5 +60,65 @@ TmpFile::~TmpFile()
 		LOG( Debug, warning ) << "Temporary file " << native() << " does not exist, won't delete it";
 	}
 }
+
+MemFile::MemFile( std::string name ): m_fd( -1 )
+{
+#if defined(__linux__) && defined(SYS_memfd_create)
+	if( name.length() > 249 ) // the kernel refuses longer names
+		name.resize( 249 );
+
+	m_fd = syscall( SYS_memfd_create, name.c_str(), 0 ); // use the syscall directly, older libc's don't have memfd_create
+
+	if( m_fd < 0 ) {
+		LOG( Debug, warning ) << "Failed to create anonymous file " << util::MSubject( name ) << ", the error was: " << strerror( errno );
+	} else {
+		std::stringstream fdpath;
+		fdpath << "/proc/self/fd/" << m_fd;
+		path::operator=( fdpath.str() );
+		LOG( Debug, info ) << "Created anonymous file " << util::MSubject( name ) << " as " << native();
+	}
+
+#else
+	LOG( Debug, info ) << "Anonymous files are not supported on this system, won't create " << util::MSubject( name );
+#endif
+}
+
+MemFile::~MemFile()
+{
+#ifdef __linux__
+
+	if( m_fd >= 0 ) {
+		LOG( Debug, verbose_info ) << "Closing anonymous file " << native();
+		close( m_fd );
+	}
+
+#endif
+}
+
+bool MemFile::good()const {return m_fd >= 0;}
+
+bool MemFile::write( const char *data, size_t len )
+{
+#ifdef __linux__
+
+	while( m_fd >= 0 && len ) {
+		const ssize_t written = ::write( m_fd, data, len );
+
+		if( written < 0 ) {
+			if( errno == EINTR )continue;
+
+			LOG( Runtime, error ) << "Failed to write to " << native() << ", the error was: " << strerror( errno );
+			return false;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return len == 0;
+#else
+	return false;
+#endif
+}
 }
 }
@@ -50,6 +50,37 @@ public:
 	///Will delete the temporary file if its still there.
 	~TmpFile();
 };
+
+/** Class to create and handle an anonymous file which only lives in memory.
+ * The file has no name in the filesystem and never touches a disk. It can be used instead of TmpFile, if an api needs a
+ * filename but the data shall not be written to disk (e.g. to give decompressed data to an io-plugin).
+ * This inherits from boost::filesystem::path and can be used as such. The path refers to the file through the file
+ * descriptor of the process (e.g. "/proc/self/fd/5"), so it is only valid inside this process.
+ * The file is closed (and its memory released) by the destructor, unless it is still mapped (e.g. by a data::FilePtr).
+ * Anonymous files are only supported on linux (through memfd_create), elsewhere good() will allways be false.
+ */
+class MemFile: public boost::filesystem::path, boost::noncopyable
+{
+private:
+	int m_fd;
+	// dont do this
+	MemFile( MemFile & );
+	MemFile &operator=( MemFile & );
+public:
+	/** Create an anonymous file.
+	 * \param name name of the file (only used for debugging, it does not show up in the filesystem, and is cut after 249 characters)
+	 */
+	MemFile( std::string name = "isis_memfile" );
+	///Will close the file.
+	~MemFile();
+	/// \returns true if the file was created, false if the system does not support anonymous files or the creation failed
+	bool good()const;
+	/**
+	 * Append data to the file.
+	 * \returns true if all data was written, false otherwise
+	 */
+	bool write( const char *data, size_t len );
+};
 }
 }
 #endif // TMPFILE_H
@@ -340,6 +340,19 @@ const util::PropertyValue &Chunk::propertyValueAt( const util::PropertyMap::KeyT
 	return vec.at( at );
 }
 
+bool Chunk::setPropertyValuesAt( const util::PropertyMap::KeyType &key, const std::vector<util::PropertyValue> &values )
+{
+	const size_t cSize = getSizeAsVector()[getRelevantDims() - 1];
+
+	if( values.size() != cSize ) {
+		LOG( Debug, warning ) << "Not setting the sub-property " << key << " to " << values.size() << " values, because the chunk has " << cSize;
+		return false;
+	}
+
+	propertyValueVec( key ) = values;
+	return true;
+}
+
 Chunk::iterator Chunk::begin()
 {
 	return asValueArrayBase().beginGeneric();
@@ -281,6 +281,18 @@ public:
 	util::PropertyValue &propertyValueAt( const util::PropertyMap::KeyType &key, size_t at );
 	/// \copydoc propertyValueAt
 	const util::PropertyValue &propertyValueAt( const util::PropertyMap::KeyType &key, size_t at )const;
+	/**
+	 * Set a property of the next lower dimension for all of them at once (e.g. the acquisition times of all slices of a volume).
+	 * This replaces the whole list, instead of resizing it and assigning one entry after another via propertyValueAt.
+	 * \param key the name of the property
+	 * \param values one value for every element of the next lower dimension
+	 * \returns false if the amount of values does not match the size of the chunk (the property is not changed then)
+	 */
+	bool setPropertyValuesAt( const util::PropertyMap::KeyType &key, const std::vector<util::PropertyValue> &values );
+	/// \copydoc setPropertyValuesAt
+	template<typename T> bool setPropertyValuesAt( const util::PropertyMap::KeyType &key, const std::vector<T> &values ) {
+		return setPropertyValuesAt( key, std::vector<util::PropertyValue>( values.begin(), values.end() ) );
+	}
 };
 
 /// Chunk class for memory-based buffers
@@ -15,6 +15,8 @@
 
 #include <iostream>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <boost/mpl/for_each.hpp>
 #include "../CoreUtils/singletons.hpp"
@@ -202,6 +204,80 @@ FilePtr::FilePtr( const boost::filesystem::path &filename, size_t len, bool writ
 	// from here on the pointer will be set if mapping succeded
 }
 
+namespace _internal
+{
+static bool madviseRange( const void *start, size_t len, FilePtr::access_pattern pattern, bool shared )
+{
+#ifdef WIN32
+	return false;
+#else
+	static const uintptr_t pagesize = sysconf( _SC_PAGESIZE );
+	uintptr_t begin = reinterpret_cast<uintptr_t>( start ), end = begin + len;
+	int advice;
+
+	switch( pattern ) {
+	case FilePtr::sequential:
+		advice = MADV_SEQUENTIAL;
+		break;
+	case FilePtr::random:
+		advice = MADV_RANDOM;
+		break;
+	case FilePtr::willneed:
+		advice = MADV_WILLNEED;
+		break;
+	case FilePtr::dontneed:
+		// MADV_DONTNEED would throw away modified pages of private mappings, so its only used on shared mappings (their data are in the file)
+		if( shared ) {
+			advice = MADV_DONTNEED;
+		} else {
+#ifdef MADV_COLD
+			advice = MADV_COLD; // just reclaim them first
+#else
+			return false;
+#endif
+		}
+
+		// don't touch pages which are only partly in the range
+		begin = ( begin + pagesize - 1 ) & ~( pagesize - 1 );
+		end &= ~( pagesize - 1 );
+		break;
+	default:
+		advice = MADV_NORMAL;
+	}
+
+	begin &= ~( pagesize - 1 ); // madvise needs page aligned addresses
+
+	if( end <= begin )
+		return true; // nothing to do
+
+	if( madvise( reinterpret_cast<void *>( begin ), end - begin, advice ) != 0 ) {
+		LOG( Debug, warning ) << "madvise failed for " << end - begin << " bytes at " << reinterpret_cast<void *>( begin ) << " (" << strerror( errno ) << ")";
+		return false;
+	}
+
+	return true;
+#endif
+}
+}
+
+bool FilePtr::advise( size_t offset, size_t len, access_pattern pattern )
+{
+	if( !m_good || offset >= getLength() )
+		return false;
+
+	if( len == 0 || len > getLength() - offset )
+		len = getLength() - offset;
+
+	return _internal::madviseRange( static_cast<uint8_t *>( getRawAddress( offset ).get() ), len, pattern, writing );
+}
+
+bool FilePtr::prefetch( size_t offset, size_t len ) {return advise( offset, len, willneed );}
+
+bool FilePtr::advise( const ValueArrayBase &data, access_pattern pattern )
+{
+	return _internal::madviseRange( data.getRawAddress().get(), data.getLength() * data.bytesPerElem(), pattern, false );
+}
+
 bool FilePtr::good() {return m_good;}
 
 void FilePtr::release()
@@ -144,6 +144,37 @@ public:
 	 */
 	data::ValueArrayReference atByID( unsigned short ID, size_t offset, size_t len = 0, bool swap_endianess = false );
 
+	/// the ways a part of a mapped file can be accessed (see advise)
+	enum access_pattern {
+		normal, ///< no special treatment
+		sequential, ///< it will be red in sequential order (the system reads ahead more aggressively)
+		random, ///< it will be red in random order (the system does not read ahead)
+		willneed, ///< it will be needed soon (the system starts reading it in the background)
+		dontneed ///< it wont be needed anymore (the system may drop it from memory first, its reread if its accessed again)
+	};
+	/**
+	 * Tell the system how a part of the mapped file will be accessed.
+	 * This is just a hint and never changes the data (modifications to files mapped read only are kept even if dontneed is given).
+	 * \param offset the position of the part in the file (in bytes)
+	 * \param len the length of the part in bytes (0 means up to the end of the file)
+	 * \param pattern the expected access
+	 * \returns true if the system accepted the hint, false otherwise (e.g. if its not supported on this platform)
+	 */
+	bool advise( size_t offset, size_t len, access_pattern pattern );
+	/**
+	 * Start reading a part of the mapped file in the background.
+	 * Useful to overlap reading the next part of a file (e.g. the next volume of a time series) with the processing of the current.
+	 * Same as advise( offset, len, willneed ).
+	 */
+	bool prefetch( size_t offset, size_t len );
+	/**
+	 * Tell the system how the memory of any ValueArray will be accessed.
+	 * This is meant for ValueArray created from a FilePtr (e.g. the voxel data of chunks red by a plugin), but can be used on any ValueArray.
+	 * As it is not known if the memory is mapped from a file, dontneed only marks it as to be dropped first, it is not dropped immediately.
+	 * \returns true if the system accepted the hint, false otherwise
+	 */
+	static bool advise( const ValueArrayBase &data, access_pattern pattern );
+
 	bool good();
 	void release();
 };
@@ -173,6 +173,72 @@ bool Image::insertChunk ( const Chunk &chunk )
 	}
 }
 
+bool Image::appendVolume ( const std::list<Chunk> &chunks )
+{
+	BOOST_FOREACH( const Chunk & ch, chunks ) {
+		if ( ch.getVolume() == 0 || ! ch.isValid() ) {
+			LOG( Runtime, error )
+					<< "Cannot append empty or invalid chunk (Size is " << ch.getSizeAsString() << ", missing properties: " << ch.getMissing() << ").";
+			return false;
+		}
+	}
+
+	if( ! clean ) { // there is no index to extend - so do it the usual way
+		LOG( Debug, info ) << "Image is not clean. Inserting the chunks and running reIndex ...";
+		bool inserted = true;
+		BOOST_FOREACH( const Chunk & ch, chunks ) {
+			inserted &= insertChunk( ch );
+		}
+		return reIndex() && inserted;
+	}
+
+	// the time dimension has to consist of the secondary sorting of the chunks (every chunk is one timestep at its position)
+	util::vector4<size_t> size = getSizeAsVector();
+
+	if( lookup[0]->getDimSize( timeDim ) > 1 || set.getHorizontalSize() != size[timeDim] ) {
+		LOG( Runtime, error ) << "Cannot append to the time dimension of an image, whose timesteps are not made of separate chunks";
+		return false;
+	}
+
+	const size_t positions = lookup.size() / size[timeDim];
+	const std::vector<boost::shared_ptr<Chunk> > appended = set.append( chunks, *this );
+
+	if( appended.empty() )
+		return false;
+
+	// find properties which where common in all chunks so far (the first chunk lacks them), but differ in or are missing from the new chunks
+	// (as in reIndex, a property missing in any chunk is not common)
+	KeyList uncommon;
+	BOOST_FOREACH( const boost::shared_ptr<Chunk> &ch, appended ) {
+		const DiffMap difference = getDifference( *ch );
+		BOOST_FOREACH( const DiffMap::value_type & ref, difference ) {
+			if( ! ref.second.first.isEmpty() && ! lookup[0]->hasProperty( ref.first ) )
+				uncommon.insert( ref.first );
+		}
+	}
+
+	if( ! uncommon.empty() ) {
+		LOG( Debug, info ) << "Moving " << util::listToString( uncommon.begin(), uncommon.end(), ", " ) << " back into all chunks, because they differ in or are missing from the appended chunks";
+		BOOST_FOREACH( const KeyType & key, uncommon ) {
+			for ( size_t i = 0; i != lookup.size(); i++ )
+				lookup[i]->propertyValue( key ) = propertyValue( key );
+
+			remove( key );
+		}
+	}
+
+	//remove common props from the new chunks
+	BOOST_FOREACH( const boost::shared_ptr<Chunk> &ch, appended ) {
+		ch->removeEqual( *this, true );
+	}
+
+	lookup.insert( lookup.end(), appended.begin(), appended.end() );
+	size[timeDim] += appended.size() / positions;
+	init( size );
+	LOG( Debug, info ) << "Appended " << appended.size() / positions << " timesteps, size of the image is " << getSizeAsString() << " now";
+	return true;
+}
+
 void Image::setIndexingDim( dimensions d )
 {
 	minIndexingDim = d;
@@ -514,6 +514,19 @@ public:
 	 * \returns true if the Chunk was inserted, false otherwise.
 	 */
 	bool insertChunk ( const Chunk &chunk );
+	/**
+	 * Append one or more volumes to the time dimension of an indexed Image.
+	 * Unlike insertChunk this does not reindex the whole image, so its costs only depend on the amount of the new chunks.
+	 * The chunks must be at the same positions as the chunks of one timestep of the image and must be sorted behind them
+	 * (e.g. have a higher acquisitionNumber). Every position must get the same amount of chunks.
+	 * Properties the new chunks have in common with the image are removed from them. Properties which where common
+	 * so far but differ in the new chunks are moved back into all chunks of the image (which is the only case where all chunks are touched).
+	 * If the image is not indexed yet, the chunks are inserted and the image is indexed the usual way.
+	 *
+	 * \param chunks the chunks to be appended
+	 * \returns true if all chunks were appended, false otherwise (the image is unchanged then).
+	 */
+	bool appendVolume ( const std::list<Chunk> &chunks );
 	/**
 	 * (Re)computes the image layout and metadata.
 	 * The image will be "clean" on success.
@@ -175,12 +175,19 @@ bool IOApplication::autoload ( const util::ParameterMap &parameters, std::list<I
 			<< ( dl.empty() ? "" : std::string( " using the dialect: " ) + dl );
 
 	bool no_progress = parameters["np"];
+	// applications which only need the metadata (like isisdump) can add the parameter "metadata"
+	const bool metadata_only = parameters.find( "metadata" ) != parameters.end() && parameters["metadata"];
+	// and the parameter "index" to use a metadata index of the directories they load
+	data::IOFactory::setUseMetadataIndex( metadata_only && parameters.find( "index" ) != parameters.end() && parameters["index"] );
+	// and the parameter "rthreads" to load the files of directories with that many threads (0 means one per core)
+	if( parameters.find( "rthreads" ) != parameters.end() )
+		data::IOFactory::setLoadThreads( ( uint16_t )parameters["rthreads"] );
 
 	if( !no_progress && feedback ) {
 		data::IOFactory::setProgressFeedback( feedback );
 	}
 
-	const std::list< Image > tImages = data::IOFactory::load( input, rf.c_str(), dl.c_str() );
+	const std::list< Image > tImages = data::IOFactory::load( input, rf.c_str(), dl.c_str(), metadata_only );
 
 	images.insert( images.end(), tImages.begin(), tImages.end() );
 
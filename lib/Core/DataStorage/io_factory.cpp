@@ -11,6 +11,7 @@
 //
 
 #include "io_factory.hpp"
+#include "metadata_index.hpp"
 #ifdef WIN32
 #include <windows.h>
 #include <Winbase.h>
@@ -20,6 +21,7 @@
 #include <dlfcn.h>
 #endif
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <algorithm>
 
@@ -30,6 +32,9 @@
 #include <boost/system/error_code.hpp>
 #include <boost/algorithm/string.hpp>
 #include "../CoreUtils/singletons.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/locks.hpp>
 
 namespace isis
 {
@@ -74,11 +79,39 @@ bool invalid_and_tell( Chunk &candidate )
 	return !candidate.isValid();
 }
 
+/// read up to image_io::FileFormat::magic_size bytes from the start of a file (returns an empty array on failure)
+ValueArray<uint8_t> readMagic( const boost::filesystem::path &filename )
+{
+	boost::system::error_code err;
+
+	if( !boost::filesystem::is_regular_file( filename, err ) )
+		return ValueArray<uint8_t>( ( uint8_t * )NULL, 0 );
+
+	std::ifstream in( filename.native().c_str(), std::ios_base::binary );
+	uint8_t *buff = ( uint8_t * )malloc( image_io::FileFormat::magic_size );
+	in.read( ( char * )buff, image_io::FileFormat::magic_size );
+	const size_t red = in.gcount();
+	LOG( Debug, verbose_info ) << "Red " << red << " bytes from " << util::MSubject( filename ) << " to check for magic";
+	return ValueArray<uint8_t>( buff, red );
+}
+
+/// files of a directory which are loaded by a pool of threads (see IOFactory::loadPath)
+struct load_queue {
+	const std::vector<boost::filesystem::path> &files;
+	std::vector<std::list<Chunk> > &buffers;
+	std::vector<size_t> todo; // indices of the files to be loaded
+	size_t next, loaded;
+	boost::mutex lock;
+	util::istring suffix_override, dialect;
+	bool metadata_only;
+	load_queue( const std::vector<boost::filesystem::path> &_files, std::vector<std::list<Chunk> > &_buffers ): files( _files ), buffers( _buffers ), next( 0 ), loaded( 0 ) {}
+};
+
 }
 /// @endcond _internal
 API_EXCLUDE_BEGIN
 
-IOFactory::IOFactory()
+IOFactory::IOFactory(): m_use_index( false ), m_load_threads( 1 )
 {
 	const char *env_path = getenv( "ISIS_PLUGIN_PATH" );
 	const char *env_home = getenv( "HOME" );
@@ -214,10 +247,11 @@ IOFactory &IOFactory::get()
 	return util::Singletons::get<IOFactory, INT_MAX>();
 }
 
-size_t IOFactory::loadFile( std::list<Chunk> &ret, const boost::filesystem::path &filename, util::istring suffix_override, util::istring dialect )
+size_t IOFactory::loadFile( std::list<Chunk> &ret, const boost::filesystem::path &filename, util::istring suffix_override, util::istring dialect, bool metadata_only )
 {
 	FileFormatList formatReader;
 	formatReader = getFileFormatList( filename.string(), suffix_override, dialect );
+	sortByMagic( formatReader, filename, dialect, suffix_override.empty() ); // don't add other formats if the user enforced one
 	const util::istring with_dialect = dialect.empty() ?
 									   util::istring( "" ) : util::istring( " with dialect \"" ) + dialect + "\"";
 
@@ -237,7 +271,7 @@ size_t IOFactory::loadFile( std::list<Chunk> &ret, const boost::filesystem::path
 					<< "plugin to load file" << with_dialect << " " << util::MSubject( filename ) << ": " << it->getName();
 
 			try {
-				int loaded=it->load( ret, filename.native(), dialect, m_feedback );
+				int loaded = it->load( ret, filename.native(), dialect, m_feedback, metadata_only );
 				BOOST_FOREACH( Chunk & ref, ret ) {
 					if ( ! ref.hasProperty( "source" ) )
 						ref.setPropertyAs( "source", filename.native() );
@@ -298,6 +332,45 @@ IOFactory::FileFormatList IOFactory::getFileFormatList( std::string filename, ut
 	return ret;
 }
 
+bool IOFactory::sortByMagic( FileFormatList &formats, const boost::filesystem::path &filename, const util::istring &dialect, bool add_unlisted )const
+{
+	const ValueArray<uint8_t> head = _internal::readMagic( filename );
+
+	if( head.getLength() == 0 )
+		return false;
+
+	FileFormatList recognised, others;
+	BOOST_FOREACH( FileFormatList::const_reference it, formats ) {
+		( it->checkMagic( head ) ? recognised : others ).push_back( it );
+	}
+
+	if( recognised.empty() && add_unlisted ) { // none of the suffix-based formats knows the file, ask all others
+		BOOST_FOREACH( FileFormatList::const_reference it, io_formats ) {
+			if( std::find( formats.begin(), formats.end(), it ) == formats.end() && it->checkMagic( head ) )
+				recognised.push_back( it );
+		}
+
+		if( !dialect.empty() ) {
+			_internal::dialect_missing remove_op;
+			remove_op.dialect = dialect;
+			remove_op.filename = filename.string();
+			recognised.remove_if( remove_op );
+		}
+	}
+
+	const bool found = !recognised.empty();
+
+	if( found ) {
+		LOG( Debug, info )
+				<< recognised.size() << " plugins recognised the content of " << util::MSubject( filename ) << ", "
+				<< recognised.front()->getName() << " will be tried first";
+	}
+
+	formats.swap( recognised );
+	formats.splice( formats.end(), others );
+	return found;
+}
+
 std::list< Image > IOFactory::chunkListToImageList( std::list<Chunk> &src )
 {
 	// throw away invalid chunks
@@ -330,21 +403,21 @@ std::list< Image > IOFactory::chunkListToImageList( std::list<Chunk> &src )
 	return ret;
 }
 
-size_t IOFactory::load( std::list<data::Chunk> &chunks, const std::string &path, util::istring suffix_override, util::istring dialect )
+size_t IOFactory::load( std::list<data::Chunk> &chunks, const std::string &path, util::istring suffix_override, util::istring dialect, bool metadata_only )
 {
 	const boost::filesystem::path p( path );
 	const size_t loaded = boost::filesystem::is_directory( p ) ?
-						  get().loadPath( chunks, p, suffix_override, dialect ) :
-						  get().loadFile( chunks, p, suffix_override, dialect );
+						  get().loadPath( chunks, p, suffix_override, dialect, metadata_only ) :
+						  get().loadFile( chunks, p, suffix_override, dialect, metadata_only );
 	return loaded;
 }
 
-std::list< Image > IOFactory::load ( const util::slist &paths, util::istring suffix_override, util::istring dialect )
+std::list< Image > IOFactory::load ( const util::slist &paths, util::istring suffix_override, util::istring dialect, bool metadata_only )
 {
 	std::list<Chunk> chunks;
 	size_t loaded = 0;
 	BOOST_FOREACH( const std::string & path, paths ) {
-		loaded += load( chunks, path , suffix_override, dialect );
+		loaded += load( chunks, path , suffix_override, dialect, metadata_only );
 	}
 	const std::list<data::Image> images = chunkListToImageList( chunks );
 	LOG( Runtime, info )
@@ -352,27 +425,108 @@ std::list< Image > IOFactory::load ( const util::slist &paths, util::istring suf
 	return images;
 }
 
-std::list<data::Image> IOFactory::load( const std::string &path, util::istring suffix_override, util::istring dialect )
+std::list<data::Image> IOFactory::load( const std::string &path, util::istring suffix_override, util::istring dialect, bool metadata_only )
 {
-	return load( util::slist( 1, path ), suffix_override, dialect );
+	return load( util::slist( 1, path ), suffix_override, dialect, metadata_only );
 }
 
-size_t IOFactory::loadPath( std::list<Chunk> &ret, const boost::filesystem::path &path, util::istring suffix_override, util::istring dialect )
+void IOFactory::loadQueue( _internal::load_queue &queue )
 {
-	int loaded = 0;
+	for( ;; ) {
+		size_t index;
+		{
+			const boost::lock_guard<boost::mutex> lock( queue.lock );
 
-	if( m_feedback ) {
-		const size_t length = std::distance( boost::filesystem::directory_iterator( path ), boost::filesystem::directory_iterator() ); //@todo this will also count directories
-		m_feedback->show( length, std::string( "Reading " ) + util::Value<std::string>( length ).toString( false ) + " files from " + path.native() );
+			if( queue.next == queue.todo.size() )
+				return;
+
+			index = queue.todo[queue.next++];
+		}
+
+		size_t loaded = 0;
+
+		try {
+			loaded = loadFile( queue.buffers[index], queue.files[index], queue.suffix_override, queue.dialect, queue.metadata_only );
+		} catch( std::exception &e ) { // exceptions must not leave the thread
+			LOG( Runtime, error ) << "Failed to load " << queue.files[index] << " (" << e.what() << ")";
+		}
+
+		const boost::lock_guard<boost::mutex> lock( queue.lock );
+		queue.loaded += loaded;
+
+		if( m_feedback )
+			m_feedback->progress();
 	}
+}
+
+size_t IOFactory::loadPath( std::list<Chunk> &ret, const boost::filesystem::path &path, util::istring suffix_override, util::istring dialect, bool metadata_only )
+{
+	std::auto_ptr<MetadataIndex> index( metadata_only && m_use_index ? new MetadataIndex( path ) : NULL );
+	std::vector<boost::filesystem::path> files;
 
 	for ( boost::filesystem::directory_iterator i( path ); i != boost::filesystem::directory_iterator(); ++i )  {
 		if ( boost::filesystem::is_directory( *i ) )continue;
 
-		loaded += loadFile( ret, *i, suffix_override, dialect );
+		files.push_back( *i );
+	}
 
-		if( m_feedback )
-			m_feedback->progress();
+	if( m_feedback ) {
+		m_feedback->show( files.size(), std::string( "Reading " ) + util::Value<std::string>( files.size() ).toString( false ) + " files from " + path.native() );
+	}
+
+	// plugins may add their chunks anywhere in the list, so every file is loaded into a separate one
+	std::vector<std::list<Chunk> > buffers( files.size() );
+	std::vector<bool> from_index( files.size(), false );
+	_internal::load_queue parallel( files, buffers ), serial( files, buffers );
+	parallel.suffix_override = serial.suffix_override = suffix_override;
+	parallel.dialect = serial.dialect = dialect;
+	parallel.metadata_only = serial.metadata_only = metadata_only;
+
+	for( size_t i = 0; i < files.size(); i++ ) {
+		if( index.get() && index->get( files[i], buffers[i] ) ) {
+			LOG( Debug, verbose_info ) << "Took " << buffers[i].size() << " chunks for " << files[i] << " from the metadata index";
+			parallel.loaded += buffers[i].size();
+			from_index[i] = true;
+
+			if( m_feedback )
+				m_feedback->progress();
+		} else { // files which can only be loaded by thread safe plugins can be loaded in parallel
+			const FileFormatList formats = getFileFormatList( files[i].native(), suffix_override, dialect );
+			bool thread_safe = !formats.empty();
+			BOOST_FOREACH( FileFormatList::const_reference format, formats ) {
+				thread_safe &= format->threadSafe( files[i].native() );
+			}
+			( thread_safe ? parallel : serial ).todo.push_back( i );
+		}
+	}
+
+	const size_t workers = std::min<size_t>( m_load_threads ? m_load_threads : boost::thread::hardware_concurrency(), parallel.todo.size() );
+
+	if( workers > 1 ) {
+		LOG( Debug, info ) << "Loading " << parallel.todo.size() << " files from " << path << " using " << workers << " threads";
+		boost::thread_group pool;
+
+		for( size_t i = 0; i < workers; i++ )
+			pool.create_thread( boost::bind( &IOFactory::loadQueue, this, boost::ref( parallel ) ) );
+
+		pool.join_all();
+	} else
+		loadQueue( parallel );
+
+	loadQueue( serial );
+
+	for( size_t i = 0; i < files.size(); i++ ) {
+		if( index.get() && !from_index[i] )
+			index->put( files[i], buffers[i].begin(), buffers[i].end() );
+
+		ret.splice( ret.end(), buffers[i] );
+	}
+
+	const size_t loaded = parallel.loaded + serial.loaded;
+
+	if( index.get() ) {
+		index->purge();
+		index->write();
 	}
 
 	if( m_feedback )
@@ -435,6 +589,16 @@ void IOFactory::setProgressFeedback( boost::shared_ptr<util::ProgressFeedback> f
 	This.m_feedback = feedback;
 }
 
+void IOFactory::setUseMetadataIndex( bool enable )
+{
+	get().m_use_index = enable;
+}
+
+void IOFactory::setLoadThreads( unsigned int threads )
+{
+	get().m_load_threads = threads;
+}
+
 IOFactory::FileFormatList IOFactory::getFormats()
 {
 	return get().io_formats;
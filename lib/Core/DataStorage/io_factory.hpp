@@ -33,6 +33,12 @@ namespace isis
 {
 namespace data
 {
+/// @cond _internal
+namespace _internal
+{
+struct load_queue;
+}
+/// @endcond _internal
 
 class IOFactory
 {
@@ -43,6 +49,8 @@ public:
 
 private:
 	boost::shared_ptr<util::ProgressFeedback> m_feedback;
+	bool m_use_index;
+	unsigned int m_load_threads;
 	// use ImageIO's logging here instead of the normal data::Runtime/Debug
 	typedef ImageIoLog Runtime;
 	typedef ImageIoDebug Debug;
@@ -52,27 +60,30 @@ public:
 	 * @param paths list if files or directories to load
 	 * @param suffix_override override the given suffix with this one (especially if there's no suffix)
 	 * @param dialect dialect of the fileformat to load
+	 * @param metadata_only only read the metadata, the voxel data of the images is undefined (see image_io::FileFormat::load)
 	 * @return list of images created from the loaded data
 	 * @note the images a re created from all loaded files, so loading mutilple files can very well result in only one image
 	 */
-	static std::list<data::Image> load( const util::slist &paths, util::istring suffix_override = "", util::istring dialect = "" );
+	static std::list<data::Image> load( const util::slist &paths, util::istring suffix_override = "", util::istring dialect = "", bool metadata_only = false );
 	/**
 	 * Load a data file or directory with given filename and dialect.
 	 * @param path file or directory to load
 	 * @param suffix_override override the given suffix with this one (especially if there's no suffix)
 	 * @param dialect dialect of the fileformat to load
+	 * @param metadata_only only read the metadata, the voxel data of the images is undefined (see image_io::FileFormat::load)
 	 * @return list of images created from the loaded data
 	 */
-	static std::list<data::Image> load( const std::string &path, util::istring suffix_override = "", util::istring dialect = "" );
+	static std::list<data::Image> load( const std::string &path, util::istring suffix_override = "", util::istring dialect = "", bool metadata_only = false );
 	/**
 	 * Load a data file with given filename and dialect into a chunklist.
 	 * @param chunks list to store the loaded chunks in
 	 * @param path file or directory to load
 	 * @param suffix_override override the given suffix with this one (especially if there's no suffix)
 	 * @param dialect dialect of the fileformat to load
+	 * @param metadata_only only read the metadata, the voxel data of the chunks is undefined (see image_io::FileFormat::load)
 	 * @return list of chunks (part of an image)
 	 */
-	static size_t load( std::list<data::Chunk> &chunks, const std::string &path, util::istring suffix_override = "", util::istring dialect = "" );
+	static size_t load( std::list<data::Chunk> &chunks, const std::string &path, util::istring suffix_override = "", util::istring dialect = "", bool metadata_only = false );
 
 	static bool write( const data::Image &image, const std::string &path, util::istring suffix_override = "", util::istring dialect = "" );
 	static bool write( std::list<data::Image> images, const std::string &path, util::istring suffix_override = "", util::istring dialect = "" );
@@ -82,6 +93,21 @@ public:
 
 	static void setProgressFeedback( boost::shared_ptr<util::ProgressFeedback> feedback );
 
+	/**
+	 * Enable or disable the use of a MetadataIndex when loading directories with metadata_only.
+	 * If enabled, the metadata of files which didn't change since the last load are taken from the index
+	 * of the directory instead of the files. New or changed files are loaded and added to the index.
+	 * The index is stored in the cache directory of the user (see MetadataIndex::defaultCache), never in the loaded directory.
+	 * The index is disabled by default.
+	 */
+	static void setUseMetadataIndex( bool enable );
+
+	/**
+	 * Set the amount of threads loading the files of a directory (see loadPath).
+	 * 0 means one thread per core. The default is 1, so directories are loaded by the calling thread only.
+	 */
+	static void setLoadThreads( unsigned int threads );
+
 	/**
 	 * Get all formats which should be able to read/write the given file.
 	 * \param filename the file which should be red/written
@@ -98,8 +124,26 @@ public:
 	 */
 	static std::list<data::Image> chunkListToImageList( std::list<Chunk> &chunks );
 protected:
-	size_t loadFile( std::list<Chunk> &ret, const boost::filesystem::path &filename, util::istring suffix_override = "", util::istring dialect = "" );
-	size_t loadPath( std::list<Chunk> &ret, const boost::filesystem::path &path, util::istring suffix_override = "", util::istring dialect = "" );
+	size_t loadFile( std::list<Chunk> &ret, const boost::filesystem::path &filename, util::istring suffix_override = "", util::istring dialect = "", bool metadata_only = false );
+	/**
+	 * Load all files in a directory.
+	 * Files which are only claimed by thread safe plugins (see image_io::FileFormat::threadSafe) are loaded by a pool of threads if enabled (see setLoadThreads).
+	 * The chunks are added in the order of the files in the directory.
+	 */
+	size_t loadPath( std::list<Chunk> &ret, const boost::filesystem::path &path, util::istring suffix_override = "", util::istring dialect = "", bool metadata_only = false );
+	/// load the files of the queue until it is empty (the worker of loadPath)
+	void loadQueue( _internal::load_queue &queue );
+	/**
+	 * Reorder a list of formats by the content of the given file.
+	 * The first FileFormat::magic_size bytes of the file are red once and given to FileFormat::checkMagic of every format.
+	 * Formats recognising them are moved to the front of the list.
+	 * \param formats the list of formats to be reordered
+	 * \param filename the file to probe
+	 * \param dialect if given, formats added from the magic must support it
+	 * \param add_unlisted if true, and no format in the list recognised the file, all other known formats recognising it are added in front
+	 * \returns true if at least one of the formats recognised the file
+	 */
+	bool sortByMagic( FileFormatList &formats, const boost::filesystem::path &filename, const util::istring &dialect, bool add_unlisted )const;
 
 	static IOFactory &get();
 	IOFactory();//shall not be created directly
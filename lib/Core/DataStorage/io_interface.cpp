@@ -46,6 +46,16 @@ void FileFormat::write( const std::list< data::Image >& images, const std::strin
 		}
 	}
 }
+int FileFormat::load( std::list< data::Chunk >& chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr< util::ProgressFeedback > feedback, bool metadata_only ) throw( std::runtime_error & )
+{
+	LOG_IF( metadata_only, Debug, verbose_info ) << getName() << " does not support loading metadata only, will do a full load of " << util::MSubject( filename );
+	return load( chunks, filename, dialect, feedback );
+}
+bool FileFormat::writeStream( const data::Image &/*image*/, std::ostream &/*out*/, const std::string &filename, const util::istring &/*dialect*/, boost::shared_ptr<util::ProgressFeedback> /*feedback*/ ) throw( std::runtime_error & )
+{
+	LOG( Debug, verbose_info ) << getName() << " cannot write " << util::MSubject( filename ) << " into a stream";
+	return false;
+}
 bool FileFormat::setGender( util::PropertyMap &object, const char *set, const char *entries )
 {
 	util::Selection g( entries );
@@ -58,7 +68,7 @@ bool FileFormat::setGender( util::PropertyMap &object, const char *set, const ch
 	return false;
 }
 
-bool FileFormat::hasOrTell( const util::PropertyMap::KeyType &name, const util::PropertyMap &object, LogLevel level )
+bool FileFormat::hasOrTell( const util::PropertyMap::PropPath &name, const util::PropertyMap &object, LogLevel level )
 {
 	if ( object.hasProperty( name ) ) {
 		return true;
@@ -68,6 +78,16 @@ bool FileFormat::hasOrTell( const util::PropertyMap::KeyType &name, const util::
 	}
 }
 
+bool FileFormat::transformOrTell( const util::PropertyMap::PropPath &from, const util::PropertyMap::PropPath &to, util::PropertyMap &object, unsigned short dstID, LogLevel level )
+{
+	if ( hasOrTell( from, object, level ) and object.transform( from, to, dstID ) ) {
+		LOG( Debug, verbose_info ) << "Transformed " << from << " into " << object.propertyValue( to );
+		return true;
+	}
+
+	return false;
+}
+
 void FileFormat::throwGenericError( std::string desc )
 {
 	throw( std::runtime_error( desc ) );
@@ -93,6 +113,9 @@ std::pair< std::string, std::string > FileFormat::makeBasename( const std::strin
 	std::list<util::istring> supported_suffixes = getSuffixes();
 	util::istring ifilename( filename.begin(), filename.end() );
 	BOOST_FOREACH( const util::istring & suffix, supported_suffixes ) {
+		if( suffix.length() >= filename.length() ) // there must be at least the "." before the suffix
+			continue;
+
 		util::istring check = ifilename.substr( ifilename.length() - suffix.length(), suffix.length() );
 
 		if( filename[filename.length() - suffix.length() - 1] == '.' && check == suffix ) {
@@ -15,6 +15,7 @@
 
 #ifdef __cplusplus
 #include <string>
+#include <iosfwd>
 #include <boost/system/system_error.hpp>
 #include "image.hpp"
 #include "common.hpp"
@@ -43,21 +44,19 @@ protected:
 	 * If the property doesn't exist a message will be sent to Log using the given loglevel.
 	 * \returns object.hasProperty(name)
 	 */
-	static bool hasOrTell( const util::PropertyMap::KeyType &name, const util::PropertyMap &object, LogLevel level );
+	static bool hasOrTell( const util::PropertyMap::PropPath &name, const util::PropertyMap &object, LogLevel level );
 	/**
 	 * Transform a given property into another and remove the original in the given PropMap.
 	 * If the property doesn't exist a message will be sent to Log using the given loglevel.
 	 * \returns true if the property existed and was transformed.
 	 */
 	template<typename TYPE> static bool
-	transformOrTell( const util::PropertyMap::KeyType &from, const util::PropertyMap::KeyType &to, util::PropertyMap &object, LogLevel level ) {
-		if ( hasOrTell( from, object, level ) and object.transform<TYPE>( from, to ) ) {
-			LOG( Debug, verbose_info ) << "Transformed " << from << " into " << object.propertyValue( to );
-			return true;
-		}
-
-		return false;
+	transformOrTell( const util::PropertyMap::PropPath &from, const util::PropertyMap::PropPath &to, util::PropertyMap &object, LogLevel level ) {
+		util::checkType<TYPE>();
+		return transformOrTell( from, to, object, util::Value<TYPE>::staticID, level );
 	}
+	/// \copydoc transformOrTell \param dstID the type id of the transformed property
+	static bool transformOrTell( const util::PropertyMap::PropPath &from, const util::PropertyMap::PropPath &to, util::PropertyMap &object, unsigned short dstID, LogLevel level );
 	/// \return the file-suffixes the plugin supports
 	virtual util::istring suffixes(io_modes modes=both)const = 0;
 	static const float invalid_float;
@@ -95,6 +94,27 @@ public:
 	/// \return if the plugin is not part of the official distribution
 	virtual bool tainted()const {return true;}
 
+	/**
+	 * Check if the plugin can load the given file while other files are loaded by the same plugin in other threads.
+	 * Proxy plugins use this to parse several files in parallel (e.g. the members of a tar archive).
+	 * The default implementation returns false.
+	 * \returns true if load does not change the plugin and uses no other global state
+	 */
+	virtual bool threadSafe( const std::string &/*filename*/ )const {return false;}
+
+	/// the amount of bytes the IOFactory reads from the start of a file to feed them to checkMagic
+	static const size_t magic_size = 4096;
+
+	/**
+	 * Check if the given data looks like the start of a file this plugin can read.
+	 * The IOFactory reads the first magic_size bytes of a file once and asks all candidate plugins.
+	 * Plugins recognising the data are tried first. If no plugin claims the suffix of a file, all plugins recognising the data are used.
+	 * The default implementation knows no magic and returns false.
+	 * \param head the first bytes of the file (may be shorter than magic_size if the file is small)
+	 * \returns true if head starts with the signature of the format
+	 */
+	virtual bool checkMagic( const data::ValueArray<uint8_t> &/*head*/ )const {return false;}
+
 	/**
 	 * Load data into the given chunk list.
 	 * I case of an error std::runtime_error will be thrown.
@@ -107,6 +127,22 @@ public:
 	virtual int load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> feedback )
 	throw( std::runtime_error & ) = 0; //@todo should be locked
 
+	/**
+	 * Load data into the given chunk list, optionally skipping the voxel data.
+	 * If metadata_only is set, the plugin shall only parse the metadata and must not read or decode the voxel data.
+	 * The resulting chunks have the same size, type and properties as after a full load, but their voxel data is deferred
+	 * (a lazy mapping of the file or an unmaterialized placeholder) and its content is undefined.
+	 * The default implementation ignores metadata_only and does a full load.
+	 * \param chunks the chunk list where the loaded chunks shall be added to
+	 * \param filename the name of the file to load from (the system does NOT check if this file exists)
+	 * \param dialect the dialect to be used when loading the file (use "" to not define a dialect)
+	 * \param feedback a shared_ptr to a ProgressFeedback-object to inform about loading progress. Not used if zero.
+	 * \param metadata_only if true, only the metadata of the file is red
+	 * \returns the amount of loaded chunks.
+	 */
+	virtual int load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> feedback, bool metadata_only )
+	throw( std::runtime_error & );
+
 	/**
 	 * Write a single image to a file.
 	 * I case of an error std::runtime_error will be thrown.
@@ -118,6 +154,22 @@ public:
 	virtual void write( const data::Image &image, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> feedback )
 	throw( std::runtime_error & ) = 0;
 
+	/**
+	 * Write a single image into a stream instead of a file.
+	 * Proxy plugins use this to pass the data on as they are written (e.g. into a compressor), so the whole file never has to exist.
+	 * The data must be written in the order of the file, so the plugin should keep no more than a part of the image in memory.
+	 * I case of an error std::runtime_error will be thrown.
+	 * The default implementation does not support streams and returns false.
+	 * \param image the image to be written
+	 * \param out the stream to write the file into
+	 * \param filename the name of the file as it would be written without the proxy (used for side files and messages)
+	 * \param dialect the dialect to be used when writing the file (use "" to not define a dialect)
+	 * \param feedback a shared_ptr to a ProgressFeedback-object to inform about writing progress. Not used if zero.
+	 * \returns true if the image was written, false (without writing anything) if the plugin cannot write the image into a stream
+	 */
+	virtual bool writeStream( const data::Image &image, std::ostream &out, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> feedback )
+	throw( std::runtime_error & );
+
 	/**
 	 * Write a image list.
 	 * I case of an error std::runtime_error will be thrown.
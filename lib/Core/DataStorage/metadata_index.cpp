@@ -0,0 +1,576 @@
+//
+// C++ Implementation: metadata_index
+//
+// Description: persistent index of the metadata of the files in a directory
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+
+#include "metadata_index.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <boost/foreach.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/system/error_code.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+#include "../CoreUtils/singletons.hpp"
+
+// we need that, because boost::mpl::for_each will instantiate all types - and this needs the output stream operations
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace isis
+{
+namespace data
+{
+API_EXCLUDE_BEGIN
+/// @cond _internal
+namespace _internal
+{
+static const char index_magic[8] = {'I', 'S', 'I', 'S', 'I', 'D', 'X', '2'};
+static const uint32_t index_byteorder = 0x01020304;
+
+/// 64bit FNV-1a hash of a string (used to name the index file of a directory, so it must not change between builds)
+uint64_t fnv1a( const std::string &str )
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	BOOST_FOREACH( const char c, str ) {
+		hash = ( hash ^ static_cast<uint8_t>( c ) ) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// binary (de)serialisation of all types of util::_internal::types in host byte order
+
+template<typename T> typename boost::enable_if<boost::is_arithmetic<T> >::type writeBin( std::ostream &out, const T &val )
+{
+	out.write( reinterpret_cast<const char *>( &val ), sizeof( T ) );
+}
+template<typename T> typename boost::enable_if<boost::is_arithmetic<T>, bool >::type readBin( std::istream &in, T &val )
+{
+	return in.read( reinterpret_cast<char *>( &val ), sizeof( T ) );
+}
+
+void writeBin( std::ostream &out, const std::string &val )
+{
+	writeBin<uint32_t>( out, val.length() );
+	out.write( val.data(), val.length() );
+}
+bool readBin( std::istream &in, std::string &val )
+{
+	uint32_t len;
+
+	if( !readBin( in, len ) )
+		return false;
+
+	val.resize( len );
+	return len == 0 || in.read( &val[0], len );
+}
+
+template<typename T> void writeBin( std::ostream &out, const util::color<T> &val )
+{
+	writeBin( out, val.r );writeBin( out, val.g );writeBin( out, val.b );
+}
+template<typename T> bool readBin( std::istream &in, util::color<T> &val )
+{
+	return readBin( in, val.r ) && readBin( in, val.g ) && readBin( in, val.b );
+}
+
+template<typename T, size_t SIZE, typename C> void writeBin( std::ostream &out, const util::FixedVector<T, SIZE, C> &val )
+{
+	for( typename util::FixedVector<T, SIZE, C>::const_iterator i = val.begin(); i != val.end(); ++i )
+		writeBin( out, *i );
+}
+template<typename T, size_t SIZE, typename C> bool readBin( std::istream &in, util::FixedVector<T, SIZE, C> &val )
+{
+	for( typename util::FixedVector<T, SIZE, C>::iterator i = val.begin(); i != val.end(); ++i )
+		if( !readBin( in, *i ) )
+			return false;
+
+	return true;
+}
+
+template<typename T> void writeBin( std::ostream &out, const std::list<T> &val )
+{
+	writeBin<uint32_t>( out, val.size() );
+	BOOST_FOREACH( const T & ref, val ) {
+		writeBin( out, ref );
+	}
+}
+template<typename T> bool readBin( std::istream &in, std::list<T> &val )
+{
+	uint32_t len;
+
+	if( !readBin( in, len ) )
+		return false;
+
+	val.clear();
+
+	for( uint32_t i = 0; i < len; i++ ) {
+		val.push_back( T() );
+
+		if( !readBin( in, val.back() ) )
+			return false;
+	}
+
+	return true;
+}
+
+template<typename T> void writeBin( std::ostream &out, const std::complex<T> &val )
+{
+	writeBin( out, val.real() );writeBin( out, val.imag() );
+}
+template<typename T> bool readBin( std::istream &in, std::complex<T> &val )
+{
+	T re, im;
+
+	if( readBin( in, re ) && readBin( in, im ) ) {
+		val = std::complex<T>( re, im );
+		return true;
+	} else
+		return false;
+}
+
+// Selection only tells the names of its entries, so we find the numbers by setting a copy to each of them
+void writeBin( std::ostream &out, const util::Selection &val )
+{
+	const std::list<util::istring> entries = val.getEntries();
+	writeBin<uint32_t>( out, entries.size() );
+	BOOST_FOREACH( const util::istring & name, entries ) {
+		util::Selection probe = val;
+		probe.set( name.c_str() );
+		writeBin<uint16_t>( out, ( int )probe );
+		writeBin( out, std::string( name.c_str() ) );
+	}
+	writeBin( out, ( int )val ? std::string( ( ( util::istring )val ).c_str() ) : std::string() );
+}
+bool readBin( std::istream &in, util::Selection &val )
+{
+	uint32_t len;
+	std::map<uint16_t, std::string> entries;
+	std::string current;
+
+	if( !readBin( in, len ) )
+		return false;
+
+	for( uint32_t i = 0; i < len; i++ ) {
+		uint16_t id;
+		std::string name;
+
+		if( !( readBin( in, id ) && readBin( in, name ) ) )
+			return false;
+
+		entries[id] = name;
+	}
+
+	if( !readBin( in, current ) )
+		return false;
+
+	val = util::Selection( entries );
+
+	if( !current.empty() )
+		val.set( current.c_str() );
+
+	return true;
+}
+
+void writeBin( std::ostream &out, const boost::posix_time::ptime &val )
+{
+	writeBin( out, boost::posix_time::to_iso_string( val ) );
+}
+bool readBin( std::istream &in, boost::posix_time::ptime &val )
+{
+	std::string buff;
+
+	if( !readBin( in, buff ) )
+		return false;
+
+	try {
+		val = boost::posix_time::from_iso_string( buff );
+	} catch( std::exception & ) {
+		val = boost::posix_time::ptime( boost::posix_time::not_a_date_time );
+	}
+
+	return true;
+}
+
+void writeBin( std::ostream &out, const boost::gregorian::date &val )
+{
+	writeBin( out, boost::gregorian::to_iso_string( val ) );
+}
+bool readBin( std::istream &in, boost::gregorian::date &val )
+{
+	std::string buff;
+
+	if( !readBin( in, buff ) )
+		return false;
+
+	try {
+		val = boost::gregorian::from_undelimited_string( buff );
+	} catch( std::exception & ) {
+		val = boost::gregorian::date( boost::gregorian::not_a_date_time );
+	}
+
+	return true;
+}
+
+/// maps the ID of each type to its writer and reader
+struct CodecMap {
+	typedef void ( *writer_type )( std::ostream &, const util::ValueBase & );
+	typedef bool ( *reader_type )( std::istream &, util::PropertyValue & );
+	std::map<unsigned short, std::pair<writer_type, reader_type> > codecs;
+
+	template<class T> static void writer( std::ostream &out, const util::ValueBase &val ) {
+		writeBin( out, val.castTo<T>() );
+	}
+	template<class T> static bool reader( std::istream &in, util::PropertyValue &dst ) {
+		T val = T();
+
+		if( !readBin( in, val ) )
+			return false;
+
+		dst = util::PropertyValue( val, dst.isNeeded() );
+		return true;
+	}
+	struct proc {
+		CodecMap *m_map;
+		proc( CodecMap *map ): m_map( map ) {}
+		template<class T> void operator()( const T & ) {
+			m_map->codecs.insert( std::make_pair( util::Value<T>::staticID, std::make_pair( &writer<T>, &reader<T> ) ) );
+		}
+	};
+	CodecMap() {
+		boost::mpl::for_each<util::_internal::types>( proc( this ) );
+		assert( !codecs.empty() );
+	}
+};
+
+void writeProperty( std::ostream &out, const util::PropertyValue &val )
+{
+	if( val.isEmpty() ) {
+		writeBin<uint16_t>( out, 0 );
+	} else {
+		const unsigned short ID = val.getTypeID();
+		writeBin<uint16_t>( out, ID );
+		util::Singletons::get<CodecMap, 10>().codecs[ID].first( out, *val );
+	}
+}
+bool readProperty( std::istream &in, util::PropertyValue &val )
+{
+	uint16_t ID;
+
+	if( !readBin( in, ID ) )
+		return false;
+
+	if( ID == 0 ) // empty property - leave it as it is
+		return true;
+
+	CodecMap &map = util::Singletons::get<CodecMap, 10>();
+	const std::map<unsigned short, std::pair<CodecMap::writer_type, CodecMap::reader_type> >::const_iterator found = map.codecs.find( ID );
+	return found != map.codecs.end() && found->second.second( in, val );
+}
+
+void writeChunk( std::ostream &out, const Chunk &ch )
+{
+	const util::vector4<size_t> size = ch.getSizeAsVector();
+	const util::PropertyMap::KeyList keys = ch.getKeys(), lists = ch.findLists();
+	const size_t list_size = size[ch.getRelevantDims() - 1];
+
+	writeBin<uint16_t>( out, ch.getTypeID() );
+
+	for( int i = 0; i < 4; i++ )
+		writeBin<uint64_t>( out, size[i] );
+
+	writeBin<uint32_t>( out, keys.size() );
+	BOOST_FOREACH( const util::PropertyMap::KeyType & key, keys ) {
+		writeBin( out, std::string( key.c_str() ) );
+
+		if( lists.find( key ) != lists.end() ) {
+			writeBin<uint8_t>( out, 1 );
+			writeBin<uint32_t>( out, list_size );
+
+			for( size_t i = 0; i < list_size; i++ ) {
+				try {
+					writeProperty( out, ch.propertyValueAt( key, i ) );
+				} catch( std::out_of_range & ) { // list is shorter than the chunk
+					writeProperty( out, util::PropertyValue() );
+				}
+			}
+		} else {
+			writeBin<uint8_t>( out, 0 );
+			writeProperty( out, ch.propertyValue( key ) );
+		}
+	}
+}
+/// highest ratio of deflate, so no file (compressed or not) can hold more voxels than this times its size
+static const uint64_t max_voxels_per_byte = 1032;
+
+/**
+ * Read a chunk written by writeChunk.
+ * \param file_size the size of the file the chunk was red from, it limits the amount of voxels the chunk can claim
+ * \returns false if the data is truncated or the chunk cannot be valid
+ */
+bool readChunk( std::istream &in, std::list<Chunk> &chunks, uint64_t file_size )
+{
+	uint16_t type;
+	uint64_t size[4];
+	uint32_t keys;
+
+	if( !readBin( in, type ) )
+		return false;
+
+	for( int i = 0; i < 4; i++ )
+		if( !readBin( in, size[i] ) )
+			return false;
+
+	if( !readBin( in, keys ) )
+		return false;
+
+	// a corrupt index must not make us allocate absurd amounts of memory, or a chunk bigger than its data
+	const uint64_t max_voxels = std::min<uint64_t>( std::numeric_limits<size_t>::max(), file_size * max_voxels_per_byte );
+	uint64_t voxels = 1;
+
+	for( int i = 0; i < 4; i++ ) {
+		if( size[i] == 0 || size[i] > max_voxels / voxels )
+			return false;
+
+		voxels *= size[i];
+	}
+
+	ValueArrayReference data = ValueArrayBase::createByID( type, voxels ); // placeholder - will not be touched
+
+	if( data.isEmpty() )
+		return false;
+
+	Chunk ch( data, size[0], size[1], size[2], size[3] );
+
+	for( uint32_t k = 0; k < keys; k++ ) {
+		std::string name;
+		uint8_t is_list;
+
+		if( !( readBin( in, name ) && readBin( in, is_list ) ) )
+			return false;
+
+		const util::PropertyMap::KeyType key( name.c_str() );
+
+		if( is_list ) {
+			uint32_t len;
+
+			if( !readBin( in, len ) )
+				return false;
+
+			for( uint32_t i = 0; i < len; i++ )
+				if( !readProperty( in, ch.propertyValueAt( key, i ) ) )
+					return false;
+		} else if( !readProperty( in, ch.propertyValue( key ) ) )
+			return false;
+	}
+
+	chunks.push_back( ch );
+	return true;
+}
+
+}
+/// @endcond _internal
+API_EXCLUDE_END
+
+boost::filesystem::path MetadataIndex::defaultCache()
+{
+	const char *env_cache = getenv( "XDG_CACHE_HOME" ), *env_home = getenv( "HOME" );
+
+	if( env_cache && *env_cache )
+		return boost::filesystem::path( env_cache ) / "isis" / "metadata";
+	else if( env_home && *env_home )
+		return boost::filesystem::path( env_home ) / ".cache" / "isis" / "metadata";
+	else
+		return boost::filesystem::path();
+}
+
+bool MetadataIndex::getStamp( const boost::filesystem::path &file, uint64_t &mtime, uint64_t &size )
+{
+	boost::system::error_code err;
+	mtime = boost::filesystem::last_write_time( file, err );
+
+	if( !err )
+		size = boost::filesystem::file_size( file, err );
+
+	return !err;
+}
+
+MetadataIndex::MetadataIndex( const boost::filesystem::path &directory, const boost::filesystem::path &cache ): m_changed( false )
+{
+	boost::system::error_code err;
+	m_directory = boost::filesystem::canonical( directory, err );
+
+	if( err )
+		m_directory = boost::filesystem::absolute( directory );
+
+	if( cache.empty() ) {
+		LOG( Runtime, info ) << "There is no cache directory for the metadata index of " << util::MSubject( m_directory );
+		return;
+	}
+
+	char name[17];
+	snprintf( name, sizeof( name ), "%016llx", static_cast<unsigned long long>( _internal::fnv1a( m_directory.native() ) ) );
+	m_file = cache / name;
+
+	std::ifstream in( m_file.native().c_str(), std::ios::binary );
+
+	if( !in.is_open() ) {
+		LOG( Debug, info ) << "There is no metadata index for " << util::MSubject( m_directory );
+		return;
+	}
+
+	char magic[sizeof( _internal::index_magic )];
+	uint32_t order, entries;
+	std::string indexed;
+
+	if( !( in.read( magic, sizeof( magic ) ) && _internal::readBin( in, order ) ) ||
+		memcmp( magic, _internal::index_magic, sizeof( magic ) ) != 0 || order != _internal::index_byteorder ||
+		!( _internal::readBin( in, indexed ) && _internal::readBin( in, entries ) ) ) {
+		LOG( Runtime, notice ) << "Ignoring unknown or foreign metadata index " << util::MSubject( m_file );
+		m_changed = true; // make sure it will be replaced
+		return;
+	}
+
+	if( indexed != m_directory.native() ) { // two directories with the same hash
+		LOG( Runtime, info ) << "Ignoring the metadata index " << util::MSubject( m_file ) << ", it belongs to " << util::MSubject( indexed );
+		m_changed = true;
+		return;
+	}
+
+	for( uint32_t i = 0; i < entries; i++ ) {
+		std::string name;
+		Entry entry;
+
+		if( !( _internal::readBin( in, name ) && _internal::readBin( in, entry.mtime ) && _internal::readBin( in, entry.size ) && _internal::readBin( in, entry.data ) ) ) {
+			LOG( Runtime, warning ) << "The metadata index " << util::MSubject( m_file ) << " is truncated, ignoring the rest of it";
+			m_changed = true;
+			break;
+		}
+
+		m_entries[name] = entry;
+	}
+
+	LOG( Debug, info ) << "Red " << m_entries.size() << " entries from the metadata index " << util::MSubject( m_file );
+}
+
+const boost::filesystem::path &MetadataIndex::getFile()const {return m_file;}
+
+bool MetadataIndex::get( const boost::filesystem::path &file, std::list<Chunk> &chunks )const
+{
+	const std::map<std::string, Entry>::const_iterator found = m_entries.find( file.filename().native() );
+	uint64_t mtime, size;
+
+	if( found == m_entries.end() || !getStamp( file, mtime, size ) || found->second.mtime != mtime || found->second.size != size )
+		return false;
+
+	std::istringstream in( found->second.data );
+	std::list<Chunk> buff;
+	uint32_t count;
+
+	if( !_internal::readBin( in, count ) )
+		return false;
+
+	for( uint32_t i = 0; i < count; i++ ) {
+		if( !_internal::readChunk( in, buff, size ) ) {
+			LOG( Runtime, warning ) << "Failed to restore chunk " << i << " of " << util::MSubject( file ) << " from the metadata index";
+			return false;
+		}
+	}
+
+	chunks.splice( chunks.end(), buff );
+	return true;
+}
+
+void MetadataIndex::put( const boost::filesystem::path &file, std::list<Chunk>::const_iterator begin, std::list<Chunk>::const_iterator end )
+{
+	Entry entry;
+
+	if( !getStamp( file, entry.mtime, entry.size ) )
+		return;
+
+	std::ostringstream out;
+	_internal::writeBin<uint32_t>( out, std::distance( begin, end ) );
+
+	for( ; begin != end; ++begin )
+		_internal::writeChunk( out, *begin );
+
+	entry.data = out.str();
+	m_entries[file.filename().native()] = entry;
+	m_changed = true;
+}
+
+void MetadataIndex::purge()
+{
+	for( std::map<std::string, Entry>::iterator i = m_entries.begin(); i != m_entries.end(); ) {
+		if( boost::filesystem::exists( m_directory / i->first ) ) {
+			++i;
+		} else {
+			m_entries.erase( i++ );
+			m_changed = true;
+		}
+	}
+}
+
+bool MetadataIndex::write()
+{
+	if( !m_changed )
+		return true;
+
+	if( m_file.empty() )
+		return false;
+
+	boost::system::error_code err;
+	boost::filesystem::create_directories( m_file.parent_path(), err );
+
+	const boost::filesystem::path tmpfile = m_file.native() + ".tmp";
+	std::ofstream out( tmpfile.native().c_str(), std::ios::binary | std::ios::trunc );
+
+	if( !out.is_open() ) {
+		LOG( Runtime, info ) << "Cannot write the metadata index into " << util::MSubject( m_file.parent_path() );
+		return false;
+	}
+
+	out.write( _internal::index_magic, sizeof( _internal::index_magic ) );
+	_internal::writeBin( out, _internal::index_byteorder );
+	_internal::writeBin( out, m_directory.native() );
+	_internal::writeBin<uint32_t>( out, m_entries.size() );
+
+	for( std::map<std::string, Entry>::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i ) {
+		_internal::writeBin( out, i->first );
+		_internal::writeBin( out, i->second.mtime );
+		_internal::writeBin( out, i->second.size );
+		_internal::writeBin( out, i->second.data );
+	}
+
+	out.close();
+
+	if( out.fail() ) {
+		LOG( Runtime, warning ) << "Failed to write the metadata index " << util::MSubject( tmpfile );
+		boost::filesystem::remove( tmpfile, err );
+		return false;
+	}
+
+	boost::filesystem::rename( tmpfile, m_file, err ); // replace the old index atomically
+
+	if( err ) {
+		LOG( Runtime, warning ) << "Failed to replace the metadata index " << util::MSubject( m_file ) << " (" << err.message() << ")";
+		boost::filesystem::remove( tmpfile, err );
+		return false;
+	}
+
+	m_changed = false;
+	return true;
+}
+
+}
+}
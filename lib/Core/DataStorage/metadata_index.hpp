@@ -0,0 +1,90 @@
+//
+// C++ Interface: metadata_index
+//
+// Description: persistent index of the metadata of the files in a directory
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+
+#ifndef METADATA_INDEX_HPP
+#define METADATA_INDEX_HPP
+
+#include <map>
+#include <string>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem/path.hpp>
+
+#include "chunk.hpp"
+
+namespace isis
+{
+namespace data
+{
+
+/**
+ * Persistent index of the metadata of all files in a directory.
+ * For every file the index stores its modification time, its size and the properties, type and size of all chunks red from it.
+ * Chunks restored from the index get an unmaterialized placeholder as voxel data, just like chunks loaded with metadata_only (see image_io::FileFormat::load).
+ * So the index is only used by IOFactory when loading metadata only.
+ *
+ * The index is not stored in the directory (which may be shared or read-only), but in a cache directory of the user.
+ * Its filename there is made from a hash of the absolute path of the indexed directory, and that path is stored in the index as well.
+ * It is stored in the byte order of the host and an index of another byte order or directory is ignored (and overwritten).
+ */
+class MetadataIndex
+{
+	struct Entry {
+		uint64_t mtime, size;
+		std::string data; // the serialized chunks
+	};
+	boost::filesystem::path m_directory, m_file;
+	std::map<std::string, Entry> m_entries;
+	bool m_changed;
+	// use ImageIO's logging here instead of the normal data::Runtime/Debug
+	typedef ImageIoLog Runtime;
+	typedef ImageIoDebug Debug;
+	static bool getStamp( const boost::filesystem::path &file, uint64_t &mtime, uint64_t &size );
+public:
+	/**
+	 * Get the default directory for the index files.
+	 * That is "isis/metadata" in $XDG_CACHE_HOME, or in $HOME/.cache if XDG_CACHE_HOME is not set.
+	 * \returns the cache directory, or an empty path if neither is set
+	 */
+	static boost::filesystem::path defaultCache();
+	/**
+	 * Create the index for the given directory.
+	 * If there is an index file for the directory in the cache it is red.
+	 * \param directory the directory to be indexed
+	 * \param cache the directory where the index files are stored (it is created when the index is written)
+	 */
+	MetadataIndex( const boost::filesystem::path &directory, const boost::filesystem::path &cache = defaultCache() );
+	/// \returns the file the index is red from and written to
+	const boost::filesystem::path &getFile()const;
+	/**
+	 * Get the chunks of a file from the index.
+	 * \param file the file (must be in the directory of the index)
+	 * \param chunks the list the chunks from the index are added to
+	 * \returns true if the file is in the index and didn't change since it was indexed, false otherwise
+	 */
+	bool get( const boost::filesystem::path &file, std::list<Chunk> &chunks )const;
+	/**
+	 * Store the chunks red from a file in the index.
+	 * Only type, size and properties of the chunks are stored. An empty range is stored as well, so files which cannot be red are not tried again.
+	 * \param file the file the chunks where red from (must be in the directory of the index)
+	 * \param begin,end range of the chunks red from the file
+	 */
+	void put( const boost::filesystem::path &file, std::list<Chunk>::const_iterator begin, std::list<Chunk>::const_iterator end );
+	/// remove all entries of files which do not exist anymore
+	void purge();
+	/**
+	 * Write the index into the cache if it was changed.
+	 * \returns false if the index was changed but could not be written, true otherwise
+	 */
+	bool write();
+};
+
+}
+}
+
+#endif // METADATA_INDEX_HPP
@@ -109,11 +109,9 @@ std::pair<boost::shared_ptr<Chunk>, bool> SortedChunkList::secondaryInsert( Seco
 		return std::pair<boost::shared_ptr<Chunk>, bool>( boost::shared_ptr<Chunk>(), false );
 	}
 }
-std::pair<boost::shared_ptr<Chunk>, bool> SortedChunkList::primaryInsert( const Chunk &ch )
+util::fvector3 SortedChunkList::positionKey( const Chunk &ch )
 {
 	static const util::PropertyMap::PropPath rowVecProb( "rowVec" ), columnVecProb( "columnVec" ), sliceVecProb( "sliceVec" ), indexOriginProb( "indexOrigin" );
-	LOG_IF( secondarySort.empty(), Debug, error ) << "There is no known secondary sorting left. Chunksort will fail.";
-	assert( ch.isValid() );
 	// compute the position of the chunk in the image space
 	// we dont have this position, but we have the position in scanner-space (indexOrigin)
 	const util::fvector3 &origin = ch.propertyValue( indexOriginProb ).castTo<util::fvector3>();
@@ -134,7 +132,13 @@ std::pair<boost::shared_ptr<Chunk>, bool> SortedChunkList::primaryInsert( const
 
 
 	// this is actually not the complete transform (it lacks the scaling for the voxel size), but its enough
-	const util::fvector3 key( origin.dot( rowVec ), origin.dot( columnVec ), origin.dot( sliceVec ) );
+	return util::fvector3( origin.dot( rowVec ), origin.dot( columnVec ), origin.dot( sliceVec ) );
+}
+std::pair<boost::shared_ptr<Chunk>, bool> SortedChunkList::primaryInsert( const Chunk &ch )
+{
+	LOG_IF( secondarySort.empty(), Debug, error ) << "There is no known secondary sorting left. Chunksort will fail.";
+	assert( ch.isValid() );
+	const util::fvector3 key = positionKey( ch );
 	const scalarPropCompare &secondaryComp = secondarySort.top();
 
 	// get the reference of the secondary map for "key" (create and insert a new if neccessary)
@@ -144,6 +148,27 @@ std::pair<boost::shared_ptr<Chunk>, bool> SortedChunkList::primaryInsert( const
 	return secondaryInsert( subMap, ch ); // insert ch into the right secondary map
 }
 
+bool SortedChunkList::isCompatible( const Chunk &first, const Chunk &ch )const
+{
+	if ( first.getSizeAsVector() != ch.getSizeAsVector() ) { // if they have different size - do not insert
+		LOG( Debug, verbose_info )
+				<< "Ignoring chunk with different size. (" << ch.getSizeAsString() << "!=" << first.getSizeAsString() << ")";
+		return false;
+	}
+
+	BOOST_FOREACH( const util::PropertyMap::PropPath & ref, equalProps ) { // check all properties which where given to the constructor of the list
+		// if at least one of them has the property and they are not equal - do not insert
+		if ( ( first.hasProperty( ref ) || ch.hasProperty( ref ) ) && first.propertyValue( ref ) != ch.propertyValue( ref ) ) {
+			LOG( Debug, verbose_info )
+					<< "Ignoring chunk with different " << ref << ". Is " << util::MSubject( ch.propertyValue( ref ) )
+					<< " but chunks already in the list have " << util::MSubject( first.propertyValue( ref ) );
+			return false;
+		}
+	}
+
+	return true;
+}
+
 // high level insert
 bool SortedChunkList::insert( const Chunk &ch )
 {
@@ -154,23 +179,8 @@ bool SortedChunkList::insert( const Chunk &ch )
 
 	if( !isEmpty() ) {
 		// compare some attributes of the first chunk and the one which shall be inserted
-		Chunk &first = *( chunks.begin()->second.begin()->second );
-
-		if ( first.getSizeAsVector() != ch.getSizeAsVector() ) { // if they have different size - do not insert
-			LOG( Debug, verbose_info )
-					<< "Ignoring chunk with different size. (" << ch.getSizeAsString() << "!=" << first.getSizeAsString() << ")";
+		if( !isCompatible( *( chunks.begin()->second.begin()->second ), ch ) )
 			return false;
-		}
-
-		BOOST_FOREACH( util::PropertyMap::PropPath & ref, equalProps ) { // check all properties which where given to the constructor of the list
-			// if at least one of them has the property and they are not equal - do not insert
-			if ( ( first.hasProperty( ref ) || ch.hasProperty( ref ) ) && first.propertyValue( ref ) != ch.propertyValue( ref ) ) {
-				LOG( Debug, verbose_info )
-						<< "Ignoring chunk with different " << ref << ". Is " << util::MSubject( ch.propertyValue( ref ) )
-						<< " but chunks already in the list have " << util::MSubject( first.propertyValue( ref ) );
-				return false;
-			}
-		}
 	} else {
 		LOG( Debug, verbose_info ) << "Inserting 1st chunk";
 		std::stack<scalarPropCompare> backup = secondarySort;
@@ -263,6 +273,78 @@ std::vector< boost::shared_ptr< Chunk > > SortedChunkList::getLookup()
 		return std::vector< boost::shared_ptr< Chunk > >();
 }
 
+std::vector<boost::shared_ptr<Chunk> > SortedChunkList::append( const std::list<Chunk> &chs, const util::PropertyMap &common )
+{
+	std::vector<boost::shared_ptr<Chunk> > ret;
+	LOG_IF( isEmpty(), Debug, error ) << "Appending to an empty list won't work. Use insert instead.";
+
+	if( isEmpty() || chs.empty() )
+		return ret;
+
+	const size_t positions = chunks.size(), steps = chs.size() / positions;
+
+	if( steps * positions != chs.size() ) {
+		LOG( Runtime, error ) << "Cannot distribute " << chs.size() << " chunks evenly over " << positions << " positions";
+		return ret;
+	}
+
+	// the chunks in the list may lack the properties which are common, so compare the new ones to a first chunk which has them
+	Chunk first = *( chunks.begin()->second.begin()->second );
+	first.join( common );
+
+	std::list<std::pair<SecondaryMap *, util::PropertyValue> > appended;
+	bool ok = true;
+
+	BOOST_FOREACH( const Chunk & ch, chs ) {
+		assert( ch.isValid() );
+		SecondaryMap *const subMap = isCompatible( first, ch ) ? primaryFind( positionKey( ch ) ) : NULL;
+
+		if( !subMap ) {
+			LOG( Runtime, error ) << "The chunk at " << ch.propertyValue( "indexOrigin" ) << " does not fit to any chunk at the same position";
+			ok = false;
+			break;
+		}
+
+		const util::PropertyMap::KeyType propName = subMap->key_comp().propertyName;
+
+		if( !ch.hasProperty( propName ) || !subMap->key_comp()( subMap->rbegin()->first, ch.propertyValue( propName ) ) ) {
+			LOG( Runtime, error )
+					<< "The chunk at " << ch.propertyValue( "indexOrigin" ) << " is not sorted behind the last chunk at that position ("
+					<< std::make_pair( propName, ch.propertyValue( propName ) ) << " but the last one has " << subMap->rbegin()->first << ")";
+			ok = false;
+			break;
+		}
+
+		subMap->insert( std::make_pair( ch.propertyValue( propName ), boost::shared_ptr<Chunk>( new Chunk( ch ) ) ) );
+		appended.push_back( std::make_pair( subMap, ch.propertyValue( propName ) ) );
+	}
+
+	if( ok && !isRectangular() ) {
+		LOG( Runtime, error ) << "The appended chunks are not distributed evenly over the positions";
+		ok = false;
+	}
+
+	if( !ok ) { // remove what was appended so far
+		for( std::list<std::pair<SecondaryMap *, util::PropertyValue> >::const_iterator i = appended.begin(); i != appended.end(); i++ )
+			i->first->erase( i->second );
+
+		return ret;
+	}
+
+	// the new chunks are the last ones in every secondary map
+	ret.resize( positions * steps );
+	PrimaryMap::iterator iP = chunks.begin();
+
+	for( size_t h = 0; h < positions; h++, iP++ ) {
+		SecondaryMap::reverse_iterator iS = iP->second.rbegin();
+
+		for( size_t v = steps; v > 0; v--, iS++ )
+			ret[h + ( v - 1 ) * positions] = iS->second;
+	}
+
+	return ret;
+}
+
 void SortedChunkList::transform( chunkPtrOperator &op )
 {
 	BOOST_FOREACH( PrimaryMap::reference outer, chunks ) {
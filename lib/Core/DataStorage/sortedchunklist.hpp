@@ -68,6 +68,11 @@ private:
 	std::pair<boost::shared_ptr<Chunk>, bool> secondaryInsert( SecondaryMap &map, const Chunk &ch );
 	std::pair<boost::shared_ptr<Chunk>, bool> primaryInsert( const Chunk &ch );
 
+	// the position of the chunk in the image space (used for primary sorting)
+	static util::fvector3 positionKey( const Chunk &ch );
+	// checks size and the properties which should be equal across all chunks
+	bool isCompatible( const Chunk &first, const Chunk &ch )const;
+
 	std::list<util::PropertyMap::PropPath> equalProps;
 public:
 
@@ -94,6 +99,16 @@ public:
 	/// \returns true if there is no chunk in the list
 	bool isEmpty()const;
 
+	/**
+	 * Appends chunks behind the existing chunks of their positions.
+	 * Every chunk must be at a position which is already in the list, and must be sorted behind the chunks already there.
+	 * All positions must get the same amount of new chunks. If one of the chunks does not fit, nothing is appended.
+	 * \param chs the chunks to be appended
+	 * \param common properties which where removed from the chunks in the list (they are used for the comparison with the new chunks)
+	 * \returns the appended chunks ordered like the end of getLookup() (empty if nothing was appended)
+	 */
+	std::vector<boost::shared_ptr<Chunk> > append( const std::list<Chunk> &chs, const util::PropertyMap &common );
+
 	/// Empties the list.
 	void clear();
 
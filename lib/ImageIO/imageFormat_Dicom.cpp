@@ -1,10 +1,32 @@
 #include "imageFormat_Dicom.hpp"
 #include <DataStorage/common.hpp>
+#include <DataStorage/fileptr.hpp>
 #include <CoreUtils/istring.hpp>
 #include <dcmtk/dcmimgle/dcmimage.h>
 #include <dcmtk/dcmimage/diregist.h> //for color support
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
 #include <dcmtk/dcmdata/dcdicent.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcuid.h> // for OFFIS_DCMTK_VERSION_NUMBER
+#include <dcmtk/dcmdata/dcrledrg.h>
+#include <dcmtk/dcmdata/dccodec.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#ifdef HAVE_DCMJPEG
+#include <dcmtk/dcmjpeg/djdecode.h>
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+#include <dcmtk/dcmjpls/djdecode.h>
+#endif //HAVE_DCMJPLS
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iomanip>
+#include <cstdio>
+#ifdef _OPENMP
+#include <omp.h>
+#endif //_OPENMP
 
 namespace isis
 {
@@ -12,6 +34,350 @@ namespace image_io
 {
 namespace _internal
 {
+/// names of tags which differ from the dcmtk dictionary (sorted by tag)
+const struct {Uint16 group, element; const char *name;} knownTags[] = {
+	{0x0008, 0x1050, "PerformingPhysiciansName"},
+	{0x0010, 0x0010, "PatientsName"},
+	{0x0010, 0x0030, "PatientsBirthDate"},
+	{0x0010, 0x0040, "PatientsSex"},
+	{0x0010, 0x1010, "PatientsAge"},
+	{0x0010, 0x1030, "PatientsWeight"},
+	// Siemens specific stuff (0019,100a) is SliceOrientation in the standard and mosaic-size for siemens - we will figure out while sanitizing
+	{0x0019, 0x100a, "SiemensNumberOfImagesInMosaic"},
+	{0x0019, 0x100c, "SiemensDiffusionBValue"},
+	{0x0019, 0x100e, "SiemensDiffusionGradientOrientation"},
+};
+
+struct TagLess {
+	bool operator()( const std::pair<DcmTagKey, util::PropertyMap::PropPath> &a, const std::pair<DcmTagKey, util::PropertyMap::PropPath> &b )const {return a.first < b.first;}
+	bool operator()( const std::pair<DcmTagKey, util::PropertyMap::PropPath> &a, const DcmTagKey &b )const {return a.first < b;}
+};
+
+/**
+ * The decoders of dcmtk are global, so they are registered when the first instance of the plugin is created and cleaned up when the last one is destroyed.
+ * Decoders which were already registered by somebody else (e.g. the application) are neither registered again nor cleaned up.
+ */
+class DecoderRegistration
+{
+	static boost::mutex lock;
+	static unsigned int users;
+	static bool rle, jpeg, jpls; // the decoders registered by the plugin
+	/// \returns true if a decoder for the transfer syntax is registered
+	static bool decodable( const char *xfer ) {
+		return DcmCodecList::canChangeCoding( DcmXfer( xfer ).getXfer(), EXS_LittleEndianExplicit );
+	}
+public:
+	static void acquire() {
+		const boost::mutex::scoped_lock guard( lock );
+
+		if( users++ )
+			return;
+
+		if( ( rle = !decodable( UID_RLELosslessTransferSyntax ) ) )
+			DcmRLEDecoderRegistration::registerCodecs();
+
+#ifdef HAVE_DCMJPEG
+
+		if( ( jpeg = !decodable( UID_JPEGProcess1TransferSyntax ) ) )
+			DJDecoderRegistration::registerCodecs();
+
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+
+		if( ( jpls = !decodable( UID_JPEGLSLosslessTransferSyntax ) ) )
+			DJLSDecoderRegistration::registerCodecs();
+
+#endif //HAVE_DCMJPLS
+		LOG( Debug, verbose_info ) << "Registered the decoders for rle: " << rle << ", jpeg: " << jpeg << ", jpeg-ls: " << jpls;
+	}
+	static void release() {
+		const boost::mutex::scoped_lock guard( lock );
+
+		if( --users )
+			return;
+
+		if( rle )
+			DcmRLEDecoderRegistration::cleanup();
+
+#ifdef HAVE_DCMJPEG
+
+		if( jpeg )
+			DJDecoderRegistration::cleanup();
+
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+
+		if( jpls )
+			DJLSDecoderRegistration::cleanup();
+
+#endif //HAVE_DCMJPLS
+		rle = jpeg = jpls = false;
+	}
+};
+boost::mutex DecoderRegistration::lock;
+unsigned int DecoderRegistration::users = 0;
+bool DecoderRegistration::rle = false, DecoderRegistration::jpeg = false, DecoderRegistration::jpls = false;
+
+/// a dicom attribute which sanitise simply converts into an isis property
+struct Transformation {
+	util::PropertyMap::PropPath from, to;
+	unsigned short type;
+	LogLevel level;
+};
+
+/// parse the paths of the transformations done by sanitise once, instead of for every chunk
+std::vector<Transformation> makeTransformations()
+{
+	static const struct {const char *from, *to; unsigned short type; LogLevel level;} table[] = {
+		{"SeriesNumber",                        "sequenceNumber",      util::Value<uint16_t>::staticID,    warning},
+		{"PatientsAge",                         "subjectAge",          util::Value<uint16_t>::staticID,    info},
+		{"SeriesDescription",                   "sequenceDescription", util::Value<std::string>::staticID, warning},
+		{"PatientsName",                        "subjectName",         util::Value<std::string>::staticID, info},
+		{"PatientsBirthDate",                   "subjectBirth",        util::Value<boost::gregorian::date>::staticID, info},
+		{"PatientsWeight",                      "subjectWeigth",       util::Value<uint16_t>::staticID,    info},
+		{"RepetitionTime",                      "repetitionTime",      util::Value<uint16_t>::staticID,    warning},
+		{"EchoTime",                            "echoTime",            util::Value<float>::staticID,       warning},
+		{"FlipAngle",                           "flipAngle",           util::Value<int16_t>::staticID,     warning},
+		{"PerformingPhysiciansName",            "performingPhysician", util::Value<std::string>::staticID, info},
+		{"NumberOfAverages",                    "numberOfAverages",    util::Value<uint16_t>::staticID,    warning},
+		{"InstanceNumber",                      "acquisitionNumber",   util::Value<uint32_t>::staticID,    error},
+		{"CSAImageHeaderInfo/UsedChannelMask",  "coilChannelMask",     util::Value<uint32_t>::staticID,    info},
+	};
+	std::vector<Transformation> ret;
+
+	for( size_t i = 0; i < sizeof( table ) / sizeof( table[0] ); i++ ) {
+		const Transformation trans = {util::istring( ImageFormat_Dicom::dicomTagTreeName ) + "/" + table[i].from, table[i].to, table[i].type, table[i].level};
+		ret.push_back( trans );
+	}
+
+	return ret;
+}
+const std::vector<Transformation> transformations = makeTransformations();
+
+/// format values as a multi valued DS (decimal string, at most 16 characters per value)
+template<typename T> std::string decimalString( const T *values, size_t count )
+{
+	std::ostringstream out;
+	out << std::setprecision( 8 );
+
+	for( size_t i = 0; i < count; i++ )
+		out << ( i ? "\\" : "" ) << values[i];
+
+	return out.str();
+}
+
+/// format a time stamp as DA (YYYYMMDD) and TM (HHMMSS.FFFFFF)
+std::pair<std::string, std::string> dateTimeString( const boost::posix_time::ptime &stamp )
+{
+	const boost::posix_time::time_duration time = stamp.time_of_day();
+	char buff[32];
+	snprintf(
+		buff, sizeof( buff ), "%02d%02d%02d.%06d",
+		int( time.hours() ), int( time.minutes() ), int( time.seconds() ),
+		int( time.fractional_seconds() * 1000000 / boost::posix_time::time_duration::ticks_per_second() )
+	);
+	return std::make_pair( boost::gregorian::to_iso_string( stamp.date() ), std::string( buff ) );
+}
+
+/// the identifiers shared by all files written from one image
+struct WriteUIDs {
+	std::string sopClass, study, series, frameOfReference;
+};
+
+/**
+ * Put the attributes which are common to all files of an image (patient, study, series, equipment, timing and the image pixel module).
+ * The values are taken from the isis properties of the first slice and from the remains of the dicom header in it.
+ */
+void putCommon( DcmItem *ds, const data::Chunk &first, const WriteUIDs &uids, const std::string &imageType, const std::string &modality )
+{
+	ds->putAndInsertString( DCM_ImageType, imageType.c_str() );
+	ds->putAndInsertString( DCM_SOPClassUID, uids.sopClass.c_str() );
+	ds->putAndInsertString( DCM_StudyInstanceUID, uids.study.c_str() );
+	ds->putAndInsertString( DCM_SeriesInstanceUID, uids.series.c_str() );
+	ds->putAndInsertString( DCM_FrameOfReferenceUID, uids.frameOfReference.c_str() );
+	ds->putAndInsertString( DCM_Modality, modality.c_str() );
+	ds->putAndInsertString( DCM_ConversionType, "WSD" ); // workstation
+
+	// patient (the tags are named differently in different versions of dcmtk)
+	ds->putAndInsertString( DcmTagKey( 0x0010, 0x0010 ), first.hasProperty( "subjectName" ) ? first.getPropertyAs<std::string>( "subjectName" ).c_str() : "" );
+
+	if( first.hasProperty( "subjectBirth" ) )
+		ds->putAndInsertString( DcmTagKey( 0x0010, 0x0030 ), boost::gregorian::to_iso_string( first.getPropertyAs<boost::gregorian::date>( "subjectBirth" ) ).c_str() );
+
+	if( first.hasProperty( "subjectGender" ) ) {
+		const std::string gender = first.getPropertyAs<std::string>( "subjectGender" );
+		ds->putAndInsertString( DcmTagKey( 0x0010, 0x0040 ), gender == "male" ? "M" : gender == "female" ? "F" : "O" );
+	}
+
+	if( first.hasProperty( "performingPhysician" ) )
+		ds->putAndInsertString( DcmTagKey( 0x0008, 0x1050 ), first.getPropertyAs<std::string>( "performingPhysician" ).c_str() );
+
+	if( first.hasProperty( "DICOM/StudyID" ) )
+		ds->putAndInsertString( DCM_StudyID, first.getPropertyAs<std::string>( "DICOM/StudyID" ).c_str() );
+
+	// series
+	if( first.hasProperty( "sequenceNumber" ) )
+		ds->putAndInsertString( DCM_SeriesNumber, first.getPropertyAs<std::string>( "sequenceNumber" ).c_str() );
+
+	if( first.hasProperty( "sequenceDescription" ) )
+		ds->putAndInsertString( DCM_SeriesDescription, first.getPropertyAs<std::string>( "sequenceDescription" ).c_str() );
+
+	if( first.hasProperty( "sequenceStart" ) ) {
+		const boost::posix_time::ptime start = first.getPropertyAs<boost::posix_time::ptime>( "sequenceStart" );
+		const std::pair<std::string, std::string> stamp = dateTimeString( start );
+		ds->putAndInsertString( DCM_StudyDate, stamp.first.c_str() );
+		ds->putAndInsertString( DCM_SeriesDate, stamp.first.c_str() );
+		ds->putAndInsertString( DCM_SeriesTime, stamp.second.c_str() );
+
+		if( first.hasProperty( "acquisitionTime" ) ) {
+			const float acqTime = first.getPropertyAs<float>( "acquisitionTime" );
+			const std::pair<std::string, std::string> acq = dateTimeString( start + boost::posix_time::microseconds( int64_t( acqTime * 1000 ) ) );
+			ds->putAndInsertString( DCM_AcquisitionDate, acq.first.c_str() );
+			ds->putAndInsertString( DCM_AcquisitionTime, acq.second.c_str() );
+		}
+	}
+
+	// acquisition
+	if( first.hasProperty( "repetitionTime" ) )
+		ds->putAndInsertString( DCM_RepetitionTime, first.getPropertyAs<std::string>( "repetitionTime" ).c_str() );
+
+	if( first.hasProperty( "echoTime" ) )
+		ds->putAndInsertString( DCM_EchoTime, first.getPropertyAs<std::string>( "echoTime" ).c_str() );
+
+	if( first.hasProperty( "flipAngle" ) )
+		ds->putAndInsertString( DCM_FlipAngle, first.getPropertyAs<std::string>( "flipAngle" ).c_str() );
+
+	// image pixel module
+	const bool color = first.getTypeID() == data::ValueArray<util::color24>::staticID;
+	const Uint16 bits = color ? 8 : first.getBytesPerVoxel() * 8;
+	const util::vector4<size_t> size = first.getSizeAsVector();
+	ds->putAndInsertUint16( DCM_SamplesPerPixel, color ? 3 : 1 );
+	ds->putAndInsertString( DCM_PhotometricInterpretation, color ? "RGB" : "MONOCHROME2" );
+
+	if( color )
+		ds->putAndInsertUint16( DCM_PlanarConfiguration, 0 ); // rgbrgb...
+
+	ds->putAndInsertUint16( DCM_Rows, size[data::columnDim] );
+	ds->putAndInsertUint16( DCM_Columns, size[data::rowDim] );
+	ds->putAndInsertUint16( DCM_BitsAllocated, bits );
+	ds->putAndInsertUint16( DCM_BitsStored, bits );
+	ds->putAndInsertUint16( DCM_HighBit, bits - 1 );
+	ds->putAndInsertUint16( DCM_PixelRepresentation, first.getTypeID() == data::ValueArray<int8_t>::staticID || first.getTypeID() == data::ValueArray<int16_t>::staticID );
+}
+
+/// put PixelSpacing, SliceThickness and SpacingBetweenSlices (for images with more than one slice)
+void putPixelMeasures( DcmItem *item, const data::Chunk &slice, bool volume )
+{
+	const util::fvector3 voxelSize = slice.getPropertyAs<util::fvector3>( "voxelSize" );
+	const util::fvector3 voxelGap = slice.hasProperty( "voxelGap" ) ? slice.getPropertyAs<util::fvector3>( "voxelGap" ) : util::fvector3();
+	const float spacing[] = {voxelSize[1] + voxelGap[1], voxelSize[0] + voxelGap[0]}; // distance between the rows / the columns
+	item->putAndInsertString( DCM_PixelSpacing, decimalString( spacing, 2 ).c_str() );
+	item->putAndInsertString( DCM_SliceThickness, decimalString( &voxelSize[2], 1 ).c_str() );
+
+	if( volume ) {
+		const float between = voxelSize[2] + voxelGap[2];
+		item->putAndInsertString( DCM_SpacingBetweenSlices, decimalString( &between, 1 ).c_str() );
+	}
+}
+
+void putOrientation( DcmItem *item, const data::Chunk &slice )
+{
+	const util::fvector3 row = slice.getPropertyAs<util::fvector3>( "rowVec" ), column = slice.getPropertyAs<util::fvector3>( "columnVec" );
+	const float orientation[] = {row[0], row[1], row[2], column[0], column[1], column[2]};
+	item->putAndInsertString( DCM_ImageOrientationPatient, decimalString( orientation, 6 ).c_str() );
+}
+
+void putPosition( DcmItem *item, const data::Chunk &slice )
+{
+	item->putAndInsertString( DCM_ImagePositionPatient, decimalString( &slice.getPropertyAs<util::fvector3>( "indexOrigin" )[0], 3 ).c_str() );
+}
+
+/**
+ * Put the voxel data of the slices [first,first+count) as PixelData.
+ * The data is copied directly into the buffer of the element (in parallel, if there are many slices).
+ */
+void putPixels( DcmItem *ds, const std::vector<data::Chunk> &slices, size_t first, size_t count )
+{
+	const size_t slice_bytes = slices[first].getVolume() * slices[first].getBytesPerVoxel(), bytes = slice_bytes * count;
+	DcmPixelData *pixels = new DcmPixelData( DCM_PixelData );
+	uint8_t *dst = NULL;
+
+	if( slices[first].getBytesPerVoxel() == 2 ) {
+		Uint16 *buff = NULL;
+		pixels->createUint16Array( bytes / 2, buff );
+		dst = reinterpret_cast<uint8_t *>( buff );
+	} else { // 8bit grey or color
+		Uint8 *buff = NULL;
+		pixels->setVR( EVR_OB );
+		pixels->createUint8Array( bytes, buff );
+		dst = buff;
+	}
+
+	ds->insert( pixels, true );
+
+#pragma omp parallel for schedule(static) if( count > 16 )
+	for( long i = 0; i < long( count ); i++ ) {
+		const boost::shared_ptr<const void> src = slices[first + i].getValueArrayBase().getRawAddress();
+		memcpy( dst + i * slice_bytes, src.get(), slice_bytes );
+	}
+}
+
+/**
+ * Copy the tiles of a mosaic into the slices of a volume.
+ * Every row of a tile is contiguous in the source and in the destination, so it is copied as a whole.
+ * BYTES is the size of a voxel, so the compiler knows the size of the moves.
+ * \param src the mosaic image
+ * \param dst the volume (width x height x images)
+ * \param width,height the size of a tile
+ * \param src_width the width of the mosaic in voxels
+ * \param matrixSize the number of tiles in a row of the mosaic
+ * \param images the number of tiles
+ */
+template<size_t BYTES> void mosaicBlit( const uint8_t *src, uint8_t *dst, size_t width, size_t height, size_t src_width, size_t matrixSize, size_t images )
+{
+	const size_t row_bytes = width * BYTES, src_row_bytes = src_width * BYTES;
+
+#pragma omp parallel for schedule(static) if( images * height * row_bytes > 0x100000 )
+	for ( long slice = 0; slice < ( long )images; slice++ ) {
+		const uint8_t *tile = src + ( slice / matrixSize ) * height * src_row_bytes + ( slice % matrixSize ) * row_bytes;
+		uint8_t *const dslice = dst + slice * height * row_bytes;
+
+		for ( size_t line = 0; line < height; line++ )
+			memcpy( dslice + line * row_bytes, tile + line * src_row_bytes, row_bytes );
+	}
+}
+void mosaicBlit( const data::Chunk &source, data::Chunk &dest, size_t matrixSize )
+{
+	const util::vector4<size_t> size = dest.getSizeAsVector();
+	const size_t src_width = source.getSizeAsVector()[data::rowDim];
+	const boost::shared_ptr<const uint8_t> src = boost::static_pointer_cast<const uint8_t>( source.getValueArrayBase().getRawAddress() );
+	const boost::shared_ptr<uint8_t> dst = boost::static_pointer_cast<uint8_t>( dest.asValueArrayBase().getRawAddress() );
+
+	switch( source.getBytesPerVoxel() ) {
+	case 1:
+		mosaicBlit<1>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	case 2:
+		mosaicBlit<2>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	case 3:
+		mosaicBlit<3>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	case 4:
+		mosaicBlit<4>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	case 6:
+		mosaicBlit<6>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	case 8:
+		mosaicBlit<8>( src.get(), dst.get(), size[0], size[1], src_width, matrixSize, size[2] );
+		break;
+	default: // treat it as bytes
+		const size_t bytes = source.getBytesPerVoxel();
+		mosaicBlit<1>( src.get(), dst.get(), size[0] * bytes, size[1], src_width * bytes, matrixSize, size[2] );
+	}
+}
+
 class DicomChunk : public data::Chunk
 {
 	struct Deleter {
@@ -31,15 +397,15 @@ class DicomChunk : public data::Chunk
 	};
 	template<typename TYPE> DicomChunk(
 		TYPE *dat, Deleter del,
-		size_t width, size_t height ):
-		data::Chunk( dat, del, width, height, 1, 1 ) {
+		size_t width, size_t height, size_t frames ):
+		data::Chunk( dat, del, width, height, frames, 1 ) {
 		LOG( Debug, verbose_info )
 				<< "Mapping greyscale pixeldata of " << del.m_filename << " at "
 				<< dat << " (" << data::ValueArray<TYPE>::staticName() << ")" ;
 	}
 	template<typename TYPE>
-	static data::Chunk *copyColor( TYPE **source, size_t width, size_t height ) {
-		data::Chunk *ret = new data::MemChunk<util::color<TYPE> >( width, height );
+	static data::Chunk *copyColor( TYPE **source, size_t width, size_t height, size_t frames ) {
+		data::Chunk *ret = new data::MemChunk<util::color<TYPE> >( width, height, frames );
 		data::ValueArray<util::color<TYPE> > &dest = ret->asValueArray<util::color<TYPE> >();
 		const size_t pixels = dest.getLength();
 
@@ -52,16 +418,415 @@ class DicomChunk : public data::Chunk
 
 		return ret;
 	}
+	/// \returns the type of the allocated bits of monochrome pixeldata (0 if it is not supported)
+	static unsigned short getStoredType( Uint16 bits, Uint16 repn ) {
+		switch ( bits ) {
+		case 8:
+			return repn ? data::ValueArray<int8_t>::staticID : data::ValueArray<uint8_t>::staticID;
+		case 16:
+			return repn ? data::ValueArray<int16_t>::staticID : data::ValueArray<uint16_t>::staticID;
+		case 32:
+			return repn ? data::ValueArray<int32_t>::staticID : data::ValueArray<uint32_t>::staticID;
+		default:
+			return 0;
+		}
+	}
+	/// \returns the smallest representation DicomImage uses for the value range (like DicomImageClass::determineRepresentation)
+	static EP_Representation getRepresentation( double min, double max ) {
+		if ( min < 0 ) {
+			if ( min >= -128 && max <= 127 )
+				return EPR_Sint8;
+			else if ( min >= -32768 && max <= 32767 )
+				return EPR_Sint16;
+			else
+				return EPR_Sint32;
+		} else if ( max <= 255 )
+			return EPR_Uint8;
+		else if ( max <= 65535 )
+			return EPR_Uint16;
+		else
+			return EPR_Uint32;
+	}
+	/**
+	 * Get the type of the voxels DicomImage makes from the pixeldata (without decoding it).
+	 * DicomImage is always created with CIF_UseAbsolutePixelRange, so it chooses the type by the range the voxels can have, which is known from the header
+	 * (and not by the range they actually have, which would need all of them).
+	 * For monochrome images this is the range of the stored bits, transformed by the modality LUT or rescaling.
+	 * \returns the type of the voxels (0 if it is not supported)
+	 */
+	static unsigned short getPixelType( DcmDataset *dcdata, Uint16 &rows, Uint16 &columns ) {
+		Uint16 bits = 0, stored = 0, repn = 0, samples = 1;
+
+		if ( dcdata->findAndGetUint16( DCM_Rows, rows ).bad() || dcdata->findAndGetUint16( DCM_Columns, columns ).bad() || dcdata->findAndGetUint16( DCM_BitsAllocated, bits ).bad() ) {
+			FileFormat::throwGenericError( "Missing image geometry (Rows, Columns or BitsAllocated)" );
+		}
+
+		if( dcdata->findAndGetUint16( DCM_BitsStored, stored ).bad() )
+			stored = bits;
+
+		dcdata->findAndGetUint16( DCM_PixelRepresentation, repn );
+		dcdata->findAndGetUint16( DCM_SamplesPerPixel, samples );
+		unsigned short type = 0;
+
+		if ( samples == 3 ) {
+			if ( stored <= 8 )type = data::ValueArray<util::color24>::staticID;
+			else if ( stored <= 16 )type = data::ValueArray<util::color48>::staticID;
+		} else if ( samples == 1 && stored > 0 && stored <= 32 ) {
+			double min = repn ? -std::ldexp( 1., stored - 1 ) : 0, max = std::ldexp( 1., repn ? stored - 1 : stored ) - 1;
+			DcmItem *lut = NULL;
+			Uint16 lut_bits = 0;
+
+			if( dcdata->findAndGetSequenceItem( DCM_ModalityLUTSequence, lut ).good() ) {
+				if( lut->findAndGetUint16( DCM_LUTDescriptor, lut_bits, 2 ).good() ) {
+					min = 0;
+					max = std::ldexp( 1., lut_bits ) - 1;
+				}
+			} else {
+				Float64 slope = 1, intercept = 0;
+				dcdata->findAndGetFloat64( DCM_RescaleSlope, slope );
+				dcdata->findAndGetFloat64( DCM_RescaleIntercept, intercept );
+				const double first = min * slope + intercept, last = max * slope + intercept;
+				min = std::min( first, last );
+				max = std::max( first, last );
+			}
+
+			type = getTypeID( getRepresentation( min, max ) );
+		}
+
+		return type;
+	}
+	/**
+	 * Copy the voxels and move the stored bits of every voxel to the lowest bits and clear (or sign extend into) the other bits.
+	 * This is what DicomImage does with pixeldata which does not use all allocated bits.
+	 * \param stored the amount of bits which hold the value
+	 * \param high the highest of these bits
+	 */
+	template<typename TYPE, typename UTYPE> static void maskStoredBits( const data::ValueArray<TYPE> &src, data::ValueArray<TYPE> &dst, Uint16 stored, Uint16 high ) {
+		const unsigned short shift = high + 1 - stored;
+		const UTYPE mask = UTYPE( ( uint64_t( 1 ) << stored ) - 1 ), sign = UTYPE( uint64_t( 1 ) << ( stored - 1 ) );
+		const TYPE *const in = &src[0];
+		TYPE *const out = &dst[0];
+
+#pragma omp parallel for schedule(static) if( src.getLength() > 0x100000 )
+		for ( long i = 0; i < long( src.getLength() ); i++ ) {
+			UTYPE value = ( UTYPE( in[i] ) >> shift ) & mask;
+
+			if( std::numeric_limits<TYPE>::is_signed && ( value & sign ) )
+				value |= ~mask;
+
+			out[i] = TYPE( value );
+		}
+	}
+	/// \returns a copy of the chunk with only the stored bits of its voxels (see above)
+	static data::Chunk maskStoredBits( const data::Chunk &chunk, Uint16 stored, Uint16 high ) {
+		data::Chunk ret = chunk.cloneToNew( chunk.getSizeAsVector()[data::rowDim], chunk.getSizeAsVector()[data::columnDim], chunk.getSizeAsVector()[data::sliceDim] );
+
+		switch( chunk.getTypeID() ) {
+		case data::ValueArray<uint8_t>::staticID:
+			maskStoredBits<uint8_t, uint8_t>( chunk.getValueArray<uint8_t>(), ret.asValueArray<uint8_t>(), stored, high );
+			break;
+		case data::ValueArray<int8_t>::staticID:
+			maskStoredBits<int8_t, uint8_t>( chunk.getValueArray<int8_t>(), ret.asValueArray<int8_t>(), stored, high );
+			break;
+		case data::ValueArray<uint16_t>::staticID:
+			maskStoredBits<uint16_t, uint16_t>( chunk.getValueArray<uint16_t>(), ret.asValueArray<uint16_t>(), stored, high );
+			break;
+		case data::ValueArray<int16_t>::staticID:
+			maskStoredBits<int16_t, uint16_t>( chunk.getValueArray<int16_t>(), ret.asValueArray<int16_t>(), stored, high );
+			break;
+		case data::ValueArray<uint32_t>::staticID:
+			maskStoredBits<uint32_t, uint32_t>( chunk.getValueArray<uint32_t>(), ret.asValueArray<uint32_t>(), stored, high );
+			break;
+		case data::ValueArray<int32_t>::staticID:
+			maskStoredBits<int32_t, uint32_t>( chunk.getValueArray<int32_t>(), ret.asValueArray<int32_t>(), stored, high );
+			break;
+		}
+
+		return ret;
+	}
+	/// \returns the number of frames stored in the pixeldata
+	static size_t getFrames( DcmDataset *dcdata ) {
+		Sint32 frames = 1;
+		dcdata->findAndGetSint32( DCM_NumberOfFrames, frames );
+		return std::max<Sint32>( frames, 1 );
+	}
+	/**
+	 * Get the rescaling of the frames of an enhanced multi-frame object from its functional groups.
+	 * The PixelValueTransformationSequence of a frame replaces the one of the shared groups.
+	 * If all frames have the same integer slope and intercept, they are put into the dataset as RescaleSlope and RescaleIntercept.
+	 * So DicomImage rescales all frames while decoding them, as it does for single frame images.
+	 * \returns true if the frames have to be rescaled by rescaleFrames (because their rescaling differs or is not by integers)
+	 */
+	static bool getFrameRescale( DcmDataset *dcdata, size_t frames, std::vector<double> &slopes, std::vector<double> &intercepts ) {
+		DcmItem *group = NULL, *transform = NULL;
+		Float64 slope = 1, intercept = 0;
+
+		if(
+			dcdata->findAndGetSequenceItem( DCM_SharedFunctionalGroupsSequence, group ).good() &&
+			group->findAndGetSequenceItem( DCM_PixelValueTransformationSequence, transform ).good()
+		) {
+			transform->findAndGetFloat64( DCM_RescaleSlope, slope );
+			transform->findAndGetFloat64( DCM_RescaleIntercept, intercept );
+		}
+
+		slopes.assign( frames, slope );
+		intercepts.assign( frames, intercept );
+
+		if( dcdata->tagExists( DCM_PerFrameFunctionalGroupsSequence ) ) {
+			for( size_t f = 0; f < frames; f++ ) {
+				if(
+					dcdata->findAndGetSequenceItem( DCM_PerFrameFunctionalGroupsSequence, group, f ).good() &&
+					group->findAndGetSequenceItem( DCM_PixelValueTransformationSequence, transform ).good()
+				) {
+					transform->findAndGetFloat64( DCM_RescaleSlope, slopes[f] );
+					transform->findAndGetFloat64( DCM_RescaleIntercept, intercepts[f] );
+				}
+			}
+		}
+
+		if( std::count( slopes.begin(), slopes.end(), slopes[0] ) != long( frames ) || std::count( intercepts.begin(), intercepts.end(), intercepts[0] ) != long( frames ) )
+			return true;
+		else if( slopes[0] == 1 && intercepts[0] == 0 )
+			return false;
+		else if( slopes[0] != std::floor( slopes[0] ) || intercepts[0] != std::floor( intercepts[0] ) )
+			return true; // DicomImage would round the rescaled values to integers
+
+		LOG( Debug, verbose_info ) << "All frames are rescaled by " << slopes[0] << "/" << intercepts[0] << ", leaving that to DicomImage";
+		dcdata->putAndInsertString( DCM_RescaleSlope, decimalString( &slopes[0], 1 ).c_str() );
+		dcdata->putAndInsertString( DCM_RescaleIntercept, decimalString( &intercepts[0], 1 ).c_str() );
+		return false;
+	}
+	/**
+	 * \returns a float copy of the (monochrome) chunk with the voxels of every frame rescaled by the slope and intercept of the frame
+	 * If all frames have the same rescaling, the chunk is converted by it in one go.
+	 */
+	static data::Chunk rescaleFrames( const data::Chunk &chunk, const std::vector<double> &slopes, const std::vector<double> &intercepts ) {
+		if(
+			std::count( slopes.begin(), slopes.end(), slopes[0] ) == long( slopes.size() ) &&
+			std::count( intercepts.begin(), intercepts.end(), intercepts[0] ) == long( intercepts.size() )
+		)
+			return data::MemChunk<float>( chunk, data::scaling_pair( util::Value<double>( slopes[0] ), util::Value<double>( intercepts[0] ) ) );
+
+		data::MemChunk<float> ret( chunk );
+		data::ValueArray<float> &voxels = ret.asValueArray<float>();
+		const size_t frame_size = chunk.getSizeAsVector()[data::rowDim] * chunk.getSizeAsVector()[data::columnDim];
+
+		for( size_t f = 0; f < slopes.size(); f++ ) {
+			for( size_t i = f * frame_size; i < ( f + 1 ) * frame_size; i++ )
+				voxels[i] = voxels[i] * slopes[f] + intercepts[f];
+		}
+
+		return ret;
+	}
+	/// \returns the type of the monochrome voxels DicomImage produces for a representation (0 if it is not supported)
+	static unsigned short getTypeID( EP_Representation repn ) {
+		switch ( repn ) {
+		case EPR_Uint8:
+			return data::ValueArray<uint8_t>::staticID;
+		case EPR_Sint8:
+			return data::ValueArray<int8_t>::staticID;
+		case EPR_Uint16:
+			return data::ValueArray<uint16_t>::staticID;
+		case EPR_Sint16:
+			return data::ValueArray<int16_t>::staticID;
+		case EPR_Uint32:
+			return data::ValueArray<uint32_t>::staticID;
+		case EPR_Sint32:
+			return data::ValueArray<int32_t>::staticID;
+		default:
+			return 0;
+		}
+	}
+	/**
+	 * Decode the frames of a compressed monochrome multi-frame object in parallel.
+	 * Every thread opens the file on its own and decodes a consecutive range of the frames by its own DicomImage with partial access
+	 * (dcmtk cannot decode the same DcmFileFormat concurrently, and DicomImage would decode all frames one after another).
+	 * \returns the decoded frames or an empty pointer if they could not be decoded like this (DicomImage has to decode them in one go then)
+	 */
+	static std::auto_ptr<data::Chunk> decodeFrames( const std::string &filename, size_t frames, unsigned long flags ) {
+		std::auto_ptr<data::Chunk> ret;
+#if defined(_OPENMP) && OFFIS_DCMTK_VERSION_NUMBER >= 360
+		const long parts = std::min<long>( frames, omp_get_max_threads() );
+		bool failed = parts < 2;
+
+		LOG_IF( !failed, Debug, info ) << "Decoding the " << frames << " frames of " << util::MSubject( filename ) << " in " << parts << " parts";
+
+#pragma omp parallel for schedule(static) num_threads(parts) if( !failed )
+		for( long part = 0; part < parts; part++ ) {
+			const size_t first = frames * part / parts, count = frames * ( part + 1 ) / parts - first;
+			DcmFileFormat file;
+
+			if( failed || file.loadFile( filename.c_str() ).bad() ) {
+				failed = true;
+				continue;
+			}
+
+			std::vector<double> slopes, intercepts;
+			getFrameRescale( file.getDataset(), frames, slopes, intercepts ); // puts a rescaling common to all frames into this dataset as well
+
+			const DicomImage img( &file, EXS_Unknown, flags | CIF_UseAbsolutePixelRange | CIF_UsePartialAccessToPixelData, first, count );
+			const DiPixel *const pix = img.getStatus() == EIS_Normal && img.isMonochrome() ? img.getInterData() : NULL;
+			const unsigned short type = pix ? getTypeID( pix->getRepresentation() ) : 0;
+			bool good;
+
+#pragma omp critical(dicom_decode_frames)
+			{
+				if( type && !failed && !ret.get() )
+					ret.reset( new data::Chunk( data::ValueArrayBase::createByID( type, img.getWidth() * img.getHeight() * frames ), img.getWidth(), img.getHeight(), frames ) );
+
+				good = type && !failed && ret->getTypeID() == type && img.getFrameCount() == count &&
+					   ret->getSizeAsVector()[data::rowDim] == img.getWidth() && ret->getSizeAsVector()[data::columnDim] == img.getHeight();
+				failed = !good;
+			}
+
+			if( good ) {
+				const size_t frame_bytes = img.getWidth() * img.getHeight() * ret->getBytesPerVoxel();
+				const boost::shared_ptr<uint8_t> dst = boost::static_pointer_cast<uint8_t>( ret->asValueArrayBase().getRawAddress() );
+				memcpy( dst.get() + first * frame_bytes, pix->getData(), count * frame_bytes );
+			}
+		}
+
+		if( failed )
+			ret.reset();
+
+#endif //_OPENMP
+		return ret;
+	}
 public:
+	/**
+	 * Create a chunk of the size and type of the pixeldata without decoding the pixeldata.
+	 * The voxel data of the resulting chunk is an unmaterialized placeholder, only its metadata is valid.
+	 */
+	static data::Chunk makePlaceholder( const ImageFormat_Dicom &loader, std::auto_ptr<DcmFileFormat> dcfile, const util::istring &dialect ) {
+		DcmDataset *dcdata = dcfile->getDataset();
+		const size_t frames = getFrames( dcdata );
+		std::vector<double> slopes, intercepts;
+		const bool rescale = getFrameRescale( dcdata, frames, slopes, intercepts ); // this may set RescaleSlope/RescaleIntercept, so do it first
+		Uint16 rows = 0, columns = 0;
+		unsigned short type = getPixelType( dcdata, rows, columns );
+
+		if ( !type ) {
+			FileFormat::throwGenericError( "Unsupported pixel type." );
+		}
+
+		if( rescale ) // a full load would rescale the frames
+			type = data::ValueArray<float>::staticID;
+
+		data::Chunk ret( data::ValueArrayBase::createByID( type, columns * rows * frames ), columns, rows, frames );
+		loader.dcmObject2PropMap( dcdata, ret.branch( ImageFormat_Dicom::dicomTagTreeName ), dialect );
+		return ret;
+	}
+	/**
+	 * Map uncompressed pixeldata directly from the file, so it is only red when it is accessed.
+	 * This is done for monochrome frames without rescaling and if the pixeldata is the last element of the file (which is where it usually is).
+	 * If not all allocated bits are stored, the voxels are masked like DicomImage would do it while they are copied from the mapping
+	 * (the masking needs all voxels anyway, and masking the copy-on-write mapping in place would copy every page one by one).
+	 * Frames rescaled differently (or not by integers) by the functional groups of enhanced objects are mapped as well, and copied by rescaleFrames.
+	 * \returns the chunk with the mapped pixeldata or an empty pointer if it can't be mapped
+	 */
+	static std::auto_ptr<data::Chunk> makeMapped( const ImageFormat_Dicom &loader, const std::string &filename, DcmFileFormat &dcfile, const util::istring &dialect ) {
+		std::auto_ptr<data::Chunk> ret;
+		DcmDataset *dcdata = dcfile.getDataset();
+		const DcmXfer xfer( dcdata->getOriginalXfer() );
+		Uint16 rows = 0, columns = 0, bits = 0, stored = 0, high = 0, samples = 1, repn = 0;
+		Float64 slope = 1, intercept = 0;
+		std::vector<double> slopes, intercepts;
+		const bool rescale = getFrameRescale( dcdata, getFrames( dcdata ), slopes, intercepts ); // this may set RescaleSlope/RescaleIntercept, so do it first
+
+		dcdata->findAndGetUint16( DCM_BitsAllocated, bits );
+		dcdata->findAndGetUint16( DCM_PixelRepresentation, repn );
+		dcdata->findAndGetUint16( DCM_SamplesPerPixel, samples );
+		dcdata->findAndGetFloat64( DCM_RescaleSlope, slope );
+		dcdata->findAndGetFloat64( DCM_RescaleIntercept, intercept );
+
+		if( dcdata->findAndGetUint16( DCM_BitsStored, stored ).bad() )
+			stored = bits;
+
+		if( dcdata->findAndGetUint16( DCM_HighBit, high ).bad() )
+			high = stored - 1;
+
+		if (
+			xfer.isEncapsulated() || samples != 1 || stored == 0 || stored > bits || high >= bits || high + 1 < stored ||
+			slope != 1 || intercept != 0 || dcdata->tagExists( DCM_ModalityLUTSequence )
+		)
+			return ret;
+
+		// the voxels are only mapped if their type is the one DicomImage would make (e.g. not if only 8 of 16 allocated bits are stored)
+		const unsigned short type = getPixelType( dcdata, rows, columns );
+
+		if( !type || type != getStoredType( bits, repn ) )
+			return ret;
+
+		data::FilePtr file( filename );
+
+		// the pixeldata element must be at the end of the file
+		const size_t frames = getFrames( dcdata ), voxels = rows * columns * frames;
+		const size_t bytes = voxels * ( bits / 8 ), padded = bytes + bytes % 2, header = xfer.isExplicitVR() ? 12 : 8;
+
+		if( !file.good() || file.getLength() < padded + header )
+			return ret;
+
+		const size_t offset = file.getLength() - padded;
+		const data::ValueArray<uint8_t> head = file.at<uint8_t>( offset - header, header );
+		const bool little = xfer.getByteOrder() == EBO_LittleEndian;
+		const uint8_t tag[] = {0xE0, 0x7F, 0x10, 0x00}, tag_be[] = {0x7F, 0xE0, 0x00, 0x10};
+		uint32_t length = 0;
+
+		for( int i = 0; i < 4; i++ ) // the length is the last 4 bytes of the element header
+			length |= uint32_t( head[header - 4 + ( little ? i : 3 - i )] ) << ( i * 8 );
+
+		if(
+			memcmp( &head[0], little ? tag : tag_be, 4 ) != 0 || length != padded ||
+			( xfer.isExplicitVR() && memcmp( &head[4], "OB", 2 ) != 0 && memcmp( &head[4], "OW", 2 ) != 0 )
+		)
+			return ret;
+
+		LOG( Debug, verbose_info ) << "Mapping pixeldata of " << util::MSubject( filename ) << " at offset " << offset;
+		ret.reset( new data::Chunk( file.atByID( type, offset, voxels, xfer.getByteOrder() != gLocalByteOrder ), columns, rows, frames ) );
+
+		if( stored != bits ) { // masking would touch every page of the mapping, so the voxels are masked while they are copied into memory
+			LOG( Debug, verbose_info ) << "Copying " << stored << " stored bits (highest is " << high << ") of " << bits << " allocated bits";
+			ret.reset( new data::Chunk( maskStoredBits( *ret, stored, high ) ) );
+		}
+
+		if( rescale )
+			ret.reset( new data::Chunk( rescaleFrames( *ret, slopes, intercepts ) ) );
+
+		loader.dcmObject2PropMap( dcdata, ret->branch( ImageFormat_Dicom::dicomTagTreeName ), dialect );
+		return ret;
+	}
 	//this uses auto_ptr by intention
 	//the ownership of the DcmFileFormat-pointer shall be transfered to this function, because it has to decide if it should be deleted
 	static data::Chunk makeChunk( const ImageFormat_Dicom &loader, std::string filename, std::auto_ptr<DcmFileFormat> dcfile, const util::istring &dialect ) {
 		std::auto_ptr<data::Chunk> ret;
-		std::auto_ptr<DicomImage> img( new DicomImage( dcfile.get(), EXS_Unknown ) );
+		std::vector<double> slopes, intercepts;
+		// the rescaling of the frames of enhanced objects is done by rescaleFrames, so DicomImage must not do it as well
+		const size_t frame_count = getFrames( dcfile->getDataset() );
+		const bool rescale = getFrameRescale( dcfile->getDataset(), frame_count, slopes, intercepts );
+		Uint16 samples = 1;
+		dcfile->getDataset()->findAndGetUint16( DCM_SamplesPerPixel, samples );
+
+		if(
+			frame_count > 1 && samples == 1 && loader.threadSafe( filename ) &&
+			DcmXfer( dcfile->getDataset()->getOriginalXfer() ).isEncapsulated()
+		) {
+			ret = decodeFrames( filename, frame_count, rescale ? CIF_IgnoreModalityTransformation : 0 );
+
+			if( ret.get() ) {
+				loader.dcmObject2PropMap( dcfile->getDataset(), ret->branch( ImageFormat_Dicom::dicomTagTreeName ), dialect );
+
+				if( rescale )
+					ret.reset( new data::Chunk( rescaleFrames( *ret, slopes, intercepts ) ) );
+
+				return *ret;
+			}
+		}
+
+		std::auto_ptr<DicomImage> img( new DicomImage( dcfile.get(), EXS_Unknown, CIF_UseAbsolutePixelRange | ( rescale ? CIF_IgnoreModalityTransformation : 0 ) ) );
 
 		if ( img->getStatus() == EIS_Normal ) {
 			const DiPixel *const  pix = img->getInterData();
-			const unsigned long width = img->getWidth(), height = img->getHeight();
+			const unsigned long width = img->getWidth(), height = img->getHeight(), frames = img->getFrameCount();
 			const void *const data = pix->getData();
 			DcmDataset *dcdata = dcfile->getDataset();
 
@@ -71,22 +836,22 @@ public:
 
 					switch ( pix->getRepresentation() ) {
 					case EPR_Uint8:
-						ret.reset( new DicomChunk( ( uint8_t * ) data, del, width, height ) );
+						ret.reset( new DicomChunk( ( uint8_t * ) data, del, width, height, frames ) );
 						break;
 					case EPR_Sint8:
-						ret.reset( new DicomChunk( ( int8_t * )  data, del, width, height ) );
+						ret.reset( new DicomChunk( ( int8_t * )  data, del, width, height, frames ) );
 						break;
 					case EPR_Uint16:
-						ret.reset( new DicomChunk( ( uint16_t * )data, del, width, height ) );
+						ret.reset( new DicomChunk( ( uint16_t * )data, del, width, height, frames ) );
 						break;
 					case EPR_Sint16:
-						ret.reset( new DicomChunk( ( int16_t * ) data, del, width, height ) );
+						ret.reset( new DicomChunk( ( int16_t * ) data, del, width, height, frames ) );
 						break;
 					case EPR_Uint32:
-						ret.reset( new DicomChunk( ( uint32_t * )data, del, width, height ) );
+						ret.reset( new DicomChunk( ( uint32_t * )data, del, width, height, frames ) );
 						break;
 					case EPR_Sint32:
-						ret.reset( new DicomChunk( ( int32_t * ) data, del, width, height ) );
+						ret.reset( new DicomChunk( ( int32_t * ) data, del, width, height, frames ) );
 						break;
 					default:
 						FileFormat::throwGenericError( "Unsupported datatype for monochrome images" ); //@todo tell the user which datatype it is
@@ -97,15 +862,18 @@ public:
 						img.release();
 						dcfile.release();
 						loader.dcmObject2PropMap( dcdata, ret->branch( ImageFormat_Dicom::dicomTagTreeName ), dialect );
+
+						if( rescale && slopes.size() == frames ) // this drops the DicomChunk, and so dcdata
+							ret.reset( new data::Chunk( rescaleFrames( *ret, slopes, intercepts ) ) );
 					}
 				} else if ( pix->getPlanes() == 3 ) { //try to load data as color image
 					// if there are 3 planes data is actually an array of 3 pointers
 					switch ( pix->getRepresentation() ) {
 					case EPR_Uint8:
-						ret.reset( copyColor( ( Uint8 ** )data, width, height ) );
+						ret.reset( copyColor( ( Uint8 ** )data, width, height, frames ) );
 						break;
 					case EPR_Uint16:
-						ret.reset( copyColor( ( Uint16 ** )data, width, height ) );
+						ret.reset( copyColor( ( Uint16 ** )data, width, height, frames ) );
 						break;
 					default:
 						FileFormat::throwGenericError( "Unsupported datatype for color images" ); //@todo tell the user which datatype it is
@@ -138,12 +906,17 @@ const char ImageFormat_Dicom::unknownTagName[] = "UnknownTag/";
 util::istring ImageFormat_Dicom::suffixes( io_modes modes )const
 {
 	if( modes == write_only )
-		return util::istring();
+		return ".dcm";
 	else
 		return ".ima .dcm";
 }
 std::string ImageFormat_Dicom::getName()const {return "Dicom";}
-util::istring ImageFormat_Dicom::dialects( const std::string &/*filename*/ )const {return "siemens withExtProtocols keepmosaic";}
+util::istring ImageFormat_Dicom::dialects( const std::string &/*filename*/ )const {return "siemens withExtProtocols keepmosaic enhanced";}
+bool ImageFormat_Dicom::checkMagic( const data::ValueArray<uint8_t> &head )const
+{
+	// part 10 files start with a 128 byte preamble followed by "DICM"
+	return head.getLength() >= 132 && memcmp( &head[128], "DICM", 4 ) == 0;
+}
 
 
 
@@ -152,18 +925,42 @@ ptime ImageFormat_Dicom::genTimeStamp( const date &date, const ptime &time )
 	return ptime( date, time.time_of_day() );
 }
 
-void ImageFormat_Dicom::addDicomDict( DcmDataDictionary &dict )
+void ImageFormat_Dicom::addDicomDict( const DcmDataDictionary &dict )
 {
+	std::vector<DictEntry> entries;
+
 	for( DcmHashDictIterator i = dict.normalBegin(); i != dict.normalEnd(); i++ ) {
 		const DcmDictEntry *entry = *i;
 		const DcmTagKey key = entry->getKey();
 		const char *name = entry->getTagName();
 
 		if( util::istring( "Unknown" ) == name ) {
-			dictionary[key] = util::istring( unknownTagName ) + key.toString().c_str();
+			entries.push_back( DictEntry( key, util::istring( unknownTagName ) + key.toString().c_str() ) );
 		} else
-			dictionary[key] = name;
+			entries.push_back( DictEntry( key, name ) );
+	}
+
+	mergeDictionary( entries );
+}
+
+void ImageFormat_Dicom::mergeDictionary( const std::vector<DictEntry> &entries )
+{
+	dictionary.insert( dictionary.end(), entries.begin(), entries.end() );
+	std::stable_sort( dictionary.begin(), dictionary.end(), _internal::TagLess() );
+
+	// of the entries for the same tag only keep the one added last
+	std::vector<DictEntry>::iterator dst = dictionary.begin();
+
+	for( std::vector<DictEntry>::iterator i = dictionary.begin(); i != dictionary.end(); i++ ) {
+		if( i + 1 == dictionary.end() || ( i + 1 )->first != i->first ) {
+			if( dst != i )
+				*dst = *i;
+
+			dst++;
+		}
 	}
+
+	dictionary.erase( dst, dictionary.end() );
 }
 
 
@@ -217,12 +1014,10 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 		object.setPropertyAs( "sequenceStart", sequenceStart );
 	}
 
-	transformOrTell<uint16_t>  ( prefix + "SeriesNumber",     "sequenceNumber",     object, warning );
-	transformOrTell<uint16_t>  ( prefix + "PatientsAge",     "subjectAge",     object, info );
-	transformOrTell<std::string>( prefix + "SeriesDescription", "sequenceDescription", object, warning );
-	transformOrTell<std::string>( prefix + "PatientsName",     "subjectName",        object, info );
-	transformOrTell<date>       ( prefix + "PatientsBirthDate", "subjectBirth",       object, info );
-	transformOrTell<uint16_t>  ( prefix + "PatientsWeight",   "subjectWeigth",      object, info );
+	BOOST_FOREACH( const _internal::Transformation & trans, _internal::transformations ) {
+		transformOrTell( trans.from, trans.to, object, trans.type, trans.level );
+	}
+
 	// compute voxelSize and gap
 	{
 		util::fvector3 voxelSize( invalid_float, invalid_float, invalid_float );
@@ -241,9 +1036,6 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 		}
 
 		object.setPropertyAs( "voxelSize", voxelSize );
-		transformOrTell<uint16_t>( prefix + "RepetitionTime", "repetitionTime", object, warning );
-		transformOrTell<float>( prefix + "EchoTime", "echoTime", object, warning );
-		transformOrTell<int16_t>( prefix + "FlipAngle", "flipAngle", object, warning );
 
 		if ( hasOrTell( prefix + "SpacingBetweenSlices", object, info ) ) {
 			if ( voxelSize[2] != invalid_float ) {
@@ -256,9 +1048,6 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 						<< "), because the slice thickness is not known";
 		}
 	}
-	transformOrTell<std::string>   ( prefix + "PerformingPhysiciansName", "performingPhysician", object, info );
-	transformOrTell<uint16_t>     ( prefix + "NumberOfAverages",        "numberOfAverages",   object, warning );
-
 	if ( hasOrTell( prefix + "ImageOrientationPatient", object, info ) ) {
 		util::dlist buff = dicomTree.getPropertyAs<util::dlist>( "ImageOrientationPatient" );
 
@@ -302,8 +1091,6 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 		LOG( Runtime, warning ) << "Making up indexOrigin, because the image lacks this information";
 	}
 
-	transformOrTell<uint32_t>( prefix + "InstanceNumber", "acquisitionNumber", object, error );
-
 	if( dicomTree.hasProperty( "AcquisitionNumber" ) && object.propertyValue( "acquisitionNumber" ) == dicomTree.propertyValue( "AcquisitionNumber" ) )
 		dicomTree.remove( "AcquisitionNumber" );
 
@@ -334,7 +1121,6 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 		}
 	}
 
-	transformOrTell<uint32_t>( prefix + "CSAImageHeaderInfo/UsedChannelMask", "coilChannelMask", object, info );
 	////////////////////////////////////////////////////////////////
 	// interpret DWI data
 	////////////////////////////////////////////////////////////////
@@ -407,7 +1193,7 @@ void ImageFormat_Dicom::sanitise( util::PropertyMap &object, util::istring diale
 	}
 }
 
-data::Chunk ImageFormat_Dicom::readMosaic( data::Chunk source )
+data::Chunk ImageFormat_Dicom::readMosaic( data::Chunk source, bool copy_data )
 {
 	// prepare some needed parameters
 	const util::istring prefix = util::istring( ImageFormat_Dicom::dicomTagTreeName ) + "/";
@@ -486,37 +1272,150 @@ data::Chunk ImageFormat_Dicom::readMosaic( data::Chunk source )
 		ref[2] = voxelSize[2] * images + voxelGap[2] * ( images - 1 );
 	}
 
-	// for every slice
-	for ( size_t slice = 0; slice < images; slice++ ) {
-		// copy the lines into the corresponding slice in the chunk
-		for ( size_t line = 0; line < size[1]; line++ ) {
-			const size_t dpos[] = {0, line, slice, 0}; //begin of the target line
-			const size_t column = slice % matrixSize; //column of the mosaic
-			const size_t row = slice / matrixSize; //row of the mosaic
-			const size_t sstart[] = {column *size[0], row *size[1] + line, 0, 0}; //begin of the source line
-			const size_t send[] = {sstart[0] + size[0] - 1, row *size[1] + line, 0, 0}; //end of the source line
-			source.copyRange( sstart, send, dest, dpos );
-		}
+	// copy the tiles into the corresponding slices in the chunk
+	if( copy_data )
+		_internal::mosaicBlit( source, dest, matrixSize );
 
-		if( haveAcqTimeList ) {
-			dest.propertyValueAt( "acquisitionTime", slice ) = float( acqTime +  * ( acqTimeIt++ ) );
-		} else {
-			dest.propertyValueAt( "acquisitionNumber", slice ) = uint32_t( acqNum * images +  slice );
-		}
+	// set the per slice properties
+	if( haveAcqTimeList ) {
+		std::vector<float> times( images );
+
+		for ( size_t slice = 0; slice < images; slice++ )
+			times[slice] = float( acqTime +  * ( acqTimeIt++ ) );
+
+		dest.setPropertyValuesAt( "acquisitionTime", times );
+	} else {
+		std::vector<uint32_t> numbers( images );
+
+		for ( size_t slice = 0; slice < images; slice++ )
+			numbers[slice] = uint32_t( acqNum * images +  slice );
+
+		dest.setPropertyValuesAt( "acquisitionNumber", numbers );
 	}
 
 	return dest;
 }
 
+void ImageFormat_Dicom::frames2Chunks( data::Chunk chunk, std::list<data::Chunk> &chunks )
+{
+	const util::vector4<size_t> size = chunk.getSizeAsVector();
+	const size_t frames = size[data::sliceDim];
+	const util::PropertyMap::PropPath positionsPath = util::istring( ImageFormat_Dicom::dicomTagTreeName ) + "/PerFrame/ImagePositionPatient";
+	std::vector<util::fvector3> positions( frames, chunk.getPropertyAs<util::fvector3>( "indexOrigin" ) );
+
+	if( chunk.hasProperty( positionsPath ) ) {
+		const util::dlist list = chunk.getPropertyAs<util::dlist>( positionsPath );
+
+		if( list.size() == frames * 3 ) {
+			util::dlist::const_iterator i = list.begin();
+
+			for( size_t f = 0; f < frames; f++ )
+				for( size_t d = 0; d < 3; d++ )
+					positions[f][d] = *( i++ );
+		} else
+			LOG( Runtime, warning ) << "Ignoring " << positionsPath << " because it has " << list.size() << " entries instead of " << frames * 3;
+	}
+
+	// find the number of frames per volume (the frames must repeat the same positions for every volume)
+	size_t stack = 1;
+
+	while( stack < frames && positions[stack] != positions[0] )
+		stack++;
+
+	bool regular = frames % stack == 0;
+
+	for( size_t f = stack; regular && f < frames; f++ )
+		regular = positions[f] == positions[f % stack];
+
+	// and the slices of a volume must be evenly spaced
+	const util::fvector3 step = stack > 1 ? positions[1] - positions[0] : util::fvector3();
+	const float distance = step.len();
+
+	for( size_t f = 2; regular && f < stack; f++ )
+		regular = ( positions[f] - positions[f - 1] - step ).len() <= distance * 1e-3;
+
+	const uint32_t acqNum = chunk.hasProperty( "acquisitionNumber" ) ? chunk.getPropertyAs<uint32_t>( "acquisitionNumber" ) : 0;
+
+	if( !regular ) {
+		LOG( Runtime, info ) << "The frames of " << chunk.getPropertyAs<std::string>( "source" ) << " do not form evenly spaced volumes, loading them as single slices";
+
+		std::vector<uint32_t> numbers( frames );
+
+		for( size_t f = 0; f < frames; f++ )
+			numbers[f] = uint32_t( acqNum * frames + f );
+
+		// per slice properties, splice distributes them to the slices
+		chunk.setPropertyValuesAt( "indexOrigin", positions );
+		chunk.setPropertyValuesAt( "acquisitionNumber", numbers );
+
+		std::list<data::Chunk> slices = chunk.splice( data::sliceDim );
+		chunks.splice( chunks.end(), slices );
+		return;
+	}
+
+	if( stack > 1 ) { // the geometry along the slices is given by the positions of the frames
+		chunk.setPropertyAs( "sliceVec", util::fvector3( step / distance ) );
+		const util::fvector3 voxelSize = chunk.getPropertyAs<util::fvector3>( "voxelSize" );
+
+		if( voxelSize[2] != invalid_float )
+			chunk.setPropertyAs( "voxelGap", util::fvector3( 0, 0, distance - voxelSize[2] ) );
+		else
+			chunk.setPropertyAs( "voxelSize", util::fvector3( voxelSize[0], voxelSize[1], distance ) );
+	}
+
+	if( stack == frames ) {
+		chunks.push_back( chunk );
+		return;
+	}
+
+	// several volumes, so make it a 4D chunk (using the same voxel data) and splice it into the volumes
+	const size_t volumes = frames / stack;
+	data::Chunk series( data::ValueArrayReference( chunk.getValueArrayBase() ), size[data::rowDim], size[data::columnDim], stack, volumes );
+	static_cast<util::PropertyMap &>( series ) = static_cast<const util::PropertyMap &>( chunk );
+	series.setPropertyAs( "acquisitionNumber", uint32_t( acqNum * volumes ) ); // autoSplice needs it
+	std::list<data::Chunk> splices = series.autoSplice( 1 );
+	uint32_t t = 0;
+
+	BOOST_FOREACH( data::Chunk & volume, splices ) {
+		volume.setPropertyAs( "acquisitionNumber", uint32_t( acqNum * volumes + t++ ) );
+	}
+
+	chunks.splice( chunks.end(), splices );
+}
+
+int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )throw( std::runtime_error & )
+{
+	return load( chunks, filename, dialect, progress, false );
+}
 
-int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )throw( std::runtime_error & )
+int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/, bool metadata_only )throw( std::runtime_error & )
 {
 
 	std::auto_ptr<DcmFileFormat> dcfile( new DcmFileFormat );
-	OFCondition loaded = dcfile->loadFile( filename.c_str() );
+#if OFFIS_DCMTK_VERSION_NUMBER >= 361
+	// only parse the header, the pixeldata is mapped from the file or decoded later (if at all)
+	OFCondition loaded = dcfile->loadFileUntilTag( filename.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData );
+#else
+	OFCondition loaded = dcfile->loadFile( filename.c_str() ); // big elements (like the pixeldata) are only loaded on access
+#endif
+	std::auto_ptr<data::Chunk> mapped;
+
+	if ( loaded.good() && !metadata_only ) {
+		mapped = _internal::DicomChunk::makeMapped( *this, filename, *dcfile, dialect );
+#if OFFIS_DCMTK_VERSION_NUMBER >= 361
+
+		if( !mapped.get() ) { // DicomImage has to decode the pixeldata, so we need all of the file
+			dcfile.reset( new DcmFileFormat );
+			loaded = dcfile->loadFile( filename.c_str() );
+		}
+
+#endif
+	}
 
 	if ( loaded.good() ) {
-		data::Chunk chunk = _internal::DicomChunk::makeChunk( *this, filename, dcfile, dialect );
+		data::Chunk chunk = metadata_only ?
+							_internal::DicomChunk::makePlaceholder( *this, dcfile, dialect ) :
+							mapped.get() ? *mapped : _internal::DicomChunk::makeChunk( *this, filename, dcfile, dialect );
 		//we got a chunk from the file
 		sanitise( chunk, dialect );
 		chunk.setPropertyAs( "source", filename );
@@ -527,8 +1426,12 @@ int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &
 				LOG( Runtime, info ) << "This seems to be an mosaic image, but dialect \"keepmosaic\" was selected";
 				chunks.push_back( chunk );
 			} else {
-				chunks.push_back( readMosaic( chunk ) );
+				chunks.push_back( readMosaic( chunk, !metadata_only ) );
 			}
+		} else if ( chunk.getSizeAsVector()[data::sliceDim] > 1 ) { // multi-frame object
+			const size_t before = chunks.size();
+			frames2Chunks( chunk, chunks );
+			return chunks.size() - before;
 		} else {
 			chunks.push_back( chunk );
 		}
@@ -541,18 +1444,173 @@ int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &
 	return 0;
 }
 
-void ImageFormat_Dicom::write( const data::Image &/*image*/, const std::string &/*filename*/, const util::istring &/*dialect*/, boost::shared_ptr<util::ProgressFeedback> /*progress*/ ) throw( std::runtime_error & )
+void ImageFormat_Dicom::write( const data::Image &image, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress ) throw( std::runtime_error & )
 {
-	throw( std::runtime_error( "writing dicom files is not yet supportet" ) );
+	data::Image tImg = image;
+	unsigned short type = image.getMajorTypeID();
+	double slope = 1, intercept = 0;
+
+	switch( type ) {
+	case data::ValueArray<uint8_t>::staticID:
+	case data::ValueArray<int8_t>::staticID:
+	case data::ValueArray<uint16_t>::staticID:
+	case data::ValueArray<int16_t>::staticID:
+	case data::ValueArray<util::color24>::staticID:
+		break;
+	case data::ValueArray<util::color48>::staticID:
+		throwGenericError( "Writing color images with 16 bit per channel is not supported" );
+	default: { // store everything else as 16bit integer and keep the original values by RescaleSlope/RescaleIntercept
+		if( image.getMinMaxAs<double>().first < 0 )
+			type = data::ValueArray<int16_t>::staticID;
+		else
+			type = data::ValueArray<uint16_t>::staticID;
+
+		const data::scaling_pair scale = image.getScalingTo( type );
+		slope = 1 / scale.first->as<double>();
+		intercept = -scale.second->as<double>() / scale.first->as<double>();
+		LOG( Runtime, info ) << "Converting " << image.getMajorTypeName() << " to " << util::getTypeMap( false, true )[type] << " (RescaleSlope: " << slope << " RescaleIntercept: " << intercept << ")";
+	}
+	}
+
+	if( !tImg.convertToType( type ) )
+		throwGenericError( "Failed to convert the image to " + util::getTypeMap( false, true )[type] );
+
+	tImg.spliceDownTo( data::sliceDim );
+	const std::vector<data::Chunk> slices = tImg.copyChunksToVector( true );
+	const util::vector4<size_t> size = tImg.getSizeAsVector();
+	const bool enhanced = ( dialect == "enhanced" );
+
+	const std::string modality = tImg.hasProperty( "DICOM/Modality" ) ? tImg.getPropertyAs<std::string>( "DICOM/Modality" ) : "OT";
+	_internal::WriteUIDs uids;
+	char uid[100];
+	uids.study = tImg.hasProperty( "DICOM/StudyInstanceUID" ) ? tImg.getPropertyAs<std::string>( "DICOM/StudyInstanceUID" ) : dcmGenerateUniqueIdentifier( uid, SITE_STUDY_UID_ROOT );
+	uids.series = dcmGenerateUniqueIdentifier( uid, SITE_SERIES_UID_ROOT );
+	uids.frameOfReference = tImg.hasProperty( "DICOM/FrameOfReferenceUID" ) ? tImg.getPropertyAs<std::string>( "DICOM/FrameOfReferenceUID" ) : dcmGenerateUniqueIdentifier( uid );
+
+	if( enhanced ) {
+		// all slices as frames of one enhanced multi-frame image (frames of the same volume are consecutive)
+		uids.sopClass = UID_EnhancedMRImageStorage;
+		DcmFileFormat file;
+		DcmDataset *ds = file.getDataset();
+		DcmItem *shared = NULL, *item = NULL;
+		_internal::putCommon( ds, slices.front(), uids, "DERIVED\\SECONDARY\\OTHER\\NONE", modality );
+		ds->putAndInsertString( DCM_SOPInstanceUID, dcmGenerateUniqueIdentifier( uid, SITE_INSTANCE_UID_ROOT ) );
+		ds->putAndInsertString( DCM_InstanceNumber, "1" );
+		ds->putAndInsertString( DCM_NumberOfFrames, boost::lexical_cast<std::string>( slices.size() ).c_str() );
+
+		ds->findOrCreateSequenceItem( DCM_SharedFunctionalGroupsSequence, shared, 0 );
+
+		if( shared->findOrCreateSequenceItem( DCM_PixelMeasuresSequence, item, 0 ).good() )
+			_internal::putPixelMeasures( item, slices.front(), size[data::sliceDim] > 1 );
+
+		if( shared->findOrCreateSequenceItem( DCM_PlaneOrientationSequence, item, 0 ).good() )
+			_internal::putOrientation( item, slices.front() );
+
+		if( ( slope != 1 || intercept != 0 ) && shared->findOrCreateSequenceItem( DCM_PixelValueTransformationSequence, item, 0 ).good() ) {
+			item->putAndInsertString( DCM_RescaleSlope, _internal::decimalString( &slope, 1 ).c_str() );
+			item->putAndInsertString( DCM_RescaleIntercept, _internal::decimalString( &intercept, 1 ).c_str() );
+			item->putAndInsertString( DCM_RescaleType, "US" ); // unspecified
+		}
+
+		for( size_t i = 0; i < slices.size(); i++ ) {
+			DcmItem *frame = NULL;
+			ds->findOrCreateSequenceItem( DCM_PerFrameFunctionalGroupsSequence, frame, -2 ); // append
+
+			if( frame->findOrCreateSequenceItem( DCM_PlanePositionSequence, item, 0 ).good() )
+				_internal::putPosition( item, slices[i] );
+
+			if( frame->findOrCreateSequenceItem( DCM_FrameContentSequence, item, 0 ).good() ) {
+				item->putAndInsertUint32( DCM_InStackPositionNumber, i % size[data::sliceDim] + 1 );
+				item->putAndInsertUint32( DCM_TemporalPositionIndex, i / size[data::sliceDim] + 1 );
+			}
+		}
+
+		_internal::putPixels( ds, slices, 0, slices.size() );
+		LOG( Runtime, info ) << "Writing " << slices.size() << " slices as frames of the enhanced dicom image " << filename;
+		const OFCondition saved = file.saveFile( filename.c_str(), EXS_LittleEndianExplicit );
+
+		if( saved.bad() )
+			throwGenericError( "Failed to write " + filename + " (" + saved.text() + ")" );
+
+		return;
+	}
+
+	// one file per slice
+	uids.sopClass = modality == "MR" ? UID_MRImageStorage : UID_SecondaryCaptureImageStorage;
+	const long count = slices.size();
+	std::vector<std::string> names( count ), instances( count );
+	const std::pair<std::string, std::string> fname = makeBasename( filename );
+	const unsigned short numLen = std::log10( double( count ) ) + 1;
+
+	for( long i = 0; i < count; i++ ) { // generate the uids in advance, dcmGenerateUniqueIdentifier is not thread safe
+		const std::string num = boost::lexical_cast<std::string>( i + 1 );
+		names[i] = count > 1 ? fname.first + "_" + std::string( numLen - num.length(), '0' ) + num + fname.second : filename;
+		instances[i] = dcmGenerateUniqueIdentifier( uid, SITE_INSTANCE_UID_ROOT );
+	}
+
+	LOG( Runtime, info ) << "Writing " << count << " slices as dicom images " << fname.first << "_" << std::string( numLen, 'X' ) << fname.second;
+
+	if( progress )
+		progress->show( count, std::string( "Writing " ) + fname.first + "_" + std::string( numLen, 'X' ) + fname.second );
+
+	std::string failed;
+
+	// the slices are encoded and written in parallel (every thread works on its own DcmFileFormat)
+#pragma omp parallel for schedule(dynamic) if( threadSafe( filename ) )
+	for( long i = 0; i < count; i++ ) {
+		DcmFileFormat file;
+		DcmDataset *ds = file.getDataset();
+		_internal::putCommon( ds, slices[i], uids, "DERIVED\\SECONDARY", modality );
+		ds->putAndInsertString( DCM_SOPInstanceUID, instances[i].c_str() );
+		ds->putAndInsertString( DCM_InstanceNumber, boost::lexical_cast<std::string>( i + 1 ).c_str() );
+		_internal::putPixelMeasures( ds, slices[i], size[data::sliceDim] > 1 );
+		_internal::putOrientation( ds, slices[i] );
+		_internal::putPosition( ds, slices[i] );
+
+		if( slope != 1 || intercept != 0 ) {
+			ds->putAndInsertString( DCM_RescaleSlope, _internal::decimalString( &slope, 1 ).c_str() );
+			ds->putAndInsertString( DCM_RescaleIntercept, _internal::decimalString( &intercept, 1 ).c_str() );
+		}
+
+		_internal::putPixels( ds, slices, i, 1 );
+		const OFCondition saved = file.saveFile( names[i].c_str(), EXS_LittleEndianExplicit );
+
+#pragma omp critical(dicom_write)
+		{
+			if( saved.bad() && failed.empty() )
+				failed = names[i] + " (" + saved.text() + ")";
+
+			if( progress )
+				progress->progress();
+		}
+	}
+
+	if( progress )
+		progress->close();
+
+	if( !failed.empty() )
+		throwGenericError( "Failed to write " + failed );
 }
 
 bool ImageFormat_Dicom::tainted()const {return false;}//internal plugins are not tainted
+bool ImageFormat_Dicom::threadSafe( const std::string &/*filename*/ )const
+{
+#ifdef WITH_THREADS
+	return true;
+#else
+	return false; // dcmtk does not lock its global state (e.g. the dictionary and the logger)
+#endif
+}
 
 ImageFormat_Dicom::ImageFormat_Dicom()
 {
+	// register the decoders for compressed transfer syntaxes (DicomImage uses them to decompress the pixeldata)
+	_internal::DecoderRegistration::acquire();
+
 	//first read external dictionary if available
+	// this also makes dcmtk load its dictionary now (newer versions load it lazily), and not when load is called from multiple threads
 	if ( dcmDataDict.isDictionaryLoaded() ) {
-		DcmDataDictionary &dict = dcmDataDict.wrlock();
+		const DcmDataDictionary &dict = dcmDataDict.rdlock(); // we only read it
 		addDicomDict( dict );
 		dcmDataDict.unlock();
 	} else {
@@ -562,29 +1620,27 @@ ImageFormat_Dicom::ImageFormat_Dicom()
 	}
 
 	// than override known entries
-	dictionary[DcmTag( 0x0010, 0x0010 )] = "PatientsName";
-	dictionary[DcmTag( 0x0010, 0x0030 )] = "PatientsBirthDate";
-	dictionary[DcmTag( 0x0010, 0x0040 )] = "PatientsSex";
-	dictionary[DcmTag( 0x0010, 0x1010 )] = "PatientsAge";
-	dictionary[DcmTag( 0x0010, 0x1030 )] = "PatientsWeight";
-
-	dictionary[DcmTag( 0x0008, 0x1050 )] = "PerformingPhysiciansName";
+	std::vector<DictEntry> known;
 
-	// override some Siemens specific stuff because it is SliceOrientation in the standard and mosaic-size for siemens - we will figure out while sanitizing
-	dictionary[DcmTag( 0x0019, 0x100a )] = "SiemensNumberOfImagesInMosaic";
-	dictionary[DcmTag( 0x0019, 0x100c )] = "SiemensDiffusionBValue";
-	dictionary[DcmTag( 0x0019, 0x100e )] = "SiemensDiffusionGradientOrientation";
+	for( size_t i = 0; i < sizeof( _internal::knownTags ) / sizeof( _internal::knownTags[0] ); i++ )
+		known.push_back( DictEntry( DcmTagKey( _internal::knownTags[i].group, _internal::knownTags[i].element ), _internal::knownTags[i].name ) );
 
 	for( unsigned short i = 0x0010; i <= 0x00FF; i++ ) {
-		dictionary[DcmTag( 0x0029, i )] = ( std::string( "Private Code for " ) + DcmTag( 0x0029, i << 8 ).toString().c_str() + "-" + DcmTag( 0x0029, ( i << 8 ) + 0xFF ).toString().c_str() ).c_str();
+		const std::string name = std::string( "Private Code for " ) + DcmTagKey( 0x0029, i << 8 ).toString().c_str() + "-" + DcmTagKey( 0x0029, ( i << 8 ) + 0xFF ).toString().c_str();
+		known.push_back( DictEntry( DcmTagKey( 0x0029, i ), name.c_str() ) );
 	}
 
+	mergeDictionary( known );
+}
 
+ImageFormat_Dicom::~ImageFormat_Dicom()
+{
+	_internal::DecoderRegistration::release();
 }
 util::PropertyMap::PropPath ImageFormat_Dicom::tag2Name( const DcmTagKey &tag )const
 {
-	std::map< DcmTagKey, util::PropertyMap::PropPath >::const_iterator entry = dictionary.find( tag );
-	return ( entry != dictionary.end() ) ? entry->second : util::PropertyMap::PropPath( util::istring( unknownTagName ) + tag.toString().c_str() );
+	const std::vector<DictEntry>::const_iterator entry = std::lower_bound( dictionary.begin(), dictionary.end(), tag, _internal::TagLess() );
+	return ( entry != dictionary.end() && entry->first == tag ) ? entry->second : util::PropertyMap::PropPath( util::istring( unknownTagName ) + tag.toString().c_str() );
 }
 
 
@@ -28,12 +28,28 @@
 #include <dcmtk/dcmdata/dcdict.h>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <vector>
 
 namespace isis
 {
 namespace image_io
 {
 
+/**
+ * Plugin for DICOM files based on dcmtk.
+ * Files are only parsed up to the pixeldata first. Uncompressed pixeldata which does not need any modality transformation is
+ * mapped from the file, everything else is decoded by DicomImage. Loading metadata only never touches the pixeldata.
+ * Compressed pixeldata is decoded by the codecs of dcmtk (rle, and jpeg / jpeg-ls if dcmjpeg / dcmjpls were found). The plugin only registers
+ * (and cleans up) the decoders which were not registered by the application already.
+ * The frames of compressed multi-frame objects are decoded in parallel, every thread decodes a part of them from its own DcmFileFormat.
+ * The Siemens CSA headers are decoded into the properties of every chunk while loading (properties cannot be decoded on access).
+ * load can be called concurrently (if dcmtk was built with thread support):
+ * - the instances of the plugin have no mutable state, the dictionary is only written by the constructor
+ * - the global state of dcmtk (its dictionary, codecs and logger) is set up by the constructor and locked by dcmtk itself
+ * - every call works on its own DcmFileFormat and DicomImage
+ * Images are written uncompressed as one MR or secondary capture file per slice (the slices are encoded in parallel),
+ * or with the dialect "enhanced" as one enhanced MR multi-frame file.
+ */
 class ImageFormat_Dicom: public FileFormat
 {
 	static void parseAS( DcmElement *elem, const util::PropertyMap::PropPath &name, util::PropertyMap &map );
@@ -57,14 +73,34 @@ class ImageFormat_Dicom: public FileFormat
 	static size_t parseCSAEntry( Uint8 *at, isis::util::PropertyMap &map, const util::istring &dialect );
 	static bool parseCSAValue( const std::string &val, const util::PropertyMap::PropPath &name, const util::istring &vr, isis::util::PropertyMap &map );
 	static bool parseCSAValueList( const isis::util::slist &val, const util::PropertyMap::PropPath &name, const util::istring &vr, isis::util::PropertyMap &map );
-	static data::Chunk readMosaic( data::Chunk source );
-	std::map<DcmTagKey, util::PropertyMap::PropPath> dictionary;
+	static data::Chunk readMosaic( data::Chunk source, bool copy_data = true );
+	typedef std::pair<DcmTagKey, util::PropertyMap::PropPath> DictEntry;
+	/// the names of the dicom tags, sorted by tag so tag2Name can do a binary search
+	std::vector<DictEntry> dictionary;
+	/// add entries to the dictionary (they replace existing entries for the same tag)
+	void mergeDictionary( const std::vector<DictEntry> &entries );
+
+	/// parse the first item of every functional group sequence in item into map
+	void functionalGroups2PropMap( DcmItem *item, util::PropertyMap &map, const util::istring &dialect )const;
+	/**
+	 * Parse the Shared- or PerFrameFunctionalGroupsSequence of an enhanced multi-frame object.
+	 * The shared groups and the groups of the first frame are stored in map as if they were part of the dataset.
+	 * Values which differ between the frames are additionally stored as lists in the branch "PerFrame".
+	 */
+	void parseFunctionalGroups( DcmSequenceOfItems *seq, bool per_frame, util::PropertyMap &map, const util::istring &dialect )const;
+	/**
+	 * Make chunks from a chunk containing all frames of a multi-frame object (stacked along the slice dimension).
+	 * If the frames form evenly spaced volumes, the chunk is kept as 3D or reshaped to 4D. Otherwise its spliced into single slices.
+	 * The voxel data is shared in both cases.
+	 */
+	static void frames2Chunks( data::Chunk chunk, std::list<data::Chunk> &chunks );
 protected:
 	util::istring suffixes( io_modes modes = both )const;
 	util::PropertyMap::PropPath tag2Name( const DcmTagKey &tag ) const;
 public:
 	ImageFormat_Dicom();
-	void addDicomDict( DcmDataDictionary &dict );
+	~ImageFormat_Dicom();
+	void addDicomDict( const DcmDataDictionary &dict );
 	static const char dicomTagTreeName[];
 	static const char unknownTagName[];
 	static void parseCSA( DcmElement *elem, isis::util::PropertyMap &map, const util::istring &dialect );
@@ -74,11 +110,14 @@ public:
 	static void sanitise( util::PropertyMap &object, util::istring dialect );
 	std::string getName()const;
 	util::istring dialects( const std::string &filename )const;
+	bool checkMagic( const data::ValueArray<uint8_t> &head )const;
 
 	int load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress ) throw( std::runtime_error & );
+	int load( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress, bool metadata_only ) throw( std::runtime_error & );
 	void write( const data::Image &image,     const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress ) throw( std::runtime_error & );
 
 	bool tainted()const;
+	bool threadSafe( const std::string &filename )const;
 };
 }
 }
@@ -59,7 +59,7 @@ void ImageFormat_Dicom::parseAS( DcmElement *elem, const util::PropertyMap::Prop
 	uint16_t duration = 0;
 	OFString buff;
 	elem->getOFString( buff, 0 );
-	static boost::numeric::converter <
+	static const boost::numeric::converter <
 	uint16_t, double,
 			boost::numeric::conversion_traits<uint16_t, double>,
 			boost::numeric::def_overflow_handler,
@@ -482,6 +482,92 @@ bool ImageFormat_Dicom::parseCSAValueList( const util::slist &val, const util::P
 	return true;
 }
 
+void ImageFormat_Dicom::functionalGroups2PropMap( DcmItem *item, util::PropertyMap &map, const util::istring &dialect )const
+{
+	// every functional group is a sequence with exactly one item, its content is stored as if it was part of the dataset
+	for ( DcmObject *obj = item->nextInContainer( NULL ); obj; obj = item->nextInContainer( obj ) ) {
+		DcmSequenceOfItems *group = dynamic_cast<DcmSequenceOfItems *>( obj );
+
+		if( group && group->card() )
+			dcmObject2PropMap( group->getItem( 0 ), map, dialect );
+		else
+			LOG( Debug, warning ) << "Ignoring " << obj->getTag().toString() << " which is not a functional group sequence";
+	}
+}
+
+void ImageFormat_Dicom::parseFunctionalGroups( DcmSequenceOfItems *seq, bool per_frame, util::PropertyMap &map, const util::istring &dialect )const
+{
+	if( !seq || seq->card() == 0 ) {
+		LOG( Runtime, warning ) << "Ignoring empty functional groups sequence";
+		return;
+	}
+
+	if( !per_frame ) { // the shared groups are valid for all frames
+		functionalGroups2PropMap( seq->getItem( 0 ), map, dialect );
+		return;
+	}
+
+	const unsigned long frames = seq->card();
+	std::vector<util::PropertyMap> groups( frames );
+
+	for ( unsigned long f = 0; f < frames; f++ )
+		functionalGroups2PropMap( seq->getItem( f ), groups[f], dialect );
+
+	// values which differ between the frames are stored as a list with an entry for each frame (lists of numbers are concatenated)
+	const util::PropertyMap::FlatMap first = groups[0].getFlatMap();
+
+	for( util::PropertyMap::FlatMap::const_iterator i = first.begin(); i != first.end(); i++ ) {
+		const util::PropertyMap::PropPath path( i->first );
+		bool same = true;
+
+		for( unsigned long f = 1; same && f < frames; f++ )
+			same = groups[f].hasProperty( path ) && groups[f].propertyValue( path ) == i->second;
+
+		if( same )
+			continue;
+
+		util::dlist numbers;
+		util::slist strings;
+		bool numeric = true;
+
+		for( unsigned long f = 0; f < frames; f++ ) {
+			const util::PropertyMap &group = groups[f];
+
+			if( !group.hasProperty( path ) ) {
+				numeric = false;
+				strings.push_back( std::string() );
+				continue;
+			}
+
+			const util::PropertyValue &val = group.propertyValue( path );
+
+			if( val.is<util::dlist>() ) {
+				const util::dlist &list = val.castTo<util::dlist>();
+				numbers.insert( numbers.end(), list.begin(), list.end() );
+			} else if( val.is<util::ilist>() ) {
+				const util::ilist &list = val.castTo<util::ilist>();
+				numbers.insert( numbers.end(), list.begin(), list.end() );
+			} else if( val.is<double>() || val.is<float>() || val.is<int32_t>() || val.is<uint32_t>() || val.is<int16_t>() || val.is<uint16_t>() ) {
+				numbers.push_back( val.as<double>() );
+			} else
+				numeric = false;
+
+			strings.push_back( ( *val ).toString() );
+		}
+
+		util::PropertyMap::PropPath list_path( "PerFrame" );
+		list_path.insert( list_path.end(), path.begin(), path.end() );
+
+		if( numeric )
+			map.setPropertyAs( list_path, numbers );
+		else
+			map.setPropertyAs( list_path, strings );
+	}
+
+	// the values of the first frame are stored as if it was a single frame object
+	map.join( groups[0] );
+}
+
 void ImageFormat_Dicom::dcmObject2PropMap( DcmObject *master_obj, util::PropertyMap &map, const util::istring &dialect )const
 {
 	for ( DcmObject *obj = master_obj->nextInContainer( NULL ); obj; obj = master_obj->nextInContainer( obj ) ) {
@@ -501,11 +587,13 @@ void ImageFormat_Dicom::dcmObject2PropMap( DcmObject *master_obj, util::Property
 			} else {
 				LOG( Runtime, warning ) << "Ignoring entry " << tag.toString() << ", binary format " << as << " is not known";
 			}
+		} else if ( tag == DcmTagKey( 0x5200, 0x9229 ) || tag == DcmTagKey( 0x5200, 0x9230 ) ) { //Shared- and PerFrameFunctionalGroupsSequence of enhanced multi-frame objects
+			parseFunctionalGroups( dynamic_cast<DcmSequenceOfItems *>( obj ), tag == DcmTagKey( 0x5200, 0x9230 ), map, dialect );
 		} else if ( tag == DcmTagKey( 0x0029, 0x0020 ) ) { //MedComHistoryInformation
 			//@todo special handling needed
 			LOG( Debug, info ) << "Ignoring MedComHistoryInformation at " << tag.toString();
 		} else if ( obj->isLeaf() ) { // common case
-			if ( obj->getTag() == DcmTag( 0x0008, 0x0032 ) ) {
+			if ( tag == DcmTagKey( 0x0008, 0x0032 ) ) { // AcquisitionTime (compare the key, creating a DcmTag would look it up in the dictionary)
 				OFString buff;
 				dynamic_cast<DcmElement *>( obj )->getOFString( buff, 0 );
 
@@ -9,24 +9,125 @@
 
 
 #include <DataStorage/io_interface.h>
-#include <stdio.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include "boost/date_time/posix_time/posix_time.hpp"
+#include <algorithm>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif //__SSE2__
 
 namespace isis
 {
 namespace image_io
 {
+namespace _internal
+{
+/// copy a row of voxels converting them to DST (a plain loop, which the compiler vectorises)
+template<typename SRC, typename DST> void copyRow( const SRC *src, DST *dst, size_t len )
+{
+	for( size_t i = 0; i < len; i++ )
+		dst[i] = src[i];
+}
+template<typename T> void copyRow( const T *src, T *dst, size_t len ) {memcpy( dst, src, len * sizeof( T ) );}
+#ifdef __SSE2__
+/// shorts (what the scanner usually sends) to float, 8 at a time (without -O3 the compiler does not vectorise the loop above)
+template<> void copyRow<uint16_t, float>( const uint16_t *src, float *dst, size_t len )
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for( ; i + 8 <= len; i += 8 ) {
+		const __m128i in = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) );
+		_mm_storeu_ps( dst + i, _mm_cvtepi32_ps( _mm_unpacklo_epi16( in, zero ) ) );
+		_mm_storeu_ps( dst + i + 4, _mm_cvtepi32_ps( _mm_unpackhi_epi16( in, zero ) ) );
+	}
+
+	for( ; i < len; i++ )
+		dst[i] = src[i];
+}
+#endif //__SSE2__
+
+/**
+ * Copy the tiles of a mosaic into the slices of a volume, converting the voxels to DST.
+ * The mosaic is walked through linearly, and every row of a tile is contiguous in the source and in the destination,
+ * so it is copied (and converted) as a whole.
+ * A mosaic of one tile is just copied, which is used to convert images which are no mosaic.
+ * \param src the mosaic image
+ * \param dst the volume (width x height x images)
+ * \param width,height the size of a tile
+ * \param matrixSize the number of tiles in a row of the mosaic (the mosaic must be exactly matrixSize*width wide)
+ * \param images the number of tiles
+ */
+template<typename SRC, typename DST> void mosaicBlit( const SRC *src, DST *dst, size_t width, size_t height, size_t matrixSize, size_t images )
+{
+	const size_t slice = width * height;
 
+	for( size_t tile_row = 0; tile_row * matrixSize < images; tile_row++ ) {
+		const size_t tiles = std::min( matrixSize, images - tile_row * matrixSize ); // the last row of tiles may be incomplete
+		DST *const dslice = dst + tile_row * matrixSize * slice;
 
+		for( size_t line = 0; line < height; line++, src += matrixSize * width ) {
+			for( size_t tile = 0; tile < tiles; tile++ )
+				copyRow( src + tile * width, dslice + tile * slice + line * width, width );
+		}
+	}
+}
+
+/// make a ValueArray using the given buffer (it shares the reference count of the buffer, so the buffer is not reused while the array lives)
+template<typename T> data::ValueArrayReference shareBuffer( const boost::shared_ptr<uint8_t> &buffer, size_t length )
+{
+	return data::ValueArray<T>( boost::shared_ptr<T>( buffer, reinterpret_cast<T *>( buffer.get() ) ), length );
+}
+
+bool startsWith( const uint8_t *data, size_t length, const std::string &tag )
+{
+	return length >= tag.length() && memcmp( data, tag.data(), tag.length() ) == 0;
+}
+}
+
+/**
+ * Receives images sent by the Siemens real time export of the scanner as UDP datagrams.
+ * Every image starts with a datagram containing the \<data_block_header\> followed by the first bytes of the data, the
+ * rest of the data follows in datagrams of up to packet_size bytes. "\<series_finished\>" ends the series.
+ *
+ * The data is received directly into a ring of buffers which are reused for the following images, and the chunks are
+ * created on these buffers. A buffer is only reused when no chunk uses it anymore. Mosaics are unpacked into another
+ * buffer of the ring.
+ *
+ * The stem of the filename selects the UDP port if it is a number (e.g. "54322.tcpip"), otherwise default_port is used.
+ * The images are converted to float unless the dialect "native" is used (mosaics while they are unpacked, in one pass).
+ */
 class ImageFormat_SiemensTcpIp: public FileFormat
 {
+	static const uint16_t default_port = 54321;
+	static const size_t packet_size = 32768;
+	static const size_t ring_size = 8;
+	static const int receive_buffer_size = 8 << 20;
+
+	struct RingSlot {
+		boost::shared_ptr<uint8_t> data;
+		size_t size;
+		RingSlot(): size( 0 ) {}
+	};
+
+	int m_socket;
+	uint16_t m_port;
+	size_t m_image_counter;
+	std::vector<RingSlot> m_ring;
+	size_t m_next;
+	uint8_t m_packet[packet_size];
 
 protected:
 	util::istring suffixes( isis::image_io::FileFormat::io_modes iomode )const {
@@ -37,281 +138,359 @@ protected:
 		}
 	}
 public:
+	ImageFormat_SiemensTcpIp(): m_socket( -1 ), m_port( 0 ), m_image_counter( 0 ), m_ring( ring_size ), m_next( 0 ) {}
+
 	std::string getName()const {
 		return "SiemensTcpIp";
 	}
+	util::istring dialects( const std::string &/*filename*/ )const {return "native";}
 
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & ) {
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & ) {
+		static const std::string header_start = "<data_block_header>";
+		static const std::string header_end =  "</data_block_header>";
+		static const std::string session_terminus = "<series_finished>";
 
+		const uint16_t port = portFromFilename( filename );
 
-		printf( "IMAGE: %d\n", image_counter );
+		if( m_socket < 0 || m_port != port )
+			openSocket( port );
+
+		LOG( Runtime, verbose_info ) << "Waiting for image " << m_image_counter << " on UDP port " << m_port;
 
-		firstHeaderArrived = false;
-		unsigned long data_received = 0L;
-		std::string header_start = "<data_block_header>";
-		std::string header_end =  "</data_block_header>";
-		std::string session_terminus = "<series_finished>";
-		unsigned int byteSize = 0;
-		char *dataBuffer;
 		std::string header;
+		boost::shared_ptr<uint8_t> volume;
+		size_t byteSize = 0, received = 0, packets = 0;
 
 		for( ;; ) {
-			memset( buffer, 0, sizeof( buffer ) );
-			unsigned int length = recvfrom( sock, buffer, sizeof( buffer ), 0, ( struct sockaddr * )&receiver_address, &receiver_address_length );
+			// data is received directly behind the data already received, everything else goes into m_packet
+			uint8_t *const target = volume ? volume.get() + received : m_packet;
+			const ssize_t length = recv( m_socket, target, packet_size, 0 );
+
+			if( length < 0 ) {
+				if( errno == EINTR )
+					continue;
 
-			if( length == 0 ) {
-				exit( 0 );
+				throwSystemError( errno, "Failed to receive from UDP port " + boost::lexical_cast<std::string>( m_port ) );
 			}
 
-			if ( memcmp( buffer, session_terminus.c_str(), session_terminus.size() - 1 ) == 0 ) {
+			if( length == 0 || _internal::startsWith( target, length, session_terminus ) ) {
+				LOG_IF( volume, Runtime, warning ) << "Series finished before image " << m_image_counter << " was complete";
+				LOG( Runtime, info ) << "Series finished after " << m_image_counter << " images";
 				return 0;
 			}
 
+			if( _internal::startsWith( target, length, header_start ) ) {
+				LOG_IF( volume, Runtime, warning )
+						<< "Dropping incomplete image " << m_image_counter << " (got " << received << " of " << byteSize << " bytes)";
 
-			if( memcmp( buffer, header_start.c_str(), header_start.size() ) == 0 ) {
-				firstHeaderArrived = true;
-				data_received = 0L;
-				unsigned int header_length = 0;
-
-				while( memcmp( header_end.c_str(), ( buffer + header_length ), header_end.size() ) != 0 ) {
-					header_length++;
-				}
-
-				header_length += header_end.size();
-				header = std::string( buffer, header_length );
-				byteSize = atoi( getStringFromHeader( "data_size_in_bytes", header ).c_str() );
+				if( target != m_packet )
+					memcpy( m_packet, target, length );
 
-				dataBuffer = ( char * )malloc( byteSize );
-				memset( dataBuffer, 0, byteSize );
-
-				// copy the first bit of data
-				memcpy( dataBuffer, ( buffer + header_length ), sizeof( buffer ) - header_length );
+				const uint8_t *const end = m_packet + length;
+				const uint8_t *data = std::search<const uint8_t *>( m_packet, end, header_end.begin(), header_end.end() );
+				volume.reset();
 
-				data_received += sizeof( buffer ) - header_length;
-
-
-			} else if ( true == firstHeaderArrived ) {
-
-				if( byteSize - data_received >= 32768 ) {
-					memcpy( dataBuffer + data_received, buffer, sizeof( buffer ) );
-					data_received += sizeof( buffer );
-
-					printf( "dataRec: '%ld'\n", data_received );
-					printf( "   imageNR: %d \n", image_counter );
-				} else {
-					// image complete
-
-					// ... read out header for the data ...
-					/******************************/
-
-					size_t width = atoi( getStringFromHeader( "width", header ).c_str() );
-					bool moco = getStringFromHeader( "motion_corrected", header ).compare( "yes" ) == 0 ? true : false;
-					size_t height = atoi( getStringFromHeader( "height", header ).c_str() );
-					bool mosaic = getStringFromHeader( "mosaic", header ).compare( "yes" ) == 0 ? true : false;
-
-					// Mosaics have to be handled special
-					size_t iim = 1; //number of images in mosaic
-					size_t slices_in_row = 1;
-					size_t width_slice = width;
-					size_t height_slice = height;
-
-					if ( true == mosaic ) {
-						iim = atoi( getStringFromHeader( "images_in_mosaic", header ).c_str() );
-						slices_in_row = static_cast<size_t> ( ceil( sqrt( static_cast<double_t> ( iim ) ) ) );
-						// Mosaics are always quadratic, so don't bother 'bout only looking for the rows
-						width_slice = width / slices_in_row;
-						height_slice = height / slices_in_row;
-					}
-
-					std::string data_type = getStringFromHeader( "data_type", header );
-
-					size_t acq_nr = atoi( getStringFromHeader( "acquisition_number", header ).c_str() );
-					std::string seq_descr = getStringFromHeader( "sequence_description", header );
-					std::string subject_name = getStringFromHeader( "patient_name", header );
-					size_t subject_gender = atoi( getStringFromHeader( "patient_sex", header ).c_str() );
-					uint16_t seq_number = atol( getStringFromHeader( "meas_uid", header ).c_str() );
-					size_t acq_time = atoi( getStringFromHeader( "acquisition_time", header ).c_str() );
-					uint16_t rep_time = atol( getStringFromHeader( "repetition_time", header ).c_str() );
-					util::fvector3 read_vec = getVectorFromString( getStringFromHeader( "read_vector", header ) );
-					util::fvector3 phase_vec = getVectorFromString( getStringFromHeader( "phase_vector", header ) );
-					util::fvector3 slice_norm_vec = getVectorFromString( getStringFromHeader( "slice_norm_vector", header ) );
-					int16_t inplane_rot = atoi( getStringFromHeader( "inplane_rotation", header ).c_str() );
-					std::string slice_orient = getStringFromHeader( "slice_orientation", header );
-
-					//Fallunterscheidung
-					// Wenn ((slice_orient == TRANSVERSE) gilt: (-45 < inplane_rot < 45)) ? -> COL : ROW -> columnVec == col + rowVec == row
-					// Wenn ((slice_orient != TRANSVERSE) gilt: (-45 < inplane_rot < 45)) ? -> ROW : COL -> columnVec == row + rowVec == col
-					std::string InPlanePhaseEncodingDirection;
-
-					if ( 0 == slice_orient.compare( 0, slice_orient.length(), "TRANSVERSE" ) ) {
-						InPlanePhaseEncodingDirection = ( -45 < inplane_rot && inplane_rot < 45 ) ? "COL" : "ROW";
-					} else {
-						InPlanePhaseEncodingDirection = ( -45 < inplane_rot && inplane_rot < 45 ) ? "ROW" : "COL";
-					}
-
-					size_t fov_read = atoi( getStringFromHeader( "fov_read", header ).c_str() );
-					size_t fov_phase = atoi( getStringFromHeader( "fov_phase", header ).c_str() );
-					float slice_thickness = atof( getStringFromHeader( "slice_thickness", header ).c_str() );
-					size_t dimension_number = atoi( getStringFromHeader( "dimension_number", header ).c_str() );
-					// get voxelGap out of the distance (in percent!) between slices
-					size_t distFactor = atoi( getStringFromHeader( "distance_factor", header ).c_str() );
-					util::fvector3 voxelGap( 0, 0, slice_thickness * ( static_cast<float>( distFactor ) / 100.0 ) );
-
-					// ... copy the data ...
-					/******************************/
-
-					image_counter++;
-
-					memcpy( dataBuffer + data_received, buffer, byteSize - data_received );
-					data_received += byteSize - data_received;
-
-
-					// ... create a chunk from data ...
-					/******************************/
-
-					//divide for the data types
-					unsigned short tID = 0;
-					unsigned short tSize = 0;
-
-					if ( 0 == data_type.compare( "byte" ) ) {
-						tID = data::ValueArray<uint8_t>::staticID;
-						tSize = sizeof( uint8_t );
-
-					} else if ( 0 == data_type.compare( "short" ) ) {
-						tID = data::ValueArray<uint16_t>::staticID;
-						tSize = sizeof( uint16_t );
-
-					} else if ( 0 == data_type.compare( "long" ) ) {
-						tID = data::ValueArray<uint32_t>::staticID;
-						tSize = sizeof( uint32_t );
-
-					} else if ( 0 == data_type.compare( "float" ) ) {
-						tID = data::ValueArray<float>::staticID;
-						tSize = sizeof( float );
-					} else {
-						LOG( isis::image_io::Runtime, isis::error ) << "Retrieving data over TCP/IP with an unknown datatype: " << tID;
-						//TODO :REMOVE this
-						printf( "DATATYPE NOT SUPPORTED\n" );
-						free( dataBuffer );
-
-						return 0;
-					}
-
-					size_t size_to_alloc = iim * width_slice * height_slice;
-					isis::data::ValueArrayReference valPtrBuffer = isis::data::ValueArrayBase::createByID( tID, size_to_alloc );
-
-					for( unsigned int _slice = 0; _slice < iim; _slice++ ) {
-						for( unsigned int _row = 0; _row < height_slice; _row++ ) {
-							char *line_start = dataBuffer + ( tSize * ( ( ( _slice / slices_in_row ) * ( slices_in_row * height_slice * width_slice ) ) +
-															  ( _row * width_slice * slices_in_row ) + ( _slice % slices_in_row * width_slice ) ) );
-
-							memcpy( valPtrBuffer->getRawAddress( ( _slice * width_slice * height_slice + _row * width_slice ) * tSize ).get(), line_start, ( width_slice * tSize ) );
-						}
-					}
-
-					/********
-					 * get each slice position from header
-					 */
-					std::string slice_pos = "slice_position_0";
-					util::fvector3 slice_pos_vec = getVectorFromString( getStringFromHeader( slice_pos, header ) ); //(val1, val2, val3);
-					//*********
-
-					// now, create a real chunk in memory and convert it to float data
-					data::Chunk myChunk( valPtrBuffer, width_slice, height_slice, iim );
-					myChunk.convertToType( isis::data::ValueArray<float>::staticID );
-
-					// set all the general properties - i.e. feed the generated chunk with metadata
-
-					myChunk.setPropertyAs( "indexOrigin", slice_pos_vec );
-					myChunk.setPropertyAs<uint32_t>( "acquisitionNumber", ( acq_nr ) );
-					myChunk.setPropertyAs<std::string>( "subjectName", subject_name );
-					isis::util::Selection isisGender( "male,female,other" );
-
-					if ( 1 == subject_gender ) {
-						isisGender.set( "male" );
-					} else if ( 2 == subject_gender ) {
-						isisGender.set( "female" );
-					} else {
-						isisGender.set( "other" );
-					}
-
-					myChunk.setPropertyAs<isis::util::Selection>( "subjectGender", isisGender );
-
-					//myChunk.setPropertyAs<>("acquisitionTime", acquisition_time);
-					if ( ( true == moco ) && ( true == mosaic ) ) {
-						myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number + 10000 ); // This is to make the sequenceNumber unique - so it's a nasty assumption there won't be more than 10000 scans in one session
-						myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "MOCO\\WAS_MOSAIC" );
-					} else if ( true == mosaic ) {
-						myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number );
-						myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "WAS_MOSAIC" );
-					} else {
-						myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number );
-						myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "" );
-					}
-
-					seq_descr.append( "_rtMPISiemensExport" );
-					myChunk.setPropertyAs<std::string>( "sequenceDescription", seq_descr );
-
-					if ( 0 == InPlanePhaseEncodingDirection.compare( 0, 3, "COL" ) ) {
-						myChunk.setPropertyAs<util::fvector3>( "rowVec", phase_vec );
-						myChunk.setPropertyAs<util::fvector3>( "columnVec", read_vec );
-						myChunk.setPropertyAs<util::fvector3>( "voxelSize", util::fvector3( fov_read / width_slice, fov_phase / height_slice, slice_thickness ) );
-					} else {
-						myChunk.setPropertyAs<util::fvector3>( "columnVec", phase_vec );
-						myChunk.setPropertyAs<util::fvector3>( "rowVec", read_vec );
-						myChunk.setPropertyAs<util::fvector3>( "voxelSize", util::fvector3( fov_phase / width_slice, fov_read / height_slice, slice_thickness ) );
-					}
-
-
-					myChunk.setPropertyAs<util::fvector3>( "sliceVec", slice_norm_vec );
-					myChunk.setPropertyAs<uint16_t>( "repetitionTime", rep_time );
-					myChunk.setPropertyAs<std::string>( "InPlanePhaseEncodingDirection", InPlanePhaseEncodingDirection );
-					myChunk.setPropertyAs<util::fvector3>( "voxelGap", util::fvector3() );
-					std::string sn = boost::posix_time::to_simple_string( boost::posix_time::microsec_clock::local_time() );
-					myChunk.setPropertyAs<std::string>( "source", sn );
-					chunks.push_back( myChunk );
-
-
-					/******************************/
-					free( dataBuffer );
-					/*****************************/
-
-
-					return chunks.size();
+				if( data == end ) {
+					LOG( Runtime, warning ) << "Ignoring a data block header without " << header_end;
+					continue;
 				}
 
+				data += header_end.length();
+				header.assign( reinterpret_cast<const char *>( m_packet ), reinterpret_cast<const char *>( data ) );
+				byteSize = atol( getStringFromHeader( "data_size_in_bytes", header ).c_str() );
+				volume = acquireBuffer( byteSize + packet_size ); // so the last datagram always fits in
+				received = std::min<size_t>( end - data, byteSize );
+				packets = 1;
+				memcpy( volume.get(), data, received );
+			} else if( volume ) {
+				received += length;
+				packets++;
+			} else {
+				continue; // data of an image whose header we missed
 			}
 
-
+			if( received >= byteSize ) {
+				LOG( Runtime, verbose_info ) << "Received image " << m_image_counter << " (" << byteSize << " bytes in " << packets << " datagrams)";
+				m_image_counter++;
+				chunks.push_back( makeChunk( header, volume, byteSize, dialect ) );
+				return 1;
+			}
 		}
 
 		return 0;
 	}
 
-	void write( const data::Image &image, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & ) {
+	void write( const data::Image &/*image*/, const std::string &/*filename*/, const util::istring &/*dialect*/, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & ) {
 		throwGenericError( "Writing TCP/IP is not supportet" );
 	}
 	bool tainted()const {return false;}//internal plugins are not tainted
 
 	~ImageFormat_SiemensTcpIp() {
+		closeSocket();
 	}
 
+private:
+	uint16_t portFromFilename( const std::string &filename )const {
+		try {
+			return boost::lexical_cast<uint16_t>( boost::filesystem::path( filename ).stem().string() );
+		} catch( const boost::bad_lexical_cast & ) {
+			return default_port;
+		}
+	}
+	void openSocket( uint16_t port ) {
+		closeSocket();
+		m_socket = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+		if( m_socket < 0 )
+			throwSystemError( errno, "Failed to create an UDP socket" );
+
+		// let the kernel queue a whole image while the last one is processed
+		const int buffer_size = receive_buffer_size;
+		LOG_IF( setsockopt( m_socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof( buffer_size ) ) != 0, Runtime, warning )
+				<< "Failed to set the receive buffer of the socket to " << buffer_size << " bytes (" << strerror( errno ) << ")";
+
+		struct sockaddr_in address;
+		memset( &address, 0, sizeof( address ) );
+		address.sin_family      = AF_INET;
+		address.sin_addr.s_addr = INADDR_ANY;
+		address.sin_port        = htons( port );
+
+		if( bind( m_socket, ( struct sockaddr * )&address, sizeof( address ) ) != 0 ) {
+			const int err = errno;
+			closeSocket();
+			throwSystemError( err, "Failed to bind to UDP port " + boost::lexical_cast<std::string>( port ) );
+		}
 
+		m_port = port;
+		LOG( Runtime, info ) << "Listening on UDP port " << m_port;
+	}
+	void closeSocket() {
+		if( m_socket >= 0 )
+			close( m_socket );
 
-public:
-	static int    sock;
-	static struct sockaddr_in receiver_address;
-	static int counter;
-	static int image_counter;
+		m_socket = -1;
+	}
 
-	static unsigned int receiver_address_length;
-	static bool firstHeaderArrived;
+	/// get a buffer of at least size bytes from the ring (a new one is only allocated if none of the ring is free and big enough)
+	boost::shared_ptr<uint8_t> acquireBuffer( size_t size ) {
+		size_t replace = m_next;
+		bool found_free = false;
+
+		for( size_t i = 0; i < m_ring.size(); i++ ) {
+			const size_t index = ( m_next + i ) % m_ring.size();
+			const RingSlot &slot = m_ring[index];
+
+			if( !slot.data || slot.data.unique() ) { // no chunk uses the buffer anymore
+				if( slot.size >= size ) {
+					m_next = ( index + 1 ) % m_ring.size();
+					return slot.data;
+				} else if( !found_free ) {
+					replace = index;
+					found_free = true;
+				}
+			}
+		}
 
-private:
-	time_t startTime;
-	time_t endTime;
+		// if all buffers are used the next one is replaced, its chunks keep the old buffer alive
+		RingSlot &slot = m_ring[replace];
+		m_next = ( replace + 1 ) % m_ring.size();
+		slot.data.reset( static_cast<uint8_t *>( malloc( size ) ), free );
+		slot.size = size;
 
-	std::string getStringFromHeader( const std::string &propName, const std::string &header ) {
+		if( !slot.data ) {
+			slot.size = 0;
+			throwSystemError( ENOMEM, "Failed to allocate a receive buffer of " + boost::lexical_cast<std::string>( size ) + " bytes" );
+		}
+
+		LOG( Debug, verbose_info ) << "Allocated a receive buffer of " << size << " bytes in slot " << replace << ( found_free ? "" : " (all buffers are in use)" );
+		return slot.data;
+	}
+
+	/**
+	 * Make the voxels of a chunk from the received data of the type SRC.
+	 * Mosaics are unpacked into another buffer of the ring, converting them to float unless native is set.
+	 * Images which are no mosaic (a mosaic of one tile) are used as they are if native is set, and converted into another buffer otherwise.
+	 */
+	template<typename SRC> data::ValueArrayReference makeVoxels( const boost::shared_ptr<uint8_t> &volume, size_t width, size_t height, size_t matrixSize, size_t images, bool mosaic, bool native ) {
+		const size_t voxels = width * height * images;
+
+		if( native && !mosaic )
+			return _internal::shareBuffer<SRC>( volume, voxels );
+
+		// the receive buffer can be reused by the next image once this is done
+		const boost::shared_ptr<uint8_t> buffer = acquireBuffer( voxels * ( native ? sizeof( SRC ) : sizeof( float ) ) );
+
+		if( native ) {
+			_internal::mosaicBlit( reinterpret_cast<const SRC *>( volume.get() ), reinterpret_cast<SRC *>( buffer.get() ), width, height, matrixSize, images );
+			return _internal::shareBuffer<SRC>( buffer, voxels );
+		} else {
+			_internal::mosaicBlit( reinterpret_cast<const SRC *>( volume.get() ), reinterpret_cast<float *>( buffer.get() ), width, height, matrixSize, images );
+			return _internal::shareBuffer<float>( buffer, voxels );
+		}
+	}
+
+	data::Chunk makeChunk( const std::string &header, boost::shared_ptr<uint8_t> volume, size_t byteSize, const util::istring &dialect ) {
+		// ... read out header for the data ...
+		/******************************/
+
+		size_t width = atoi( getStringFromHeader( "width", header ).c_str() );
+		bool moco = getStringFromHeader( "motion_corrected", header ).compare( "yes" ) == 0 ? true : false;
+		size_t height = atoi( getStringFromHeader( "height", header ).c_str() );
+		bool mosaic = getStringFromHeader( "mosaic", header ).compare( "yes" ) == 0 ? true : false;
+
+		// Mosaics have to be handled special
+		size_t iim = 1; //number of images in mosaic
+		size_t slices_in_row = 1;
+		size_t width_slice = width;
+		size_t height_slice = height;
+
+		if ( true == mosaic ) {
+			iim = atoi( getStringFromHeader( "images_in_mosaic", header ).c_str() );
+			slices_in_row = static_cast<size_t> ( ceil( sqrt( static_cast<double_t> ( iim ) ) ) );
+			// Mosaics are always quadratic, so don't bother 'bout only looking for the rows
+			width_slice = width / slices_in_row;
+			height_slice = height / slices_in_row;
+		}
+
+		std::string data_type = getStringFromHeader( "data_type", header );
+
+		size_t acq_nr = atoi( getStringFromHeader( "acquisition_number", header ).c_str() );
+		std::string seq_descr = getStringFromHeader( "sequence_description", header );
+		std::string subject_name = getStringFromHeader( "patient_name", header );
+		size_t subject_gender = atoi( getStringFromHeader( "patient_sex", header ).c_str() );
+		uint16_t seq_number = atol( getStringFromHeader( "meas_uid", header ).c_str() );
+		uint16_t rep_time = atol( getStringFromHeader( "repetition_time", header ).c_str() );
+		util::fvector3 read_vec = getVectorFromString( getStringFromHeader( "read_vector", header ) );
+		util::fvector3 phase_vec = getVectorFromString( getStringFromHeader( "phase_vector", header ) );
+		util::fvector3 slice_norm_vec = getVectorFromString( getStringFromHeader( "slice_norm_vector", header ) );
+		int16_t inplane_rot = atoi( getStringFromHeader( "inplane_rotation", header ).c_str() );
+		std::string slice_orient = getStringFromHeader( "slice_orientation", header );
+
+		//Fallunterscheidung
+		// Wenn ((slice_orient == TRANSVERSE) gilt: (-45 < inplane_rot < 45)) ? -> COL : ROW -> columnVec == col + rowVec == row
+		// Wenn ((slice_orient != TRANSVERSE) gilt: (-45 < inplane_rot < 45)) ? -> ROW : COL -> columnVec == row + rowVec == col
+		std::string InPlanePhaseEncodingDirection;
+
+		if ( 0 == slice_orient.compare( 0, slice_orient.length(), "TRANSVERSE" ) ) {
+			InPlanePhaseEncodingDirection = ( -45 < inplane_rot && inplane_rot < 45 ) ? "COL" : "ROW";
+		} else {
+			InPlanePhaseEncodingDirection = ( -45 < inplane_rot && inplane_rot < 45 ) ? "ROW" : "COL";
+		}
+
+		size_t fov_read = atoi( getStringFromHeader( "fov_read", header ).c_str() );
+		size_t fov_phase = atoi( getStringFromHeader( "fov_phase", header ).c_str() );
+		float slice_thickness = atof( getStringFromHeader( "slice_thickness", header ).c_str() );
+
+		// ... create a chunk from data ...
+		/******************************/
+
+		//divide for the data types
+		unsigned short tSize = 0;
+
+		if ( 0 == data_type.compare( "byte" ) ) {
+			tSize = sizeof( uint8_t );
+		} else if ( 0 == data_type.compare( "short" ) ) {
+			tSize = sizeof( uint16_t );
+		} else if ( 0 == data_type.compare( "long" ) ) {
+			tSize = sizeof( uint32_t );
+		} else if ( 0 == data_type.compare( "float" ) ) {
+			tSize = sizeof( float );
+		} else {
+			throwGenericError( "Retrieving data over TCP/IP with an unknown datatype: \"" + data_type + "\"" );
+		}
+
+		const size_t voxels = iim * width_slice * height_slice;
+
+		if( voxels == 0 || width * height * tSize > byteSize )
+			throwGenericError( "The header describes an image of " + boost::lexical_cast<std::string>( width ) + "x" + boost::lexical_cast<std::string>( height ) +
+							   " " + data_type + " voxels, but only " + boost::lexical_cast<std::string>( byteSize ) + " bytes were sent" );
+
+		if( mosaic && ( width != width_slice * slices_in_row || height != height_slice * slices_in_row ) )
+			throwGenericError( "A mosaic of " + boost::lexical_cast<std::string>( iim ) + " images must be a multiple of " +
+							   boost::lexical_cast<std::string>( slices_in_row ) + " in width and height, but it is " +
+							   boost::lexical_cast<std::string>( width ) + "x" + boost::lexical_cast<std::string>( height ) );
+
+		// unpack the mosaic and convert to float (unless the native type is requested) in one pass
+		data::ValueArrayReference valPtrBuffer;
+		const bool native = dialect == "native";
+
+		switch( tSize ) {
+		case sizeof( uint8_t ):
+			valPtrBuffer = makeVoxels<uint8_t>( volume, width_slice, height_slice, slices_in_row, iim, mosaic, native );
+			break;
+		case sizeof( uint16_t ):
+			valPtrBuffer = makeVoxels<uint16_t>( volume, width_slice, height_slice, slices_in_row, iim, mosaic, native );
+			break;
+		default:
+			valPtrBuffer = data_type == "float" ?
+						   makeVoxels<float>( volume, width_slice, height_slice, slices_in_row, iim, mosaic, native ) :
+						   makeVoxels<uint32_t>( volume, width_slice, height_slice, slices_in_row, iim, mosaic, native );
+			break;
+		}
+
+		/********
+		 * get each slice position from header
+		 */
+		std::string slice_pos = "slice_position_0";
+		util::fvector3 slice_pos_vec = getVectorFromString( getStringFromHeader( slice_pos, header ) ); //(val1, val2, val3);
+		//*********
+
+		// now, create a real chunk on the received data
+		data::Chunk myChunk( valPtrBuffer, width_slice, height_slice, iim );
+
+		// set all the general properties - i.e. feed the generated chunk with metadata
+
+		myChunk.setPropertyAs( "indexOrigin", slice_pos_vec );
+		myChunk.setPropertyAs<uint32_t>( "acquisitionNumber", ( acq_nr ) );
+		myChunk.setPropertyAs<std::string>( "subjectName", subject_name );
+		isis::util::Selection isisGender( "male,female,other" );
+
+		if ( 1 == subject_gender ) {
+			isisGender.set( "male" );
+		} else if ( 2 == subject_gender ) {
+			isisGender.set( "female" );
+		} else {
+			isisGender.set( "other" );
+		}
+
+		myChunk.setPropertyAs<isis::util::Selection>( "subjectGender", isisGender );
+
+		//myChunk.setPropertyAs<>("acquisitionTime", acquisition_time);
+		if ( ( true == moco ) && ( true == mosaic ) ) {
+			myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number + 10000 ); // This is to make the sequenceNumber unique - so it's a nasty assumption there won't be more than 10000 scans in one session
+			myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "MOCO\\WAS_MOSAIC" );
+		} else if ( true == mosaic ) {
+			myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number );
+			myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "WAS_MOSAIC" );
+		} else {
+			myChunk.setPropertyAs<uint16_t>( "sequenceNumber", seq_number );
+			myChunk.setPropertyAs<std::string>( "DICOM/ImageType", "" );
+		}
+
+		seq_descr.append( "_rtMPISiemensExport" );
+		myChunk.setPropertyAs<std::string>( "sequenceDescription", seq_descr );
+
+		if ( 0 == InPlanePhaseEncodingDirection.compare( 0, 3, "COL" ) ) {
+			myChunk.setPropertyAs<util::fvector3>( "rowVec", phase_vec );
+			myChunk.setPropertyAs<util::fvector3>( "columnVec", read_vec );
+			myChunk.setPropertyAs<util::fvector3>( "voxelSize", util::fvector3( fov_read / width_slice, fov_phase / height_slice, slice_thickness ) );
+		} else {
+			myChunk.setPropertyAs<util::fvector3>( "columnVec", phase_vec );
+			myChunk.setPropertyAs<util::fvector3>( "rowVec", read_vec );
+			myChunk.setPropertyAs<util::fvector3>( "voxelSize", util::fvector3( fov_phase / width_slice, fov_read / height_slice, slice_thickness ) );
+		}
+
+
+		myChunk.setPropertyAs<util::fvector3>( "sliceVec", slice_norm_vec );
+		myChunk.setPropertyAs<uint16_t>( "repetitionTime", rep_time );
+		myChunk.setPropertyAs<std::string>( "InPlanePhaseEncodingDirection", InPlanePhaseEncodingDirection );
+		myChunk.setPropertyAs<util::fvector3>( "voxelGap", util::fvector3() );
+		std::string sn = boost::posix_time::to_simple_string( boost::posix_time::microsec_clock::local_time() );
+		myChunk.setPropertyAs<std::string>( "source", sn );
+		return myChunk;
+	}
+
+	std::string getStringFromHeader( const std::string &propName, const std::string &header )const {
 
 		std::string prop_start = "<";
 		prop_start.append( propName );
@@ -329,7 +508,7 @@ private:
 		return propString;
 	}
 
-	util::fvector3 getVectorFromString( std::string propName ) {
+	util::fvector3 getVectorFromString( std::string propName )const {
 		size_t indexK1 = propName.find( ",", 0, 1 );
 		size_t indexK2 = propName.find( ",", indexK1 + 1, 1 );
 		double_t val1 = atof( propName.substr( 0, indexK1 ).c_str() );
@@ -337,40 +516,18 @@ private:
 		double_t val3 = atof( propName.substr( indexK2 + 1, propName.length() - indexK2 ).c_str() );
 		return util::fvector3( val1, val2, val3 );
 	}
-	char   buffer[32768];
 };
 
-int    ImageFormat_SiemensTcpIp::sock;
-struct sockaddr_in ImageFormat_SiemensTcpIp::receiver_address;
-int ImageFormat_SiemensTcpIp::counter;
-int ImageFormat_SiemensTcpIp::image_counter;
-
-unsigned int ImageFormat_SiemensTcpIp::receiver_address_length;
-bool ImageFormat_SiemensTcpIp::firstHeaderArrived;
-
 }
 }
 isis::image_io::FileFormat *factory()
 {
+	// the socket is opened by the first load, so just loading the plugin does not occupy the port
 	isis::image_io::ImageFormat_SiemensTcpIp *pluginRtExport = new isis::image_io::ImageFormat_SiemensTcpIp();
 
-	pluginRtExport->sock = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
-	printf( "[receiver2] sock --> %i\n", pluginRtExport->sock );
-
-	memset( ( void * )&pluginRtExport->receiver_address, 0, sizeof( pluginRtExport->receiver_address ) );
-	pluginRtExport->receiver_address.sin_family      = PF_INET;
-	pluginRtExport->receiver_address.sin_addr.s_addr = INADDR_ANY;
-	pluginRtExport->receiver_address.sin_port        = htons( 54321 );
-
-	printf( "[bind] --> %i\n", bind( pluginRtExport->sock, ( struct sockaddr * )&pluginRtExport->receiver_address, sizeof( pluginRtExport->receiver_address ) ) );
-	pluginRtExport->receiver_address_length = sizeof( pluginRtExport->receiver_address );
-	pluginRtExport->counter = 0;
-	pluginRtExport->image_counter = 0;
-
 	//Just a workaround to generate all the converters
 	isis::data::MemChunk<int32_t> test( 2, 3, 4 );
 	test.convertToType( isis::data::ValueArray<float>::staticID );
-	printf( "end of plugin load\n" );
 	return ( isis::image_io::FileFormat * ) pluginRtExport;
 }
 
@@ -49,6 +49,10 @@ protected:
 public:
 	std::string getName()const { return std::string( "Vista" );}
 	bool tainted()const {return false;}//internal plugins are not tainted
+	/// vista files start with the line "V-data 2 {"
+	bool checkMagic( const data::ValueArray<uint8_t> &head )const {
+		return head.getLength() >= 6 && memcmp( &head[0], "V-data", 6 ) == 0;
+	}
 
 	/**
 	 * This plugin supports the following dialects:
@@ -13,15 +13,35 @@
 #include <boost/iostreams/filter/bzip2.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/lexical_cast.hpp>
+#include <memory>
+#include <cstdlib>
 
 #include <boost/filesystem/fstream.hpp>
 #include "DataStorage/fileptr.hpp"
 #include <boost/iostreams/categories.hpp>  // tags
+#include <zlib.h>
+
+#include "imageFormat_compressed_gzindex.hpp"
+#include <boost/bind.hpp>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif //_OPENMP
 
 #ifdef HAVE_LZMA
 #include "imageFormat_compressed_lzma.hpp"
 #endif //HAVE_LZMA
 
+#ifdef HAVE_ZSTD
+#include "imageFormat_compressed_zstd.hpp"
+#endif //HAVE_ZSTD
+
+#ifdef HAVE_LZ4
+#include "imageFormat_compressed_lz4.hpp"
+#include <lz4hc.h>
+#endif //HAVE_LZ4
+
 namespace isis
 {
 namespace image_io
@@ -59,12 +79,270 @@ public:
 		return boost::iostreams::write( dest, s, n );
 	}
 };
+
+/// \returns the amount of omp threads to use if threads are requested (0 means as many as omp offers)
+inline int workers( int threads )
+{
+#ifdef _OPENMP
+	return threads > 0 ? threads : omp_get_max_threads();
+#else
+	return 1;
+#endif //_OPENMP
+}
+
+/**
+ * Parallel gzip compressor (like pigz).
+ * The input is split into blocks which are deflated independently on all available (omp) threads.
+ * Each block is primed with the last 32k of its predecessor to keep the compression ratio.
+ * The blocks are concatenated into one standard gzip member, so the result can be red by any gzip implementation.
+ * The result does not depend on the amount of threads.
+ * Without omp the blocks are compressed one after another.
+ */
+class parallel_gzip
+{
+	static const size_t blocksize = 0x20000; // 128k
+	static const size_t dictsize = 0x8000; // 32k - the size of the deflate window
+	int m_level, m_threads;
+	static bool deflateBlock( const uint8_t *data, size_t len, const uint8_t *dict, size_t dictlen, bool last, int level, std::string &out ) {
+		z_stream strm;
+		memset( &strm, 0, sizeof( strm ) );
+
+		if( deflateInit2( &strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) // raw deflate - we write the gzip header ourself
+			return false;
+
+		if( dictlen && deflateSetDictionary( &strm, dict, dictlen ) != Z_OK ) {
+			deflateEnd( &strm );
+			return false;
+		}
+
+		out.resize( deflateBound( &strm, len ) + 16 ); // a bit more for the sync-flush marker
+		strm.next_in = const_cast<Bytef *>( data );
+		strm.avail_in = len;
+		strm.next_out = reinterpret_cast<Bytef *>( &out[0] );
+		strm.avail_out = out.size();
+
+		// all but the last block end with a sync-flush, so they end on a byte boundary and can just be concatenated
+		const int ret = deflate( &strm, last ? Z_FINISH : Z_SYNC_FLUSH );
+		const bool ok = last ? ret == Z_STREAM_END : ( ret == Z_OK && strm.avail_in == 0 && strm.avail_out > 0 );
+		out.resize( strm.total_out );
+		deflateEnd( &strm );
+		return ok;
+	}
+	static void writeLE32( std::ostream &out, uint32_t val ) {
+		const char buff[4] = {( char )( val & 0xFF ), ( char )( ( val >> 8 ) & 0xFF ), ( char )( ( val >> 16 ) & 0xFF ), ( char )( ( val >> 24 ) & 0xFF )};
+		out.write( buff, 4 );
+	}
+	static void writeHeader( std::ostream &out ) {
+		static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3}; // deflate, no flags, no mtime, unix
+		out.write( header, sizeof( header ) );
+	}
+	/**
+	 * Deflate data block by block and update the crc.
+	 * The first block is primed with dict (the data preceding data in the stream), all others with the end of their predecessor.
+	 * Only if last is true, the deflate stream is finished.
+	 */
+	bool deflateBlocks( const uint8_t *data, size_t len, const uint8_t *dict, size_t dictlen, bool last, uLong &crc, std::ostream &out, util::ProgressFeedback *progress )const {
+		const long count = blocks( len );
+		bool ok = true;
+
+#pragma omp parallel for ordered schedule(dynamic) num_threads(workers(m_threads))
+		for( long i = 0; i < count; i++ ) {
+			const size_t start = i * blocksize, blen = std::min( blocksize, len - start ), dlen = start ? dictsize : dictlen;
+			std::string buff;
+			const bool block_ok = deflateBlock( data + start, blen, start ? data + start - dlen : dict, dlen, last && i == count - 1, m_level, buff );
+			const uLong block_crc = crc32( crc32( 0L, Z_NULL, 0 ), data + start, blen );
+
+#pragma omp ordered
+			{
+				if( block_ok && ok ) {
+					out.write( buff.data(), buff.size() );
+					crc = crc32_combine( crc, block_crc, blen );
+				} else
+					ok = false;
+
+				if( progress )
+					progress->progress();
+			}
+		}
+
+		return ok;
+	}
+public:
+	/**
+	 * \param level the zlib compression level
+	 * \param threads the amount of threads to compress with (0 means as many as omp offers, e.g. OMP_NUM_THREADS)
+	 */
+	parallel_gzip( int level = Z_DEFAULT_COMPRESSION, int threads = 0 ): m_level( level ), m_threads( threads ) {}
+	static size_t blocks( size_t len ) {return len ? ( len + blocksize - 1 ) / blocksize : 1;}
+	/**
+	 * Compress data into a gzip stream.
+	 * \param data the data to be compressed
+	 * \param len the length of data in bytes
+	 * \param out the stream to write the gzip data into
+	 * \param progress if not NULL progress() is called once for every compressed block (see blocks())
+	 * \returns false if zlib failed to compress any block (out is incomplete then)
+	 */
+	bool operator()( const uint8_t *data, size_t len, std::ostream &out, util::ProgressFeedback *progress = NULL )const {
+		uLong crc = crc32( 0L, Z_NULL, 0 );
+
+		writeHeader( out );
+		const bool ok = deflateBlocks( data, len, NULL, 0, true, crc, out, progress );
+		writeLE32( out, crc );
+		writeLE32( out, len & 0xFFFFFFFF ); // gzip stores the size modulo 2^32
+		return ok;
+	}
+	class Stream;
+};
+
+/**
+ * Compression of data which come in batches (see compressing_sink).
+ * All batches go into one gzip member, which is the same as if all data were compressed at once.
+ */
+class parallel_gzip::Stream
+{
+	parallel_gzip m_compressor;
+	uLong m_crc;
+	uint64_t m_len;
+	std::vector<uint8_t> m_dict;
+public:
+	Stream( const parallel_gzip &compressor ): m_compressor( compressor ), m_crc( crc32( 0L, Z_NULL, 0 ) ), m_len( 0 ) {}
+	/// \returns the size of the batches given to write()
+	size_t batchsize()const {return blocksize * workers( m_compressor.m_threads ) * 4;}
+	/// compress a batch of batchsize() bytes (or a multiple of that) which is not the end of the data
+	bool write( const uint8_t *data, size_t len, std::ostream &out ) {
+		if( !m_len )
+			writeHeader( out );
+
+		const bool ok = m_compressor.deflateBlocks( data, len, m_dict.empty() ? NULL : &m_dict[0], m_dict.size(), false, m_crc, out, NULL );
+		m_dict.assign( data + len - dictsize, data + len );
+		m_len += len;
+		return ok;
+	}
+	/// compress the rest of the data (up to one batch, may be empty) and finish the gzip member
+	bool finish( const uint8_t *data, size_t len, std::ostream &out ) {
+		if( !m_len )
+			writeHeader( out );
+
+		const bool ok = m_compressor.deflateBlocks( data, len, m_dict.empty() ? NULL : &m_dict[0], m_dict.size(), true, m_crc, out, NULL );
+		m_len += len;
+		writeLE32( out, m_crc );
+		writeLE32( out, m_len & 0xFFFFFFFF );
+		return ok;
+	}
+};
+const size_t parallel_gzip::blocksize;
+const size_t parallel_gzip::dictsize;
+
+/// sink writing into an anonymous util::MemFile
+class memfile_sink
+{
+	util::MemFile &m_file;
+public:
+	typedef char char_type;
+	typedef boost::iostreams::sink_tag category;
+
+	memfile_sink( util::MemFile &file ): m_file( file ) {}
+	std::streamsize write( const char *s, std::streamsize n ) {
+		if( !m_file.write( s, n ) )
+			throw std::ios_base::failure( "Failed to write to anonymous file " + m_file.native() );
+
+		return n;
+	}
+};
+
+/**
+ * Sink compressing everything written into it using the Stream of one of the parallel compressors.
+ * The data are collected until there is more than one batch, so the compressor always gets whole batches.
+ * finish() must be called after the last write to compress the rest and finish the compressed stream.
+ */
+template<typename COMPRESSOR> class compressing_sink
+{
+	struct State {
+		typename COMPRESSOR::Stream stream;
+		std::ostream &out;
+		std::vector<uint8_t> buffer;
+		State( const COMPRESSOR &compressor, std::ostream &_out ): stream( compressor ), out( _out ) {}
+	};
+	boost::shared_ptr<State> m_state; // the sink is copied when pushed into a stream, so all copies share the state
+public:
+	typedef char char_type;
+	typedef boost::iostreams::sink_tag category;
+
+	compressing_sink( const COMPRESSOR &compressor, std::ostream &out ): m_state( new State( compressor, out ) ) {}
+	std::streamsize write( const char *s, std::streamsize n ) {
+		State &st = *m_state;
+		const size_t batch = st.stream.batchsize();
+		st.buffer.insert( st.buffer.end(), s, s + n );
+
+		if( st.buffer.size() > batch ) { // compress all whole batches, but keep at least one byte for finish
+			const size_t len = ( st.buffer.size() - 1 ) / batch * batch;
+
+			if( !st.stream.write( &st.buffer[0], len, st.out ) )
+				throw std::ios_base::failure( "Failed to compress" );
+
+			st.buffer.erase( st.buffer.begin(), st.buffer.begin() + len );
+		}
+
+		return n;
+	}
+	void finish() {
+		State &st = *m_state;
+
+		if( !st.stream.finish( st.buffer.empty() ? NULL : &st.buffer[0], st.buffer.size(), st.out ) )
+			throw std::ios_base::failure( "Failed to compress" );
+
+		st.buffer.clear();
+	}
+};
+
+/**
+ * Get the length of the header (including the extensions) of a nifti file from a gzip index.
+ * \returns vox_offset if the uncompressed data are a nifti-1 or nifti-2 file, 0 otherwise
+ */
+uint64_t niftiHeaderLength( const GzipIndex &index )
+{
+	uint8_t head[544];
+
+	if( index.extract( 0, head, sizeof( head ) ) != sizeof( head ) )
+		return 0;
+
+	int32_t sizeof_hdr;
+	memcpy( &sizeof_hdr, head, sizeof( sizeof_hdr ) );
+	const bool swap = ( sizeof_hdr != 348 && sizeof_hdr != 540 );
+	uint64_t vox_offset;
+
+	if( swap )
+		sizeof_hdr = data::endianSwap( sizeof_hdr );
+
+	if( sizeof_hdr == 348 && memcmp( head + 344, "n+1", 4 ) == 0 ) {
+		float offset;
+		memcpy( &offset, head + 108, sizeof( offset ) );
+		vox_offset = static_cast<uint64_t>( swap ? data::endianSwap( offset ) : offset );
+	} else if( sizeof_hdr == 540 && memcmp( head + 4, "n+2", 4 ) == 0 ) {
+		int64_t offset;
+		memcpy( &offset, head + 168, sizeof( offset ) );
+		vox_offset = static_cast<uint64_t>( swap ? data::endianSwap( offset ) : offset );
+	} else
+		return 0;
+
+	// the nifti plugin assumes the smallest possible vox_offset if it is invalid
+	return std::min( std::max<uint64_t>( vox_offset, sizeof_hdr + 4 ), index.getLength() );
+}
+
+/// a regular file from a tar archive, red into memory (or a temporary file) and waiting to be parsed
+struct tar_member {
+	boost::shared_ptr<boost::filesystem::path> file; // util::MemFile or util::TmpFile
+	std::string source; // the value for the "source" property of the chunks (archive/member)
+	util::istring suffix; // the suffix of the member (needed because the anonymous file has none)
+	bool parallel; // all plugins which may read the member can do so in parallel
+	std::list<data::Chunk> chunks;
+};
 }
 
 class ImageFormat_Compressed: public FileFormat
 {
 private:
-	struct {
+	struct tar_header {
 		char name[100];
 		char mode[8];
 		char uid[8];
@@ -82,21 +360,165 @@ private:
 		char devminor[8];
 		char prefix[155];
 		char padding[12];
-	} tar_header;
-	bool read_header( const boost::iostreams::filtering_istream &src, size_t &size, size_t &next_header_in ) {
-		if( boost::iostreams::read( src, reinterpret_cast<char *>( &tar_header ), 512 ) == 512 ) {
-			if( tar_header.size[0] & 0x80 ) { // its base-256
+	};
+	// the largest amount of threads which can be selected by the dialect "threads<N>" (powers of two)
+	static const int max_threads_dialect = 64;
+	// the members of a tar archive are loaded in batches of up to max_batch_members members or max_batch_bytes bytes
+	static const size_t max_batch_bytes = 0x10000000; // 256M
+	// if the plugin cannot write into a stream, images of up to max_memfile_bytes are written into memory before they are compressed, bigger ones into a temporary file
+	static const size_t max_memfile_bytes = 0x40000000; // 1G
+	static size_t max_batch_members() {
+#ifdef _OPENMP
+		return omp_get_max_threads() * 2;
+#else
+		return 1;
+#endif //_OPENMP
+	}
+	/// \returns the suffix for the compression (or tar) the given data starts with, or an empty string if its none
+	static util::istring suffixFromMagic( const uint8_t *h, size_t len ) {
+		if( len >= 2 && h[0] == 0x1f && h[1] == 0x8b )return ".gz"; // gzip
+		if( len >= 3 && memcmp( h, "BZh", 3 ) == 0 )return ".bz2"; // bzip2
+#ifdef HAVE_LZMA
+		if( len >= 6 && memcmp( h, "\xFD" "7zXZ\0", 6 ) == 0 )return ".xz"; // xz
+#endif //HAVE_LZMA
+#ifdef HAVE_ZSTD
+		if( len >= 4 && memcmp( h, "\x28\xB5\x2F\xFD", 4 ) == 0 )return ".zst"; // zstd
+#endif //HAVE_ZSTD
+#ifdef HAVE_LZ4
+		if( len >= 4 && memcmp( h, "\x04\x22\x4D\x18", 4 ) == 0 )return ".lz4"; // lz4 frame
+#endif //HAVE_LZ4
+		if( len >= 262 && memcmp( h + 257, "ustar", 5 ) == 0 )return ".tar"; // uncompressed (posix) tar
+
+		return util::istring();
+	}
+	/// \returns the suffix for the compression of the given file guessed from its first bytes
+	static util::istring suffixFromMagic( const std::string &filename ) {
+		uint8_t head[262];
+		std::ifstream file( filename.c_str(), std::ios_base::binary );
+		file.read( reinterpret_cast<char *>( head ), sizeof( head ) );
+		return suffixFromMagic( head, file.gcount() );
+	}
+	static bool isArchive( const util::istring &suffix ) {
+		return suffix == ".tgz" || suffix == ".tbz" || suffix == ".taz" || suffix.find( ".tar" ) == 0;
+	}
+	static bool allThreadSafe( const data::IOFactory::FileFormatList &formats, const std::string &filename ) {
+		BOOST_FOREACH( data::IOFactory::FileFormatList::const_reference format, formats ) {
+			if( !format->threadSafe( filename ) )
+				return false;
+		}
+		return !formats.empty();
+	}
+	/**
+	 * Parse the members collected so far and move the resulting chunks (in the order of the members) into chunks.
+	 * If all members can be parsed in parallel, they are (if omp is enabled).
+	 */
+	static int loadMembers( std::vector<_internal::tar_member> &batch, std::list<data::Chunk> &chunks, bool metadata_only ) {
+		const int count = batch.size();
+		bool parallel = true;
+		int ret = 0;
+
+		BOOST_FOREACH( const _internal::tar_member & member, batch ) {
+			parallel &= member.parallel;
+		}
+
+		LOG_IF( parallel && count > 1, Debug, info ) << "Parsing " << count << " members of the archive in parallel";
+
+#pragma omp parallel for schedule(dynamic) reduction(+:ret) if(parallel)
+		for( int i = 0; i < count; i++ ) {
+			_internal::tar_member &member = batch[i];
+
+			try {
+				ret += data::IOFactory::load( member.chunks, member.file->native(), member.suffix, "", metadata_only );
+			} catch( std::exception &e ) { // exceptions must not leave the parallel loop
+				LOG( Runtime, error ) << "Failed to load " << member.source << " (" << e.what() << ")";
+			}
+
+			BOOST_FOREACH( data::Chunk & ch, member.chunks ) { // set the source property of the red chunks to something more usefull
+				ch.setPropertyAs( "source", member.source );
+			}
+		}
+
+		BOOST_FOREACH( _internal::tar_member & member, batch ) {
+			chunks.splice( chunks.end(), member.chunks );
+		}
+		batch.clear(); // closes the files
+		return ret;
+	}
+	/**
+	 * Compress a file using one of the parallel compressors (the file is mapped into memory for that).
+	 * \param compressor the compressor (see _internal::parallel_gzip)
+	 * \param src the file to be compressed
+	 * \param output the stream to write the compressed data into
+	 * \param filename the name of the target (for the progress bar and error messages)
+	 * \param progress the progress bar (may be empty)
+	 */
+	template<typename COMPRESSOR> void writeMapped( const COMPRESSOR &compressor, const boost::filesystem::path &src, std::ostream &output, const std::string &filename, boost::shared_ptr<util::ProgressFeedback> progress ) {
+		const size_t size = boost::filesystem::file_size( src );
+		data::FilePtr input;
+
+		if( size ) {
+			input = data::FilePtr( src );
+
+			if( !input.good() )
+				throwSystemError( errno, std::string( "Failed to map temporary " ) + src.native() );
+		}
+
+		if( progress )
+			progress->show( COMPRESSOR::blocks( size ), std::string( "compressing " ) + filename );
+
+		if( !compressor( size ? &input[0] : NULL, size, output, progress.get() ) )
+			throwGenericError( "Failed to compress " + src.native() + " into " + filename );
+	}
+	/**
+	 * Let the plugin write the image directly into one of the parallel compressors, so there is no intermediate file.
+	 * \param compressor the compressor (see _internal::parallel_gzip)
+	 * \param image the image to be written
+	 * \param format the plugin writing the uncompressed data
+	 * \param inner_filename the name of the uncompressed file (the plugin may write side files next to it)
+	 * \param dialect the dialect for the plugin
+	 * \param filename the name of the target
+	 * \param progress the progress bar (may be empty)
+	 * \returns false if the plugin cannot write into a stream (nothing was written then)
+	 */
+	template<typename COMPRESSOR> bool writeStreamed(
+		const COMPRESSOR &compressor, const data::Image &image, const data::IOFactory::FileFormatPtr &format,
+		const std::string &inner_filename, const util::istring &dialect, const std::string &filename, boost::shared_ptr<util::ProgressFeedback> progress
+	) {
+		std::ofstream output( filename.c_str(), std::ios_base::binary );
+		output.exceptions( std::ios::badbit );
+
+		_internal::compressing_sink<COMPRESSOR> sink( compressor, output );
+		boost::iostreams::filtering_ostream out;
+
+		if( progress ) {
+			progress->show( image.getVolume() * image.getMaxBytesPerVoxel() / _internal::progress_filter::blocksize, std::string( "compressing " ) + filename );
+			out.push( _internal::progress_filter( *progress ) );
+		}
+
+		out.push( sink );
+		out.exceptions( std::ios::badbit ); // only after the chain is complete, it is bad before
+
+		if( !format->writeStream( image, out, inner_filename, dialect, progress ) )
+			return false;
+
+		out.reset(); // flushes everything into the sink
+		sink.finish();
+		return true;
+	}
+	static bool read_header( const boost::iostreams::filtering_istream &src, tar_header &header, size_t &size, size_t &next_header_in ) {
+		if( boost::iostreams::read( src, reinterpret_cast<char *>( &header ), 512 ) == 512 ) {
+			if( header.size[0] & 0x80 ) { // its base-256
 				size = 0;
 
 				for( uint_fast8_t i = 4; i < 11; i++ ) {
-					size |= reinterpret_cast<uint8_t *>( tar_header.size )[i];
+					size |= reinterpret_cast<uint8_t *>( header.size )[i];
 					size = size << 8;
 				}
 
-				size |= reinterpret_cast<uint8_t *>( tar_header.size )[11];
-			} else if( tar_header.size[10] != 0 ) { //normal octal
+				size |= reinterpret_cast<uint8_t *>( header.size )[11];
+			} else if( header.size[10] != 0 ) { //normal octal
 				//get the size
-				std::stringstream buff( tar_header.size );
+				std::stringstream buff( header.size );
 				size = 0, next_header_in = 0;
 
 				buff >> std::oct >> size;
@@ -119,17 +541,22 @@ private:
 	}
 protected:
 	util::istring suffixes( io_modes modes = both )const {
+		util::istring compressed = "gz bz2 Z", archives = "tar tar.gz tgz tar.bz2 tbz tar.Z taz";
 #ifdef HAVE_LZMA
-
-		if( modes == write_only )return "gz bz2 Z xz";
-		else return "tar tar.gz tgz tar.bz2 tbz tar.Z tar.xz taz gz bz2 Z xz";
-
-#else
-
-		if( modes == write_only )return "gz bz2 Z";
-		else return "tar tar.gz tgz tar.bz2 tbz tar.Z taz gz bz2 Z";
-
+		compressed += " xz";
+		archives += " tar.xz";
 #endif //HAVE_LZMA
+#ifdef HAVE_ZSTD
+		compressed += " zst";
+		archives += " tar.zst";
+#endif //HAVE_ZSTD
+#ifdef HAVE_LZ4
+		compressed += " lz4";
+		archives += " tar.lz4";
+#endif //HAVE_LZ4
+
+		if( modes == write_only )return compressed;
+		else return archives + " " + compressed;
 	}
 public:
 	util::istring dialects( const std::string &/*filename*/ )const {
@@ -142,19 +569,56 @@ public:
 		suffixes.sort();
 		suffixes.unique();
 
+		// add the dialect for reading gzip files with an index
+		suffixes.push_back( "index" );
+
+		// the dialects for the compression level
+		suffixes.push_back( "fast" );
+		suffixes.push_back( "best" );
+
+		// and for the amount of threads compressing gz, zst and lz4
+		for( int threads = 1; threads <= max_threads_dialect; threads *= 2 )
+			suffixes.push_back( util::istring( "threads" ) + boost::lexical_cast<std::string>( threads ).c_str() );
+
 		return util::listToString( suffixes.begin(), suffixes.end(), " ", "", "" ).c_str();
 	}
 	std::string getName()const {return "(de)compression proxy for other formats";}
+	// compressed files can be loaded in parallel if the plugins for the uncompressed file can (archives parse their members in parallel themself)
+	bool threadSafe( const std::string &filename )const {
+		const std::pair<std::string, std::string> proxyBase = makeBasename( filename );
+		return !isArchive( proxyBase.second.c_str() ) && allThreadSafe( data::IOFactory::getFileFormatList( proxyBase.first ), proxyBase.first );
+	}
+	bool checkMagic( const data::ValueArray<uint8_t> &head )const {
+		return !suffixFromMagic( &head[0], head.getLength() ).empty();
+	}
 
 	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )
+	throw( std::runtime_error & ) {
+		return load( chunks, filename, dialect, progress, false );
+	}
+	// metadata_only is passed on to the plugin reading the uncompressed data
+	// the data has to be decompressed anyway, except for gzipped nifti files with an index (then only their header is inflated)
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress, bool metadata_only )
 	throw( std::runtime_error & ) {
 		std::list<data::Chunk>::iterator prev = chunks.end();
 		--prev; //memory current position in the output list
 
+		// the dialect "index" stores the index of a gzip file in a sidecar file (see _internal::GzipIndex)
+		// all other dialects enforce the suffix of the uncompressed data
+		const bool keep_index = ( dialect == "index" );
+		const util::istring inner_dialect = keep_index ? util::istring() : dialect;
+
 		//select filters for input
 		boost::iostreams::filtering_istream in;
 
 		std::pair< std::string, std::string > proxyBase = makeBasename( filename );
+		const bool guessed = proxyBase.second.empty();
+
+		if( guessed ) { // there is no known suffix (e.g. for the anonymous file of a member of an archive), so look at the data
+			proxyBase.second = suffixFromMagic( filename ).c_str();
+			LOG( Debug, info ) << "Guessed the suffix " << util::MSubject( proxyBase.second ) << " for " << filename << " from its content";
+		}
+
 		util::istring suffix = proxyBase.second.c_str();
 		bool isTar = true;
 		int ret = 0;
@@ -175,6 +639,14 @@ public:
 #ifdef HAVE_LZMA
 			else if( suffix == ".xz" )in.push( boost::iostreams::lzma_decompressor() );
 
+#endif
+#ifdef HAVE_ZSTD
+			else if( suffix == ".zst" )in.push( _internal::zstd_decompressor() );
+
+#endif
+#ifdef HAVE_LZ4
+			else if( suffix == ".lz4" )in.push( _internal::lz4_decompressor() );
+
 #endif
 			else { // if its tar having no compression is fine
 				throwGenericError( "Cannot determine the compression format of \"" + filename + "\"" );
@@ -185,7 +657,8 @@ public:
 		if( progress && progress->getMax() == 0 ) {
 			progress->show( boost::filesystem::file_size( filename ) / _internal::progress_filter::blocksize, std::string( "decompressing " ) + filename );
 			in.push( _internal::progress_filter( *progress ) );
-		}
+		} else // don't touch a progress bar set up by someone else (e.g. by the archive this file is from, while other members are parsed in parallel)
+			progress.reset();
 
 		// and on the top the source file
 		std::ifstream input( filename.c_str(), std::ios_base::binary );
@@ -193,31 +666,35 @@ public:
 		in.push( input );
 
 		if( isTar ) { // if it is tar we use out own tar "parser"
-			size_t size, next_header_in;
+			// the archive is red sequentially, but the members are collected and parsed in parallel (if all their plugins support that)
+			size_t size, next_header_in, batch_bytes = 0;
+			tar_header header;
+			std::vector<_internal::tar_member> batch;
+			batch.reserve( max_batch_members() );
 
-			while( in.good() && read_header( in, size, next_header_in ) ) { //read the header block
+			while( in.good() && read_header( in, header, size, next_header_in ) ) { //read the header block
 
 				boost::filesystem::path org_file;
 
-				if( tar_header.typeflag == 'L' ) { // the filename of the next file is to long - so its stored in the next block (following this header)
+				if( header.typeflag == 'L' ) { // the filename of the next file is to long - so its stored in the next block (following this header)
 					char namebuff[size];
 					next_header_in -= tar_readstream( in, namebuff, size, "overlong filename for next entry" );
 					in.ignore( next_header_in ); // skip the remaining input until the next header
 					org_file = boost::filesystem::path( std::string( namebuff ) );
 					LOG( Debug, verbose_info ) << "Got overlong name " << util::MSubject( org_file ) << " for next file.";
 
-					read_header( in, size, next_header_in ); //continue with the next header
+					read_header( in, header, size, next_header_in ); //continue with the next header
 				} else {
 					//get the original filename (use substr, because these fields are not \0-terminated)
-					org_file = boost::filesystem::path( std::string( tar_header.prefix ).substr( 0, 155 ) + std::string( tar_header.name ).substr( 0, 100 ) );
+					org_file = boost::filesystem::path( std::string( header.prefix ).substr( 0, 155 ) + std::string( header.name ).substr( 0, 100 ) );
 				}
 
 				if( size == 0 ) //if there is no content skip this entry (there are allways two "empty" blocks at the end of a tar)
 					continue;
 
-				if( tar_header.typeflag == '\0' || tar_header.typeflag == '0' ) { //only do regulars files
+				if( header.typeflag == '\0' || header.typeflag == '0' ) { //only do regulars files
 
-					data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( org_file.string(), dialect ); // and get the reading pluging for that
+					data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( org_file.string(), inner_dialect ); // and get the reading pluging for that
 
 					if( formats.empty() ) {
 						LOG( Runtime, notice ) << "Skipping " << org_file << " from " << filename << " because no plugin was found to read it"; // skip if we found none
@@ -225,12 +702,18 @@ public:
 						LOG( Debug, info ) << "Got " << org_file << " from " << filename << " there are " << formats.size() << " plugins which should be able to read it";
 
 						const std::pair<std::string, std::string> base = formats.front()->makeBasename( org_file.string() );//ask any of the plugins for the suffix
-						util::TmpFile tmpfile( "", base.second );//create a temporary file with this suffix
+						_internal::tar_member member;
+						boost::shared_ptr<util::MemFile> memfile( new util::MemFile( org_file.filename().native() ) );
+
+						if( memfile->good() )
+							member.file = memfile;
+						else
+							member.file.reset( new util::TmpFile( "", base.second ) ); // fallback if the system has no anonymous files
 
-						data::FilePtr mfile( tmpfile, size, true );
+						data::FilePtr mfile( *member.file, size, true );
 
 						if( !mfile.good() ) {
-							throwSystemError( errno, std::string( "Failed to open temporary " ) + tmpfile.native() );
+							throwSystemError( errno, std::string( "Failed to open temporary " ) + member.file->native() );
 						}
 
 						size_t red = boost::iostreams::read( in, ( char * )&mfile[0], size ); // read data from the stream into the mapped memory
@@ -238,40 +721,88 @@ public:
 						mfile.release(); //close and unmap the temporary file/mapped memory
 
 						if( red != size ) { // read the data from the stream
-							LOG( Runtime, warning ) << "Could not read all " << size << " bytes for " << tmpfile.native();
+							LOG( Runtime, warning ) << "Could not read all " << size << " bytes for " << member.file->native();
 						}
 
-						// read the temporary file
-						std::list<data::Chunk>::iterator ch = chunks.end();
-						--ch;
-						ret += data::IOFactory::load( chunks, tmpfile.string(), dialect.c_str() );
+						// the anonymous file has no suffix, so it must be given
+						member.suffix = inner_dialect.empty() ? base.second.c_str() : inner_dialect;
+						member.source = ( boost::filesystem::path( filename ) / org_file ).native();
+						member.parallel = allThreadSafe( formats, org_file.string() );
 
-						for( ; ch != chunks.end(); ++ch ) { // set the source property of the red chunks to something more usefull
-							ch->setPropertyAs( "source", ( boost::filesystem::path( filename ) / org_file ).native() );
+						if( !member.parallel && !batch.empty() ) // parse the members before, so the order is kept
+							ret += loadMembers( batch, chunks, metadata_only );
+
+						batch.push_back( member );
+						batch_bytes += size;
+
+						if( !member.parallel || batch.size() >= max_batch_members() || batch_bytes >= max_batch_bytes ) {
+							ret += loadMembers( batch, chunks, metadata_only );
+							batch_bytes = 0;
 						}
 					}
 				} else {
-					LOG( Debug, verbose_info ) << "Skipping " << org_file << " because its no regular file (type is " << tar_header.typeflag << ")" ;
+					LOG( Debug, verbose_info ) << "Skipping " << org_file << " because its no regular file (type is " << header.typeflag << ")" ;
 				}
 
 				in.ignore( next_header_in ); // skip the remaining input until the next header
 			}
 
+			ret += loadMembers( batch, chunks, metadata_only );
+
 		} else { // otherwise just decompress the file and read it
-			const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( proxyBase.first, dialect );
+			const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( proxyBase.first, inner_dialect );
 
-			if( formats.empty() ) {
+			if( formats.empty() && !guessed ) {
 				throwGenericError( "Cannot determine the uncompressed suffix of \"" + filename + "\" because no io-plugin was found for it" );
 			}
 
-			// set up the input stream
-			util::TmpFile tmpFile( "", formats.front()->makeBasename( proxyBase.first ).second );
-			boost::filesystem::ofstream output( tmpFile, std::ios_base::binary );
-			output.exceptions( std::ios::badbit );
+			// if the name has no suffix the uncompressed data are recognised by their content as well (IOFactory does that for an empty suffix)
+			const std::string inner_suffix = formats.empty() ? std::string() : formats.front()->makeBasename( proxyBase.first ).second;
+			util::MemFile memfile( boost::filesystem::path( proxyBase.first ).filename().native() );
+
+			if( memfile.good() && suffix == ".gz" ) { // inflate gzip into memory using (or building) an index
+				_internal::GzipIndex index( filename );
+
+				if( index.load( _internal::GzipIndex::sidecarOf( filename ) ) ) { // there is an index, so we can inflate its spans in parallel
+					if( index.getLength() ) {
+						data::FilePtr mfile( memfile, index.getLength(), true );
+
+						if( !mfile.good() )
+							throwSystemError( errno, std::string( "Failed to map " ) + memfile.native() );
+
+						// the nifti plugin does not touch the voxel data when loading only metadata, so only its header is inflated
+						// the rest of the anonymous file is a hole, which costs no memory
+						const uint64_t header = metadata_only ? _internal::niftiHeaderLength( index ) : 0;
+
+						if( header ) {
+							LOG( Debug, info ) << "Inflating only the " << header << " bytes of the nifti header of " << util::MSubject( filename );
+
+							if( index.extract( 0, &mfile[0], header ) != header )
+								throwGenericError( "Failed to inflate the header of \"" + filename + "\"" );
+						} else if( !index.extractAll( &mfile[0], progress.get() ) )
+							throwGenericError( "Failed to inflate \"" + filename + "\"" );
+					}
+				} else {
+					if( !index.build( boost::bind( &util::MemFile::write, &memfile, _1, _2 ), progress.get() ) )
+						throwGenericError( "Failed to inflate \"" + filename + "\"" );
+
+					if( keep_index && index.valid() ) // store the index for the next time if requested
+						index.save( _internal::GzipIndex::sidecarOf( filename ) );
+				}
 
-			boost::iostreams::copy( in, output );
+				ret = data::IOFactory::load( chunks, memfile.native(), inner_dialect.empty() ? inner_suffix.c_str() : inner_dialect, "", metadata_only );
+			} else if( memfile.good() ) { // decompress into memory and let the plugin map that
+				boost::iostreams::copy( in, _internal::memfile_sink( memfile ) );
+				ret = data::IOFactory::load( chunks, memfile.native(), inner_dialect.empty() ? inner_suffix.c_str() : inner_dialect, "", metadata_only );
+			} else { // fall back to a temporary file
+				util::TmpFile tmpFile( "", inner_suffix );
+				boost::filesystem::ofstream output( tmpFile, std::ios_base::binary );
+				output.exceptions( std::ios::badbit );
 
-			ret = data::IOFactory::load( chunks, tmpFile.native(), dialect );
+				boost::iostreams::copy( in, output );
+
+				ret = data::IOFactory::load( chunks, tmpFile.native(), inner_dialect, "", metadata_only );
+			}
 
 			if( ret ) { //re-set source of all new chunks
 				prev++;
@@ -288,33 +819,106 @@ public:
 		std::pair< std::string, std::string > proxyBase = makeBasename( filename );
 		const util::istring suffix = proxyBase.second.c_str();
 
-		const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( proxyBase.first, dialect );
+		// the dialects "fast" and "best" select the compression level, "threads<N>" the amount of threads for gz, zst and lz4
+		// all others are passed to the plugin writing the uncompressed data
+		int level = Z_DEFAULT_COMPRESSION, threads = 0;
+		util::istring inner_dialect = dialect;
+
+		if( dialect == "fast" ) {
+			level = Z_BEST_SPEED;
+			inner_dialect.clear();
+		} else if( dialect == "best" ) {
+			level = Z_BEST_COMPRESSION;
+			inner_dialect.clear();
+		} else if( dialect.find( "threads" ) == 0 && dialect.length() > 7 ) {
+			threads = std::atoi( dialect.c_str() + 7 );
+			inner_dialect.clear();
+		}
+
+		const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( proxyBase.first, inner_dialect );
 
 		if( formats.empty() ) {
 			throwGenericError( "Cannot determine the uncompressed suffix of \"" + filename + "\" because no io-plugin was found for it" );
 		}
 
-		// create the intermediate file
-		util::TmpFile tmpFile( "", formats.front()->makeBasename( proxyBase.first ).second );
+		// gzip, zstd and lz4 get the uncompressed data directly from the plugin if it can write into a stream
+		if( suffix == ".gz" && writeStreamed( _internal::parallel_gzip( level, threads ), image, formats.front(), proxyBase.first, inner_dialect, filename, progress ) )
+			return;
 
-		if( !data::IOFactory::write( image, tmpFile.native(), dialect ) ) {throwGenericError( tmpFile.native() + " failed to write" );}
+#ifdef HAVE_ZSTD
+		const int zstd_level = level == Z_BEST_SPEED ? 1 : ( level == Z_BEST_COMPRESSION ? 19 : ZSTD_CLEVEL_DEFAULT );
+
+		if( suffix == ".zst" && writeStreamed( _internal::parallel_zstd( zstd_level, threads ), image, formats.front(), proxyBase.first, inner_dialect, filename, progress ) )
+			return;
+
+#endif //HAVE_ZSTD
+#ifdef HAVE_LZ4
+		const int lz4_level = level == Z_BEST_SPEED ? -1 : ( level == Z_BEST_COMPRESSION ? LZ4HC_CLEVEL_MAX : 0 );
+
+		if( suffix == ".lz4" && writeStreamed( _internal::parallel_lz4( lz4_level, threads ), image, formats.front(), proxyBase.first, inner_dialect, filename, progress ) )
+			return;
+
+#endif //HAVE_LZ4
+
+		// otherwise create an intermediate file - in memory, so the uncompressed data never go to the disk
+		// big images go into a temporary file instead, so they don't take their whole size from the memory (as do all if the system has no anonymous files)
+		const std::string inner_suffix = formats.front()->makeBasename( proxyBase.first ).second;
+		const size_t expected_bytes = image.getVolume() * image.getMaxBytesPerVoxel();
+		std::auto_ptr<util::MemFile> memfile;
+		std::auto_ptr<util::TmpFile> tmpfile;
+
+		if( expected_bytes <= max_memfile_bytes )
+			memfile.reset( new util::MemFile( boost::filesystem::path( proxyBase.first ).filename().native() ) );
+		else
+			LOG( Debug, info ) << "Writing the " << expected_bytes << " uncompressed bytes for " << util::MSubject( filename ) << " into a temporary file";
+
+		if( !memfile.get() || !memfile->good() )
+			tmpfile.reset( new util::TmpFile( "", inner_suffix ) );
+
+		const boost::filesystem::path &intermediate = tmpfile.get() ? *tmpfile : static_cast<const boost::filesystem::path &>( *memfile );
+
+		// the anonymous file has no suffix, so it must be given
+		if( !data::IOFactory::write( image, intermediate.native(), inner_suffix.c_str(), inner_dialect ) ) {throwGenericError( intermediate.native() + " failed to write" );}
 
-		// set up the compression stream
-		boost::filesystem::ifstream input( tmpFile, std::ios_base::binary );
 		std::ofstream output( filename.c_str(), std::ios_base::binary );
-		input.exceptions( std::ios::badbit );
 		output.exceptions( std::ios::badbit );
 
+		// gzip, zstd and lz4 compress the mapped file in parallel
+		if( suffix == ".gz" ) {
+			writeMapped( _internal::parallel_gzip( level, threads ), intermediate, output, filename, progress );
+			return;
+		}
+
+#ifdef HAVE_ZSTD
+
+		if( suffix == ".zst" ) {
+			writeMapped( _internal::parallel_zstd( zstd_level, threads ), intermediate, output, filename, progress );
+			return;
+		}
+
+#endif //HAVE_ZSTD
+#ifdef HAVE_LZ4
+
+		if( suffix == ".lz4" ) {
+			writeMapped( _internal::parallel_lz4( lz4_level, threads ), intermediate, output, filename, progress );
+			return;
+		}
+
+#endif //HAVE_LZ4
+
+		// set up the compression stream
+		boost::filesystem::ifstream input( intermediate, std::ios_base::binary );
+		input.exceptions( std::ios::badbit );
+
 		boost::iostreams::filtering_ostream out;
 
 		if( progress ) {
-			progress->show( boost::filesystem::file_size( tmpFile ) / _internal::progress_filter::blocksize, std::string( "compressing " ) + filename );
+			progress->show( boost::filesystem::file_size( intermediate ) / _internal::progress_filter::blocksize, std::string( "compressing " ) + filename );
 			out.push( _internal::progress_filter( *progress ) );
 		}
 
-		if( suffix == ".gz" )out.push( boost::iostreams::gzip_compressor() );
-		else if( suffix == ".bz2" )out.push( boost::iostreams::bzip2_compressor() );
-		else if( suffix == ".Z" )out.push( boost::iostreams::zlib_compressor() );
+		if( suffix == ".bz2" )out.push( boost::iostreams::bzip2_compressor( level == Z_BEST_SPEED ? 1 : boost::iostreams::bzip2::default_block_size ) );
+		else if( suffix == ".Z" )out.push( boost::iostreams::zlib_compressor( level ) );
 
 #ifdef HAVE_LZMA
 		else if( suffix == ".xz" )out.push( boost::iostreams::lzma_compressor() );
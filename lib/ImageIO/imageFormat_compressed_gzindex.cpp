@@ -0,0 +1,355 @@
+#include "imageFormat_compressed_gzindex.hpp"
+#include <DataStorage/common.hpp>
+#include <CoreUtils/message.hpp>
+#include <zlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem/operations.hpp>
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+const size_t GzipIndex::span;
+const size_t GzipIndex::winsize;
+const size_t GzipIndex::chunksize;
+
+namespace
+{
+const char sidecar_magic[8] = {'I', 'S', 'I', 'S', 'G', 'Z', 'I', '1'};
+const uint32_t sidecar_byteorder = 0x01020304;
+
+/// FILE handle closing itself
+struct AutoFile {
+	FILE *f;
+	AutoFile( const boost::filesystem::path &name ): f( fopen( name.native().c_str(), "rb" ) ) {}
+	~AutoFile() {if( f )fclose( f );}
+};
+
+template<typename T> bool readBin( std::istream &in, T &val ) {return in.read( reinterpret_cast<char *>( &val ), sizeof( T ) );}
+template<typename T> void writeBin( std::ostream &out, const T &val ) {out.write( reinterpret_cast<const char *>( &val ), sizeof( T ) );}
+}
+
+GzipIndex::GzipIndex( const boost::filesystem::path &file ): m_file( file ), m_length( 0 ), m_valid( false ) {}
+
+boost::filesystem::path GzipIndex::sidecarOf( const boost::filesystem::path &file )
+{
+	return boost::filesystem::path( file.native() + ".gzidx" );
+}
+
+bool GzipIndex::fileStamp( uint64_t &size, uint64_t &mtime )const
+{
+	boost::system::error_code err;
+	size = boost::filesystem::file_size( m_file, err );
+
+	if( !err )
+		mtime = boost::filesystem::last_write_time( m_file, err );
+
+	return !err;
+}
+
+void GzipIndex::addPoint( int bits, uint64_t in, uint64_t out, size_t left, const uint8_t *window )
+{
+	m_points.push_back( AccessPoint() );
+	AccessPoint &next = m_points.back();
+	next.bits = bits;
+	next.in = in;
+	next.out = out;
+	next.window.resize( winsize );
+
+	// the window is used circular, so the oldest data is behind the current position
+	if( left )
+		memcpy( &next.window[0], window + winsize - left, left );
+
+	if( left < winsize )
+		memcpy( &next.window[left], window, winsize - left );
+}
+
+bool GzipIndex::build( sink_type sink, util::ProgressFeedback *progress )
+{
+	AutoFile in( m_file );
+
+	if( !in.f ) {
+		LOG( Runtime, error ) << "Failed to open " << util::MSubject( m_file ) << " (" << strerror( errno ) << ")";
+		return false;
+	}
+
+	z_stream strm;
+	memset( &strm, 0, sizeof( strm ) );
+
+	if( inflateInit2( &strm, 47 ) != Z_OK ) // 47 = 32+15 - automatic zlib or gzip decoding with the biggest window
+		return false;
+
+	std::vector<uint8_t> input( chunksize ), window( winsize );
+	uint64_t totin = 0, totout = 0, last = 0;
+	bool multi = false, ok = true, done = false;
+
+	m_points.clear();
+	strm.avail_out = 0;
+
+	while( ok && !done ) {
+		strm.avail_in = fread( &input[0], 1, chunksize, in.f );
+		strm.next_in = &input[0];
+
+		if( ferror( in.f ) || strm.avail_in == 0 ) {
+			LOG( Runtime, error ) << "Failed to read from " << util::MSubject( m_file ) << ", the gzip stream is truncated";
+			ok = false;
+			break;
+		}
+
+		if( progress )
+			progress->progress();
+
+		do {
+			if( strm.avail_out == 0 ) { // wrap around the window
+				strm.avail_out = winsize;
+				strm.next_out = &window[0];
+			}
+
+			const uint8_t *const out_start = strm.next_out;
+
+			// inflate until the end of a deflate block, so we can add access points there
+			totin += strm.avail_in;
+			totout += strm.avail_out;
+			int ret = inflate( &strm, Z_BLOCK );
+			totin -= strm.avail_in;
+			totout -= strm.avail_out;
+
+			if( strm.next_out != out_start && !sink( reinterpret_cast<const char *>( out_start ), strm.next_out - out_start ) ) {
+				ok = false;
+				break;
+			}
+
+			if( ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR ) {
+				LOG( Runtime, error ) << "Failed to inflate " << util::MSubject( m_file ) << " (" << ( strm.msg ? strm.msg : "zlib error" ) << ")";
+				ok = false;
+				break;
+			}
+
+			if( ret == Z_STREAM_END ) {
+				if( strm.avail_in == 0 && ( feof( in.f ) || ungetc( getc( in.f ), in.f ) == EOF ) ) {
+					done = true;
+					break;
+				} else { // another gzip member follows - we can inflate it, but the index is useless
+					multi = true;
+					inflateReset( &strm );
+					continue;
+				}
+			}
+
+			// add an access point at the end of a block (except the last), if we're far enough from the last one
+			if( ( strm.data_type & 128 ) && !( strm.data_type & 64 ) && ( totout == 0 || totout - last > span ) ) {
+				addPoint( strm.data_type & 7, totin, totout, strm.avail_out, &window[0] );
+				last = totout;
+			}
+		} while( strm.avail_in != 0 );
+	}
+
+	inflateEnd( &strm );
+	m_length = totout;
+	m_valid = ok && !multi;
+	LOG_IF( multi, Debug, info ) << util::MSubject( m_file ) << " has more than one gzip member, it cannot be indexed";
+	LOG_IF( m_valid, Debug, info ) << "Created index with " << m_points.size() << " access points for " << util::MSubject( m_file );
+
+	if( !m_valid )
+		m_points.clear();
+
+	return ok;
+}
+
+bool GzipIndex::valid()const {return m_valid;}
+
+uint64_t GzipIndex::getLength()const {return m_length;}
+
+size_t GzipIndex::extract( uint64_t offset, uint8_t *dst, size_t len )const
+{
+	if( !m_valid || m_points.empty() || offset >= m_length )
+		return 0;
+
+	// find the last access point before offset
+	std::vector<AccessPoint>::const_iterator here = m_points.begin();
+
+	while( here + 1 != m_points.end() && ( here + 1 )->out <= offset )
+		++here;
+
+	AutoFile in( m_file );
+
+	if( !in.f || fseeko( in.f, here->in - ( here->bits ? 1 : 0 ), SEEK_SET ) != 0 )
+		return 0;
+
+	z_stream strm;
+	memset( &strm, 0, sizeof( strm ) );
+
+	if( inflateInit2( &strm, -15 ) != Z_OK ) // raw inflate - we start in the middle of the stream
+		return 0;
+
+	if( here->bits ) { // feed the bits of the incomplete byte
+		const int ch = getc( in.f );
+
+		if( ch == EOF || inflatePrime( &strm, here->bits, ch >> ( 8 - here->bits ) ) != Z_OK ) {
+			inflateEnd( &strm );
+			return 0;
+		}
+	}
+
+	inflateSetDictionary( &strm, &here->window[0], winsize );
+
+	std::vector<uint8_t> input( chunksize ), discard;
+	uint64_t skip = offset - here->out;
+	size_t got = 0;
+	int ret = Z_OK;
+
+	if( skip )
+		discard.resize( winsize );
+
+	while( ret != Z_STREAM_END && got < len ) {
+		if( strm.avail_in == 0 ) {
+			strm.avail_in = fread( &input[0], 1, chunksize, in.f );
+			strm.next_in = &input[0];
+
+			if( ferror( in.f ) || strm.avail_in == 0 )
+				break;
+		}
+
+		if( skip ) { // inflate into the discard buffer until offset is reached
+			strm.avail_out = std::min<uint64_t>( skip, winsize );
+			strm.next_out = &discard[0];
+		} else {
+			strm.avail_out = std::min<size_t>( len - got, 0x40000000 ); // avail_out is only 32bit
+			strm.next_out = dst + got;
+		}
+
+		const uInt before = strm.avail_out;
+		ret = inflate( &strm, Z_NO_FLUSH );
+
+		if( ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR ) {
+			LOG( Runtime, error ) << "Failed to inflate " << util::MSubject( m_file ) << " at " << offset << " (" << ( strm.msg ? strm.msg : "zlib error" ) << ")";
+			break;
+		}
+
+		if( skip )
+			skip -= before - strm.avail_out;
+		else
+			got += before - strm.avail_out;
+	}
+
+	inflateEnd( &strm );
+	return got;
+}
+
+bool GzipIndex::extractAll( uint8_t *dst, util::ProgressFeedback *progress )const
+{
+	if( !m_valid )
+		return false;
+
+	const long count = m_points.size();
+	bool ok = true;
+
+#pragma omp parallel for schedule(dynamic)
+	for( long i = 0; i < count; i++ ) {
+		const uint64_t start = m_points[i].out, end = ( i + 1 < count ) ? m_points[i + 1].out : m_length;
+
+		if( extract( start, dst + start, end - start ) != end - start ) {
+#pragma omp critical
+			ok = false;
+		}
+
+		if( progress ) {
+			const uint64_t in_end = ( i + 1 < count ) ? m_points[i + 1].in : m_points[i].in + chunksize;
+#pragma omp critical
+			progress->progress( "", ( in_end - m_points[i].in ) / chunksize );
+		}
+	}
+
+	LOG_IF( !ok, Runtime, error ) << "Failed to inflate " << util::MSubject( m_file ) << " using its index";
+	return ok;
+}
+
+bool GzipIndex::save( const boost::filesystem::path &sidecar )const
+{
+	uint64_t size, mtime;
+
+	if( !m_valid || !fileStamp( size, mtime ) )
+		return false;
+
+	std::ofstream out( sidecar.native().c_str(), std::ios::binary | std::ios::trunc );
+
+	if( !out.is_open() ) {
+		LOG( Runtime, info ) << "Cannot write the gzip index " << util::MSubject( sidecar );
+		return false;
+	}
+
+	out.write( sidecar_magic, sizeof( sidecar_magic ) );
+	writeBin( out, sidecar_byteorder );
+	writeBin( out, size );
+	writeBin( out, mtime );
+	writeBin( out, m_length );
+	writeBin<uint32_t>( out, m_points.size() );
+
+	for( std::vector<AccessPoint>::const_iterator i = m_points.begin(); i != m_points.end(); ++i ) {
+		writeBin( out, i->out );
+		writeBin( out, i->in );
+		writeBin<int32_t>( out, i->bits );
+		out.write( reinterpret_cast<const char *>( &i->window[0] ), winsize );
+	}
+
+	out.close();
+	LOG_IF( out.fail(), Runtime, warning ) << "Failed to write the gzip index " << util::MSubject( sidecar );
+	LOG_IF( !out.fail(), Runtime, info ) << "Stored the gzip index of " << util::MSubject( m_file ) << " in " << util::MSubject( sidecar );
+	return !out.fail();
+}
+
+bool GzipIndex::load( const boost::filesystem::path &sidecar )
+{
+	std::ifstream in( sidecar.native().c_str(), std::ios::binary );
+	uint64_t size, mtime, stored_size, stored_mtime, length;
+	uint32_t order, count;
+	char magic[sizeof( sidecar_magic )];
+
+	m_valid = false;
+	m_points.clear();
+
+	if( !in.is_open() || !fileStamp( size, mtime ) )
+		return false;
+
+	if( !( in.read( magic, sizeof( magic ) ) && readBin( in, order ) && readBin( in, stored_size ) && readBin( in, stored_mtime ) && readBin( in, length ) && readBin( in, count ) ) ||
+		memcmp( magic, sidecar_magic, sizeof( magic ) ) != 0 || order != sidecar_byteorder ) {
+		LOG( Runtime, notice ) << "Ignoring unknown or foreign gzip index " << util::MSubject( sidecar );
+		return false;
+	}
+
+	if( stored_size != size || stored_mtime != mtime ) {
+		LOG( Runtime, info ) << "Ignoring outdated gzip index " << util::MSubject( sidecar );
+		return false;
+	}
+
+	m_points.resize( count );
+
+	for( std::vector<AccessPoint>::iterator i = m_points.begin(); i != m_points.end(); ++i ) {
+		int32_t bits;
+		i->window.resize( winsize );
+
+		if( !( readBin( in, i->out ) && readBin( in, i->in ) && readBin( in, bits ) && in.read( reinterpret_cast<char *>( &i->window[0] ), winsize ) ) ) {
+			LOG( Runtime, warning ) << "The gzip index " << util::MSubject( sidecar ) << " is truncated, ignoring it";
+			m_points.clear();
+			return false;
+		}
+
+		i->bits = bits;
+	}
+
+	m_length = length;
+	m_valid = !m_points.empty();
+	LOG( Debug, info ) << "Red index with " << m_points.size() << " access points for " << util::MSubject( m_file ) << " from " << util::MSubject( sidecar );
+	return m_valid;
+}
+
+}
+}
+}
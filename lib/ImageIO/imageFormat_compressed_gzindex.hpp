@@ -0,0 +1,104 @@
+#ifndef IMAGEFORMAT_COMPRESSED_GZINDEX_HPP
+#define IMAGEFORMAT_COMPRESSED_GZINDEX_HPP
+
+#include <vector>
+#include <stdint.h>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <CoreUtils/progressfeedback.hpp>
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+/**
+ * Index for random access into gzip files (the approach of zran.c from the zlib examples).
+ * While the file is inflated once, an access point is stored about every span bytes of uncompressed data.
+ * An access point holds the position in the compressed and the uncompressed data and the 32k of uncompressed data
+ * before it (the deflate window). So inflation can be started at any access point, without inflating anything before it.
+ *
+ * The index can be stored in a sidecar file next to the gzip file, it is only used as long as the gzip file does not change.
+ * The plugin for compressed data always uses an existing sidecar, and writes it when loading with the dialect "index".
+ * With a sidecar it inflates the spans in parallel, and when only the metadata of a nifti file are loaded it inflates nothing but the header.
+ * Building the index costs hardly more than inflating the file, so without a sidecar the file is inflated while the index is built.
+ * Only files consisting of one gzip member can be indexed.
+ */
+class GzipIndex
+{
+public:
+	/// function receiving the uncompressed data while the index is built
+	typedef boost::function<bool( const char *, size_t )> sink_type;
+	/// distance of the access points in the uncompressed data
+	static const size_t span = 0x400000; // 4M
+	/// size of the deflate window
+	static const size_t winsize = 0x8000; // 32k
+	/// size of the blocks red from the compressed file (progress is reported per block)
+	static const size_t chunksize = 0x40000; // 256k
+private:
+	struct AccessPoint {
+		uint64_t out; // offset in the uncompressed data
+		uint64_t in; // offset of the first complete byte in the compressed file
+		int bits; // number of bits (1-7) from the byte before "in", or 0
+		std::vector<uint8_t> window; // uncompressed data before "out"
+	};
+	boost::filesystem::path m_file;
+	std::vector<AccessPoint> m_points;
+	uint64_t m_length;
+	bool m_valid;
+	bool fileStamp( uint64_t &size, uint64_t &mtime )const;
+	void addPoint( int bits, uint64_t in, uint64_t out, size_t left, const uint8_t *window );
+public:
+	/// Create an empty index for the given gzip file.
+	GzipIndex( const boost::filesystem::path &file );
+	/// \returns the default sidecar file of the given gzip file (the filename with ".gzidx" appended)
+	static boost::filesystem::path sidecarOf( const boost::filesystem::path &file );
+	/**
+	 * Inflate the whole file and build the index.
+	 * \param sink function receiving the uncompressed data (in order), returning false stops the inflation
+	 * \param progress if not NULL, progress() will be called for every chunksize bytes of compressed data
+	 * \returns true if the whole file was inflated, false otherwise
+	 */
+	bool build( sink_type sink, util::ProgressFeedback *progress = NULL );
+	/// \returns true if the index was built or red successfully and can be used for random access
+	bool valid()const;
+	/// \returns the length of the uncompressed data
+	uint64_t getLength()const;
+	/**
+	 * Get uncompressed data from any position (requires a valid index).
+	 * Inflation starts at the last access point before offset, so at most span bytes are inflated in vain.
+	 * \param offset position in the uncompressed data
+	 * \param dst memory to store the data
+	 * \param len amount of bytes to get
+	 * \returns the amount of bytes stored in dst (less than len if the data ended before or could not be inflated)
+	 */
+	size_t extract( uint64_t offset, uint8_t *dst, size_t len )const;
+	/**
+	 * Get all uncompressed data (requires a valid index).
+	 * The spans between the access points are inflated in parallel (if omp is enabled).
+	 * \param dst memory to store the data (must be at least getLength() bytes)
+	 * \param progress if not NULL, progress() will be called for every chunksize bytes of compressed data
+	 * \returns true if all data was inflated, false otherwise
+	 */
+	bool extractAll( uint8_t *dst, util::ProgressFeedback *progress = NULL )const;
+	/**
+	 * Store the index in a sidecar file.
+	 * \returns true if the index was written, false otherwise
+	 */
+	bool save( const boost::filesystem::path &sidecar )const;
+	/**
+	 * Read the index from a sidecar file.
+	 * The index is only used if it was built from the current version of the gzip file (same size and modification time).
+	 * \returns true if the index was red and is valid, false otherwise
+	 */
+	bool load( const boost::filesystem::path &sidecar );
+};
+
+}
+}
+}
+
+#endif // IMAGEFORMAT_COMPRESSED_GZINDEX_HPP
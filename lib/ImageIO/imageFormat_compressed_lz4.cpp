@@ -0,0 +1,104 @@
+#include "imageFormat_compressed_lz4.hpp"
+#include <DataStorage/common.hpp>
+#include <CoreUtils/message.hpp>
+#include <algorithm>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif //_OPENMP
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+const size_t parallel_lz4::blocksize;
+
+lz4_decompressor::lz4_decompressor(): m_state( new State )
+{
+	LZ4F_dctx *ctx = NULL;
+
+	if( LZ4F_isError( LZ4F_createDecompressionContext( &ctx, LZ4F_VERSION ) ) )
+		throw std::ios_base::failure( "Failed to initialize lz4 decompression" );
+
+	m_state->ctx.reset( ctx, LZ4F_freeDecompressionContext );
+	m_state->buffer.resize( 0x40000 ); // 256k
+	m_state->pos = m_state->len = m_state->last = 0;
+	m_state->eof = false;
+}
+
+parallel_lz4::parallel_lz4( int level, int threads ): m_level( level ), m_threads( threads ) {}
+
+size_t parallel_lz4::blocks( size_t len ) {return len ? ( len + blocksize - 1 ) / blocksize : 1;}
+
+bool parallel_lz4::operator()( const uint8_t *data, size_t len, std::ostream &out, util::ProgressFeedback *progress )const
+{
+	const long count = blocks( len );
+	bool ok = true;
+
+	LZ4F_preferences_t prefs;
+	memset( &prefs, 0, sizeof( prefs ) );
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+	prefs.compressionLevel = m_level;
+
+#ifdef _OPENMP
+	const int workers = m_threads > 0 ? m_threads : omp_get_max_threads();
+#endif //_OPENMP
+
+#pragma omp parallel for ordered schedule(dynamic) num_threads(workers)
+	for( long i = 0; i < count; i++ ) {
+		const size_t start = i * blocksize, blen = std::min( blocksize, len - start );
+		LZ4F_preferences_t block_prefs = prefs;
+		block_prefs.frameInfo.contentSize = blen; // stored in the frame header
+
+		std::string buff( LZ4F_compressFrameBound( blen, &block_prefs ), '\0' );
+		const size_t ret = LZ4F_compressFrame( &buff[0], buff.size(), data + start, blen, &block_prefs );
+		const bool block_ok = !LZ4F_isError( ret );
+
+#pragma omp ordered
+		{
+			if( block_ok && ok ) {
+				out.write( buff.data(), ret );
+			} else {
+				LOG_IF( ok, Runtime, error ) << "lz4 failed to compress (" << LZ4F_getErrorName( ret ) << ")";
+				ok = false;
+			}
+
+			if( progress )
+				progress->progress();
+		}
+	}
+
+	return ok;
+}
+
+parallel_lz4::Stream::Stream( const parallel_lz4 &compressor ): m_compressor( compressor ), m_written( false ) {}
+
+size_t parallel_lz4::Stream::batchsize()const
+{
+#ifdef _OPENMP
+	return blocksize * ( m_compressor.m_threads > 0 ? m_compressor.m_threads : omp_get_max_threads() );
+#else
+	return blocksize;
+#endif //_OPENMP
+}
+
+bool parallel_lz4::Stream::write( const uint8_t *data, size_t len, std::ostream &out )
+{
+	m_written = true;
+	return m_compressor( data, len, out );
+}
+
+bool parallel_lz4::Stream::finish( const uint8_t *data, size_t len, std::ostream &out )
+{
+	// an empty rest is only compressed into an (empty) frame if there was no data at all
+	return ( len == 0 && m_written ) || m_compressor( data, len, out );
+}
+
+}
+}
+}
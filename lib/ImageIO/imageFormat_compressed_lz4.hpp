@@ -0,0 +1,133 @@
+#ifndef IMAGEFORMAT_COMPRESSED_LZ4_HPP
+#define IMAGEFORMAT_COMPRESSED_LZ4_HPP
+
+#include <lz4frame.h>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/read.hpp>
+#include <boost/iostreams/detail/ios.hpp>
+#include <CoreUtils/progressfeedback.hpp>
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+/**
+ * Input filter for boost::iostreams decompressing lz4 data (lz4 frame format).
+ * Concatenated lz4 frames are decompressed one after another.
+ * If the data ends within a frame, reading fails with std::ios_base::failure.
+ */
+class lz4_decompressor
+{
+	struct State {
+		boost::shared_ptr<LZ4F_dctx> ctx;
+		std::vector<char> buffer;
+		size_t pos, len;
+		size_t last; // the result of the last LZ4F_decompress which did something (0 means the frame is complete)
+		bool eof;
+	};
+	boost::shared_ptr<State> m_state; // the filter is copied when pushed into a stream, so all copies share the state
+public:
+	typedef char char_type;
+	typedef boost::iostreams::multichar_input_filter_tag category;
+
+	lz4_decompressor();
+	template<typename Source> std::streamsize read( Source &src, char *s, std::streamsize n ) {
+		State &st = *m_state;
+		std::streamsize done = 0;
+
+		while( done < n ) {
+			if( st.pos == st.len && !st.eof ) { // get more compressed data
+				const std::streamsize red = boost::iostreams::read( src, &st.buffer[0], st.buffer.size() );
+
+				if( red > 0 ) {
+					st.pos = 0;
+					st.len = red;
+				} else
+					st.eof = true;
+			}
+
+			size_t dst_size = n - done, src_size = st.len - st.pos;
+			// pos might be at the end of the buffer, so don't index it
+			const size_t ret = LZ4F_decompress( st.ctx.get(), s + done, &dst_size, &st.buffer[0] + st.pos, &src_size, NULL );
+
+			if( LZ4F_isError( ret ) )
+				throw std::ios_base::failure( std::string( "lz4 failed to decompress (" ) + LZ4F_getErrorName( ret ) + ")" );
+
+			if( src_size || dst_size ) // without any input lz4 just asks for the next frame header
+				st.last = ret;
+
+			st.pos += src_size;
+			done += dst_size;
+
+			if( st.eof && st.pos == st.len && dst_size == 0 ) { // there is nothing left
+				if( st.last != 0 )
+					throw std::ios_base::failure( "lz4 data ends within a frame (the file is truncated)" );
+
+				break;
+			}
+		}
+
+		return done ? done : -1;
+	}
+};
+
+/**
+ * Parallel lz4 compressor.
+ * The input is split into blocks which are compressed into independent lz4 frames on all available (omp) threads.
+ * The frames are concatenated, which is a valid lz4 file for any lz4 implementation.
+ * Without omp the blocks are compressed one after another.
+ */
+class parallel_lz4
+{
+	static const size_t blocksize = 0x400000; // 4M - the maximum block size of the lz4 frame format
+	int m_level, m_threads;
+public:
+	/**
+	 * \param level the compression level of lz4frame (0 is the default fast compression, 3 and above use lz4hc)
+	 * \param threads the amount of threads to compress with (0 means as many as omp offers)
+	 */
+	parallel_lz4( int level = 0, int threads = 0 );
+	static size_t blocks( size_t len );
+	/**
+	 * Compress data into a lz4 stream.
+	 * \param data the data to be compressed
+	 * \param len the length of data in bytes
+	 * \param out the stream to write the lz4 data into
+	 * \param progress if not NULL progress() is called once for every compressed block (see blocks())
+	 * \returns false if liblz4 failed to compress any block (out is incomplete then)
+	 */
+	bool operator()( const uint8_t *data, size_t len, std::ostream &out, util::ProgressFeedback *progress = NULL )const;
+	class Stream;
+};
+
+/**
+ * Compression of data which come in batches (see compressing_sink).
+ * The frames of the batches are the same as if all data were compressed at once.
+ */
+class parallel_lz4::Stream
+{
+	parallel_lz4 m_compressor;
+	bool m_written;
+public:
+	Stream( const parallel_lz4 &compressor );
+	/// \returns the size of the batches given to write()
+	size_t batchsize()const;
+	/// compress a batch of batchsize() bytes (or a multiple of that) which is not the end of the data
+	bool write( const uint8_t *data, size_t len, std::ostream &out );
+	/// compress the rest of the data (up to one batch, may be empty)
+	bool finish( const uint8_t *data, size_t len, std::ostream &out );
+};
+
+}
+}
+}
+
+#endif // IMAGEFORMAT_COMPRESSED_LZ4_HPP
@@ -0,0 +1,118 @@
+#include "imageFormat_compressed_zstd.hpp"
+#include <DataStorage/common.hpp>
+#include <CoreUtils/message.hpp>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif //_OPENMP
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+const size_t parallel_zstd::blocksize;
+
+zstd_decompressor::zstd_decompressor(): m_state( new State )
+{
+	m_state->stream.reset( ZSTD_createDStream(), ZSTD_freeDStream );
+	m_state->buffer.resize( ZSTD_DStreamInSize() );
+	m_state->in.src = NULL;
+	m_state->in.size = m_state->in.pos = 0;
+	m_state->last = 0;
+	m_state->eof = false;
+
+	if( !m_state->stream || ZSTD_isError( ZSTD_initDStream( m_state->stream.get() ) ) )
+		throw std::ios_base::failure( "Failed to initialize zstd decompression" );
+}
+
+parallel_zstd::parallel_zstd( int level, int threads ): m_level( level ), m_threads( threads ) {}
+
+size_t parallel_zstd::blocks( size_t len ) {return len ? ( len + blocksize - 1 ) / blocksize : 1;}
+
+boost::shared_ptr<ZSTD_CCtx> parallel_zstd::createContext()const
+{
+	boost::shared_ptr<ZSTD_CCtx> ctx( ZSTD_createCCtx(), ZSTD_freeCCtx );
+
+	if( !ctx )
+		return ctx;
+
+#ifdef _OPENMP
+	const int workers = m_threads > 0 ? m_threads : omp_get_max_threads();
+#else
+	const int workers = m_threads > 0 ? m_threads : boost::thread::hardware_concurrency();
+#endif //_OPENMP
+
+	if( ZSTD_isError( ZSTD_CCtx_setParameter( ctx.get(), ZSTD_c_compressionLevel, m_level ) ) )
+		return boost::shared_ptr<ZSTD_CCtx>();
+
+	if( workers > 1 && ZSTD_isError( ZSTD_CCtx_setParameter( ctx.get(), ZSTD_c_nbWorkers, workers ) ) ) {
+		LOG( Runtime, info ) << "libzstd has no thread support, compressing single threaded";
+	}
+
+	return ctx;
+}
+
+bool parallel_zstd::compressBlocks( ZSTD_CCtx *ctx, const uint8_t *data, size_t len, bool last, std::ostream &out, util::ProgressFeedback *progress )
+{
+	std::vector<char> buffer( ZSTD_CStreamOutSize() );
+	const size_t count = blocks( len );
+
+	for( size_t i = 0; i < count; i++ ) {
+		const size_t start = i * blocksize, blen = std::min( blocksize, len - start );
+		const bool end = last && ( i == count - 1 );
+		ZSTD_inBuffer in = {data + start, blen, 0};
+		size_t remaining;
+
+		// loop until the block is consumed (and for the last block, until the frame is finished)
+		do {
+			ZSTD_outBuffer obuff = {&buffer[0], buffer.size(), 0};
+			remaining = ZSTD_compressStream2( ctx, &obuff, &in, end ? ZSTD_e_end : ZSTD_e_continue );
+
+			if( ZSTD_isError( remaining ) ) {
+				LOG( Runtime, error ) << "zstd failed to compress (" << ZSTD_getErrorName( remaining ) << ")";
+				return false;
+			}
+
+			out.write( &buffer[0], obuff.pos );
+		} while( end ? remaining != 0 : in.pos < in.size );
+
+		if( progress )
+			progress->progress();
+	}
+
+	return true;
+}
+
+bool parallel_zstd::operator()( const uint8_t *data, size_t len, std::ostream &out, util::ProgressFeedback *progress )const
+{
+	const boost::shared_ptr<ZSTD_CCtx> ctx = createContext();
+
+	if( !ctx )
+		return false;
+
+	ZSTD_CCtx_setPledgedSrcSize( ctx.get(), len ); // stored in the frame header
+	return compressBlocks( ctx.get(), data, len, true, out, progress );
+}
+
+parallel_zstd::Stream::Stream( const parallel_zstd &compressor ): m_ctx( compressor.createContext() ) {}
+
+size_t parallel_zstd::Stream::batchsize()const {return blocksize;}
+
+bool parallel_zstd::Stream::write( const uint8_t *data, size_t len, std::ostream &out )
+{
+	return m_ctx && compressBlocks( m_ctx.get(), data, len, false, out, NULL );
+}
+
+bool parallel_zstd::Stream::finish( const uint8_t *data, size_t len, std::ostream &out )
+{
+	return m_ctx && compressBlocks( m_ctx.get(), data, len, true, out, NULL );
+}
+
+}
+}
+}
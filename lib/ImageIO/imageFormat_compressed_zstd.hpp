@@ -0,0 +1,133 @@
+#ifndef IMAGEFORMAT_COMPRESSED_ZSTD_HPP
+#define IMAGEFORMAT_COMPRESSED_ZSTD_HPP
+
+#include <zstd.h>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/read.hpp>
+#include <boost/iostreams/detail/ios.hpp>
+#include <CoreUtils/progressfeedback.hpp>
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+/**
+ * Input filter for boost::iostreams decompressing zstd data.
+ * Concatenated zstd frames are decompressed one after another.
+ * If the data ends within a frame, reading fails with std::ios_base::failure.
+ */
+class zstd_decompressor
+{
+	struct State {
+		boost::shared_ptr<ZSTD_DStream> stream;
+		std::vector<char> buffer;
+		ZSTD_inBuffer in;
+		size_t last; // the result of the last ZSTD_decompressStream which did something (0 means the frame is complete)
+		bool eof;
+	};
+	boost::shared_ptr<State> m_state; // the filter is copied when pushed into a stream, so all copies share the state
+public:
+	typedef char char_type;
+	typedef boost::iostreams::multichar_input_filter_tag category;
+
+	zstd_decompressor();
+	template<typename Source> std::streamsize read( Source &src, char *s, std::streamsize n ) {
+		State &st = *m_state;
+		ZSTD_outBuffer out = {s, static_cast<size_t>( n ), 0};
+
+		while( out.pos < out.size ) {
+			if( st.in.pos == st.in.size && !st.eof ) { // get more compressed data
+				const std::streamsize red = boost::iostreams::read( src, &st.buffer[0], st.buffer.size() );
+
+				if( red > 0 ) {
+					st.in.src = &st.buffer[0];
+					st.in.size = red;
+					st.in.pos = 0;
+				} else
+					st.eof = true;
+			}
+
+			const size_t before = out.pos, in_before = st.in.pos;
+			const size_t ret = ZSTD_decompressStream( st.stream.get(), &out, &st.in );
+
+			if( ZSTD_isError( ret ) )
+				throw std::ios_base::failure( std::string( "zstd failed to decompress (" ) + ZSTD_getErrorName( ret ) + ")" );
+
+			if( out.pos != before || st.in.pos != in_before ) // without any input zstd just asks for the next frame header
+				st.last = ret;
+
+			if( st.eof && st.in.pos == st.in.size && out.pos == before ) { // there is nothing left
+				if( st.last != 0 )
+					throw std::ios_base::failure( "zstd data ends within a frame (the file is truncated)" );
+
+				break;
+			}
+		}
+
+		return out.pos ? out.pos : -1;
+	}
+};
+
+/**
+ * Multithreaded zstd compressor.
+ * The data is compressed into one zstd frame by the worker threads of libzstd.
+ * The amount of workers is given, or the amount of omp threads if omp is enabled, and the amount of cores otherwise.
+ * If libzstd was built without thread support, the data is compressed in the calling thread.
+ */
+class parallel_zstd
+{
+	static const size_t blocksize = 0x400000; // 4M - the data is passed to libzstd in blocks of this size
+	int m_level, m_threads;
+	/// \returns a compression context set up for the level and the amount of workers (empty if libzstd failed)
+	boost::shared_ptr<ZSTD_CCtx> createContext()const;
+	/// pass data to libzstd block by block, if last is true the frame is finished
+	static bool compressBlocks( ZSTD_CCtx *ctx, const uint8_t *data, size_t len, bool last, std::ostream &out, util::ProgressFeedback *progress );
+public:
+	/**
+	 * \param level the zstd compression level
+	 * \param threads the amount of workers of libzstd (0 means the amount of omp threads or cores)
+	 */
+	parallel_zstd( int level = ZSTD_CLEVEL_DEFAULT, int threads = 0 );
+	static size_t blocks( size_t len );
+	/**
+	 * Compress data into a zstd stream.
+	 * \param data the data to be compressed
+	 * \param len the length of data in bytes
+	 * \param out the stream to write the zstd data into
+	 * \param progress if not NULL progress() is called once for every block passed to libzstd (see blocks())
+	 * \returns false if libzstd failed to compress (out is incomplete then)
+	 */
+	bool operator()( const uint8_t *data, size_t len, std::ostream &out, util::ProgressFeedback *progress = NULL )const;
+	class Stream;
+};
+
+/**
+ * Compression of data which come in batches (see compressing_sink).
+ * All batches go into one zstd frame (without the content size in its header).
+ */
+class parallel_zstd::Stream
+{
+	boost::shared_ptr<ZSTD_CCtx> m_ctx;
+public:
+	Stream( const parallel_zstd &compressor );
+	/// \returns the size of the batches given to write()
+	size_t batchsize()const;
+	/// compress a batch of batchsize() bytes (or a multiple of that) which is not the end of the data
+	bool write( const uint8_t *data, size_t len, std::ostream &out );
+	/// compress the rest of the data (up to one batch, may be empty) and finish the frame
+	bool finish( const uint8_t *data, size_t len, std::ostream &out );
+};
+
+}
+}
+}
+
+#endif // IMAGEFORMAT_COMPRESSED_ZSTD_HPP
@@ -32,7 +32,7 @@ public:
 	}
 	std::string getName()const {return "filelist proxy (gets filenames from files or stdin)";}
 
-	size_t doLoad( std::istream &in, std::list<data::Chunk> &chunks, const util::istring &dialect ) {
+	size_t doLoad( std::istream &in, std::list<data::Chunk> &chunks, const util::istring &dialect, bool metadata_only ) {
 		size_t red = 0;
 		const boost::regex linebreak( "[[.newline.][.carriage-return.]]" );
 		std::string fnames;
@@ -42,7 +42,7 @@ public:
 			in >> fnames ;
 			BOOST_FOREACH( const std::string fname, util::stringToList<std::string>( fnames, linebreak ) ) {
 				LOG( Runtime, info ) << "loading " << fname;
-				red += data::IOFactory::load( chunks, fname, "", dialect );
+				red += data::IOFactory::load( chunks, fname, "", dialect, metadata_only );
 				fcnt++;
 			}
 		}
@@ -52,15 +52,18 @@ public:
 		return red;
 	}
 
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ ) throw( std::runtime_error & ) {
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress ) throw( std::runtime_error & ) {
+		return load( chunks, filename, dialect, progress, false );
+	}
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/, bool metadata_only ) throw( std::runtime_error & ) {
 		if( filename.empty() ) {
 			LOG( Runtime, info ) << "getting filelist from stdin";
-			return doLoad( std::cin, chunks, dialect );
+			return doLoad( std::cin, chunks, dialect, metadata_only );
 		} else {
 			LOG( Runtime, info ) << "getting filelist from " << filename;
 			std::ifstream in( filename.c_str() );
 			in.exceptions( std::ios::badbit );
-			return doLoad( in, chunks, dialect );
+			return doLoad( in, chunks, dialect, metadata_only );
 		}
 	}
 
@@ -0,0 +1,253 @@
+#include "imageFormat_nifti_kernels.hpp"
+#include <CoreUtils/color.hpp>
+#include <CoreUtils/vector.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/detail/endian.hpp>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif //__SSE2__
+
+// the SSSE3 kernels are compiled with a target attribute and selected at runtime, so the build does not need -mssse3
+#if defined( __SSE2__ ) && defined( __GNUC__ )
+#define ISIS_NIFTI_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+// the kernels are used on color24 and fvector3, so they must be plain triplets
+BOOST_STATIC_ASSERT( sizeof( util::color24 ) == 3 && sizeof( util::fvector3 ) == 3 * sizeof( float ) );
+
+#ifdef ISIS_NIFTI_SSSE3
+// shuffle masks for pshufb to move the bytes of 16 interleaved triplets (3 registers) from/to 3 planes
+struct _ShuffleMasks {
+	int8_t deinterleave[3][3][16]; // [plane][source register]
+	int8_t interleave[3][3][16]; // [destination register][plane]
+	_ShuffleMasks() {
+		for( int k = 0; k < 3; k++ )
+			for( int p = 0; p < 3; p++ )
+				for( int i = 0; i < 16; i++ ) {
+					const int src = i * 3 + p - 16 * k; // position of element i of plane p in register k
+					const int dst = 16 * k + i; // position of byte i of register k in the interleaved data
+					deinterleave[p][k][i] = ( src >= 0 && src < 16 ) ? src : -1; // -1 (highest bit set) makes pshufb write a 0
+					interleave[k][p][i] = ( dst % 3 == p ) ? dst / 3 : -1;
+				}
+	}
+} static const shuffle_masks;
+
+static inline __m128i mask( const int8_t( &bytes )[16] ) {return _mm_loadu_si128( reinterpret_cast<const __m128i *>( bytes ) );}
+
+__attribute__( ( target( "ssse3" ) ) )
+static void interleave3SSSE3( const uint8_t *plane0, const uint8_t *plane1, const uint8_t *plane2, uint8_t *dst, size_t len )
+{
+	const size_t blocks = len / 16;
+
+	for( size_t b = 0; b < blocks; b++, dst += 48 ) {
+		const __m128i p[3] = {
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( plane0 + b * 16 ) ),
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( plane1 + b * 16 ) ),
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( plane2 + b * 16 ) )
+		};
+
+		for( int k = 0; k < 3; k++ ) {
+			const __m128i out =
+				_mm_or_si128( _mm_or_si128(
+								  _mm_shuffle_epi8( p[0], mask( shuffle_masks.interleave[k][0] ) ),
+								  _mm_shuffle_epi8( p[1], mask( shuffle_masks.interleave[k][1] ) ) ),
+							  _mm_shuffle_epi8( p[2], mask( shuffle_masks.interleave[k][2] ) ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dst ) + k, out );
+		}
+	}
+
+	const size_t done = blocks * 16; // do the rest the generic way
+	interleave3Scalar( plane0 + done, plane1 + done, plane2 + done, dst, len - done );
+}
+__attribute__( ( target( "ssse3" ) ) )
+static void deinterleave3SSSE3( const uint8_t *src, uint8_t *plane0, uint8_t *plane1, uint8_t *plane2, size_t len )
+{
+	const size_t blocks = len / 16;
+	uint8_t *const planes[3] = {plane0, plane1, plane2};
+
+	for( size_t b = 0; b < blocks; b++, src += 48 ) {
+		const __m128i in[3] = {
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( src ) ),
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( src ) + 1 ),
+			_mm_loadu_si128( reinterpret_cast<const __m128i *>( src ) + 2 )
+		};
+
+		for( int p = 0; p < 3; p++ ) {
+			const __m128i out =
+				_mm_or_si128( _mm_or_si128(
+								  _mm_shuffle_epi8( in[0], mask( shuffle_masks.deinterleave[p][0] ) ),
+								  _mm_shuffle_epi8( in[1], mask( shuffle_masks.deinterleave[p][1] ) ) ),
+							  _mm_shuffle_epi8( in[2], mask( shuffle_masks.deinterleave[p][2] ) ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( planes[p] + b * 16 ), out );
+		}
+	}
+
+	const size_t done = blocks * 16;
+	deinterleave3Scalar( src, plane0 + done, plane1 + done, plane2 + done, len - done );
+}
+
+bool hasSSSE3()
+{
+	static const bool has = __builtin_cpu_supports( "ssse3" );
+	return has;
+}
+#else
+bool hasSSSE3() {return false;}
+#endif //ISIS_NIFTI_SSSE3
+
+template<> void interleave3<uint8_t>( const uint8_t *plane0, const uint8_t *plane1, const uint8_t *plane2, uint8_t *dst, size_t len )
+{
+#ifdef ISIS_NIFTI_SSSE3
+
+	if( hasSSSE3() ) {
+		interleave3SSSE3( plane0, plane1, plane2, dst, len );
+		return;
+	}
+
+#endif //ISIS_NIFTI_SSSE3
+	interleave3Scalar( plane0, plane1, plane2, dst, len );
+}
+template<> void deinterleave3<uint8_t>( const uint8_t *src, uint8_t *plane0, uint8_t *plane1, uint8_t *plane2, size_t len )
+{
+#ifdef ISIS_NIFTI_SSSE3
+
+	if( hasSSSE3() ) {
+		deinterleave3SSSE3( src, plane0, plane1, plane2, len );
+		return;
+	}
+
+#endif //ISIS_NIFTI_SSSE3
+	deinterleave3Scalar( src, plane0, plane1, plane2, len );
+}
+
+// 4 float-triplets fit into 3 registers, so they can be (de)interleaved with shufps
+template<> void interleave3<float>( const float *plane0, const float *plane1, const float *plane2, float *dst, size_t len )
+{
+#ifdef __SSE2__
+	const size_t blocks = len / 4;
+
+	for( size_t b = 0; b < blocks; b++, dst += 12 ) {
+		const __m128 x = _mm_loadu_ps( plane0 + b * 4 ), y = _mm_loadu_ps( plane1 + b * 4 ), z = _mm_loadu_ps( plane2 + b * 4 );
+		const __m128 xy_lo = _mm_unpacklo_ps( x, y ), xy_hi = _mm_unpackhi_ps( x, y ); // x0 y0 x1 y1 / x2 y2 x3 y3
+		const __m128 z0x1 = _mm_shuffle_ps( z, x, _MM_SHUFFLE( 1, 1, 0, 0 ) ); // z0 z0 x1 x1
+		const __m128 y1z1 = _mm_shuffle_ps( xy_lo, z, _MM_SHUFFLE( 1, 1, 3, 3 ) ); // y1 y1 z1 z1
+		const __m128 z2x3 = _mm_shuffle_ps( z, xy_hi, _MM_SHUFFLE( 2, 2, 2, 2 ) ); // z2 z2 x3 x3
+		const __m128 y3z3 = _mm_shuffle_ps( xy_hi, z, _MM_SHUFFLE( 3, 3, 3, 3 ) ); // y3 y3 z3 z3
+
+		_mm_storeu_ps( dst, _mm_shuffle_ps( xy_lo, z0x1, _MM_SHUFFLE( 2, 1, 1, 0 ) ) ); // x0 y0 z0 x1
+		_mm_storeu_ps( dst + 4, _mm_shuffle_ps( y1z1, xy_hi, _MM_SHUFFLE( 1, 0, 2, 0 ) ) ); // y1 z1 x2 y2
+		_mm_storeu_ps( dst + 8, _mm_shuffle_ps( z2x3, y3z3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) ); // z2 x3 y3 z3
+	}
+
+	const size_t done = blocks * 4;
+	interleave3Scalar( plane0 + done, plane1 + done, plane2 + done, dst, len - done );
+#else
+	interleave3Scalar( plane0, plane1, plane2, dst, len );
+#endif //__SSE2__
+}
+template<> void deinterleave3<float>( const float *src, float *plane0, float *plane1, float *plane2, size_t len )
+{
+#ifdef __SSE2__
+	const size_t blocks = len / 4;
+
+	for( size_t b = 0; b < blocks; b++, src += 12 ) {
+		const __m128 a = _mm_loadu_ps( src ), b_ = _mm_loadu_ps( src + 4 ), c = _mm_loadu_ps( src + 8 ); // x0 y0 z0 x1 / y1 z1 x2 y2 / z2 x3 y3 z3
+		const __m128 xy = _mm_shuffle_ps( b_, c, _MM_SHUFFLE( 2, 1, 3, 2 ) ); // x2 y2 x3 y3
+		const __m128 yz = _mm_shuffle_ps( a, b_, _MM_SHUFFLE( 1, 0, 2, 1 ) ); // y0 z0 y1 z1
+
+		_mm_storeu_ps( plane0 + b * 4, _mm_shuffle_ps( a, xy, _MM_SHUFFLE( 2, 0, 3, 0 ) ) ); // x0 x1 x2 x3
+		_mm_storeu_ps( plane1 + b * 4, _mm_shuffle_ps( yz, xy, _MM_SHUFFLE( 3, 1, 2, 0 ) ) ); // y0 y1 y2 y3
+		_mm_storeu_ps( plane2 + b * 4, _mm_shuffle_ps( yz, c, _MM_SHUFFLE( 3, 0, 3, 1 ) ) ); // z0 z1 z2 z3
+	}
+
+	const size_t done = blocks * 4;
+	deinterleave3Scalar( src, plane0 + done, plane1 + done, plane2 + done, len - done );
+#else
+	deinterleave3Scalar( src, plane0, plane1, plane2, len );
+#endif //__SSE2__
+}
+
+BOOST_STATIC_ASSERT( sizeof( bool ) == 1 );
+
+// the 8 bools for every possible byte
+struct _BitLUT {
+	uint8_t bools[256][8];
+	_BitLUT() {
+		for( int byte = 0; byte < 256; byte++ )
+			for( int bit = 0; bit < 8; bit++ )
+				bools[byte][bit] = ( byte >> ( 7 - bit ) ) & 1;
+	}
+} static const bit_lut;
+
+void packBits( const bool *src, uint8_t *dst, size_t len )
+{
+	const size_t bytes = len / 8;
+
+	for( size_t b = 0; b < bytes; b++, src += 8 ) {
+#if BOOST_BYTE_ORDER == 1234
+		uint64_t word;
+		memcpy( &word, src, 8 );
+		// every byte of word is 0 or 1, the multiplication moves bit 0 of byte j to bit 63-j (without any carries)
+		dst[b] = ( word * 0x8040201008040201ULL ) >> 56;
+#else
+		dst[b] = src[0] << 7 | src[1] << 6 | src[2] << 5 | src[3] << 4 | src[4] << 3 | src[5] << 2 | src[6] << 1 | src[7];
+#endif
+	}
+
+	if( len % 8 ) { // the last byte is only partly used, the rest is 0
+		dst[bytes] = 0;
+
+		for( size_t i = 0; i < len % 8; i++ )
+			dst[bytes] |= src[i] << ( 7 - i );
+	}
+}
+
+void packBits( const bool *src, uint8_t *dst, size_t len, unsigned int first_bit )
+{
+	if( first_bit ) { // fill up the first byte
+		const size_t head = std::min<size_t>( len, 8 - first_bit );
+
+		for( size_t i = 0; i < head; i++ ) {
+			const uint8_t mask = 0x80 >> ( first_bit + i );
+			dst[0] = ( dst[0] & ~mask ) | ( src[i] ? mask : 0 );
+		}
+
+		src += head;
+		len -= head;
+		dst++;
+	}
+
+	const size_t bytes = len / 8;
+	packBits( src, dst, bytes * 8 );
+
+	for( size_t i = 0; i < len % 8; i++ ) { // the rest goes into the last byte, keeping its other bits
+		const uint8_t mask = 0x80 >> i;
+		dst[bytes] = ( dst[bytes] & ~mask ) | ( src[bytes * 8 + i] ? mask : 0 );
+	}
+}
+
+void unpackBits( const uint8_t *src, bool *dst, size_t len )
+{
+	const size_t bytes = len / 8;
+
+	for( size_t b = 0; b < bytes; b++, dst += 8 )
+		memcpy( dst, bit_lut.bools[src[b]], 8 );
+
+	if( len % 8 )
+		memcpy( dst, bit_lut.bools[src[bytes]], len % 8 );
+}
+
+}
+}
+}
@@ -0,0 +1,72 @@
+#ifndef IMAGEFORMAT_NIFTI_KERNELS_HPP
+#define IMAGEFORMAT_NIFTI_KERNELS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace isis
+{
+namespace image_io
+{
+namespace _internal
+{
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// (de)interleaving of three planes (fsl stores color and vector images as 3 volumes)
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// plain loop interleaving three planes (used for the generic versions and for the rest which does not fill a whole register)
+template<typename T> void interleave3Scalar( const T *plane0, const T *plane1, const T *plane2, T *dst, size_t len )
+{
+	for( size_t i = 0; i < len; i++, dst += 3 ) {
+		dst[0] = plane0[i];
+		dst[1] = plane1[i];
+		dst[2] = plane2[i];
+	}
+}
+/// plain loop splitting triplets into three planes (used for the generic versions and for the rest which does not fill a whole register)
+template<typename T> void deinterleave3Scalar( const T *src, T *plane0, T *plane1, T *plane2, size_t len )
+{
+	for( size_t i = 0; i < len; i++, src += 3 ) {
+		plane0[i] = src[0];
+		plane1[i] = src[1];
+		plane2[i] = src[2];
+	}
+}
+
+/// interleave three planes of len elements into dst (dst[i*3+p]=plane_p[i])
+template<typename T> void interleave3( const T *plane0, const T *plane1, const T *plane2, T *dst, size_t len )
+{
+	interleave3Scalar( plane0, plane1, plane2, dst, len );
+}
+/// split len interleaved triplets from src into three planes (plane_p[i]=src[i*3+p])
+template<typename T> void deinterleave3( const T *src, T *plane0, T *plane1, T *plane2, size_t len )
+{
+	deinterleave3Scalar( src, plane0, plane1, plane2, len );
+}
+
+// bytes (color24) use pshufb if the cpu has SSSE3 (checked at runtime), floats (fvector3) use SSE2 if the build targets it
+template<> void interleave3<uint8_t>( const uint8_t *plane0, const uint8_t *plane1, const uint8_t *plane2, uint8_t *dst, size_t len );
+template<> void deinterleave3<uint8_t>( const uint8_t *src, uint8_t *plane0, uint8_t *plane1, uint8_t *plane2, size_t len );
+template<> void interleave3<float>( const float *plane0, const float *plane1, const float *plane2, float *dst, size_t len );
+template<> void deinterleave3<float>( const float *src, float *plane0, float *plane1, float *plane2, size_t len );
+
+/// \returns true if interleave3<uint8_t> and deinterleave3<uint8_t> use the SSSE3 kernels on this cpu
+bool hasSSSE3();
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// bit (un)packing for NIFTI_TYPE_BINARY (the first voxel is the highest bit of the first byte)
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// pack len bools (0 or 1) into (len+7)/8 bytes, the unused bits of the last byte are 0
+void packBits( const bool *src, uint8_t *dst, size_t len );
+/// pack len bools (0 or 1) starting at bit first_bit (0-7, counted from the highest) of dst, the other bits of the first and the last byte are kept
+void packBits( const bool *src, uint8_t *dst, size_t len, unsigned int first_bit );
+/// unpack len bools from (len+7)/8 bytes
+void unpackBits( const uint8_t *src, bool *dst, size_t len );
+
+}
+}
+}
+
+#endif // IMAGEFORMAT_NIFTI_KERNELS_HPP
@@ -24,6 +24,7 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/phoenix.hpp>
+#include <memory>
 #include "imageFormat_nifti_parser.hpp"
 
 namespace isis
@@ -76,26 +77,65 @@ struct flattener { // simply insert subarrays into the array above
 
 template<typename T> struct read {typedef qi::rule<ch_iterator, T(), SKIP_TYPE> rule;};
 
-bool parse_json( isis::data::ValueArray< uint8_t > stream, isis::util::PropertyMap &json_map, char extra_token )
-{
-	using qi::lit;
-	using namespace boost::spirit;
-
-	int version;
+/**
+ * Grammar for the json objects of DcmMeta.
+ * Constructing the rules is expensive, but they don't change while parsing. So a grammar can be built once and
+ * then be used by parallel calls of parse_json.
+ */
+struct json_grammar: qi::grammar<ch_iterator, util::PropertyMap(), SKIP_TYPE> {
 	read<value_cont>::rule value;
-	read<std::string>::rule string( lexeme['"' >> *( ascii::print - '"' ) >> '"'], "string" ), label( string >> ':', "label" );
-	read<fusion::vector2<std::string, value_cont> >::rule member( label >> value, "member" );
-	read<isis::util::PropertyMap>::rule object( lit( '{' ) >> member[add_member( extra_token )] % ',' >> '}', "object" );
-	read<int>::rule integer(int_ >> !lit('.'),"integer") ;
-	read<util::dlist>::rule dlist( lit( '[' ) >> ( ( double_[phoenix::push_back( _val, _1 )] | dlist[flattener()] ) % ',' ) >> ']', "dlist" );
-	read<util::ilist>::rule ilist( lit( '[' ) >> ( ( integer[phoenix::push_back( _val, _1 )] | ilist[flattener()] ) % ',' ) >> ']', "ilist" );
-	read<util::slist>::rule slist( lit( '[' ) >> ( ( string [phoenix::push_back( _val, _1 )] | slist[flattener()] ) % ',' ) >> ']', "slist" );
+	read<std::string>::rule string, label;
+	read<fusion::vector2<std::string, value_cont> >::rule member;
+	read<isis::util::PropertyMap>::rule object;
+	read<int>::rule integer;
+	read<util::dlist>::rule dlist;
+	read<util::ilist>::rule ilist;
+	read<util::slist>::rule slist;
+
+	json_grammar( char extra_token ): json_grammar::base_type( object, "json" ) {
+		using qi::lit;
+		using namespace boost::spirit;
+
+		string = lexeme['"' >> *( ascii::print - '"' ) >> '"'];
+		label = string >> ':';
+		member = label >> value;
+		object = lit( '{' ) >> member[add_member( extra_token )] % ',' >> '}';
+		integer = int_ >> !lit( '.' );
+		dlist = lit( '[' ) >> ( ( double_[phoenix::push_back( _val, _1 )] | dlist[flattener()] ) % ',' ) >> ']';
+		ilist = lit( '[' ) >> ( ( integer[phoenix::push_back( _val, _1 )] | ilist[flattener()] ) % ',' ) >> ']';
+		slist = lit( '[' ) >> ( ( string [phoenix::push_back( _val, _1 )] | slist[flattener()] ) % ',' ) >> ']';
+
+		value = string | integer | double_ | slist | ilist | dlist |  object;
+
+		string.name( "string" );
+		label.name( "label" );
+		member.name( "member" );
+		object.name( "object" );
+		integer.name( "integer" );
+		dlist.name( "dlist" );
+		ilist.name( "ilist" );
+		slist.name( "slist" );
+	}
+};
 
-	value = string | integer | double_ | slist | ilist | dlist |  object;
+// the grammars for the usual separators are built when the plugin is loaded
+const json_grammar json_plain( 0 ), json_dotted( '.' );
+
+bool parse_json( isis::data::ValueArray< uint8_t > stream, isis::util::PropertyMap &json_map, char extra_token )
+{
+	std::auto_ptr<json_grammar> own;
+	const json_grammar *grammar = &json_plain;
+
+	if( extra_token == '.' ) {
+		grammar = &json_dotted;
+	} else if( extra_token != 0 ) {
+		own.reset( new json_grammar( extra_token ) );
+		grammar = own.get();
+	}
 
 	data::ValueArray< uint8_t >::iterator begin = stream.begin(), end = stream.end();
-	bool erg = phrase_parse( begin, end, object[phoenix::ref( json_map )=_1], ascii::space | '\t' | eol );
-	return end == stream.end();
+	qi::phrase_parse( begin, end, *grammar, ascii::space | '\t' | boost::spirit::eol, json_map );
+	return begin == stream.end();
 }
 
 }
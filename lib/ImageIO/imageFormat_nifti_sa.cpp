@@ -7,8 +7,19 @@
 #include <boost/property_tree/json_parser.hpp>
 #include "imageFormat_nifti_sa.hpp"
 #include "imageFormat_nifti_parser.hpp"
+#include "imageFormat_nifti_kernels.hpp"
 #include <errno.h>
 #include <fstream>
+#include <boost/lexical_cast.hpp>
+#include <boost/static_assert.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif //__linux__
 
 
 namespace isis
@@ -18,7 +29,136 @@ namespace image_io
 
 namespace _internal
 {
-WriteOp::WriteOp( const data::Image &image, size_t bitsPerVoxel ): data::_internal::NDimensional<4>( image ), m_bpv( bitsPerVoxel ) {}
+BOOST_STATIC_ASSERT( sizeof( nifti_1_header ) == 348 && sizeof( nifti_2_header ) == 540 );
+
+#define COPY(FIELD) dst.FIELD=src.FIELD
+#define COPYA(FIELD,SIZE) std::copy(src.FIELD,src.FIELD+SIZE,dst.FIELD)
+
+void nifti1to2( const nifti_1_header &src, nifti_2_header &dst )
+{
+	memset( &dst, 0, sizeof( nifti_2_header ) );
+	memcpy( dst.magic, src.magic, 4 );
+
+	COPY( sizeof_hdr );
+	COPY( datatype );
+	COPY( bitpix );
+	COPYA( dim, 8 );
+	COPY( intent_p1 );
+	COPY( intent_p2 );
+	COPY( intent_p3 );
+	COPYA( pixdim, 8 );
+	COPY( vox_offset );
+	COPY( scl_slope );
+	COPY( scl_inter );
+	COPY( cal_max );
+	COPY( cal_min );
+	COPY( slice_duration );
+	COPY( toffset );
+	COPY( slice_start );
+	COPY( slice_end );
+	COPYA( descrip, 80 );
+	COPYA( aux_file, 24 );
+	COPY( qform_code );
+	COPY( sform_code );
+	COPY( quatern_b );
+	COPY( quatern_c );
+	COPY( quatern_d );
+	COPY( qoffset_x );
+	COPY( qoffset_y );
+	COPY( qoffset_z );
+	COPYA( srow_x, 4 );
+	COPYA( srow_y, 4 );
+	COPYA( srow_z, 4 );
+	COPY( slice_code );
+	COPY( xyzt_units );
+	COPY( intent_code );
+	COPYA( intent_name, 16 );
+	COPY( dim_info );
+}
+
+bool nifti2to1( const nifti_2_header &src, nifti_1_header &dst )
+{
+	for( int i = 0; i < 8; i++ )
+		if( src.dim[i] > std::numeric_limits<short>::max() || src.dim[i] < std::numeric_limits<short>::min() )
+			return false;
+
+	if( src.vox_offset > ( 1 << 24 ) ) // float can hold every integer up to 2^24
+		return false;
+
+	memset( &dst, 0, sizeof( nifti_1_header ) );
+	dst.sizeof_hdr = 348;
+	memcpy( dst.magic, "n+1", 4 );
+
+	COPY( datatype );
+	COPY( bitpix );
+	COPYA( dim, 8 );
+	COPY( intent_p1 );
+	COPY( intent_p2 );
+	COPY( intent_p3 );
+	COPYA( pixdim, 8 );
+	COPY( vox_offset );
+	COPY( scl_slope );
+	COPY( scl_inter );
+	COPY( cal_max );
+	COPY( cal_min );
+	COPY( slice_duration );
+	COPY( toffset );
+	COPY( slice_start );
+	COPY( slice_end );
+	COPYA( descrip, 80 );
+	COPYA( aux_file, 24 );
+	COPY( qform_code );
+	COPY( sform_code );
+	COPY( quatern_b );
+	COPY( quatern_c );
+	COPY( quatern_d );
+	COPY( qoffset_x );
+	COPY( qoffset_y );
+	COPY( qoffset_z );
+	COPYA( srow_x, 4 );
+	COPYA( srow_y, 4 );
+	COPYA( srow_z, 4 );
+	COPY( slice_code );
+	COPY( xyzt_units );
+	COPY( intent_code );
+	COPYA( intent_name, 16 );
+	COPY( dim_info );
+	return true;
+}
+#undef COPY
+#undef COPYA
+
+WriteOp::WriteOp( const data::Image &image, size_t bitsPerVoxel ): data::_internal::NDimensional<4>( image ), m_fd( -1 ), m_stream( NULL ), m_stream_pos( 0 ), m_nifti2( false ), m_bpv( bitsPerVoxel ) {}
+
+WriteOp::~WriteOp()
+{
+	if( m_fd != -1 )
+		close( m_fd );
+}
+
+bool WriteOp::usePwrite( const std::string &filename )
+{
+#ifdef __linux__
+	// the file might not exist yet, so ask for the filesystem of its directory
+	const boost::filesystem::path dir = boost::filesystem::path( filename ).parent_path();
+	struct statfs fs;
+
+	if( statfs( dir.empty() ? "." : dir.native().c_str(), &fs ) == 0 ) {
+		switch( static_cast<uint32_t>( fs.f_type ) ) {
+		case 0x6969: // NFS
+		case 0x517B: // SMB
+		case 0xFF534D42: // CIFS
+		case 0xFE534D42: // SMB2
+		case 0x0BD00BD0: // Lustre
+		case 0x47504653: // GPFS
+			LOG( Debug, info ) << "Writing " << filename << " with pwrite, because it is on a network filesystem";
+			return true;
+		}
+	}
+
+#endif //__linux__
+	return false;
+}
 
 void WriteOp::addFlip( data::dimensions dim ) {flip_list.insert( dim );}
 
@@ -32,33 +172,174 @@ size_t WriteOp::getDataSize()
 	return bitsize / 8;
 }
 
-bool WriteOp::setOutput( const std::string &filename, size_t voxelstart )
+void WriteOp::setupHeader( const std::string &filename )
 {
-	m_out = data::FilePtr( filename, voxelstart + getDataSize(), true );
-	m_voxelstart = voxelstart;
+	m_nifti2 = false;
 
-	if( m_out.good() ) {
-		nifti_1_header *header = getHeader();
-		memset( header, 0, sizeof( _internal::nifti_1_header ) );
-
-		// store the image size in dim and fill up the rest with "1" (to prevent fsl from exploding)
-		header->dim[0] = getRelevantDims();
-		getSizeAsVector().copyTo( header->dim + 1 );
-		std::fill( header->dim + 5, header->dim + 8, 1 );
-
-		//some nifti readers expect analyze fields, but for now we disable this
-		/*header->extents=16*1024;
-		header->regular='r';
-		memcpy(header->data_type,"dsr        ",10);*/
-		header->sizeof_hdr = 348; // must be 348
-		header->vox_offset = m_voxelstart;
-		header->bitpix = m_bpv;
-		return m_out.good();
+	for( int i = 0; i < 4; i++ ) {
+		if( getSizeAsVector()[i] > ( size_t )std::numeric_limits<short>::max() ) { // dim of nifti-1 is short, use nifti-2 if the image is larger
+			LOG( Runtime, info ) << "Writing " << filename << " as nifti-2, because the image size " << getSizeAsString() << " does not fit into nifti-1";
+			m_nifti2 = true;
+		}
+	}
+
+	// vox_offset must be >=352 for nifti-1 / >=544 for nifti-2 (and multiple of 16)  (http://nifti.nimh.nih.gov/nifti-1/documentation/nifti1fields/nifti1fields_pages/vox_offset.html)
+	m_voxelstart = m_nifti2 ? 544 : 352;
+	memset( &m_header, 0, sizeof( _internal::nifti_2_header ) );
+
+	// store the image size in dim and fill up the rest with "1" (to prevent fsl from exploding)
+	m_header.dim[0] = getRelevantDims();
+	getSizeAsVector().copyTo( m_header.dim + 1 );
+	std::fill( m_header.dim + 5, m_header.dim + 8, 1 );
+
+	//some nifti readers expect analyze fields, but for now we disable this
+	/*header->extents=16*1024;
+	header->regular='r';
+	memcpy(header->data_type,"dsr        ",10);*/
+	m_header.vox_offset = m_voxelstart;
+	m_header.bitpix = m_bpv;
+}
+
+bool WriteOp::setOutput( const std::string &filename, bool pwrite_output )
+{
+	setupHeader( filename );
+
+	if( pwrite_output || usePwrite( filename ) ) {
+		m_fd = open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666 );
+
+		if( m_fd == -1 || ftruncate( m_fd, m_voxelstart + getDataSize() ) != 0 )
+			return false;
+
+		m_head.assign( m_voxelstart, 0 );
+	} else {
+		m_out = data::FilePtr( filename, m_voxelstart + getDataSize(), true );
+	}
+
+	return m_fd != -1 || m_out.good();
+}
+
+void WriteOp::setOutput( std::ostream &out, const std::string &filename )
+{
+	setupHeader( filename );
+	m_stream = &out;
+	m_stream_pos = 0;
+	m_head.assign( m_voxelstart, 0 );
+}
+
+bool WriteOp::writeHeader()
+{
+	bool ok = true;
+	uint8_t *const head = m_out.good() ? &m_out[0] : &m_head[0];
+
+	if( m_nifti2 ) {
+		m_header.sizeof_hdr = 540; // must be 540
+		memcpy( m_header.magic, "n+2\0\r\n\032\n", 8 );
+		memcpy( head, &m_header, sizeof( nifti_2_header ) );
+	} else {
+		nifti_1_header header1;
+		ok = nifti2to1( m_header, header1 ); // setOutput made sure it fits
+		memcpy( head, &header1, sizeof( nifti_1_header ) );
+	}
+
+	if( !m_out.good() ) // the header is in m_head and has to be written
+		ok &= putOutput( data::ValueArray<uint8_t>( &m_head[0], m_head.size(), data::ValueArray<uint8_t>::NonDeleter() ), 0 );
+
+	return ok;
+}
+
+bool WriteOp::closeOutput()
+{
+	if( m_stream ) {
+		LOG_IF( m_stream_pos != m_voxelstart + getDataSize(), Runtime, error )
+				<< "Only " << m_stream_pos << " of " << m_voxelstart + getDataSize() << " bytes were written into the stream";
+		return m_stream_pos == m_voxelstart + getDataSize();
+	}
+
+	bool ok = writeHeader();
+
+	if( m_fd != -1 ) {
+		ok &= ( close( m_fd ) == 0 );
+		m_fd = -1;
 	} else
-		return false;
+		m_out.release();
+
+	return ok;
+}
+
+nifti_2_header *WriteOp::getHeader() {return &m_header;}
+
+data::ValueArrayReference WriteOp::getOutput( unsigned short ID, size_t offset, size_t len )
+{
+	return m_out.good() ? m_out.atByID( ID, offset, len ) : data::ValueArrayBase::createByID( ID, len );
+}
+
+bool WriteOp::putOutput( const data::ValueArrayBase &data, size_t offset )
+{
+	if( m_out.good() ) // its mapped, so the data are in the file already
+		return true;
+
+	const boost::shared_ptr<const void> raw = data.getRawAddress();
+	const char *ptr = static_cast<const char *>( raw.get() );
+	size_t remaining = data.getLength() * data.bytesPerElem();
+
+	if( m_stream ) { // a stream can only be written in order
+		if( offset != m_stream_pos ) {
+			LOG( Runtime, error ) << "Cannot write " << remaining << " bytes at " << offset << " into a stream at " << m_stream_pos;
+			return false;
+		}
+
+		m_stream->write( ptr, remaining );
+		m_stream_pos += remaining;
+		return m_stream->good();
+	}
+
+	while( remaining ) {
+		const ssize_t written = pwrite( m_fd, ptr, remaining, offset );
+
+		if( written < 0 ) {
+			if( errno == EINTR )
+				continue;
+
+			LOG( Runtime, error ) << "Failed to write " << remaining << " bytes at " << offset << " (" << strerror( errno ) << ")";
+			return false;
+		}
+
+		ptr += written;
+		offset += written;
+		remaining -= written;
+	}
+
+	return true;
 }
 
-nifti_1_header *WriteOp::getHeader() {return reinterpret_cast<nifti_1_header *>( &m_out[0] );}
+bool WriteOp::readOutput( uint8_t *dst, size_t offset, size_t len )
+{
+	if( m_out.good() ) {
+		memcpy( dst, &m_out[offset], len );
+		return true;
+	}
+
+	if( m_fd == -1 ) // a stream can't be red
+		return false;
+
+	while( len ) {
+		const ssize_t red = pread( m_fd, dst, len, offset );
+
+		if( red <= 0 ) {
+			if( red < 0 && errno == EINTR )
+				continue;
+
+			LOG( Runtime, error ) << "Failed to read " << len << " bytes at " << offset << " back from the output (" << ( red ? strerror( errno ) : "end of file" ) << ")";
+			return false;
+		}
+
+		dst += red;
+		offset += red;
+		len -= red;
+	}
+
+	return true;
+}
 
 bool WriteOp::operator()( data::Chunk &ch, util::vector4<size_t> posInImage )
 {
@@ -66,9 +347,14 @@ bool WriteOp::operator()( data::Chunk &ch, util::vector4<size_t> posInImage )
 		return true;
 	else {
 		LOG( Runtime, error ) << "Failed to copy chunk at " << posInImage;
-		return true;
+		return false;
 	}
 }
+size_t WriteOp::outputOffset( const data::Chunk &ch, util::vector4<size_t> posInImage )
+{
+	applyFlipToCoords( posInImage, ( data::dimensions )ch.getRelevantDims() );
+	return m_voxelstart + getLinearIndex( posInImage ) * m_bpv / 8;
+}
 void WriteOp::applyFlipToData ( data::ValueArrayReference &dat, util::vector4< size_t > chunkSize )
 {
 	if( !flip_list.empty() ) {
@@ -105,14 +391,15 @@ public:
 		WriteOp( image, bitsPerVoxel ),
 		m_targetId( targetId ), m_scale( image.getScalingTo( m_targetId ) ) {}
 
+	bool streamable()const {return true;}
+
 	bool doCopy( data::Chunk &ch, util::vector4<size_t> posInImage ) {
-		applyFlipToCoords( posInImage, ( data::dimensions )ch.getRelevantDims() );
-		size_t offset = m_voxelstart + getLinearIndex( posInImage ) * m_bpv / 8;
-		data::ValueArrayReference out_data = m_out.atByID( m_targetId, offset, ch.getVolume() );
+		const size_t offset = outputOffset( ch, posInImage );
+		data::ValueArrayReference out_data = getOutput( m_targetId, offset, ch.getVolume() );
 		ch.asValueArrayBase().copyTo( *out_data, m_scale );
 
 		applyFlipToData( out_data, ch.getSizeAsVector() );
-		return true;
+		return putOutput( *out_data, offset );
 	}
 
 	short unsigned int getTypeId() {return m_targetId;}
@@ -121,26 +408,6 @@ public:
 class FslRgbWriteOp: public WriteOp
 {
 	const data::scaling_pair m_scale;
-	struct VoxelCp: data::VoxelOp<util::color24> {
-		uint8_t mode;
-		uint8_t *ptr;
-		virtual bool operator()( util::color24 &vox, const isis::util::vector4<size_t>& /*pos*/ ) {
-			switch( mode ) {
-			case 0:
-				*ptr = vox.r;
-				break;
-			case 1:
-				*ptr = vox.g;
-				break;
-			case 2:
-				*ptr = vox.b;
-				break;
-			}
-
-			ptr++;
-			return true;
-		}
-	};
 public:
 	FslRgbWriteOp( const data::Image &image ):
 		WriteOp( image, 8 ), m_scale( util::ValueReference( util::Value<uint8_t>( 1 ) ), util::ValueReference( util::Value<uint8_t>( 0 ) ) ) {
@@ -154,16 +421,29 @@ public:
 	bool doCopy( data::Chunk &src, util::vector4<size_t> posInImage ) {
 		data::Chunk ch = src;
 		ch.convertToType( data::ValueArray<util::color24>::staticID, m_scale );
-		VoxelCp cp;
+		const data::ValueArray<util::color24> in_data = ch.asValueArrayBase().castToValueArray<util::color24>();
+		data::ValueArrayReference out_data[3];
+		size_t offset[3];
 		assert( posInImage[data::timeDim] == 0 );
 
-		for( ; posInImage[data::timeDim] < 3; posInImage[data::timeDim]++ ) { //copy each color/timestep into m_out
-			const size_t offset = m_voxelstart + getLinearIndex( posInImage ) * m_bpv / 8;
-			data::ValueArray<uint8_t> out_data = m_out.at<uint8_t>( offset, ch.getVolume() );
-			cp.ptr = &out_data[0];
-			cp.mode = ( uint8_t )posInImage[data::timeDim]; //the "timesteps" represent the color thus there are just 3
-			ch.foreachVoxel( cp );
-			assert( cp.ptr == &out_data[0] + out_data.getLength() );
+		for( ; posInImage[data::timeDim] < 3; posInImage[data::timeDim]++ ) { //the "timesteps" represent the color thus there are just 3
+			const size_t t = posInImage[data::timeDim];
+			offset[t] = m_voxelstart + getLinearIndex( posInImage ) * m_bpv / 8;
+			out_data[t] = getOutput( data::ValueArray<uint8_t>::staticID, offset[t], ch.getVolume() );
+		}
+
+		// split the colors into the timesteps
+		deinterleave3(
+			&in_data[0].r,
+			&out_data[0]->castToValueArray<uint8_t>()[0],
+			&out_data[1]->castToValueArray<uint8_t>()[0],
+			&out_data[2]->castToValueArray<uint8_t>()[0],
+			in_data.getLength()
+		);
+
+		for( size_t t = 0; t < 3; t++ ) {
+			if( !putOutput( *out_data[t], offset[t] ) )
+				return false;
 		}
 
 		return true;
@@ -172,28 +452,38 @@ public:
 	short unsigned int getTypeId() {return data::ValueArray<uint8_t>::staticID;}
 };
 
+/// stores the chunks of an image and their positions (e.g. to process them in parallel afterwards)
+struct ChunkCollector: data::ChunkOp {
+	std::vector<data::Chunk> chunks;
+	std::vector<util::vector4<size_t> > positions;
+	bool operator()( data::Chunk &ch, util::vector4<size_t> posInImage ) {
+		chunks.push_back( ch );
+		positions.push_back( posInImage );
+		return true;
+	}
+};
+
 class BitWriteOp: public WriteOp
 {
 public:
 	BitWriteOp( const data::Image &image ): WriteOp( image, 1 ) {}
+	bool parallel()const {return false;} // chunks may share a byte in the file
 
 	bool doCopy( data::Chunk &src, util::vector4<size_t> posInImage ) {
 		data::ValueArray<bool> in_data = src.asValueArrayBase().as<bool>();
-		const size_t offset = m_voxelstart + getLinearIndex( posInImage ) * m_bpv ;
+		const size_t first = getLinearIndex( posInImage ), len = in_data.getLength();
+		const size_t offset = m_voxelstart + first / 8, bytes = ( first % 8 + len + 7 ) / 8;
 
-		data::ValueArray<uint8_t> out_data = m_out.at<uint8_t>( offset, in_data.getLength() / 8 );
-		memset( &out_data[0], 0, out_data.getLength() );
+		data::ValueArray<uint8_t> out_data = getOutput( data::ValueArray<uint8_t>::staticID, offset, bytes )->castToValueArray<uint8_t>();
 
-		for( size_t i = 0; i < in_data.getLength(); i++ ) {
-			const size_t byte = i / 8;
-			const uint8_t mask = 128 >> ( i % 8 );
-
-			if( in_data[i] ) {
-				out_data[byte] |= mask;
-			}
+		// a chunk not starting or ending at a byte boundary shares that byte with its neighbours, so their bits are kept
+		if( !m_out.good() && bytes && ( first % 8 || ( first + len ) % 8 ) ) {
+			if( !readOutput( &out_data[0], offset, 1 ) || !readOutput( &out_data[bytes - 1], offset + bytes - 1, 1 ) )
+				return false;
 		}
 
-		return true;
+		packBits( &in_data[0], &out_data[0], len, first % 8 );
+		return putOutput( out_data, offset );
 	}
 
 	short unsigned int getTypeId() {return data::ValueArray<bool>::staticID;}
@@ -284,7 +574,7 @@ float ImageFormat_NiftiSa::determinant( const util::Matrix3x3< float >& m )
 		   - m.elem( 0, 0 ) * m.elem( 1, 2 ) * m.elem( 2, 1 ) - m.elem( 0, 1 ) * m.elem( 1, 0 ) * m.elem( 2, 2 ) - m.elem( 0, 2 ) * m.elem( 1, 1 ) * m.elem( 2, 0 );
 }
 
-void ImageFormat_NiftiSa::guessSliceOrdering( const data::Image img, char &slice_code, float &slice_duration )
+void ImageFormat_NiftiSa::guessSliceOrdering( const data::Image img, int &slice_code, double &slice_duration )
 {
 
 	if( img.getChunk( 0, 0, 0, 0, false ).getRelevantDims() != data::sliceDim || img.getSizeAsVector()[data::sliceDim] <= 1 ) {
@@ -331,7 +621,7 @@ void ImageFormat_NiftiSa::guessSliceOrdering( const data::Image img, char &slice
 
 }
 
-std::list<data::Chunk> ImageFormat_NiftiSa::parseSliceOrdering( const boost::shared_ptr< isis::image_io::_internal::nifti_1_header >& head, isis::data::Chunk current )
+std::list<data::Chunk> ImageFormat_NiftiSa::parseSliceOrdering( const boost::shared_ptr< isis::image_io::_internal::nifti_2_header >& head, isis::data::Chunk current )
 {
 	double time_fac;
 
@@ -462,7 +752,7 @@ bool ImageFormat_NiftiSa::parseDescripForSPM( isis::util::PropertyMap &props, co
 	} else
 		return false;
 }
-void ImageFormat_NiftiSa::storeHeader( const util::PropertyMap &props, _internal::nifti_1_header *head )
+void ImageFormat_NiftiSa::storeHeader( const util::PropertyMap &props, _internal::nifti_2_header *head )
 {
 	bool saved_sform = false, saved_qform = false;
 
@@ -523,11 +813,8 @@ void ImageFormat_NiftiSa::storeHeader( const util::PropertyMap &props, _internal
 	// spm apparently doesn't know about that and only looks for the sform, so we "violate" the rule and store it in any case
 	if( !saved_sform )
 		storeSForm( props, head );
-
-
-	strcpy( head->magic, "n+1" );
 }
-std::list< data::Chunk > ImageFormat_NiftiSa::parseHeader( const boost::shared_ptr< isis::image_io::_internal::nifti_1_header >& head, isis::data::Chunk props )
+std::list< data::Chunk > ImageFormat_NiftiSa::parseHeader( const boost::shared_ptr< isis::image_io::_internal::nifti_2_header >& head, isis::data::Chunk props )
 {
 	unsigned short dims = head->dim[0];
 	double time_fac = 1;
@@ -564,9 +851,9 @@ std::list< data::Chunk > ImageFormat_NiftiSa::parseHeader( const boost::shared_p
 
 	if( head->qform_code ) { // get the quaternion if qform_code>0
 		props.setPropertyAs( "nifti/qform_code", formCode ).castTo<util::Selection>().set( head->qform_code );
-		props.setPropertyAs( "nifti/quatern_b", head->quatern_b );
-		props.setPropertyAs( "nifti/quatern_c", head->quatern_c );
-		props.setPropertyAs( "nifti/quatern_d", head->quatern_d );
+		props.setPropertyAs<float>( "nifti/quatern_b", head->quatern_b );
+		props.setPropertyAs<float>( "nifti/quatern_c", head->quatern_c );
+		props.setPropertyAs<float>( "nifti/quatern_d", head->quatern_d );
 		props.setPropertyAs( "nifti/qoffset", util::fvector4( head->qoffset_x, head->qoffset_y, head->qoffset_z, 0 ) );
 		props.setPropertyAs( "nifti/qfac", ( head->pixdim[0] == -1 ) ? -1 : 1 );
 
@@ -609,14 +896,14 @@ std::list< data::Chunk > ImageFormat_NiftiSa::parseHeader( const boost::shared_p
 	}
 
 	if( head->intent_code  ) {
-		props.setPropertyAs( "nifti/intent_code", head->intent_code ); // use it the usual way
+		props.setPropertyAs<int16_t>( "nifti/intent_code", head->intent_code ); // use it the usual way
 		LOG( Runtime, warning ) << "Ignoring intent_code " << props.propertyValue( "nifti/intent_code" );
 	}
 
 
 	if( head->cal_max != 0 || head->cal_min != 0 ) { // maybe someone needs that, we dont ...
-		props.setPropertyAs( "nifti/cal_max", head->cal_max );
-		props.setPropertyAs( "nifti/cal_min", head->cal_min );
+		props.setPropertyAs<float>( "nifti/cal_max", head->cal_max );
+		props.setPropertyAs<float>( "nifti/cal_min", head->cal_min );
 	}
 
 	return parseSliceOrdering( head, props );
@@ -624,6 +911,27 @@ std::list< data::Chunk > ImageFormat_NiftiSa::parseHeader( const boost::shared_p
 
 std::string ImageFormat_NiftiSa::getName()const {return "Nifti standalone";}
 
+bool ImageFormat_NiftiSa::checkMagic( const data::ValueArray<uint8_t> &head )const
+{
+	if( head.getLength() < sizeof( _internal::nifti_1_header ) )
+		return false;
+
+	const _internal::nifti_1_header *header = reinterpret_cast<const _internal::nifti_1_header *>( &head[0] );
+
+	// sizeof_hdr must be 540 for nifti-2 (in either endianess) and the magic must be "n+2" or "ni2" followed by "\0\r\n\032\n"
+	if( header->sizeof_hdr == 540 || data::endianSwap( header->sizeof_hdr ) == 540 ) {
+		const _internal::nifti_2_header *header2 = reinterpret_cast<const _internal::nifti_2_header *>( &head[0] );
+		return head.getLength() >= sizeof( _internal::nifti_2_header ) &&
+			   ( memcmp( header2->magic, "n+2\0\r\n\032\n", 8 ) == 0 || memcmp( header2->magic, "ni2\0\r\n\032\n", 8 ) == 0 );
+	}
+
+	// sizeof_hdr must be 348 (in either endianess) and the magic must be "n+1" or "ni1"
+	if( header->sizeof_hdr != 348 && data::endianSwap( header->sizeof_hdr ) != 348 )
+		return false;
+
+	return memcmp( header->magic, "n+1", 4 ) == 0 || memcmp( header->magic, "ni1", 4 ) == 0;
+}
+
 isis::data::ValueArray< bool > ImageFormat_NiftiSa::bitRead( data::ValueArray< uint8_t > src, size_t size )
 {
 	assert( size );
@@ -635,17 +943,11 @@ isis::data::ValueArray< bool > ImageFormat_NiftiSa::bitRead( data::ValueArray< u
 	}
 
 	isis::data::ValueArray< bool > ret( size );
-
-	for( size_t i = 0; i < size; i++ ) {
-		const size_t byte = i / 8;
-		const uint8_t mask = 128 >> ( i % 8 );
-		ret[i] = mask & src[byte];
-	}
-
+	_internal::unpackBits( &src[0], &ret[0], size );
 	return ret;
 }
 
-bool ImageFormat_NiftiSa::checkSwapEndian ( boost::shared_ptr< isis::image_io::_internal::nifti_1_header > header )
+bool ImageFormat_NiftiSa::checkSwapEndian ( _internal::nifti_1_header *header )
 {
 #define DO_SWAP(VAR) VAR=data::endianSwap(VAR)
 #define DO_SWAPA(VAR,SIZE) data::endianSwapArray(VAR,VAR+SIZE,VAR);
@@ -700,7 +1002,64 @@ bool ImageFormat_NiftiSa::checkSwapEndian ( boost::shared_ptr< isis::image_io::_
 #undef DO_SWAPA
 }
 
-int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & )
+bool ImageFormat_NiftiSa::checkSwapEndian ( _internal::nifti_2_header *header )
+{
+#define DO_SWAP(VAR) VAR=data::endianSwap(VAR)
+#define DO_SWAPA(VAR,SIZE) data::endianSwapArray(VAR,VAR+SIZE,VAR);
+
+	if( data::endianSwap( header->sizeof_hdr ) == 540 ) { // ok we have to swap the endianess
+		DO_SWAP( header->sizeof_hdr );
+		DO_SWAP( header->datatype );
+		DO_SWAP( header->bitpix );
+
+		DO_SWAP( header->intent_p1 );
+		DO_SWAP( header->intent_p2 );
+		DO_SWAP( header->intent_p3 );
+
+		DO_SWAP( header->vox_offset );
+		DO_SWAP( header->scl_slope );
+		DO_SWAP( header->scl_inter );
+		DO_SWAP( header->cal_max );
+		DO_SWAP( header->cal_min );
+		DO_SWAP( header->slice_duration );
+		DO_SWAP( header->toffset );
+		DO_SWAP( header->slice_start );
+		DO_SWAP( header->slice_end );
+
+		DO_SWAP( header->qform_code );
+		DO_SWAP( header->sform_code );
+
+		DO_SWAP( header->quatern_b );
+		DO_SWAP( header->quatern_c );
+		DO_SWAP( header->quatern_d );
+		DO_SWAP( header->qoffset_x );
+		DO_SWAP( header->qoffset_y );
+		DO_SWAP( header->qoffset_z );
+
+		DO_SWAP( header->slice_code );
+		DO_SWAP( header->xyzt_units );
+		DO_SWAP( header->intent_code );
+
+		DO_SWAPA( header->dim, 8 );
+		DO_SWAPA( header->pixdim, 8 );
+		DO_SWAPA( header->srow_x, 4 );
+		DO_SWAPA( header->srow_y, 4 );
+		DO_SWAPA( header->srow_z, 4 );
+
+		return true;
+	} else
+		return false;
+
+#undef DO_SWAP
+#undef DO_SWAPA
+}
+
+int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & )
+{
+	return load( chunks, filename, dialect, progress, false );
+}
+
+int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/, bool metadata_only )  throw( std::runtime_error & )
 {
 	data::FilePtr mfile( filename );
 
@@ -712,18 +1071,37 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 			throwGenericError( filename + " could not be opened" );
 	}
 
-	//get the header - we use it directly from the file
-	boost::shared_ptr< _internal::nifti_1_header > header = boost::static_pointer_cast<_internal::nifti_1_header>( mfile.getRawAddress() );
-	const bool swap_endian = checkSwapEndian( header );
+	if( mfile.getLength() < sizeof( _internal::nifti_1_header ) )
+		throwGenericError( filename + " is too short for a nifti file" );
+
+	//get the header - nifti-1 headers are converted to nifti-2 (which can hold all their values), so the rest only has to deal with one
+	boost::shared_ptr< _internal::nifti_2_header > header( new _internal::nifti_2_header );
+	bool swap_endian;
+	const int32_t sizeof_hdr = *reinterpret_cast<const int32_t *>( &mfile[0] );
 
-	if( header->sizeof_hdr < 348 ) {
-		LOG( Runtime, warning ) << "sizeof_hdr of the file (" << header->vox_offset << ") is invalid, assuming 348";
-		header->sizeof_hdr = 348;
+	if( sizeof_hdr == 540 || data::endianSwap( sizeof_hdr ) == 540 ) {
+		if( mfile.getLength() < sizeof( _internal::nifti_2_header ) )
+			throwGenericError( filename + " is too short for a nifti-2 file" );
+
+		memcpy( header.get(), &mfile[0], sizeof( _internal::nifti_2_header ) );
+		swap_endian = checkSwapEndian( header.get() );
+		LOG( Runtime, info ) << filename << " is a nifti-2 file";
+	} else {
+		_internal::nifti_1_header header1;
+		memcpy( &header1, &mfile[0], sizeof( _internal::nifti_1_header ) );
+		swap_endian = checkSwapEndian( &header1 );
+
+		if( header1.sizeof_hdr < 348 ) {
+			LOG( Runtime, warning ) << "sizeof_hdr of the file (" << header1.sizeof_hdr << ") is invalid, assuming 348";
+			header1.sizeof_hdr = 348;
+		}
+
+		_internal::nifti1to2( header1, *header );
 	}
 
-	if( header->vox_offset < 352 ) {
-		LOG( Runtime, warning ) << "vox_offset of the file (" << header->vox_offset << ") is invalid, assuming 352";
-		header->vox_offset = 352;
+	if( header->vox_offset < header->sizeof_hdr + 4 ) {
+		LOG( Runtime, warning ) << "vox_offset of the file (" << header->vox_offset << ") is invalid, assuming " << header->sizeof_hdr + 4;
+		header->vox_offset = header->sizeof_hdr + 4;
 	}
 
 	if( header->slice_duration < 0 ) {
@@ -753,7 +1131,19 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 	data::ValueArrayReference data_src;
 
 	if( header->datatype == NIFTI_TYPE_BINARY ) { // image is binary encoded - needs special decoding
-		data_src = bitRead( mfile.at<uint8_t>( header->vox_offset ), size.product() );
+		data_src = metadata_only ?
+				   data::ValueArray<bool>( size.product() ) : // placeholder - will not be touched
+				   bitRead( mfile.at<uint8_t>( header->vox_offset ), size.product() );
+	} else if( metadata_only && util::istring( "fsl" ) == dialect.c_str() && size[data::timeDim] == 3 &&
+			   ( header->datatype == NIFTI_TYPE_UINT8 || header->datatype == NIFTI_TYPE_FLOAT32 ) ) { // don't de-interleave fsl color/vector images, just create the placeholder
+		const size_t volume = size.product() / 3;
+
+		if( header->datatype == NIFTI_TYPE_UINT8 )
+			data_src = data::ValueArray<util::color24>( volume );
+		else
+			data_src = data::ValueArray<util::fvector3>( volume );
+
+		size[data::timeDim] = 1;
 	} else if( util::istring( "fsl" ) == dialect.c_str() && header->datatype == NIFTI_TYPE_UINT8 && size[data::timeDim] == 3 ) { //if its fsl-three-volume-color copy the volumes
 		LOG( Runtime, notice ) << "The image has 3 timesteps and its type is UINT8, assuming it is an fsl color image.";
 		const size_t volume = size.product() / 3;
@@ -761,11 +1151,7 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 		const data::ValueArray<uint8_t> src = mfile.at<uint8_t>( header->vox_offset, volume * 3 );
 		LOG( Runtime, info ) << "Mapping nifti image as FSL RBG set of 3*" << volume << " elements";
 
-		for( size_t v = 0; v < volume; v++ ) {
-			buff[v].r = src[v];
-			buff[v].g = src[v + volume];
-			buff[v].b = src[v + volume * 2];
-		}
+		_internal::interleave3( &src[0], &src[volume], &src[volume * 2], &buff[0].r, volume );
 
 		data_src = buff;
 		size[data::timeDim] = 1;
@@ -775,19 +1161,18 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 		data::ValueArray<util::fvector3> buff( volume );
 		const data::ValueArray<float> src = mfile.at<float>( header->vox_offset, size.product(), swap_endian );
 
-		for( size_t v = 0; v < volume; v++ ) {
-			buff[v][0] = src[v];
-			buff[v][1] = src[v + volume];
-			buff[v][2] = src[v + volume * 2];
-		}
+		_internal::interleave3( &src[0], &src[volume], &src[volume * 2], &buff[0][0], volume );
 
 		data_src = buff;
 		size[data::timeDim] = 1;
 	} else {
-		unsigned int type = nifti_type2isis_type[header->datatype];
+		// use find, operator[] would insert unknown types (load must not change the plugin, it may be called in parallel)
+		const std::map<short, unsigned short>::const_iterator found = nifti_type2isis_type.find( header->datatype );
+		const unsigned int type = found == nifti_type2isis_type.end() ? 0 : found->second;
 
 		if( type ) {
-			data_src = mfile.atByID( type, header->vox_offset, size.product(), swap_endian );
+			// when reading only metadata, don't swap (which would copy all data) - the mapping is never touched anyway
+			data_src = mfile.atByID( type, header->vox_offset, size.product(), swap_endian && !metadata_only );
 
 			if( swap_endian ) {
 				LOG( Runtime, info ) << "Opened nifti image as endianess swapped " << data_src->getTypeName() << " of " << data_src->getLength()
@@ -795,6 +1180,16 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 			} else {
 				LOG( Runtime, info ) << "Mapped nifti image natively as " << data_src->getTypeName() << " of " << data_src->getLength()
 				<< " elements (" << data_src->bytesPerElem()*data_src->getLength()*( 1. / 0x100000 ) << "M)";
+
+				if( !metadata_only && size[data::timeDim] > 1 ) {
+					// the volumes of a timeseries are usually accessed one after another - tell the kernel,
+					// and start reading the first volumes (as many as fit into max_prefetch, at least one) so they are (partly) there when they are accessed
+					// the readahead of the kernel takes care of the following volumes
+					const size_t volume_bytes = size.product() / size[data::timeDim] * data_src->bytesPerElem();
+					const size_t prefetch_volumes = std::min<size_t>( size[data::timeDim], std::max<size_t>( max_prefetch / volume_bytes, 1 ) );
+					mfile.advise( header->vox_offset, 0, data::FilePtr::sequential );
+					mfile.prefetch( header->vox_offset, prefetch_volumes * volume_bytes );
+				}
 			}
 
 			LOG_IF( ( size_t )header->bitpix != data_src->bytesPerElem() * 8, Runtime, warning )
@@ -813,12 +1208,26 @@ int ImageFormat_NiftiSa::load ( std::list<data::Chunk> &chunks, const std::strin
 	data::ValueArray< uint8_t > extID = mfile.at<uint8_t>( header->sizeof_hdr, 4, swap_endian );
 
 	if( extID[0] != 0 ) { // there is an extension http://nifti.nimh.nih.gov/nifti-1/documentation/nifti1fields/nifti1fields_pages/extension.html
-		for( size_t pos = header->sizeof_hdr + 4; pos < header->vox_offset; ) {
+		for( size_t pos = header->sizeof_hdr + 4; pos < ( size_t )header->vox_offset; ) {
 			data::ValueArray<uint32_t> ext_hdr = mfile.at<uint32_t>( pos, 2, swap_endian );
 
+			// esize includes its own 8 bytes, so anything smaller (or reaching beyond the data) is broken
+			if( ext_hdr[0] < 8 || ext_hdr[0] > ( size_t )header->vox_offset - pos ) {
+				LOG( Runtime, warning ) << "Ignoring the nifti extensions from offset " << pos << " on, because of the invalid extension size " << ext_hdr[0];
+				break;
+			}
+
 			switch( ext_hdr[1] ) {
 			case 0: { // @todo for now we just assume its DcmMeta https://dcmstack.readthedocs.org/en/v0.6.1/DcmMeta_Extension.html
-				_internal::parse_json( mfile.at<uint8_t>( header->sizeof_hdr + 4 + 8, ext_hdr[0], swap_endian ), orig.branch( "DcmMeta" ), '.' );
+				// the json text is padded with zeros to the size of the extension
+				const data::ValueArray<uint8_t> ext = mfile.at<uint8_t>( pos + 8, ext_hdr[0] - 8 );
+				const size_t len = std::find( ext.begin(), ext.end(), 0 ) - ext.begin();
+
+				if( dialect == "rawdcmmeta" ) { // don't parse it, the user can do that if its needed
+					orig.setPropertyAs<std::string>( "DcmMeta", std::string( ext.begin(), ext.begin() + len ) );
+				} else if( !_internal::parse_json( mfile.at<uint8_t>( pos + 8, len ), orig.branch( "DcmMeta" ), '.' ) ) {
+					LOG( Runtime, warning ) << "Failed to parse the DcmMeta extension completely";
+				}
 			}
 			break;
 			case 2:
@@ -884,17 +1293,116 @@ std::auto_ptr< _internal::WriteOp > ImageFormat_NiftiSa::getWriteOp( const isis:
 }
 
 
+/// set up the flips of the dialects, the side files of fsl and the header of the writer
+void ImageFormat_NiftiSa::setupWrite( data::Image &image, _internal::WriteOp &writer, const std::string &filename, const util::istring &dialect, unsigned int nifti_id )
+{
+	if( dialect == "spm" ) {
+		writer.addFlip( image.mapScannerAxisToImageDimension( data::z ) );
+	} else if( dialect == "fsl" ) {
+		//dcm2nii flips the slice ordering of a mosaic if the determinant if the orientation is negative
+		//don't ask, dcm2nii does it, fsl seems to expect it, so we do it
+		if( image.hasProperty( "DICOM/ImageType" ) ) {
+			const util::slist tp = image.getPropertyAs<util::slist>( "DICOM/ImageType" );
+			const bool was_mosaic = ( std::find( tp.begin(), tp.end(), "WAS_MOSAIC" ) != tp.end() );
+			const util::Matrix3x3<float> mat( image.getPropertyAs<util::fvector3>( "rowVec" ), image.getPropertyAs<util::fvector3>( "columnVec" ), image.getPropertyAs<util::fvector3>( "sliceVec" ) );
+
+			if( was_mosaic  && determinant( mat ) < 0 ) {
+				LOG( Runtime, info ) << "Flipping slices of a siemens mosaic image for fsl compatibility";
+				flipGeometry( image, data::sliceDim );
+				writer.addFlip( data::sliceDim );
+			}
+		}
+
+		//invert columnVec and flip the order of the images lines
+		//well, you know ... ask dcm2nii ....
+		LOG( Runtime, info ) << "Flipping columns of image for fsl compatibility";
+		flipGeometry( image, data::columnDim );
+		writer.addFlip( data::columnDim );
+	}
+
+	// if the image seems to have diffusion data, and we are writing for fsl we store the data conforming as dcm2nii does it
+	if( dialect == "fsl" && image.getChunkAt( 0 ).hasProperty( "diffusionGradient" ) ) {
+		LOG_IF( image.getNrOfTimesteps() < 2, Runtime, warning ) << "The image seems to have diffusion data, but has only one volume";
+		std::ofstream bvecFile( ( makeBasename( filename ).first + ".bvec" ).c_str() );
+		std::ofstream bvalFile( ( makeBasename( filename ).first + ".bval" ).c_str() );
+		bvecFile.exceptions( std::ios::failbit | std::ios::badbit );
+		bvalFile.exceptions( std::ios::failbit | std::ios::badbit );
+		std::list<util::dvector3> bvecList;
+
+		for( size_t i = 0; i < image.getNrOfTimesteps(); i++ ) { // go through all "volumes"
+			const util::PropertyMap chunk = image.getChunk( 0, 0, 0, i );
+			util::dvector3 gradient = chunk.getPropertyAs<util::dvector3>( "diffusionGradient" );
+			const util::Matrix3x3<double> M(
+				chunk.getPropertyAs<util::dvector3>( "rowVec" ),
+				chunk.getPropertyAs<util::dvector3>( "columnVec" ),
+				chunk.getPropertyAs<util::dvector3>( "sliceVec" )
+			);
+
+			// the bvalue is the length of the gradient direction,
+			bvalFile << gradient.len() << " ";
+
+			if( gradient.len() > 0 ) {
+				gradient.norm();// the direction itself must be normalized
+				bvecList.push_back( M.dot( gradient ) ); // .. transformed into slice space and stored
+			} else {
+				bvecList.push_back( util::dvector3( 0, 0, 0 ) );
+			}
+		}
+
+		// the bvec file is the x-elements of all directions, then all y-elements and so on...
+		bvecFile.precision( 14 );
+		BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[0] << " ";
+		bvecFile << std::endl;
+		BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[1] << " ";
+		bvecFile << std::endl;
+		BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[2] << " ";
+		bvecFile << std::endl;
+
+		LOG( Runtime, notice ) << "Stored bvec information for fsl to " << makeBasename( filename ).first + ".bvec";
+		LOG( Runtime, notice ) << "Stored bval information for fsl to " << makeBasename( filename ).first + ".bval";
+	}
+
+
+	// get the header (its stored as nifti-1 if the image fits, as nifti-2 otherwise)
+	_internal::nifti_2_header *header = writer.getHeader();
+	header->datatype = nifti_id;
+
+	guessSliceOrdering( image, header->slice_code, header->slice_duration );
+
+	if( image.getMajorTypeID() == data::ValueArray<util::color24>::staticID ) {
+		header->cal_min = 0;
+		header->cal_max = 255;
+	} else {
+		const std::pair< float, float > minmax = image.getMinMaxAs<float>();
+		header->cal_min = minmax.first;
+		header->cal_max = minmax.second;
+	}
+
+	{
+		//join the properties of the first chunk into the image and store that to the header
+		util::PropertyMap props = image;
+		props.join( image.getChunkAt( 0, false ) );
+		storeHeader( props, header );
+	}
+
+	if( image.getSizeAsVector()[data::timeDim] > 1 && image.hasProperty( "repetitionTime" ) )
+		header->pixdim[data::timeDim + 1] = image.getPropertyAs<float>( "repetitionTime" );
+
+	if( util::istring( dialect.c_str() ) == "spm" ) { // override "normal" description with the "spm-description"
+		storeDescripForSPM( image.getChunk( 0, 0 ), header->descrip );
+	}
+}
+
 void ImageFormat_NiftiSa::write( const data::Image &img, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & )
 {
 	data::Image image = img;
-	const size_t voxel_offset = 352; // must be >=352 (and multiple of 16)  (http://nifti.nimh.nih.gov/nifti-1/documentation/nifti1fields/nifti1fields_pages/vox_offset.html)
 	std::auto_ptr< _internal::WriteOp > writer = getWriteOp( image, dialect.c_str() ); // get a fitting writer for the datatype
 	const unsigned int nifti_id = isis_type2nifti_type[writer->getTypeId()]; // get the nifti datatype corresponding to our datatype
 
 	if( nifti_id ) { // there is a corresponding nifti datatype
 
-		// open/map the new file
-		if( !writer->setOutput( filename, voxel_offset ) ) {
+		// open/map the new file (the dialect "pwrite" enforces pwrite, e.g. for filesystems which are not recognised as network filesystems)
+		if( !writer->setOutput( filename, util::istring( dialect.c_str() ) == "pwrite" ) ) {
 			if( errno ) {
 				throwSystemError( errno, filename + " could not be opened" );
 				errno = 0;
@@ -902,110 +1410,104 @@ void ImageFormat_NiftiSa::write( const data::Image &img, const std::string &file
 				throwGenericError( filename + " could not be opened" );
 		}
 
-		if( dialect == "spm" ) {
-			writer->addFlip( image.mapScannerAxisToImageDimension( data::z ) );
-		} else if( dialect == "fsl" ) {
-			//dcm2nii flips the slice ordering of a mosaic if the determinant if the orientation is negative
-			//don't ask, dcm2nii does it, fsl seems to expect it, so we do it
-			if( image.hasProperty( "DICOM/ImageType" ) ) {
-				const util::slist tp = image.getPropertyAs<util::slist>( "DICOM/ImageType" );
-				const bool was_mosaic = ( std::find( tp.begin(), tp.end(), "WAS_MOSAIC" ) != tp.end() );
-				const util::Matrix3x3<float> mat( image.getPropertyAs<util::fvector3>( "rowVec" ), image.getPropertyAs<util::fvector3>( "columnVec" ), image.getPropertyAs<util::fvector3>( "sliceVec" ) );
-
-				if( was_mosaic  && determinant( mat ) < 0 ) {
-					LOG( Runtime, info ) << "Flipping slices of a siemens mosaic image for fsl compatibility";
-					flipGeometry( image, data::sliceDim );
-					writer->addFlip( data::sliceDim );
-				}
-			}
+		setupWrite( image, *writer, filename, dialect, nifti_id );
 
-			//invert columnVec and flip the order of the images lines
-			//well, you know ... ask dcm2nii ....
-			LOG( Runtime, info ) << "Flipping columns of image for fsl compatibility";
-			flipGeometry( image, data::columnDim );
-			writer->addFlip( data::columnDim );
+		// actually copy the data from each chunk of the image
+		// collect the chunks first, the writer can copy them in parallel, as each chunk has its own region in the file
+		_internal::ChunkCollector collector;
+		const_cast<data::Image &>( image ).foreachChunk( collector ); // @todo we _do_ need a const version of foreachChunk/Voxel
+		const int count = collector.chunks.size();
+		int errors = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:errors) if(writer->parallel())
+		for( int i = 0; i < count; i++ ) {
+			try {
+				if( !( *writer )( collector.chunks[i], collector.positions[i] ) )
+					errors++;
+			} catch( std::exception &e ) { // exceptions must not leave the parallel loop
+				LOG( Runtime, error ) << "Failed to write chunk at " << collector.positions[i] << " (" << e.what() << ")";
+				errors++;
+			}
 		}
 
-		// if the image seems to have diffusion data, and we are writing for fsl we store the data conforming as dcm2nii does it
-		if( dialect == "fsl" && image.getChunkAt( 0 ).hasProperty( "diffusionGradient" ) ) {
-			LOG_IF( image.getNrOfTimesteps() < 2, Runtime, warning ) << "The image seems to have diffusion data, but has only one volume";
-			std::ofstream bvecFile( ( makeBasename( filename ).first + ".bvec" ).c_str() );
-			std::ofstream bvalFile( ( makeBasename( filename ).first + ".bval" ).c_str() );
-			bvecFile.exceptions( std::ios::failbit | std::ios::badbit );
-			bvalFile.exceptions( std::ios::failbit | std::ios::badbit );
-			std::list<util::dvector3> bvecList;
-
-			for( size_t i = 0; i < image.getNrOfTimesteps(); i++ ) { // go through all "volumes"
-				const util::PropertyMap chunk = image.getChunk( 0, 0, 0, i );
-				util::dvector3 gradient = chunk.getPropertyAs<util::dvector3>( "diffusionGradient" );
-				const util::Matrix3x3<double> M(
-					chunk.getPropertyAs<util::dvector3>( "rowVec" ),
-					chunk.getPropertyAs<util::dvector3>( "columnVec" ),
-					chunk.getPropertyAs<util::dvector3>( "sliceVec" )
-				);
-
-				// the bvalue is the length of the gradient direction,
-				bvalFile << gradient.len() << " ";
-
-				if( gradient.len() > 0 ) {
-					gradient.norm();// the direction itself must be normalized
-					bvecList.push_back( M.dot( gradient ) ); // .. transformed into slice space and stored
-				} else {
-					bvecList.push_back( util::dvector3( 0, 0, 0 ) );
-				}
-			}
+		if( !writer->closeOutput() ) {
+			throwSystemError( errno, filename + " could not be written" );
+		}
 
-			// the bvec file is the x-elements of all directions, then all y-elements and so on...
-			bvecFile.precision( 14 );
-			BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[0] << " ";
-			bvecFile << std::endl;
-			BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[1] << " ";
-			bvecFile << std::endl;
-			BOOST_FOREACH( const util::dvector3 & dir, bvecList )bvecFile << dir[2] << " ";
-			bvecFile << std::endl;
-
-			LOG( Runtime, notice ) << "Stored bvec information for fsl to " << makeBasename( filename ).first + ".bvec";
-			LOG( Runtime, notice ) << "Stored bval information for fsl to " << makeBasename( filename ).first + ".bval";
+		if( errors ) {
+			throwGenericError( boost::lexical_cast<std::string>( errors ) + " chunks could not be written to " + filename );
 		}
 
+	} else {
+		LOG( Runtime, error ) << "Sorry, the datatype " << util::MSubject( image.getMajorTypeName() ) << " is not supportet for nifti output";
+		throwGenericError( "unsupported datatype" );
+	}
 
-		// get the first 348 bytes as header
-		_internal::nifti_1_header *header = writer->getHeader();
-		header->datatype = nifti_id;
+}
 
-		guessSliceOrdering( image, header->slice_code, header->slice_duration );
+bool ImageFormat_NiftiSa::writeStream( const data::Image &img, std::ostream &out, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & )
+{
+	data::Image image = img;
+	std::auto_ptr< _internal::WriteOp > writer = getWriteOp( image, dialect.c_str() );
+	const unsigned int nifti_id = isis_type2nifti_type[writer->getTypeId()];
 
-		if( image.getMajorTypeID() == data::ValueArray<util::color24>::staticID ) {
-			header->cal_min = 0;
-			header->cal_max = 255;
-		} else {
-			const std::pair< float, float > minmax = image.getMinMaxAs<float>();
-			header->cal_min = minmax.first;
-			header->cal_max = minmax.second;
-		}
+	// unsupported types are reported by write, and "pwrite" asks for a file
+	if( !nifti_id || !writer->streamable() || util::istring( dialect.c_str() ) == "pwrite" )
+		return false;
 
-		{
-			//join the properties of the first chunk into the image and store that to the header
-			util::PropertyMap props = image;
-			props.join( image.getChunkAt( 0, false ) );
-			storeHeader( props, header );
-		}
+	writer->setOutput( out, filename );
+	setupWrite( image, *writer, filename, dialect, nifti_id );
+
+	if( !writer->writeHeader() )
+		throwGenericError( "Failed to write the header of " + filename );
 
-		if( image.getSizeAsVector()[data::timeDim] > 1 && image.hasProperty( "repetitionTime" ) )
-			header->pixdim[data::timeDim + 1] = image.getPropertyAs<float>( "repetitionTime" );
+	// the chunks are written one after another in the order of the file
+	// big chunks are spliced, so the converted data of no more than max_stream_piece bytes are in memory
+	_internal::ChunkCollector collector;
+	image.foreachChunk( collector );
+	std::vector<data::Chunk> pieces;
+	std::vector<util::vector4<size_t> > positions;
+	std::vector<std::pair<size_t, size_t> > order; // offset in the file => index in pieces
+	const size_t bytes = image.getMaxBytesPerVoxel();
 
-		if( util::istring( dialect.c_str() ) == "spm" ) { // override "normal" description with the "spm-description"
-			storeDescripForSPM( image.getChunk( 0, 0 ), header->descrip );
+	for( size_t c = 0; c < collector.chunks.size(); c++ ) {
+		const data::Chunk &ch = collector.chunks[c];
+		const util::vector4<size_t> size = ch.getSizeAsVector();
+		size_t dim = ch.getRelevantDims(), piece_volume = ch.getVolume();
+
+		while( dim > 1 && piece_volume * bytes > max_stream_piece ) // pieces of the dimensions below dim
+			piece_volume /= size[--dim];
+
+		if( dim == ch.getRelevantDims() ) { // small enough
+			pieces.push_back( ch );
+			positions.push_back( collector.positions[c] );
+		} else {
+			const std::list<data::Chunk> spliced = ch.splice( ( data::dimensions )dim );
+			size_t index = 0;
+			BOOST_FOREACH( const data::Chunk & piece, spliced ) {
+				size_t coords[4];
+				ch.getCoordsFromLinIndex( index, coords );
+				pieces.push_back( piece );
+				positions.push_back( collector.positions[c] + util::vector4<size_t>( coords ) );
+				index += piece.getVolume();
+			}
 		}
+	}
 
-		// actually copy the data from each chunk of the image
-		const_cast<data::Image &>( image ).foreachChunk( *writer ); // @todo we _do_ need a const version of foreachChunk/Voxel
+	for( size_t i = 0; i < pieces.size(); i++ )
+		order.push_back( std::make_pair( writer->outputOffset( pieces[i], positions[i] ), i ) );
 
-	} else {
-		LOG( Runtime, error ) << "Sorry, the datatype " << util::MSubject( image.getMajorTypeName() ) << " is not supportet for nifti output";
-		throwGenericError( "unsupported datatype" );
+	std::sort( order.begin(), order.end() );
+
+	for( size_t i = 0; i < order.size(); i++ ) {
+		if( !( *writer )( pieces[order[i].second], positions[order[i].second] ) )
+			throwGenericError( "Failed to write the chunk at " + boost::lexical_cast<std::string>( positions[order[i].second] ) + " into the stream for " + filename );
 	}
 
+	if( !writer->closeOutput() )
+		throwGenericError( "Failed to write " + filename + " into a stream" );
+
+	return true;
 }
 
 /// get the tranformation matrix from image space to Nifti space using row-,column and sliceVec from the given PropertyMap
@@ -1179,7 +1681,7 @@ void ImageFormat_NiftiSa::useQForm( util::PropertyMap &props )
 	props.setPropertyAs( "voxelSize", util::Value<util::dlist>( vsize ).as<util::fvector3>() );
 	LOG_IF( props.hasProperty( "voxelSize" ), Debug, info ) << "Computed voxelSize=" << props.propertyValue( "voxelSize" ) << " from pixdim " << props.propertyValue( "nifti/pixdim" );
 }
-bool ImageFormat_NiftiSa::storeQForm( const util::PropertyMap &props, _internal::nifti_1_header *head )
+bool ImageFormat_NiftiSa::storeQForm( const util::PropertyMap &props, _internal::nifti_2_header *head )
 {
 
 	// take values of the 3x3 matrix == analog to the nifti reference implementation
@@ -1250,7 +1752,7 @@ bool ImageFormat_NiftiSa::storeQForm( const util::PropertyMap &props, _internal:
 
 	return true;
 }
-void ImageFormat_NiftiSa::storeSForm( const util::PropertyMap &props, _internal::nifti_1_header *head )
+void ImageFormat_NiftiSa::storeSForm( const util::PropertyMap &props, _internal::nifti_2_header *head )
 {
 	const util::Matrix4x4<double> sform = getNiftiMatrix( props );
 
@@ -60,6 +60,8 @@
 #include <DataStorage/io_interface.h>
 #include <CoreUtils/matrix.hpp>
 #include <sys/stat.h>
+#include <stdint.h>
+#include <vector>
 
 namespace isis
 {
@@ -130,8 +132,78 @@ struct nifti_1_header {
 
 } ;                   /**** 348 bytes total ****/
 
+//define the nifti-2 header (brazenly stolen from nifti2.h)
+#pragma pack(push,1)
+struct nifti_2_header {
+	/* NIFTI-2 usage           */  /* NIFTI-1 counterpart */
+	int     sizeof_hdr;     /*!< MUST be 540           */  /* int sizeof_hdr; (348) */
+	char    magic[8] ;      /*!< MUST be "n+2\0\r\n\032\n" */  /* char magic[4];    */
+	short   datatype;       /*!< Defines data type!    */  /* short datatype;       */
+	short   bitpix;         /*!< Number bits/voxel.    */  /* short bitpix;         */
+	int64_t dim[8];         /*!< Data array dimensions.*/  /* short dim[8];         */
+	double  intent_p1 ;     /*!< 1st intent parameter. */  /* float intent_p1;      */
+	double  intent_p2 ;     /*!< 2nd intent parameter. */  /* float intent_p2;      */
+	double  intent_p3 ;     /*!< 3rd intent parameter. */  /* float intent_p3;      */
+	double  pixdim[8];      /*!< Grid spacings.        */  /* float pixdim[8];      */
+	int64_t vox_offset;     /*!< Offset into .nii file */  /* float vox_offset;     */
+	double  scl_slope ;     /*!< Data scaling: slope.  */  /* float scl_slope;      */
+	double  scl_inter ;     /*!< Data scaling: offset. */  /* float scl_inter;      */
+	double  cal_max;        /*!< Max display intensity */  /* float cal_max;        */
+	double  cal_min;        /*!< Min display intensity */  /* float cal_min;        */
+	double  slice_duration; /*!< Time for 1 slice.     */  /* float slice_duration; */
+	double  toffset;        /*!< Time axis shift.      */  /* float toffset;        */
+	int64_t slice_start;    /*!< First slice index.    */  /* short slice_start;    */
+	int64_t slice_end;      /*!< Last slice index.     */  /* short slice_end;      */
+	char    descrip[80];    /*!< any text you like.    */  /* char descrip[80];     */
+	char    aux_file[24];   /*!< auxiliary filename.   */  /* char aux_file[24];    */
+	int     qform_code ;    /*!< NIFTI_XFORM_* code.   */  /* short qform_code;     */
+	int     sform_code ;    /*!< NIFTI_XFORM_* code.   */  /* short sform_code;     */
+	double  quatern_b ;     /*!< Quaternion b param.   */  /* float quatern_b;      */
+	double  quatern_c ;     /*!< Quaternion c param.   */  /* float quatern_c;      */
+	double  quatern_d ;     /*!< Quaternion d param.   */  /* float quatern_d;      */
+	double  qoffset_x ;     /*!< Quaternion x shift.   */  /* float qoffset_x;      */
+	double  qoffset_y ;     /*!< Quaternion y shift.   */  /* float qoffset_y;      */
+	double  qoffset_z ;     /*!< Quaternion z shift.   */  /* float qoffset_z;      */
+	double  srow_x[4] ;     /*!< 1st row affine transform. */  /* float srow_x[4];  */
+	double  srow_y[4] ;     /*!< 2nd row affine transform. */  /* float srow_y[4];  */
+	double  srow_z[4] ;     /*!< 3rd row affine transform. */  /* float srow_z[4];  */
+	int     slice_code ;    /*!< Slice timing order.   */  /* char slice_code;      */
+	int     xyzt_units ;    /*!< Units of pixdim[1..4] */  /* char xyzt_units;      */
+	int     intent_code ;   /*!< NIFTI_INTENT_* code.  */  /* short intent_code;    */
+	char    intent_name[16];/*!< 'name' or meaning of data. */ /* char intent_name[16]; */
+	char    dim_info;       /*!< MRI slice ordering.   */  /* char dim_info;        */
+	char    unused_str[15]; /*!< unused, filled with \0 */
+} ;                   /**** 540 bytes total ****/
+#pragma pack(pop)
+
+/**
+ * Convert a nifti-1 header into a nifti-2 header.
+ * All values of nifti-1 fit into nifti-2, so this never fails.
+ * sizeof_hdr and magic are copied as they are, so the result still tells where it came from.
+ */
+void nifti1to2( const nifti_1_header &src, nifti_2_header &dst );
+/**
+ * Convert a nifti-2 header into a nifti-1 header.
+ * sizeof_hdr and magic are set for nifti-1.
+ * \returns false if the dimensions or vox_offset don't fit into nifti-1 (dst is undefined then)
+ */
+bool nifti2to1( const nifti_2_header &src, nifti_1_header &dst );
+
+/**
+ * Base class for the operations copying the chunks of an image into a nifti file.
+ * Each chunk is written to its own region of the file, so (unless parallel() says otherwise) chunks can be written concurrently.
+ * The output is either mapped into memory, or (on network filesystems, where big shared writable mappings are slow) written with pwrite.
+ */
 class WriteOp: public data::ChunkOp, protected data::_internal::NDimensional<4>
 {
+	int m_fd; // the output file if it is written with pwrite, -1 if its mapped
+	std::vector<uint8_t> m_head; // the header if the output is written with pwrite
+	std::ostream *m_stream; // the output if it is a stream, NULL otherwise
+	size_t m_stream_pos; // the amount of bytes written into m_stream
+	nifti_2_header m_header; // the header is set up as nifti-2, and stored as nifti-1 if possible by writeHeader
+	bool m_nifti2;
+	static bool usePwrite( const std::string &filename );
+	void setupHeader( const std::string &filename );
 protected:
 	std::set<data::dimensions> flip_list;
 	data::FilePtr m_out;
@@ -141,14 +213,43 @@ protected:
 	void applyFlipToCoords ( util::vector4< size_t > &coords, data::dimensions blockdims );
 	void applyFlipToData ( data::ValueArrayReference &dat, util::vector4< size_t > chunkSize );
 	void applyFlipToData ( data::Chunk& dat );
+	/// \returns memory for len elements of the given type at offset in the output (mapped file or a buffer to be given to putOutput)
+	data::ValueArrayReference getOutput( unsigned short ID, size_t offset, size_t len );
+	/// store the data got from getOutput at offset (writes them with pwrite or into the stream, if the output is not mapped)
+	bool putOutput( const data::ValueArrayBase &data, size_t offset );
+	/// read len bytes at offset from the output (e.g. bytes shared with data written before), not possible for streams
+	bool readOutput( uint8_t *dst, size_t offset, size_t len );
 public:
-	virtual ~WriteOp() {}
-	nifti_1_header *getHeader();
+	virtual ~WriteOp();
+	/// \returns the header of the output (it will be stored as nifti-1 if it fits, see isNifti2())
+	nifti_2_header *getHeader();
+	/// \returns true if the output is written as nifti-2 (if any dimension of the image is larger than 32767)
+	bool isNifti2()const {return m_nifti2;}
 	virtual unsigned short getTypeId() = 0;
 	virtual size_t getDataSize();
+	/// \returns true if the chunks can be written concurrently (they don't share bytes in the file)
+	virtual bool parallel()const {return true;}
+	/// \returns true if every chunk is written into one contiguous region of the file (so they can be written into a stream ordered by outputOffset)
+	virtual bool streamable()const {return false;}
+	/// \returns the offset of the data of the chunk at posInImage in the file
+	size_t outputOffset( const data::Chunk &ch, util::vector4<size_t> posInImage );
 
 	bool operator()( data::Chunk &ch, util::vector4<size_t> posInImage );
-	bool setOutput( const std::string &filename, size_t voxelstart = 352 );
+	/**
+	 * Open the output file and set up the header.
+	 * If any dimension of the image does not fit into nifti-1 (is larger than 32767), the file will be a nifti-2 file.
+	 * The file is written with pwrite instead of being mapped if it is on a network filesystem (or if pwrite_output is set).
+	 */
+	bool setOutput( const std::string &filename, bool pwrite_output = false );
+	/**
+	 * Use a stream as output and set up the header.
+	 * The header must be written by writeHeader before the chunks, and the chunks must be written in the order of their outputOffset.
+	 */
+	void setOutput( std::ostream &out, const std::string &filename );
+	/// store the header into the output (this is done by closeOutput if the output is a file)
+	bool writeHeader();
+	/// store the header into the file and close the output (for a stream, check that all data were written)
+	bool closeOutput();
 	void addFlip( data::dimensions dim );
 };
 
@@ -159,6 +260,8 @@ class ImageFormat_NiftiSa: public FileFormat
 {
 	static const util::Matrix4x4<short> nifti2isis;
 	static const util::Selection formCode;
+	static const size_t max_prefetch = 0x4000000; // 64M - the amount of voxel data of a timeseries which is read ahead on load
+	static const size_t max_stream_piece = 0x1000000; // 16M - chunks written into a stream are spliced into pieces of about this size
 
 	typedef bool(*demuxer_type)(const util::PropertyValue &value,std::list<data::Chunk> &chunks,util::PropertyMap::PropPath name);
 
@@ -166,8 +269,8 @@ class ImageFormat_NiftiSa: public FileFormat
 	static util::Matrix4x4<double> getNiftiMatrix( const util::PropertyMap &props );
 	static void useSForm( util::PropertyMap &props );
 	static void useQForm( util::PropertyMap &props );
-	static bool storeQForm( const util::PropertyMap &props, _internal::nifti_1_header *head );
-	static void storeSForm( const util::PropertyMap &props, _internal::nifti_1_header *head );
+	static bool storeQForm( const util::PropertyMap &props, _internal::nifti_2_header *head );
+	static void storeSForm( const util::PropertyMap &props, _internal::nifti_2_header *head );
 	std::map<short, unsigned short> nifti_type2isis_type;
 	std::map<unsigned short, short> isis_type2nifti_type;
 	std::map<unsigned short,demuxer_type> prop_demuxer;
@@ -175,25 +278,31 @@ class ImageFormat_NiftiSa: public FileFormat
 		LOG( Runtime, info ) << data::ValueArray<T>::staticName() <<  " is not supported by " << name << " falling back to " << data::ValueArray<NEW_T>::staticName();
 		return data::ValueArray<NEW_T>::staticID;
 	}
-	static void guessSliceOrdering( const data::Image img, char &slice_code, float &slice_duration );
-	static std::list<data::Chunk> parseSliceOrdering( const boost::shared_ptr< _internal::nifti_1_header > &head, data::Chunk current );
+	static void guessSliceOrdering( const data::Image img, int &slice_code, double &slice_duration );
+	static std::list<data::Chunk> parseSliceOrdering( const boost::shared_ptr< _internal::nifti_2_header > &head, data::Chunk current );
 
 	static bool parseDescripForSPM( util::PropertyMap &props, const char desc[] );
 	static void storeDescripForSPM( const isis::util::PropertyMap &props, char desc[] );
-	static void storeHeader( const util::PropertyMap &props, _internal::nifti_1_header *head );
+	static void storeHeader( const util::PropertyMap &props, _internal::nifti_2_header *head );
 	static float determinant( const util::Matrix3x3<float> &m );
-	static std::list<data::Chunk> parseHeader( const boost::shared_ptr< _internal::nifti_1_header > &head, data::Chunk props );
+	static std::list<data::Chunk> parseHeader( const boost::shared_ptr< _internal::nifti_2_header > &head, data::Chunk props );
 	std::auto_ptr<_internal::WriteOp> getWriteOp( const data::Image &src, util::istring dialect );
+	void setupWrite( data::Image &image, _internal::WriteOp &writer, const std::string &filename, const util::istring &dialect, unsigned int nifti_id );
 	data::ValueArray<bool> bitRead( isis::data::ValueArray< uint8_t > src, size_t length );
-	bool checkSwapEndian ( boost::shared_ptr< _internal::nifti_1_header > header );
+	static bool checkSwapEndian ( _internal::nifti_1_header *header );
+	static bool checkSwapEndian ( _internal::nifti_2_header *header );
 	void flipGeometry( data::Image &image, data::dimensions flipdim );
 public:
 	ImageFormat_NiftiSa();
 	std::string getName()const;
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &/*dialect*/, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & );
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & );
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress, bool metadata_only )  throw( std::runtime_error & );
 	void write( const data::Image &image, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & );
+	bool writeStream( const data::Image &image, std::ostream &out, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & );
 	bool tainted()const {return false;}//internal plugins are not tainted
-	util::istring dialects( const std::string &/*filename*/ )const {return "fsl spm";}
+	bool threadSafe( const std::string &/*filename*/ )const {return true;}
+	util::istring dialects( const std::string &/*filename*/ )const {return "fsl spm rawdcmmeta pwrite";}
+	bool checkMagic( const data::ValueArray<uint8_t> &head )const;
 
 protected:
 	util::istring suffixes( io_modes mode = both )const;
@@ -12,15 +12,18 @@ class ImageFormat_png: public FileFormat
 protected:
 	util::istring suffixes( io_modes /*modes = both */ )const {return ".png";}
 	struct Reader {
-		virtual data::Chunk operator()( png_structp png_ptr, png_infop info_ptr )const = 0;
+		virtual data::Chunk operator()( png_structp png_ptr, png_infop info_ptr, bool metadata_only )const = 0;
 		virtual ~Reader() {}
 	};
 	template<typename TYPE> struct GenericReader: Reader {
-		data::Chunk operator()( png_structp png_ptr, png_infop info_ptr )const {
+		data::Chunk operator()( png_structp png_ptr, png_infop info_ptr, bool metadata_only )const {
 			const png_uint_32 width = png_get_image_width ( png_ptr, info_ptr );
 			const png_uint_32 height = png_get_image_height ( png_ptr, info_ptr );
 			data::Chunk ret = data::MemChunk<TYPE >( width, height );
 
+			if( metadata_only ) // don't decode the image - ret is just a placeholder
+				return ret;
+
 			/* png needs a pointer to each row */
 			boost::scoped_array<png_bytep> row_pointers( new png_bytep[height] );
 
@@ -58,6 +61,9 @@ public:
 	util::istring dialects( const std::string &/*filename*/ ) const {
 		return "middle stacked";
 	}
+	bool checkMagic( const data::ValueArray<uint8_t> &head )const {
+		return head.getLength() >= 8 && png_sig_cmp( const_cast<png_bytep>( &head[0] ), 0, 8 ) == 0;
+	}
 	bool write_png( const std::string &filename, const data::Chunk &src, int color_type, int bit_depth ) {
 		assert( src.getRelevantDims() == 2 );
 		FILE *fp;
@@ -151,7 +157,7 @@ public:
 		return true;
 	}
 
-	data::Chunk read_png( const std::string &filename ) {
+	data::Chunk read_png( const std::string &filename, bool metadata_only ) {
 		png_byte header[8]; // 8 is the maximum size that can be checked
 
 		/* open file and test for it being a png */
@@ -188,20 +194,31 @@ public:
 		png_read_update_info( png_ptr, info_ptr );
 		const png_byte color_type = png_get_color_type ( png_ptr, info_ptr );
 		const png_byte bit_depth = png_get_bit_depth( png_ptr, info_ptr );
-		boost::shared_ptr< Reader > reader = readers[color_type][bit_depth];
+		boost::shared_ptr< Reader > reader; // don't use operator[] here, it would change readers (and load may be called in parallel)
+		const std::map<png_byte, std::map<png_byte, boost::shared_ptr<Reader> > >::const_iterator by_color = readers.find( color_type );
+
+		if( by_color != readers.end() ) {
+			const std::map<png_byte, boost::shared_ptr<Reader> >::const_iterator by_depth = by_color->second.find( bit_depth );
+
+			if( by_depth != by_color->second.end() )
+				reader = by_depth->second;
+		}
 
 		if( !reader ) {
 			LOG( Runtime, error ) << "Sorry, the color type " << ( int )color_type << " with " << ( int )bit_depth << " bits is not supportet.";
 			throwGenericError( "Wrong color type" );
 		}
 
-		data::Chunk ret = ( *reader )( png_ptr, info_ptr );
+		data::Chunk ret = ( *reader )( png_ptr, info_ptr, metadata_only );
 
 		fclose( fp );
 		return ret;
 	}
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ )  throw( std::runtime_error & ) {
-		data::Chunk ch = read_png( filename );
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress )  throw( std::runtime_error & ) {
+		return load( chunks, filename, dialect, progress, false );
+	}
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/, bool metadata_only )  throw( std::runtime_error & ) {
+		data::Chunk ch = read_png( filename, metadata_only );
 
 		if( dialect == "stacked" ) {
 			float slice;
@@ -299,6 +316,7 @@ public:
 
 	}
 	bool tainted()const {return false;}//internal plugins are not tainted
+	bool threadSafe( const std::string &/*filename*/ )const {return true;}
 };
 }
 }
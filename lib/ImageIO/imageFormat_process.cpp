@@ -33,7 +33,10 @@ public:
 	}
 	std::string getName()const {return "process proxy (gets filenames from child process given in the filename)";}
 
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/ ) throw( std::runtime_error & ) {
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> progress ) throw( std::runtime_error & ) {
+		return load( chunks, filename, dialect, progress, false );
+	}
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const util::istring &dialect, boost::shared_ptr<util::ProgressFeedback> /*progress*/, bool metadata_only ) throw( std::runtime_error & ) {
 		size_t red = 0;
 		LOG( Runtime, info ) << "Running " << util::MSubject( filename );
 		FILE *in = popen( filename.c_str(), "r" );
@@ -52,7 +55,7 @@ public:
 			if( got == '\n' ) {
 				if( !fname.empty() ) {
 					LOG( Runtime, info ) << "Got " << util::MSubject( fname ) << " from " << util::MSubject( filename );
-					red += data::IOFactory::load( chunks, fname, dialect.c_str(), "" );
+					red += data::IOFactory::load( chunks, fname, dialect.c_str(), "", metadata_only );
 					fname.clear();
 					fcnt++;
 				}
@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE MemFileTest
+#include <boost/test/unit_test.hpp>
+
+#include "CoreUtils/tmpfile.hpp"
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#endif
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+std::string readAll( const boost::filesystem::path &file )
+{
+	std::ifstream in( file.native().c_str(), std::ios::binary );
+	return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+}
+}
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+
+BOOST_AUTO_TEST_CASE( memfile_write_test )
+{
+	std::string content( 100000, 0 );
+
+	for( size_t i = 0; i < content.size(); i++ )
+		content[i] = i * 7;
+
+	boost::filesystem::path name;
+	{
+		util::MemFile file;
+		BOOST_REQUIRE( file.good() );
+		name = file;
+		BOOST_CHECK( boost::filesystem::exists( file ) );
+		BOOST_CHECK_EQUAL( boost::filesystem::file_size( file ), 0 );
+
+		// append in two parts
+		BOOST_REQUIRE( file.write( content.data(), 1000 ) );
+		BOOST_REQUIRE( file.write( content.data() + 1000, content.size() - 1000 ) );
+		BOOST_CHECK_EQUAL( boost::filesystem::file_size( file ), content.size() );
+		BOOST_CHECK( _internal::readAll( file ) == content );
+	}
+	BOOST_CHECK( !boost::filesystem::exists( name ) ); // the descriptor is closed
+}
+
+BOOST_AUTO_TEST_CASE( memfile_long_name_test )
+{
+	// the name is only for debugging, a name longer than the kernel allows must not make the creation fail
+	util::MemFile file( std::string( 300, 'x' ) );
+	BOOST_CHECK( file.good() );
+}
+
+BOOST_AUTO_TEST_CASE( memfile_fallback_test )
+{
+	// the plugins fall back to a util::TmpFile if MemFile is not good(), so it must behave well on systems without memfd_create
+	// simulate such a system by a seccomp filter failing memfd_create with ENOSYS in a child process
+	std::cout.flush(); // don't let the child print the buffered output again
+	const pid_t child = fork();
+	BOOST_REQUIRE( child >= 0 );
+
+	if( child == 0 ) {
+		struct sock_filter filter[] = {
+			BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( struct seccomp_data, nr ) ),
+			BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, SYS_memfd_create, 0, 1 ),
+			BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS ),
+			BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_ALLOW ),
+		};
+		struct sock_fprog prog = {sizeof( filter ) / sizeof( filter[0] ), filter};
+
+		if( prctl( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) || prctl( PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog ) )
+			_exit( 2 ); // cannot simulate it here
+
+		util::MemFile file;
+		const bool ok = !file.good() && file.empty() && !file.write( "x", 1 );
+		_exit( ok ? 0 : 1 );
+	}
+
+	int status;
+	BOOST_REQUIRE_EQUAL( waitpid( child, &status, 0 ), child );
+	BOOST_REQUIRE( WIFEXITED( status ) );
+
+	if( WEXITSTATUS( status ) == 2 )
+		BOOST_TEST_MESSAGE( "Cannot install a seccomp filter, skipping the fallback test" );
+	else
+		BOOST_CHECK_EQUAL( WEXITSTATUS( status ), 0 );
+}
+
+#else
+
+BOOST_AUTO_TEST_CASE( memfile_unsupported_test )
+{
+	util::MemFile file;
+	BOOST_CHECK( !file.good() );
+	BOOST_CHECK( file.empty() );
+	BOOST_CHECK( !file.write( "x", 1 ) );
+}
+
+#endif
+
+}
+}
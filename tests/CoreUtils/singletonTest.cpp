@@ -1,5 +1,8 @@
 #include "CoreUtils/singletons.hpp"
 #include <iostream>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 
 namespace isis
@@ -17,12 +20,31 @@ public:
 		std::cout << "Deleting SingleTest<" << NUMBER << ">" << std::endl;
 	}
 };
+
+/// counts its creations, and takes its time, so concurrent requests will overlap with the creation
+class SlowSingleTest
+{
+public:
+	static int created;
+	SlowSingleTest() {
+		created++;
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 100 ) );
+		isis::util::Singletons::get<SingleTest<4>, 5>(); // ask for another singleton while being created
+	}
+};
+int SlowSingleTest::created = 0;
+
+void getSlow( SlowSingleTest **got )
+{
+	*got = &isis::util::Singletons::get<SlowSingleTest, 5>();
+}
 }
 }
 using namespace isis::util;
 using namespace isis::test;
 int main()
 {
+	int ret = 0;
 	SingleTest<1> &s1 = Singletons::get<SingleTest<1>, 10>();
 
 	if ( &s1 != &Singletons::get<SingleTest<1>, 0>() )
@@ -33,4 +55,28 @@ int main()
 
 	if ( ( void * )&s1 == ( void * )&Singletons::get<SingleTest<3>, 5>() ) // this should be deleted before SingleTest<2>
 		std::cerr << "request for SingleTest<3> gets Singleton1" << std::endl;
+
+	// several threads asking for the same singleton at the same time must get the same object, and it must be created once
+	const int threads = 16;
+	SlowSingleTest *got[threads];
+	boost::thread_group group;
+
+	for( int i = 0; i < threads; i++ )
+		group.create_thread( boost::bind( getSlow, got + i ) );
+
+	group.join_all();
+
+	if( SlowSingleTest::created != 1 ) {
+		std::cerr << "SlowSingleTest was created " << SlowSingleTest::created << " times" << std::endl;
+		ret = 1;
+	}
+
+	for( int i = 1; i < threads; i++ ) {
+		if( got[i] != got[0] ) {
+			std::cerr << "Concurrent request " << i << " for SlowSingleTest differs" << std::endl;
+			ret = 1;
+		}
+	}
+
+	return ret;
 }
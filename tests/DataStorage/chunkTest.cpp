@@ -329,6 +329,41 @@ BOOST_AUTO_TEST_CASE ( chunk_splice_test )//Copy chunks
 	}
 }
 
+BOOST_AUTO_TEST_CASE ( chunk_splice_values_test )
+{
+	data::MemChunk<float> ch1( 3, 3, 4 );
+	ch1.setPropertyAs( "indexOrigin", util::fvector3( 1, 1, 1 ) );
+	ch1.setPropertyAs( "rowVec", util::fvector3( 1, 0, 0 ) );
+	ch1.setPropertyAs( "columnVec", util::fvector3( 0, 1, 0 ) );
+	ch1.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+
+	std::vector<uint32_t> numbers;
+	std::vector<float> times;
+
+	for( uint32_t i = 0; i < 4; i++ ) {
+		numbers.push_back( 10 + i );
+		times.push_back( i * 0.5 );
+	}
+
+	BOOST_REQUIRE( ch1.setPropertyValuesAt( "acquisitionNumber", numbers ) );
+	BOOST_REQUIRE( ch1.setPropertyValuesAt( "acquisitionTime", times ) );
+	BOOST_CHECK_EQUAL( ch1.propertyValueAt( "acquisitionNumber", 2 ).as<uint32_t>(), uint32_t( 12 ) );
+
+	// the wrong amount of values does not change the property
+	times.pop_back();
+	BOOST_CHECK( !ch1.setPropertyValuesAt( "acquisitionTime", times ) );
+	BOOST_CHECK_EQUAL( ch1.propertyValueAt( "acquisitionTime", 3 ).as<float>(), 1.5f );
+
+	const std::list<data::Chunk> splices = ch1.splice( data::sliceDim );
+	BOOST_REQUIRE_EQUAL( splices.size(), 4 );
+	uint32_t cnt = 0;
+	BOOST_FOREACH( const data::Chunk & ref, splices ) {
+		BOOST_CHECK_EQUAL( ref.getPropertyAs<uint32_t>( "acquisitionNumber" ), 10 + cnt );
+		BOOST_CHECK_EQUAL( ref.getPropertyAs<float>( "acquisitionTime" ), cnt * 0.5f );
+		cnt++;
+	}
+}
+
 BOOST_AUTO_TEST_CASE ( chunk_swap_test )
 {
 	class : public data::VoxelOp<int>
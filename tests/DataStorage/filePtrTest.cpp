@@ -118,5 +118,86 @@ BOOST_AUTO_TEST_CASE( FilePtr_at_test )
 
 }
 
+BOOST_AUTO_TEST_CASE( FilePtr_advise_test )
+{
+	util::TmpFile testfile;
+	const size_t length = 0x30000 + 100; // several pages, and a part of one
+	{
+		data::FilePtr fptr( testfile, length, true );
+		BOOST_REQUIRE( fptr.good() );
+
+		for( size_t i = 0; i < length; i++ )
+			fptr[i] = i % 251;
+	}
+
+	data::FilePtr fptr( testfile ); // read only (a private mapping)
+	BOOST_REQUIRE( fptr.good() );
+
+	// any range within the file is fine, even if its not page aligned
+	BOOST_CHECK( fptr.advise( 0, length, data::FilePtr::sequential ) );
+	BOOST_CHECK( fptr.advise( 10, 100, data::FilePtr::random ) );
+	BOOST_CHECK( fptr.advise( 0x1000 - 1, 2, data::FilePtr::normal ) );
+	BOOST_CHECK( fptr.prefetch( 0x10000, 0x10000 ) );
+
+	// len=0 means up to the end, and a len going behind the end is cut there
+	BOOST_CHECK( fptr.prefetch( 0, 0 ) );
+	BOOST_CHECK( fptr.prefetch( length - 1, 0 ) );
+	BOOST_CHECK( fptr.advise( length - 10, 1000, data::FilePtr::willneed ) );
+
+	// ranges starting at or behind the end are rejected
+	BOOST_CHECK( !fptr.advise( length, 0, data::FilePtr::willneed ) );
+	BOOST_CHECK( !fptr.prefetch( length, 1 ) );
+	BOOST_CHECK( !fptr.prefetch( length + 0x10000, 10 ) );
+	BOOST_CHECK( !data::FilePtr().prefetch( 0, 0 ) ); // and so is everything on a FilePtr which is not mapped
+
+	// the hints never change the data (the result of dontneed is not checked, as it depends on the system)
+	for( size_t i = 0; i < length; i++ )
+		BOOST_REQUIRE_EQUAL( fptr[i], i % 251 );
+
+	// modifications of a private mapping only exist in memory, dontneed must not throw them away
+	data::ValueArray<uint8_t> values = fptr.at<uint8_t>( 0 );
+
+	for( size_t i = 0; i < length; i++ )
+		values[i] = 255 - i % 251;
+
+	fptr.advise( 0, 0, data::FilePtr::dontneed );
+	data::FilePtr::advise( values, data::FilePtr::dontneed );
+
+	for( size_t i = 0; i < length; i++ )
+		BOOST_REQUIRE_EQUAL( values[i], 255 - i % 251 );
+
+	// and the file is not changed
+	boost::filesystem::ifstream in( testfile, std::ios::binary );
+	BOOST_REQUIRE( in.good() );
+
+	for( size_t i = 0; i < length; i++ )
+		BOOST_REQUIRE_EQUAL( in.get(), ( int )( i % 251 ) );
+}
+
+BOOST_AUTO_TEST_CASE( FilePtr_advise_write_test )
+{
+	util::TmpFile testfile;
+	const size_t length = 0x30000 + 100;
+	{
+		data::FilePtr fptr( testfile, length, true ); // a shared mapping
+		BOOST_REQUIRE( fptr.good() );
+
+		for( size_t i = 0; i < length; i++ )
+			fptr[i] = i % 251;
+
+		// dontneed may drop the pages here, but they are in the file, so they are read again
+		BOOST_CHECK( fptr.advise( 0, 0, data::FilePtr::dontneed ) );
+
+		for( size_t i = 0; i < length; i++ )
+			BOOST_REQUIRE_EQUAL( fptr[i], i % 251 );
+	}
+
+	boost::filesystem::ifstream in( testfile, std::ios::binary );
+	BOOST_REQUIRE( in.good() );
+
+	for( size_t i = 0; i < length; i++ )
+		BOOST_REQUIRE_EQUAL( in.get(), ( int )( i % 251 ) );
+}
+
 }
 }
@@ -264,6 +264,104 @@ BOOST_AUTO_TEST_CASE ( minindexdim_test )
 }
 
 
+BOOST_AUTO_TEST_CASE ( image_append_test )
+{
+	std::list<data::Chunk> all;
+	std::vector<std::list<data::Chunk> > volumes( 5 );
+
+	for( uint32_t t = 0; t < 5; t++ ) {
+		for( int s = 0; s < 3; s++ ) {
+			data::Chunk ch = genSlice<float>( 4, 4, s, t * 3 + s );
+			ch.voxel<float>( 1, 2 ) = t * 10 + s;
+			ch.setPropertyAs<std::string>( "sequenceDescription", t < 3 ? "first" : "second" );
+
+			if( t < 4 ) // missing in the last volume
+				ch.setPropertyAs<uint16_t>( "repetitionTime", 2000 );
+
+			volumes[t].push_back( ch );
+			all.push_back( ch );
+		}
+	}
+
+	data::Image img( volumes[0] );
+	data::Image ref( all );
+	BOOST_REQUIRE( img.isClean() );
+	BOOST_REQUIRE( ref.isClean() );
+	BOOST_CHECK_EQUAL( img.getPropertyAs<std::string>( "sequenceDescription" ), "first" );
+
+	for( size_t t = 1; t < 5; t++ ) {
+		BOOST_REQUIRE( img.appendVolume( volumes[t] ) );
+		BOOST_REQUIRE( img.isClean() ); // no reindexing needed
+		BOOST_CHECK_EQUAL( img.getNrOfTimesteps(), t + 1 );
+	}
+
+	BOOST_CHECK_EQUAL( img.getSizeAsVector(), ref.getSizeAsVector() );
+	BOOST_CHECK_EQUAL( img.compare( ref ), 0 );
+
+	for( size_t t = 0; t < 5; t++ ) {
+		for( size_t s = 0; s < 3; s++ ) {
+			const data::Chunk ch = img.getChunk( 0, 0, s, t );
+			BOOST_CHECK_EQUAL( img.voxel<float>( 1, 2, s, t ), t * 10 + s );
+			BOOST_CHECK_EQUAL( ch.getPropertyAs<uint32_t>( "acquisitionNumber" ), t * 3 + s );
+			BOOST_CHECK_EQUAL( ch.getPropertyAs<util::fvector3>( "indexOrigin" ), util::fvector3( 0, 0, s ) );
+			// sequenceDescription is not common anymore, so it must be in the chunks
+			BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "sequenceDescription" ), t < 3 ? "first" : "second" );
+			// repetitionTime is missing in the last volume, which makes it not common as well (as in ref)
+			BOOST_CHECK_EQUAL( ch.hasProperty( "repetitionTime" ), t < 4 );
+			BOOST_CHECK_EQUAL( ch.hasProperty( "repetitionTime" ), ref.getChunk( 0, 0, s, t ).hasProperty( "repetitionTime" ) );
+		}
+	}
+
+	BOOST_CHECK( !img.hasProperty( "sequenceDescription" ) );
+	BOOST_CHECK( !img.hasProperty( "repetitionTime" ) );
+	BOOST_CHECK( !ref.hasProperty( "repetitionTime" ) );
+	BOOST_CHECK( img.hasProperty( "sequenceNumber" ) ); // but this still is
+}
+
+BOOST_AUTO_TEST_CASE ( image_append_reject_test )
+{
+	std::list<data::Chunk> chunks;
+
+	for( int s = 0; s < 3; s++ )
+		chunks.push_back( genSlice<float>( 4, 4, s, s ) );
+
+	data::Image img( chunks );
+	BOOST_REQUIRE( img.isClean() );
+	const util::vector4<size_t> size = img.getSizeAsVector();
+
+	std::list<data::Chunk> volume;
+
+	for( int s = 0; s < 3; s++ )
+		volume.push_back( genSlice<float>( 4, 4, s, 3 + s ) );
+
+	std::list<data::Chunk> incomplete( volume ); // not all positions
+	incomplete.pop_back();
+	BOOST_CHECK( !img.appendVolume( incomplete ) );
+
+	std::list<data::Chunk> moved( volume ); // a new position
+	moved.back().setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 5 ) );
+	BOOST_CHECK( !img.appendVolume( moved ) );
+
+	std::list<data::Chunk> early( volume ); // sorted before the existing chunks
+	early.back().setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
+	BOOST_CHECK( !img.appendVolume( early ) );
+
+	std::list<data::Chunk> bigger( volume ); // a different size
+	bigger.back() = genSlice<float>( 5, 4, 2, 5 );
+	BOOST_CHECK( !img.appendVolume( bigger ) );
+
+	BOOST_CHECK( img.isClean() );
+	BOOST_CHECK_EQUAL( img.getSizeAsVector(), size );
+
+	// the failed attempts must not have left anything behind
+	BOOST_REQUIRE( img.appendVolume( volume ) );
+	BOOST_CHECK_EQUAL( img.getNrOfTimesteps(), 2 );
+
+	data::Image copy( img ); // the copy gets its lookup from the sorted chunks
+	BOOST_CHECK_EQUAL( copy.getSizeAsVector(), img.getSizeAsVector() );
+	BOOST_CHECK_EQUAL( copy.compare( img ), 0 );
+}
+
 BOOST_AUTO_TEST_CASE ( type_selection_test )
 {
 	float org = 0;
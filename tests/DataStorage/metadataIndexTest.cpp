@@ -0,0 +1,218 @@
+#define BOOST_TEST_MODULE MetadataIndexTest
+#include <boost/test/unit_test.hpp>
+
+#include <DataStorage/metadata_index.hpp>
+#include <DataStorage/chunk.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/foreach.hpp>
+#include <iterator>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+/// a directory which is removed with its content when the object is destroyed
+struct TmpDir: boost::filesystem::path {
+	TmpDir(): boost::filesystem::path( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path() ) {
+		boost::filesystem::create_directories( *this );
+	}
+	~TmpDir() {boost::filesystem::remove_all( *this );}
+};
+
+void writeFile( const boost::filesystem::path &file, const std::string &content )
+{
+	boost::filesystem::ofstream out( file, std::ios::binary | std::ios::trunc );
+	out << content;
+}
+
+std::list<data::Chunk> makeChunks()
+{
+	std::list<data::Chunk> ret;
+
+	for( uint32_t i = 0; i < 2; i++ ) {
+		data::MemChunk<int16_t> ch( 3, 4, 5 );
+		ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, i ) );
+		ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+		ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+		ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+		ch.setPropertyAs( "acquisitionNumber", i );
+		ch.setPropertyAs( "sequenceDescription", std::string( "index test" ) );
+		ret.push_back( ch );
+	}
+
+	return ret;
+}
+
+void checkChunks( const std::list<data::Chunk> &got, const std::list<data::Chunk> &expected )
+{
+	BOOST_REQUIRE_EQUAL( got.size(), expected.size() );
+
+	for( std::list<data::Chunk>::const_iterator g = got.begin(), e = expected.begin(); g != got.end(); ++g, ++e ) {
+		BOOST_CHECK_EQUAL( g->getSizeAsVector(), e->getSizeAsVector() );
+		BOOST_CHECK_EQUAL( g->getTypeID(), e->getTypeID() );
+		const util::PropertyMap::DiffMap diff = g->getDifference( *e );
+		BOOST_CHECK_MESSAGE( diff.empty(), "restored chunk differs: " << diff );
+	}
+}
+}
+
+BOOST_AUTO_TEST_CASE( index_hit_test )
+{
+	_internal::TmpDir dir, cache;
+	const boost::filesystem::path file = dir / "image.dat";
+	_internal::writeFile( file, "some data" );
+	const std::list<data::Chunk> chunks = _internal::makeChunks();
+
+	{
+		data::MetadataIndex index( dir, cache );
+		std::list<data::Chunk> got;
+		BOOST_CHECK( !index.get( file, got ) ); // nothing indexed yet
+		index.put( file, chunks.begin(), chunks.end() );
+		BOOST_REQUIRE( index.write() );
+
+		// the index is in the cache, the indexed directory is untouched
+		BOOST_CHECK_EQUAL( index.getFile().parent_path(), cache );
+		BOOST_CHECK( boost::filesystem::exists( index.getFile() ) );
+		BOOST_CHECK_EQUAL( std::distance( boost::filesystem::directory_iterator( dir ), boost::filesystem::directory_iterator() ), 1 );
+	}
+
+	data::MetadataIndex index( dir, cache );
+	std::list<data::Chunk> got;
+	BOOST_REQUIRE( index.get( file, got ) );
+	_internal::checkChunks( got, chunks );
+
+	// another directory does not get the index
+	_internal::TmpDir other;
+	BOOST_CHECK( data::MetadataIndex( other, cache ).getFile() != index.getFile() );
+}
+
+BOOST_AUTO_TEST_CASE( index_stale_test )
+{
+	_internal::TmpDir dir, cache;
+	const boost::filesystem::path resized = dir / "resized.dat", touched = dir / "touched.dat", removed = dir / "removed.dat";
+	_internal::writeFile( resized, "some data" );
+	_internal::writeFile( touched, "some data" );
+	_internal::writeFile( removed, "some data" );
+	const std::list<data::Chunk> chunks = _internal::makeChunks();
+
+	{
+		data::MetadataIndex index( dir, cache );
+		index.put( resized, chunks.begin(), chunks.end() );
+		index.put( touched, chunks.begin(), chunks.end() );
+		index.put( removed, chunks.begin(), chunks.end() );
+		BOOST_REQUIRE( index.write() );
+	}
+
+	_internal::writeFile( resized, "some more data" ); // changes the size
+	boost::filesystem::last_write_time( touched, boost::filesystem::last_write_time( touched ) + 10 ); // changes only the mtime
+	boost::filesystem::remove( removed );
+
+	data::MetadataIndex index( dir, cache );
+	std::list<data::Chunk> got;
+	BOOST_CHECK( !index.get( resized, got ) );
+	BOOST_CHECK( !index.get( touched, got ) );
+	BOOST_CHECK( got.empty() );
+
+	// purge drops the removed file, so the index has to be written
+	index.put( resized, chunks.begin(), chunks.begin() ); // an empty entry
+	index.purge();
+	BOOST_REQUIRE( index.write() );
+
+	data::MetadataIndex reread( dir, cache );
+	BOOST_CHECK( reread.get( resized, got ) );
+	BOOST_CHECK( got.empty() );
+	BOOST_CHECK( !reread.get( removed, got ) );
+}
+
+BOOST_AUTO_TEST_CASE( index_corrupt_test )
+{
+	_internal::TmpDir dir, cache;
+	const boost::filesystem::path file = dir / "image.dat";
+	_internal::writeFile( file, "some data" );
+	const std::list<data::Chunk> chunks = _internal::makeChunks();
+	boost::filesystem::path index_file;
+
+	{
+		data::MetadataIndex index( dir, cache );
+		index.put( file, chunks.begin(), chunks.end() );
+		BOOST_REQUIRE( index.write() );
+		index_file = index.getFile();
+	}
+
+	// a truncated index
+	boost::filesystem::resize_file( index_file, boost::filesystem::file_size( index_file ) - 10 );
+	{
+		data::MetadataIndex index( dir, cache );
+		std::list<data::Chunk> got;
+		BOOST_CHECK( !index.get( file, got ) );
+	}
+
+	// garbage
+	_internal::writeFile( index_file, "this is not an index" );
+	{
+		data::MetadataIndex index( dir, cache );
+		std::list<data::Chunk> got;
+		BOOST_CHECK( !index.get( file, got ) );
+		BOOST_CHECK( index.write() ); // the broken index is replaced even without new entries
+	}
+
+	// an empty file
+	_internal::writeFile( index_file, "" );
+	{
+		data::MetadataIndex index( dir, cache );
+		std::list<data::Chunk> got;
+		BOOST_CHECK( !index.get( file, got ) );
+		index.put( file, chunks.begin(), chunks.end() );
+		BOOST_REQUIRE( index.write() );
+	}
+
+	data::MetadataIndex index( dir, cache );
+	std::list<data::Chunk> got;
+	BOOST_REQUIRE( index.get( file, got ) );
+	_internal::checkChunks( got, chunks );
+}
+
+BOOST_AUTO_TEST_CASE( index_sizes_test )
+{
+	_internal::TmpDir dir, cache;
+	const boost::filesystem::path file = dir / "image.dat";
+	_internal::writeFile( file, "some data" );
+	const std::list<data::Chunk> chunks = _internal::makeChunks();
+	boost::filesystem::path index_file;
+
+	{
+		data::MetadataIndex index( dir, cache );
+		index.put( file, chunks.begin(), chunks.end() );
+		BOOST_REQUIRE( index.write() );
+		index_file = index.getFile();
+	}
+
+	std::string content;
+	{
+		boost::filesystem::ifstream in( index_file, std::ios::binary );
+		content.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+	}
+
+	// the size of the chunks (3x4x5x1) is stored as four uint64_t
+	const uint64_t stored[] = {3, 4, 5, 1};
+	const std::string size( reinterpret_cast<const char *>( stored ), sizeof( stored ) );
+	const size_t pos = content.find( size );
+	BOOST_REQUIRE( pos != std::string::npos );
+
+	// sizes whose product overflows, which are 0, or which claim more voxels than the file can hold, are not restored
+	const uint64_t broken[][4] = {{1ULL << 32, 1ULL << 32, 1 << 16, 1}, {3, 0, 5, 1}, {1ULL << 20, 1 << 10, 5, 1}};
+	BOOST_FOREACH( const uint64_t( &sizes )[4], broken ) {
+		_internal::writeFile( index_file, content.substr( 0, pos ) + std::string( reinterpret_cast<const char *>( sizes ), sizeof( sizes ) ) + content.substr( pos + size.size() ) );
+		data::MetadataIndex index( dir, cache );
+		std::list<data::Chunk> got;
+		BOOST_CHECK( !index.get( file, got ) );
+		BOOST_CHECK( got.empty() );
+	}
+}
+
+}
+}
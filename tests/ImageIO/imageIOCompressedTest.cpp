@@ -0,0 +1,380 @@
+/*
+ * imageIOCompressedTest.cpp
+ *
+ * Checks the proxy plugin for compressed data: files written by its (parallel) compressors must be readable by the
+ * reference implementations, and the files must round-trip through the plugin.
+ */
+
+#define BOOST_TEST_MODULE "imageIOCompressedTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#include <DataStorage/image.hpp>
+#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/tmpfile.hpp>
+
+#include <zlib.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <sstream>
+
+#if defined( HAVE_ZSTD ) || defined( HAVE_LZ4 )
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/copy.hpp>
+#endif
+
+#ifdef HAVE_ZSTD
+#include "imageFormat_compressed_zstd.hpp"
+#endif
+#ifdef HAVE_LZ4
+#include "imageFormat_compressed_lz4.hpp"
+#endif
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+/// an image of 256x256x10 shorts, big enough for several blocks of the parallel compressors
+data::Image makeImage()
+{
+	data::MemChunk<short> ch( 256, 256, 10 );
+	ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+	ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+	ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+
+	uint32_t rnd = 1;
+
+	for( size_t i = 0; i < ch.getVolume(); i++ ) { // something compressible, but not too much
+		rnd = rnd * 1103515245 + 12345;
+		ch.asValueArray<short>()[i] = ( i % 256 ) + ( ( rnd >> 16 ) & 0xF );
+	}
+
+	return data::Image( ch );
+}
+
+std::string readFile( const boost::filesystem::path &file )
+{
+	std::ifstream in( file.native().c_str(), std::ios::binary );
+	return std::string( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+}
+
+/// decompress a gzip file using zlib (which checks the crc and the length of every member)
+bool gunzip( const boost::filesystem::path &file, std::string &out )
+{
+	gzFile gz = gzopen( file.native().c_str(), "rb" );
+
+	if( !gz )
+		return false;
+
+	std::vector<char> buff( 0x10000 );
+	int red;
+
+	while( ( red = gzread( gz, &buff[0], buff.size() ) ) > 0 )
+		out.append( &buff[0], red );
+
+	int err;
+	gzerror( gz, &err );
+	gzclose( gz );
+	return red == 0 && err == Z_OK;
+}
+
+void checkImage( const boost::filesystem::path &file, const data::Image &org )
+{
+	std::list<data::Image> images = data::IOFactory::load( file.native() );
+	BOOST_REQUIRE_EQUAL( images.size(), 1 );
+	const data::Image &img = images.front();
+	BOOST_REQUIRE_EQUAL( img.getSizeAsVector(), org.getSizeAsVector() );
+
+	for( size_t z = 0; z < 10; z++ )
+		for( size_t y = 0; y < 256; y++ )
+			for( size_t x = 0; x < 256; x++ )
+				BOOST_REQUIRE_EQUAL( img.voxel<short>( x, y, z ), org.voxel<short>( x, y, z ) );
+}
+
+#if defined( HAVE_ZSTD ) || defined( HAVE_LZ4 )
+/// data of the given length, compressible but not too much
+std::string makeData( size_t len )
+{
+	std::string ret( len, 0 );
+	uint32_t rnd = 1;
+
+	for( size_t i = 0; i < len; i++ ) {
+		rnd = rnd * 1103515245 + 12345;
+		ret[i] = ( i % 251 ) + ( ( rnd >> 16 ) & 0x7 );
+	}
+
+	return ret;
+}
+
+template<typename COMPRESSOR> std::string compress( const COMPRESSOR &compressor, const std::string &data )
+{
+	std::ostringstream out;
+	BOOST_REQUIRE( compressor( ( const uint8_t * )data.data(), data.size(), out ) );
+	return out.str();
+}
+
+template<typename DECOMPRESSOR> std::string decompress( const std::string &compressed )
+{
+	boost::iostreams::filtering_istream in;
+	in.push( DECOMPRESSOR() );
+	in.push( boost::iostreams::array_source( compressed.data(), compressed.size() ) );
+
+	std::string out;
+	boost::iostreams::copy( in, boost::iostreams::back_inserter( out ) );
+	return out;
+}
+
+/// round trip of the compressor and the decompressor and the decompressor on truncated data
+template<typename COMPRESSOR, typename DECOMPRESSOR> void checkCodec( const COMPRESSOR &compressor, const std::string &suffix )
+{
+	const std::string data = makeData( 0x900000 ); // more than two blocks
+	const std::string compressed = compress( compressor, data );
+	BOOST_CHECK( decompress<DECOMPRESSOR>( compressed ) == data );
+
+	// concatenated streams are decompressed one after another
+	const std::string small = makeData( 1000 );
+	BOOST_CHECK( decompress<DECOMPRESSOR>( compressed + compress( compressor, small ) ) == data + small );
+
+	// nothing in, nothing out
+	BOOST_CHECK( decompress<DECOMPRESSOR>( std::string() ).empty() );
+
+	// data ending within a frame must be reported, not be taken as the end of the data
+	const size_t cuts[] = {compressed.size() - 1, compressed.size() / 2, 10};
+	BOOST_FOREACH( size_t cut, cuts ) {
+		BOOST_TEST_MESSAGE( "decompressing " << suffix << " cut at " << cut << " of " << compressed.size() << " bytes" );
+		BOOST_CHECK_THROW( decompress<DECOMPRESSOR>( compressed.substr( 0, cut ) ), std::ios_base::failure );
+	}
+
+	// the plugin writes and reads images, and does not load truncated files
+	const data::Image img = makeImage();
+	util::TmpFile file( "", ".nii" + suffix );
+	BOOST_REQUIRE( data::IOFactory::write( img, file.native() ) );
+	checkImage( file, img );
+
+	boost::filesystem::resize_file( file, boost::filesystem::file_size( file ) / 2 );
+	util::DefaultMsgPrint::stopBelow( error ); // the failing load is logged as an error, which must not stop the test
+	BOOST_CHECK( data::IOFactory::load( file.native() ).empty() );
+}
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( gzipReferenceTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+	const std::string uncompressed = _internal::readFile( niifile );
+
+	std::string first_gz;
+	const char *dialects[] = {"", "threads1", "threads4", "fast"};
+	BOOST_FOREACH( const char *dialect, dialects ) {
+		BOOST_TEST_MESSAGE( "writing gzip with dialect \"" << dialect << "\"" );
+		util::TmpFile gzfile( "", ".nii.gz" );
+		BOOST_REQUIRE( data::IOFactory::write( img, gzfile.native(), "", dialect ) );
+
+		// zlib must read the blocks compressed in parallel as one valid member, with the content of the uncompressed file
+		std::string gunzipped;
+		BOOST_REQUIRE( _internal::gunzip( gzfile, gunzipped ) );
+		BOOST_REQUIRE_EQUAL( gunzipped.size(), uncompressed.size() );
+		BOOST_CHECK( gunzipped == uncompressed );
+
+		// the amount of threads must not change the result
+		const std::string gz = _internal::readFile( gzfile );
+
+		if( std::string( dialect ) == "" )
+			first_gz = gz;
+		else if( std::string( dialect ).find( "threads" ) == 0 )
+			BOOST_CHECK( gz == first_gz );
+
+		_internal::checkImage( gzfile, img );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( gzipMembersTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile niifile( "", ".nii" ), gzfile( "", ".nii.gz" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+	BOOST_REQUIRE( data::IOFactory::write( img, gzfile.native(), "", "threads4" ) );
+	const std::string uncompressed = _internal::readFile( niifile ), trailing = "another gzip member";
+
+	// the member written by the plugin must end properly, so zlib continues with a member behind it
+	{
+		gzFile append = gzopen( gzfile.native().c_str(), "ab" );
+		BOOST_REQUIRE( append );
+		BOOST_REQUIRE_EQUAL( gzwrite( append, trailing.data(), trailing.size() ), ( int )trailing.size() );
+		BOOST_REQUIRE_EQUAL( gzclose( append ), Z_OK );
+	}
+	std::string gunzipped;
+	BOOST_REQUIRE( _internal::gunzip( gzfile, gunzipped ) );
+	BOOST_CHECK( gunzipped == uncompressed + trailing );
+
+	// and the plugin must read a file made of several members (e.g. concatenated gzip files) as the concatenation of the members
+	util::TmpFile members( "", ".nii.gz" );
+	const size_t half = uncompressed.size() / 2;
+	const char *modes[] = {"wb", "ab"};
+
+	for( int m = 0; m < 2; m++ ) {
+		gzFile gz = gzopen( members.native().c_str(), modes[m] );
+		BOOST_REQUIRE( gz );
+		const std::string part = m ? uncompressed.substr( half ) : uncompressed.substr( 0, half );
+		BOOST_REQUIRE_EQUAL( gzwrite( gz, part.data(), part.size() ), ( int )part.size() );
+		BOOST_REQUIRE_EQUAL( gzclose( gz ), Z_OK );
+	}
+
+	_internal::checkImage( members, img );
+}
+
+BOOST_AUTO_TEST_CASE( gzipIndexDialectTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile gzfile( "", ".nii.gz" );
+	const boost::filesystem::path sidecar( gzfile.native() + ".gzidx" );
+	BOOST_REQUIRE( data::IOFactory::write( img, gzfile.native() ) );
+
+	// a normal load does not write anything next to the file
+	_internal::checkImage( gzfile, img );
+	BOOST_CHECK( !boost::filesystem::exists( sidecar ) );
+
+	// the dialect "index" stores the index
+	std::list<data::Image> images = data::IOFactory::load( gzfile.native(), "", "index" );
+	BOOST_REQUIRE_EQUAL( images.size(), 1 );
+	BOOST_CHECK( images.front().getSizeAsVector() == img.getSizeAsVector() );
+	BOOST_REQUIRE( boost::filesystem::exists( sidecar ) );
+
+	// which is used for the next loads (with or without the dialect)
+	const std::time_t stored = boost::filesystem::last_write_time( sidecar );
+	_internal::checkImage( gzfile, img );
+	BOOST_CHECK_EQUAL( data::IOFactory::load( gzfile.native(), "", "index" ).size(), 1 );
+	BOOST_CHECK_EQUAL( boost::filesystem::last_write_time( sidecar ), stored );
+
+	boost::filesystem::remove( sidecar );
+}
+
+BOOST_AUTO_TEST_CASE( gzipIndexHeaderOnlyTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	data::MemChunk<short> ch( 256, 256, 48 ); // more than one span of the index (4M)
+	ch.join( _internal::makeImage().getChunkAt( 0 ) ); // take the properties of the usual test image
+
+	for( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValueArray<short>()[i] = i * 7;
+
+	const data::Image img( ch );
+	util::TmpFile gzfile( "", ".nii.gz" );
+	const boost::filesystem::path sidecar( gzfile.native() + ".gzidx" );
+	BOOST_REQUIRE( data::IOFactory::write( img, gzfile.native() ) );
+
+	std::list<data::Chunk> full, meta;
+	BOOST_REQUIRE_EQUAL( data::IOFactory::load( full, gzfile.native(), "", "index" ), 1 );
+	BOOST_REQUIRE( boost::filesystem::exists( sidecar ) );
+
+	// destroy the compressed data near the end of the file, but keep its size and time, so the index is still used
+	const std::time_t mtime = boost::filesystem::last_write_time( gzfile );
+	const uintmax_t size = boost::filesystem::file_size( gzfile );
+	{
+		std::fstream io( gzfile.native().c_str(), std::ios::binary | std::ios::in | std::ios::out );
+		io.seekp( size - size / 4 );
+		const std::string zeros( size / 8, 0 );
+		io.write( zeros.data(), zeros.size() );
+	}
+	boost::filesystem::last_write_time( gzfile, mtime );
+
+	// loading only the metadata only inflates the header, so it does not notice
+	BOOST_REQUIRE_EQUAL( data::IOFactory::load( meta, gzfile.native(), "", "", true ), 1 );
+	BOOST_CHECK_EQUAL( meta.front().getSizeAsVector(), full.front().getSizeAsVector() );
+	BOOST_CHECK_EQUAL( meta.front().getTypeID(), full.front().getTypeID() );
+	const util::PropertyMap::DiffMap diff = meta.front().getDifference( full.front() );
+	BOOST_CHECK_MESSAGE( diff.empty(), "metadata differs from full load: " << diff );
+
+	// a full load inflates the destroyed data (it fails, or at least does not get the original voxels)
+	util::DefaultMsgPrint::stopBelow( error );
+	std::list<data::Image> images = data::IOFactory::load( gzfile.native() );
+	bool same = images.size() == 1;
+
+	for( size_t z = 0; same && z < 48; z++ )
+		for( size_t y = 0; same && y < 256; y++ )
+			for( size_t x = 0; same && x < 256; x++ )
+				same = images.front().voxel<short>( x, y, z ) == img.voxel<short>( x, y, z );
+
+	BOOST_CHECK( !same );
+	boost::filesystem::remove( sidecar );
+}
+
+BOOST_AUTO_TEST_CASE( streamedWriteTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+
+	// an image of many chunks, and one of a chunk the nifti plugin splices before it writes it into the compressor (more than 16M)
+	std::list<data::Chunk> slices = _internal::makeImage().getChunkAt( 0 ).splice( data::sliceDim );
+	data::MemChunk<short> big( 256, 256, 160 );
+	big.join( _internal::makeImage().getChunkAt( 0 ) );
+
+	for( size_t i = 0; i < big.getVolume(); i++ )
+		big.asValueArray<short>()[i] = i * 7;
+
+	const data::Image images[] = {data::Image( slices ), data::Image( big )};
+
+	for( int i = 0; i < 2; i++ ) {
+		BOOST_TEST_MESSAGE( "writing an image of " << images[i].copyChunksToVector( false ).size() << " chunks" );
+		util::TmpFile niifile( "", ".nii" );
+		BOOST_REQUIRE( data::IOFactory::write( images[i], niifile.native() ) );
+		const std::string uncompressed = _internal::readFile( niifile );
+
+		// the data streamed into the compressor must be the same as the uncompressed file
+		const char *dialects[] = {"", "threads1"};
+		BOOST_FOREACH( const char *dialect, dialects ) {
+			util::TmpFile gzfile( "", ".nii.gz" );
+			BOOST_REQUIRE( data::IOFactory::write( images[i], gzfile.native(), "", dialect ) );
+			std::string gunzipped;
+			BOOST_REQUIRE( _internal::gunzip( gzfile, gunzipped ) );
+			BOOST_REQUIRE_EQUAL( gunzipped.size(), uncompressed.size() );
+			BOOST_CHECK( gunzipped == uncompressed );
+		}
+
+#ifdef HAVE_ZSTD
+		util::TmpFile zstfile( "", ".nii.zst" );
+		BOOST_REQUIRE( data::IOFactory::write( images[i], zstfile.native() ) );
+		BOOST_CHECK( _internal::decompress<image_io::_internal::zstd_decompressor>( _internal::readFile( zstfile ) ) == uncompressed );
+#endif
+#ifdef HAVE_LZ4
+		util::TmpFile lz4file( "", ".nii.lz4" );
+		BOOST_REQUIRE( data::IOFactory::write( images[i], lz4file.native() ) );
+		BOOST_CHECK( _internal::decompress<image_io::_internal::lz4_decompressor>( _internal::readFile( lz4file ) ) == uncompressed );
+#endif
+	}
+}
+
+#ifdef HAVE_ZSTD
+BOOST_AUTO_TEST_CASE( zstdTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	_internal::checkCodec<image_io::_internal::parallel_zstd, image_io::_internal::zstd_decompressor>( image_io::_internal::parallel_zstd( 3, 4 ), ".zst" );
+}
+#endif
+
+#ifdef HAVE_LZ4
+BOOST_AUTO_TEST_CASE( lz4Test )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	_internal::checkCodec<image_io::_internal::parallel_lz4, image_io::_internal::lz4_decompressor>( image_io::_internal::parallel_lz4( 0, 4 ), ".lz4" );
+}
+#endif
+
+}
+}
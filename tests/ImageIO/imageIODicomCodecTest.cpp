@@ -0,0 +1,202 @@
+/*
+ * imageIODicomCodecTest.cpp
+ *
+ * Writes a dicom series uncompressed and with all available lossless codecs of dcmtk and checks
+ * that the plugin loads the compressed files bit-exactly like the uncompressed ones.
+ */
+
+#define BOOST_TEST_MODULE "imageIODicomCodecTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <DataStorage/chunk.hpp>
+#include <DataStorage/io_factory.hpp>
+
+#define HAVE_CONFIG_H // this is needed for autoconf configured dcmtk (e.g. the debian package)
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dctk.h>
+#include <dcmtk/dcmdata/dcrleerg.h>
+#include <dcmtk/dcmdata/dcrlerp.h>
+#ifdef HAVE_DCMJPEG
+#include <dcmtk/dcmjpeg/djencode.h>
+#include <dcmtk/dcmjpeg/djrplol.h>
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+#include <dcmtk/dcmjpls/djencode.h>
+#include <dcmtk/dcmjpls/djrparam.h>
+#endif //HAVE_DCMJPLS
+
+#include <map>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+const unsigned short rows = 64, columns = 48, slices = 16;
+
+struct Codecs {
+	Codecs() {
+		DcmRLEEncoderRegistration::registerCodecs();
+#ifdef HAVE_DCMJPEG
+		DJEncoderRegistration::registerCodecs();
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+		DJLSEncoderRegistration::registerCodecs();
+#endif //HAVE_DCMJPLS
+	}
+	~Codecs() {
+		DcmRLEEncoderRegistration::cleanup();
+#ifdef HAVE_DCMJPEG
+		DJEncoderRegistration::cleanup();
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+		DJLSEncoderRegistration::cleanup();
+#endif //HAVE_DCMJPLS
+	}
+};
+
+/// temporary directory which is removed with all its content when the test ends (also if it fails)
+struct TmpDir: boost::filesystem::path {
+	TmpDir(): boost::filesystem::path( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "isis_dicom_codecs%%%%-%%%%" ) ) {
+		boost::filesystem::create_directory( *this );
+	}
+	~TmpDir() {boost::filesystem::remove_all( *this );}
+};
+
+uint16_t voxel( size_t i, unsigned short slice ) {return ( i * 7919 + slice * 131 ) & 0xFFFF;} // use all 16 bits
+
+/// create an uncompressed slice (a new one for every codec, because chooseRepresentation changes the dataset)
+std::auto_ptr<DcmFileFormat> makeSlice( unsigned short slice )
+{
+	std::auto_ptr<DcmFileFormat> ret( new DcmFileFormat );
+	DcmDataset *ds = ret->getDataset();
+	const std::string number = boost::lexical_cast<std::string>( slice + 1 );
+	const std::string position = "-24\\-32\\" + boost::lexical_cast<std::string>( slice * 2.5 );
+	const std::string uid = "1.2.826.0.1.3680043.2.1143.7." + number;
+
+	ds->putAndInsertString( DCM_ImageType, "ORIGINAL\\PRIMARY\\M\\ND" );
+	ds->putAndInsertString( DCM_SOPClassUID, UID_MRImageStorage );
+	ds->putAndInsertString( DCM_SOPInstanceUID, uid.c_str() );
+	ds->putAndInsertString( DCM_StudyDate, "20120101" );
+	ds->putAndInsertString( DCM_SeriesDate, "20120101" );
+	ds->putAndInsertString( DCM_AcquisitionDate, "20120101" );
+	ds->putAndInsertString( DCM_SeriesTime, "120000.000000" );
+	ds->putAndInsertString( DCM_AcquisitionTime, "120001.500000" );
+	ds->putAndInsertString( DCM_Modality, "MR" );
+	ds->putAndInsertString( DCM_SeriesDescription, "codec test" );
+	ds->putAndInsertString( DcmTagKey( 0x0010, 0x0010 ), "Test^Patient" );
+	ds->putAndInsertString( DCM_SliceThickness, "2" );
+	ds->putAndInsertString( DCM_RepetitionTime, "2000" );
+	ds->putAndInsertString( DCM_EchoTime, "30" );
+	ds->putAndInsertString( DCM_SeriesNumber, "7" );
+	ds->putAndInsertString( DCM_InstanceNumber, number.c_str() );
+	ds->putAndInsertString( DCM_ImagePositionPatient, position.c_str() );
+	ds->putAndInsertString( DCM_ImageOrientationPatient, "1\\0\\0\\0\\1\\0" );
+	ds->putAndInsertUint16( DCM_SamplesPerPixel, 1 );
+	ds->putAndInsertString( DCM_PhotometricInterpretation, "MONOCHROME2" );
+	ds->putAndInsertUint16( DCM_Rows, rows );
+	ds->putAndInsertUint16( DCM_Columns, columns );
+	ds->putAndInsertString( DCM_PixelSpacing, "1\\1" );
+	ds->putAndInsertUint16( DCM_BitsAllocated, 16 );
+	ds->putAndInsertUint16( DCM_BitsStored, 16 );
+	ds->putAndInsertUint16( DCM_HighBit, 15 );
+	ds->putAndInsertUint16( DCM_PixelRepresentation, 0 );
+
+	std::vector<Uint16> data( rows * columns );
+
+	for( size_t i = 0; i < data.size(); i++ )
+		data[i] = voxel( i, slice );
+
+	ds->putAndInsertUint16Array( DCM_PixelData, &data[0], data.size() );
+	return ret;
+}
+
+bool save( DcmFileFormat &file, const boost::filesystem::path &filename, E_TransferSyntax xfer, const DcmRepresentationParameter *param )
+{
+	DcmDataset *ds = file.getDataset();
+
+	if( xfer != EXS_LittleEndianExplicit && ( ds->chooseRepresentation( xfer, param ).bad() || !ds->canWriteXfer( xfer ) ) )
+		return false;
+
+	return file.saveFile( filename.native().c_str(), xfer ).good();
+}
+
+/// load a directory (so the files are loaded in parallel if possible) and map the chunks to the names of their files
+std::map<std::string, data::Chunk> load( const boost::filesystem::path &dir )
+{
+	std::list<data::Chunk> chunks;
+	std::map<std::string, data::Chunk> ret;
+	data::IOFactory::load( chunks, dir.native() );
+
+	BOOST_FOREACH( const data::Chunk & ch, chunks ) {
+		ret.insert( std::make_pair( boost::filesystem::path( ch.getPropertyAs<std::string>( "source" ) ).stem().string(), ch ) );
+	}
+	return ret;
+}
+}
+
+BOOST_AUTO_TEST_CASE( loadCompressedDicom )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const _internal::Codecs codecs;
+	const _internal::TmpDir dir;
+
+	struct {const char *name; E_TransferSyntax xfer; const DcmRepresentationParameter *param;} formats[] = {
+		{"native", EXS_LittleEndianExplicit, NULL},
+		{"rle", EXS_RLELossless, NULL},
+#ifdef HAVE_DCMJPEG
+		{"jpeg", EXS_JPEGProcess14SV1, NULL}, // lossless, first order prediction
+#endif //HAVE_DCMJPEG
+#ifdef HAVE_DCMJPLS
+		{"jpegls", EXS_JPEGLSLossless, NULL},
+#endif //HAVE_DCMJPLS
+	};
+	const size_t count = sizeof( formats ) / sizeof( formats[0] );
+
+	for( size_t f = 0; f < count; f++ ) {
+		boost::filesystem::create_directory( dir / formats[f].name );
+
+		for( unsigned short s = 0; s < _internal::slices; s++ ) {
+			const boost::filesystem::path filename = dir / formats[f].name / ( "slice" + boost::lexical_cast<std::string>( s ) + ".dcm" );
+			BOOST_REQUIRE_MESSAGE( _internal::save( *_internal::makeSlice( s ), filename, formats[f].xfer, formats[f].param ), "Failed to write " << filename );
+		}
+	}
+
+	// the uncompressed files must contain exactly what was written
+	const std::map<std::string, data::Chunk> native = _internal::load( dir / "native" );
+	BOOST_REQUIRE_EQUAL( native.size(), _internal::slices );
+
+	for( unsigned short s = 0; s < _internal::slices; s++ ) {
+		const std::map<std::string, data::Chunk>::const_iterator found = native.find( "slice" + boost::lexical_cast<std::string>( s ) );
+		BOOST_REQUIRE( found != native.end() );
+		BOOST_REQUIRE( found->second.is<uint16_t>() );
+		const data::ValueArray<uint16_t> voxels = found->second.getValueArray<uint16_t>();
+		BOOST_REQUIRE_EQUAL( voxels.getLength(), _internal::rows * _internal::columns );
+
+		for( size_t i = 0; i < voxels.getLength(); i++ )
+			BOOST_REQUIRE_EQUAL( voxels[i], _internal::voxel( i, s ) );
+	}
+
+	// and the compressed files must give the same
+	for( size_t f = 1; f < count; f++ ) {
+		const std::map<std::string, data::Chunk> compressed = _internal::load( dir / formats[f].name );
+		BOOST_REQUIRE_EQUAL( compressed.size(), _internal::slices );
+
+		for( std::map<std::string, data::Chunk>::const_iterator i = native.begin(); i != native.end(); i++ ) {
+			const std::map<std::string, data::Chunk>::const_iterator found = compressed.find( i->first );
+			BOOST_REQUIRE( found != compressed.end() );
+			BOOST_REQUIRE_EQUAL( found->second.getTypeID(), i->second.getTypeID() );
+			BOOST_REQUIRE( found->second.getSizeAsVector() == i->second.getSizeAsVector() );
+			BOOST_CHECK_MESSAGE( i->second.compare( found->second ) == 0, i->first << " differs after " << formats[f].name << " compression" );
+		}
+	}
+}
+
+}
+}
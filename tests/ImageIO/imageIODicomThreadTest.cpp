@@ -0,0 +1,214 @@
+/*
+ * imageIODicomThreadTest.cpp
+ *
+ * Loads a synthetic dicom series from many threads and compares the result with serial loading.
+ */
+
+#define BOOST_TEST_MODULE "imageIODicomThreadTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <DataStorage/chunk.hpp>
+#include <DataStorage/io_factory.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+/// writes elements in explicit VR little endian (elements must be added in ascending tag order)
+class DicomWriter
+{
+	std::ostringstream m_meta, m_data;
+	static void put16( std::ostream &out, uint16_t val ) {out.put( val & 0xFF ).put( val >> 8 );}
+	static void put32( std::ostream &out, uint32_t val ) {put16( out, val & 0xFFFF );put16( out, val >> 16 );}
+	static void element( std::ostream &out, uint16_t group, uint16_t elem, const char vr[3], const std::string &value ) {
+		put16( out, group );
+		put16( out, elem );
+		out.write( vr, 2 );
+
+		if( std::string( "OB OW SQ UN UT" ).find( vr ) != std::string::npos ) {
+			put16( out, 0 );
+			put32( out, value.length() );
+		} else
+			put16( out, value.length() );
+
+		out.write( value.data(), value.length() );
+	}
+	static std::string pad( std::string value, char padding ) {
+		if( value.length() % 2 )
+			value += padding;
+
+		return value;
+	}
+public:
+	void meta( uint16_t elem, const char vr[3], const std::string &value ) {element( m_meta, 0x0002, elem, vr, value );}
+	void str( uint16_t group, uint16_t elem, const char vr[3], const std::string &value ) {
+		element( m_data, group, elem, vr, pad( value, std::string( "UI" ) == vr ? '\0' : ' ' ) );
+	}
+	void us( uint16_t group, uint16_t elem, uint16_t value ) {
+		std::ostringstream buff;
+		put16( buff, value );
+		element( m_data, group, elem, "US", buff.str() );
+	}
+	void pixels( const std::vector<uint16_t> &data ) {
+		std::ostringstream buff;
+		BOOST_FOREACH( uint16_t val, data ) {
+			put16( buff, val );
+		}
+		element( m_data, 0x7FE0, 0x0010, "OW", buff.str() );
+	}
+	void write( const std::string &filename )const {
+		std::ostringstream group_length;
+		put32( group_length, m_meta.str().length() );
+
+		std::ofstream out( filename.c_str(), std::ios::binary );
+		out << std::string( 128, '\0' ) << "DICM";
+		element( out, 0x0002, 0x0000, "UL", group_length.str() );
+		out << m_meta.str() << m_data.str();
+	}
+};
+
+void writeSlice( const std::string &filename, unsigned short slice, unsigned short series )
+{
+	const unsigned short rows = 64, columns = 48;
+	std::ostringstream instance, position, seriesno, uid;
+	instance << slice + 1;
+	seriesno << series;
+	position << "-24\\-32\\" << slice * 2.5;
+	uid << "1.2.826.0.1.3680043.2.1143." << series << "." << slice + 1;
+
+	DicomWriter dcm;
+	dcm.meta( 0x0001, "OB", std::string( "\0\1", 2 ) );
+	dcm.meta( 0x0002, "UI", std::string( "1.2.840.10008.5.1.4.1.1.4", 26 ) ); // MR Image Storage
+	dcm.meta( 0x0003, "UI", uid.str().length() % 2 ? uid.str() + '\0' : uid.str() );
+	dcm.meta( 0x0010, "UI", std::string( "1.2.840.10008.1.2.1", 20 ) ); // explicit VR little endian
+
+	dcm.str( 0x0008, 0x0008, "CS", "ORIGINAL\\PRIMARY\\M\\ND" ); // ImageType
+	dcm.str( 0x0008, 0x0016, "UI", "1.2.840.10008.5.1.4.1.1.4" ); // SOPClassUID
+	dcm.str( 0x0008, 0x0018, "UI", uid.str() ); // SOPInstanceUID
+	dcm.str( 0x0008, 0x0020, "DA", "20120101" ); // StudyDate
+	dcm.str( 0x0008, 0x0021, "DA", "20120101" ); // SeriesDate
+	dcm.str( 0x0008, 0x0022, "DA", "20120101" ); // AcquisitionDate
+	dcm.str( 0x0008, 0x0031, "TM", "120000.000000" ); // SeriesTime
+	dcm.str( 0x0008, 0x0032, "TM", "120001.500000" ); // AcquisitionTime
+	dcm.str( 0x0008, 0x0060, "CS", "MR" ); // Modality
+	dcm.str( 0x0008, 0x103E, "LO", "thread test" ); // SeriesDescription
+	dcm.str( 0x0010, 0x0010, "PN", "Test^Patient" ); // PatientsName
+	dcm.str( 0x0018, 0x0050, "DS", "2" ); // SliceThickness
+	dcm.str( 0x0018, 0x0080, "DS", "2000" ); // RepetitionTime
+	dcm.str( 0x0018, 0x0081, "DS", "30" ); // EchoTime
+	dcm.str( 0x0020, 0x0011, "IS", seriesno.str() ); // SeriesNumber
+	dcm.str( 0x0020, 0x0013, "IS", instance.str() ); // InstanceNumber
+	dcm.str( 0x0020, 0x0032, "DS", position.str() ); // ImagePositionPatient
+	dcm.str( 0x0020, 0x0037, "DS", "1\\0\\0\\0\\1\\0" ); // ImageOrientationPatient
+	dcm.us( 0x0028, 0x0002, 1 ); // SamplesPerPixel
+	dcm.str( 0x0028, 0x0004, "CS", "MONOCHROME2" ); // PhotometricInterpretation
+	dcm.us( 0x0028, 0x0010, rows );
+	dcm.us( 0x0028, 0x0011, columns );
+	dcm.str( 0x0028, 0x0030, "DS", "1\\1" ); // PixelSpacing
+	dcm.us( 0x0028, 0x0100, 16 ); // BitsAllocated
+	dcm.us( 0x0028, 0x0101, 12 ); // BitsStored
+	dcm.us( 0x0028, 0x0102, 11 ); // HighBit
+	dcm.us( 0x0028, 0x0103, 0 ); // PixelRepresentation
+
+	std::vector<uint16_t> data( rows * columns );
+
+	for( size_t i = 0; i < data.size(); i++ )
+		data[i] = ( i * 7 + slice * 131 ) % 4096;
+
+	dcm.pixels( data );
+	dcm.write( filename );
+}
+
+/// temporary directory which is removed with all its content when the test ends (also if it fails)
+struct TmpDir: boost::filesystem::path {
+	TmpDir(): boost::filesystem::path( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "isis_dicom_threads%%%%-%%%%" ) ) {
+		boost::filesystem::create_directory( *this );
+	}
+	~TmpDir() {boost::filesystem::remove_all( *this );}
+};
+
+struct Loader {
+	data::IOFactory::FileFormatPtr format;
+	std::vector<std::string> files;
+	std::vector<std::list<data::Chunk> > &result;
+	size_t offset;
+	bool &failed;
+	void operator()()const {
+		try {
+			// start at a different file in every thread
+			for( size_t i = 0; i < files.size(); i++ ) {
+				const size_t index = ( i + offset ) % files.size();
+				format->load( result[index], files[index], "", boost::shared_ptr<util::ProgressFeedback>() );
+			}
+		} catch( std::runtime_error & ) {
+			failed = true;
+		}
+	}
+};
+}
+
+BOOST_AUTO_TEST_CASE( parallelDicomLoad )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const size_t slices = 32, threads = 8, rounds = 4;
+
+	const _internal::TmpDir dir;
+	std::vector<std::string> files;
+
+	for( unsigned short s = 0; s < slices; s++ ) {
+		files.push_back( ( dir / ( "slice" + boost::lexical_cast<std::string>( s ) + ".dcm" ) ).native() );
+		_internal::writeSlice( files.back(), s, 3 );
+	}
+
+	const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( files.front() );
+	BOOST_REQUIRE( !formats.empty() );
+	const data::IOFactory::FileFormatPtr format = formats.front();
+	BOOST_REQUIRE_MESSAGE( format->threadSafe( files.front() ), format->getName() << " is not thread safe" );
+
+	// serial reference
+	std::vector<std::list<data::Chunk> > serial( slices );
+
+	for( size_t i = 0; i < slices; i++ ) {
+		BOOST_REQUIRE_EQUAL( format->load( serial[i], files[i], "", boost::shared_ptr<util::ProgressFeedback>() ), 1 );
+		BOOST_REQUIRE( serial[i].front().isValid() );
+	}
+
+	for( size_t r = 0; r < rounds; r++ ) {
+		std::vector<std::vector<std::list<data::Chunk> > > parallel( threads, std::vector<std::list<data::Chunk> >( slices ) );
+		bool failed[threads] = {false};
+		boost::thread_group group;
+
+		for( size_t t = 0; t < threads; t++ ) {
+			const _internal::Loader loader = {format, files, parallel[t], t * slices / threads, failed[t]};
+			group.create_thread( loader );
+		}
+
+		group.join_all();
+
+		for( size_t t = 0; t < threads; t++ ) {
+			BOOST_REQUIRE( !failed[t] );
+
+			for( size_t i = 0; i < slices; i++ ) {
+				BOOST_REQUIRE_EQUAL( parallel[t][i].size(), 1 );
+				const data::Chunk &ref = serial[i].front(), &got = parallel[t][i].front();
+				BOOST_REQUIRE( ref.getSizeAsVector() == got.getSizeAsVector() );
+				BOOST_CHECK_EQUAL( ref.compare( got ), 0 );
+				BOOST_CHECK( ref.getDifference( got ).empty() );
+			}
+		}
+	}
+}
+
+}
+}
@@ -0,0 +1,160 @@
+/*
+ * imageIODicomWriteTest.cpp
+ *
+ * Writes images with the dicom plugin (one file per slice and as enhanced multi-frame file) and checks
+ * that loading them again gives the same voxels and geometry.
+ */
+
+#define BOOST_TEST_MODULE "imageIODicomWriteTest"
+#include <boost/test/unit_test.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#include <DataStorage/io_factory.hpp>
+
+#include <list>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+const size_t rows = 64, columns = 48;
+
+/// temporary directory which is removed with all its content when the test ends (also if it fails)
+struct TmpDir: boost::filesystem::path {
+	TmpDir(): boost::filesystem::path( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "isis_dicom_write%%%%-%%%%" ) ) {
+		boost::filesystem::create_directory( *this );
+	}
+	~TmpDir() {boost::filesystem::remove_all( *this );}
+};
+
+int16_t voxel( size_t i, size_t slice, size_t timestep ) {return ( i * 7919 + slice * 131 + timestep * 1031 ) % 0x10000 - 0x8000;} // use all 16 bits
+
+data::Image makeImage( size_t slices, size_t timesteps )
+{
+	std::list<data::MemChunk<int16_t> > chunks;
+
+	for( size_t t = 0; t < timesteps; t++ ) {
+		for( size_t s = 0; s < slices; s++ ) {
+			data::MemChunk<int16_t> ch( columns, rows );
+			data::ValueArray<int16_t> &voxels = ch.asValueArray<int16_t>();
+
+			for( size_t i = 0; i < voxels.getLength(); i++ )
+				voxels[i] = voxel( i, s, t );
+
+			ch.setPropertyAs( "indexOrigin", util::fvector3( -24, -48, s * 2.5 ) );
+			ch.setPropertyAs( "rowVec", util::fvector3( 1, 0, 0 ) );
+			ch.setPropertyAs( "columnVec", util::fvector3( 0, 1, 0 ) );
+			ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+			ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1.5, 2 ) );
+			ch.setPropertyAs( "voxelGap", util::fvector3( 0, 0, 0.5 ) );
+			ch.setPropertyAs<uint32_t>( "acquisitionNumber", t * slices + s );
+			ch.setPropertyAs<uint16_t>( "sequenceNumber", 5 );
+			ch.setPropertyAs<std::string>( "sequenceDescription", "write test" );
+			ch.setPropertyAs<std::string>( "subjectName", "Test^Patient" );
+			chunks.push_back( ch );
+		}
+	}
+
+	return data::Image( chunks );
+}
+
+/// the image of makeImage as float in [-100,100) (which is written as 16bit integers with RescaleSlope and RescaleIntercept)
+data::Image makeFloatImage( size_t slices, size_t timesteps )
+{
+	const std::vector<data::Chunk> chunks = makeImage( slices, timesteps ).copyChunksToVector();
+	std::list<data::MemChunk<float> > fchunks;
+
+	for( size_t c = 0; c < chunks.size(); c++ ) {
+		fchunks.push_back( data::MemChunk<float>( chunks[c] ) );
+		data::ValueArray<float> &voxels = fchunks.back().asValueArray<float>();
+
+		for( size_t i = 0; i < voxels.getLength(); i++ )
+			voxels[i] /= 327.68;
+	}
+
+	return data::Image( fchunks );
+}
+
+void checkImage( const data::Image &written, const std::list<data::Image> &loaded )
+{
+	BOOST_REQUIRE_EQUAL( loaded.size(), 1 );
+	const data::Image &img = loaded.front();
+
+	BOOST_REQUIRE( img.getSizeAsVector() == written.getSizeAsVector() );
+	BOOST_REQUIRE( img.getMajorTypeID() == data::ValueArray<int16_t>::staticID );
+
+	const char *vectors[] = {"indexOrigin", "rowVec", "columnVec", "voxelSize"};
+
+	for( size_t i = 0; i < sizeof( vectors ) / sizeof( vectors[0] ); i++ ) {
+		BOOST_CHECK_MESSAGE(
+			img.getPropertyAs<util::fvector3>( vectors[i] ).fuzzyEqual( written.getPropertyAs<util::fvector3>( vectors[i] ) ),
+			vectors[i] << " is " << img.propertyValue( vectors[i] ) << " instead of " << written.propertyValue( vectors[i] )
+		);
+	}
+
+	BOOST_CHECK( img.getPropertyAs<util::fvector3>( "voxelGap" ).fuzzyEqual( util::fvector3( 0, 0, 0.5 ) ) );
+	BOOST_CHECK_EQUAL( img.getPropertyAs<uint16_t>( "sequenceNumber" ), 5 );
+	BOOST_CHECK_EQUAL( img.getPropertyAs<std::string>( "sequenceDescription" ), "write test" );
+	BOOST_CHECK_EQUAL( img.getPropertyAs<std::string>( "subjectName" ), "Test^Patient" );
+
+	std::vector<int16_t> expected( written.getVolume() ), got( img.getVolume() );
+	written.copyToMem<int16_t>( &expected[0], expected.size() );
+	img.copyToMem<int16_t>( &got[0], got.size() );
+	BOOST_CHECK_EQUAL_COLLECTIONS( got.begin(), got.end(), expected.begin(), expected.end() );
+}
+}
+
+BOOST_AUTO_TEST_CASE( writeDicomSlices )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const _internal::TmpDir dir;
+	const data::Image img = _internal::makeImage( 8, 1 );
+
+	BOOST_REQUIRE( data::IOFactory::write( img, ( dir / "slices.dcm" ).native() ) );
+	BOOST_REQUIRE( boost::filesystem::exists( dir / "slices_1.dcm" ) );
+	BOOST_REQUIRE( boost::filesystem::exists( dir / "slices_8.dcm" ) );
+
+	_internal::checkImage( img, data::IOFactory::load( dir.native() ) );
+}
+
+BOOST_AUTO_TEST_CASE( writeEnhancedDicom )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const _internal::TmpDir dir;
+	const data::Image img = _internal::makeImage( 8, 3 );
+	BOOST_REQUIRE_EQUAL( img.getSizeAsVector()[data::timeDim], 3 );
+
+	BOOST_REQUIRE( data::IOFactory::write( img, ( dir / "enhanced.dcm" ).native(), "", "enhanced" ) );
+	BOOST_REQUIRE( boost::filesystem::exists( dir / "enhanced.dcm" ) );
+
+	_internal::checkImage( img, data::IOFactory::load( ( dir / "enhanced.dcm" ).native() ) );
+}
+
+BOOST_AUTO_TEST_CASE( writeEnhancedFloatDicom )
+{
+	// the rescaling is stored in the functional groups, which must be applied when loading
+	util::DefaultMsgPrint::stopBelow( warning );
+	const _internal::TmpDir dir;
+	const data::Image img = _internal::makeFloatImage( 8, 2 );
+	BOOST_REQUIRE( img.getMajorTypeID() == data::ValueArray<float>::staticID );
+
+	BOOST_REQUIRE( data::IOFactory::write( img, ( dir / "float.dcm" ).native(), "", "enhanced" ) );
+	const std::list<data::Image> loaded = data::IOFactory::load( ( dir / "float.dcm" ).native() );
+	BOOST_REQUIRE_EQUAL( loaded.size(), 1 );
+	BOOST_REQUIRE( loaded.front().getSizeAsVector() == img.getSizeAsVector() );
+	BOOST_REQUIRE( loaded.front().getMajorTypeID() == data::ValueArray<float>::staticID );
+
+	std::vector<float> expected( img.getVolume() ), got( img.getVolume() );
+	img.copyToMem<float>( &expected[0], expected.size() );
+	loaded.front().copyToMem<float>( &got[0], got.size() );
+
+	for( size_t i = 0; i < got.size(); i++ ) // 16 bit for a range of 200 gives steps of about 0.003
+		BOOST_REQUIRE_SMALL( got[i] - expected[i], 0.01f );
+}
+
+}
+}
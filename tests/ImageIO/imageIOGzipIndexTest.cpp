@@ -0,0 +1,131 @@
+/*
+ * imageIOGzipIndexTest.cpp
+ *
+ * Checks the index for random access into gzip files used by the plugin for compressed data.
+ */
+
+#define BOOST_TEST_MODULE "imageIOGzipIndexTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#include <CoreUtils/tmpfile.hpp>
+#include "imageFormat_compressed_gzindex.hpp"
+
+#include <zlib.h>
+#include <fstream>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+/// data of the given length, compressible but not too much
+std::string makeData( size_t len )
+{
+	std::string ret( len, 0 );
+	uint32_t rnd = 1;
+
+	for( size_t i = 0; i < len; i++ ) {
+		rnd = rnd * 1103515245 + 12345;
+		ret[i] = ( i % 251 ) + ( ( rnd >> 16 ) & 0x7 );
+	}
+
+	return ret;
+}
+
+/// write the given parts as gzip members into the file
+void gzip( const boost::filesystem::path &file, const std::vector<std::string> &parts )
+{
+	for( size_t i = 0; i < parts.size(); i++ ) {
+		gzFile gz = gzopen( file.native().c_str(), i ? "ab" : "wb" );
+		BOOST_REQUIRE( gz );
+		BOOST_REQUIRE_EQUAL( gzwrite( gz, parts[i].data(), parts[i].size() ), ( int )parts[i].size() );
+		BOOST_REQUIRE_EQUAL( gzclose( gz ), Z_OK );
+	}
+}
+
+bool append( std::string *out, const char *data, size_t len )
+{
+	out->append( data, len );
+	return true;
+}
+}
+
+BOOST_AUTO_TEST_CASE( gzindex_build_load_extract_test )
+{
+	const std::string data = _internal::makeData( image_io::_internal::GzipIndex::span * 3 + 12345 ); // several access points
+	util::TmpFile gzfile( "", ".gz" ), sidecar( "", ".gzidx" );
+	_internal::gzip( gzfile, std::vector<std::string>( 1, data ) );
+
+	// build the index while inflating
+	image_io::_internal::GzipIndex index( gzfile );
+	std::string inflated;
+	BOOST_REQUIRE( index.build( boost::bind( _internal::append, &inflated, _1, _2 ) ) );
+	BOOST_REQUIRE( index.valid() );
+	BOOST_CHECK_EQUAL( index.getLength(), data.size() );
+	BOOST_CHECK( inflated == data );
+
+	// the index inflates all spans on its own
+	std::vector<uint8_t> extracted( index.getLength() );
+	BOOST_REQUIRE( index.extractAll( &extracted[0] ) );
+	BOOST_CHECK( std::string( extracted.begin(), extracted.end() ) == data );
+
+	// store it and read it again
+	BOOST_REQUIRE( index.save( sidecar ) );
+	image_io::_internal::GzipIndex loaded( gzfile );
+	BOOST_REQUIRE( loaded.load( sidecar ) );
+	BOOST_CHECK_EQUAL( loaded.getLength(), data.size() );
+
+	std::vector<uint8_t> from_sidecar( loaded.getLength() );
+	BOOST_REQUIRE( loaded.extractAll( &from_sidecar[0] ) );
+	BOOST_CHECK( std::string( from_sidecar.begin(), from_sidecar.end() ) == data );
+}
+
+BOOST_AUTO_TEST_CASE( gzindex_stale_test )
+{
+	const std::string data = _internal::makeData( image_io::_internal::GzipIndex::span + 100 );
+	util::TmpFile gzfile( "", ".gz" ), sidecar( "", ".gzidx" );
+	_internal::gzip( gzfile, std::vector<std::string>( 1, data ) );
+
+	image_io::_internal::GzipIndex index( gzfile );
+	std::string inflated;
+	BOOST_REQUIRE( index.build( boost::bind( _internal::append, &inflated, _1, _2 ) ) );
+	BOOST_REQUIRE( index.save( sidecar ) );
+
+	// a truncated sidecar is ignored
+	boost::filesystem::resize_file( sidecar, boost::filesystem::file_size( sidecar ) - 100 );
+	BOOST_CHECK( !image_io::_internal::GzipIndex( gzfile ).load( sidecar ) );
+
+	// as is the sidecar of an older version of the file
+	BOOST_REQUIRE( index.save( sidecar ) );
+	boost::filesystem::last_write_time( gzfile, boost::filesystem::last_write_time( gzfile ) + 10 );
+	BOOST_CHECK( !image_io::_internal::GzipIndex( gzfile ).load( sidecar ) );
+
+	// and something which is no index at all
+	std::ofstream( sidecar.native().c_str() ) << "no index";
+	BOOST_CHECK( !image_io::_internal::GzipIndex( gzfile ).load( sidecar ) );
+}
+
+BOOST_AUTO_TEST_CASE( gzindex_members_test )
+{
+	// a file of several members is inflated completely, but cannot be indexed
+	std::vector<std::string> parts;
+	parts.push_back( _internal::makeData( 1000 ) );
+	parts.push_back( _internal::makeData( 2000 ) );
+	util::TmpFile gzfile( "", ".gz" ), sidecar( "", ".gzidx" );
+	_internal::gzip( gzfile, parts );
+
+	image_io::_internal::GzipIndex index( gzfile );
+	std::string inflated;
+	BOOST_REQUIRE( index.build( boost::bind( _internal::append, &inflated, _1, _2 ) ) );
+	BOOST_CHECK( inflated == parts[0] + parts[1] );
+	BOOST_CHECK( !index.valid() );
+	BOOST_CHECK( !index.save( sidecar ) );
+}
+
+}
+}
@@ -0,0 +1,146 @@
+/*
+ * imageIOMagicTest.cpp
+ *
+ * Checks that the IOFactory finds the right plugin by the content of a file (FileFormat::checkMagic),
+ * if the suffix of the file is missing or misleading.
+ */
+
+#define BOOST_TEST_MODULE "imageIOMagicTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#include <DataStorage/image.hpp>
+#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/tmpfile.hpp>
+
+#include <fstream>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+data::Image makeImage()
+{
+	data::MemChunk<short> ch( 13, 7, 3 );
+	ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+	ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+	ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+
+	for( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValueArray<short>()[i] = i * 3;
+
+	return data::Image( ch );
+}
+
+data::ValueArray<uint8_t> readHead( const boost::filesystem::path &filename )
+{
+	std::vector<char> buff( image_io::FileFormat::magic_size );
+	std::ifstream in( filename.native().c_str(), std::ios::binary );
+	in.read( &buff[0], buff.size() );
+	data::ValueArray<uint8_t> ret( in.gcount() );
+	std::copy( buff.begin(), buff.begin() + in.gcount(), &ret[0] );
+	return ret;
+}
+
+data::IOFactory::FileFormatPtr formatFor( const std::string &suffix )
+{
+	const data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( "x." + suffix );
+	return formats.empty() ? data::IOFactory::FileFormatPtr() : formats.front();
+}
+
+void checkLoaded( const boost::filesystem::path &filename, const data::Image &org )
+{
+	std::list<data::Image> images = data::IOFactory::load( filename.native() );
+	BOOST_REQUIRE_EQUAL( images.size(), 1 );
+	const data::Image &img = images.front();
+	BOOST_REQUIRE_EQUAL( img.getSizeAsVector(), org.getSizeAsVector() );
+
+	for( size_t z = 0; z < 3; z++ )
+		for( size_t y = 0; y < 7; y++ )
+			for( size_t x = 0; x < 13; x++ )
+				BOOST_REQUIRE_EQUAL( img.voxel<short>( x, y, z ), org.voxel<short>( x, y, z ) );
+}
+}
+
+BOOST_AUTO_TEST_CASE( checkMagicTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+	const data::ValueArray<uint8_t> head = _internal::readHead( niifile );
+
+	const data::IOFactory::FileFormatPtr nifti = _internal::formatFor( "nii" );
+	BOOST_REQUIRE( nifti );
+	BOOST_CHECK( nifti->checkMagic( head ) );
+	BOOST_CHECK( !nifti->checkMagic( data::ValueArray<uint8_t>( ( uint8_t * )NULL, 0 ) ) ); // too short for any header
+
+	const data::IOFactory::FileFormatPtr png = _internal::formatFor( "png" );
+
+	if( png ) {
+		const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+		data::ValueArray<uint8_t> png_head( sizeof( signature ) );
+		std::copy( signature, signature + sizeof( signature ), &png_head[0] );
+
+		BOOST_CHECK( !png->checkMagic( head ) );
+		BOOST_CHECK( png->checkMagic( png_head ) );
+		BOOST_CHECK( !nifti->checkMagic( png_head ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( misnamedSuffixTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+
+	// the png plugin claims the suffix, but does not recognise the content, so the nifti plugin must be used
+	util::TmpFile pngfile( "", ".png" );
+	boost::filesystem::copy_file( niifile, pngfile, boost::filesystem::copy_option::overwrite_if_exists );
+	_internal::checkLoaded( pngfile, img );
+
+	// a suffix no plugin knows
+	util::TmpFile unknown( "", ".unknownsuffix" );
+	boost::filesystem::copy_file( niifile, unknown, boost::filesystem::copy_option::overwrite_if_exists );
+	_internal::checkLoaded( unknown, img );
+}
+
+BOOST_AUTO_TEST_CASE( missingSuffixTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+
+	util::TmpFile nosuffix( "", "" );
+	boost::filesystem::copy_file( niifile, nosuffix, boost::filesystem::copy_option::overwrite_if_exists );
+	_internal::checkLoaded( nosuffix, img );
+}
+
+BOOST_AUTO_TEST_CASE( enforcedSuffixTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img = _internal::makeImage();
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+
+	// if the user enforces a format by the suffix, no other format is added by its magic
+	if( _internal::formatFor( "png" ) ) {
+		std::list<data::Chunk> chunks;
+		BOOST_CHECK_EQUAL( data::IOFactory::load( chunks, niifile.native(), "png" ), 0 );
+		BOOST_CHECK( chunks.empty() );
+	}
+}
+
+}
+}
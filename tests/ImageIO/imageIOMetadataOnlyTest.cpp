@@ -0,0 +1,121 @@
+/*
+ * imageIOMetadataOnlyTest.cpp
+ *
+ * Checks that loading with metadata_only gives the same chunks (size, type and properties) as a full load,
+ * but does not read the voxel data.
+ */
+
+#define BOOST_TEST_MODULE "imageIOMetadataOnlyTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+
+#include <DataStorage/image.hpp>
+#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/tmpfile.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+data::MemChunk<uint16_t> makeChunk( size_t columns, size_t rows, size_t slices, size_t timesteps )
+{
+	data::MemChunk<uint16_t> ch( columns, rows, slices, timesteps );
+	ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+	ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector3( 1, 2, 3 ) );
+	ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	ch.setPropertyAs( "sequenceNumber", ( uint16_t )1 );
+
+	for( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValueArray<uint16_t>()[i] = i * 7;
+
+	return ch;
+}
+
+/// check that both lists contain chunks of the same size, type and properties
+void checkSameMetadata( std::list<data::Chunk> full, std::list<data::Chunk> meta )
+{
+	BOOST_REQUIRE_EQUAL( full.size(), meta.size() );
+
+	for( std::list<data::Chunk>::iterator f = full.begin(), m = meta.begin(); f != full.end(); ++f, ++m ) {
+		BOOST_CHECK_EQUAL( f->getSizeAsVector(), m->getSizeAsVector() );
+		BOOST_CHECK_EQUAL( f->getTypeID(), m->getTypeID() );
+
+		const util::PropertyMap::DiffMap diff = f->getDifference( *m );
+		BOOST_CHECK_MESSAGE( diff.empty(), "metadata differs from full load: " << diff );
+	}
+}
+}
+
+BOOST_AUTO_TEST_CASE( niftiMetadataOnlyTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const data::Image img( _internal::makeChunk( 11, 13, 5, 4 ) );
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+
+	std::list<data::Chunk> full, meta;
+	BOOST_REQUIRE_EQUAL( data::IOFactory::load( full, niifile.native() ), 1 );
+	BOOST_REQUIRE_EQUAL( data::IOFactory::load( meta, niifile.native(), "", "", true ), 1 );
+	_internal::checkSameMetadata( full, meta );
+
+	// the image build from the metadata looks like the original
+	std::list<data::Image> images = data::IOFactory::load( niifile.native(), "", "", true );
+	BOOST_REQUIRE_EQUAL( images.size(), 1 );
+	BOOST_CHECK_EQUAL( images.front().getSizeAsVector(), img.getSizeAsVector() );
+	BOOST_CHECK_EQUAL( images.front().getPropertyAs<util::fvector3>( "voxelSize" ), util::fvector3( 1, 2, 3 ) );
+}
+
+BOOST_AUTO_TEST_CASE( pngMetadataOnlyTest )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+
+	if( data::IOFactory::getFileFormatList( "x.png" ).empty() ) {
+		BOOST_TEST_MESSAGE( "No png plugin found, skipping test" );
+		return;
+	}
+
+	const data::Image img( _internal::makeChunk( 64, 48, 1, 1 ) );
+	util::TmpFile pngfile( "", ".png" );
+	BOOST_REQUIRE( data::IOFactory::write( img, pngfile.native(), "", "middle" ) );
+
+	std::list<data::Chunk> full, meta;
+	data::IOFactory::load( full, pngfile.native() ); // the png plugin does not count its chunks, so check the lists
+	data::IOFactory::load( meta, pngfile.native(), "", "", true );
+	BOOST_REQUIRE_EQUAL( full.size(), 1 );
+	_internal::checkSameMetadata( full, meta );
+
+	// destroy the compressed image data behind the header of the IDAT chunk
+	std::vector<char> file;
+	{
+		std::ifstream in( pngfile.native().c_str(), std::ios::binary );
+		file.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+	}
+	const char idat[] = "IDAT";
+	const std::vector<char>::iterator found = std::search( file.begin(), file.end(), idat, idat + 4 );
+	BOOST_REQUIRE( found != file.end() );
+	std::fill( found + 4, file.end(), 0 );
+	{
+		std::ofstream out( pngfile.native().c_str(), std::ios::binary | std::ios::trunc );
+		out.write( &file[0], file.size() );
+	}
+
+	// decoding the voxel data would fail now (libpng aborts on the broken stream, so a full load is not tried here),
+	// reading only the metadata still works, so it did not touch the voxel data
+	std::list<data::Chunk> broken_meta;
+	data::IOFactory::load( broken_meta, pngfile.native(), "", "", true );
+	_internal::checkSameMetadata( meta, broken_meta );
+}
+
+}
+}
@@ -0,0 +1,133 @@
+/*
+ * imageIONiftiKernelTest.cpp
+ *
+ * Checks the vectorised kernels of the nifti plugin against the plain loops, and the bit (un)packing for binary images.
+ */
+
+#define BOOST_TEST_MODULE "imageIONiftiKernelTest"
+#include <boost/test/unit_test.hpp>
+
+#include "imageFormat_nifti_kernels.hpp"
+
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+// lengths around the register sizes (16 bytes / 4 floats) and bigger ones with a rest
+const size_t lengths[] = {0, 1, 2, 3, 4, 5, 15, 16, 17, 31, 32, 33, 47, 48, 49, 1000, 1013};
+
+template<typename T> T value( size_t i ) {return static_cast<T>( ( i * 37 + 11 ) % 251 );}
+template<> float value<float>( size_t i ) {return i * 0.25f - 100;}
+
+template<typename T> void checkInterleave()
+{
+	for( size_t l = 0; l < sizeof( lengths ) / sizeof( size_t ); l++ ) {
+		const size_t len = lengths[l];
+		BOOST_TEST_MESSAGE( "checking " << len << " triplets" );
+		std::vector<T> planes( len * 3 + 1 ), interleaved( len * 3 + 1 ), scalar( len * 3 + 1 ); // one more, so &[0] is valid for len==0
+
+		for( size_t i = 0; i < len * 3; i++ )
+			planes[i] = value<T>( i );
+
+		// interleave
+		image_io::_internal::interleave3<T>( &planes[0], &planes[len], &planes[len * 2], &interleaved[0], len );
+		image_io::_internal::interleave3Scalar<T>( &planes[0], &planes[len], &planes[len * 2], &scalar[0], len );
+		BOOST_CHECK( interleaved == scalar );
+
+		for( size_t i = 0; i < len; i++ )
+			for( size_t p = 0; p < 3; p++ )
+				BOOST_REQUIRE_EQUAL( interleaved[i * 3 + p], planes[p * len + i] );
+
+		// and back
+		std::vector<T> deinterleaved( len * 3 + 1 ), deinterleaved_scalar( len * 3 + 1 );
+		image_io::_internal::deinterleave3<T>( &interleaved[0], &deinterleaved[0], &deinterleaved[len], &deinterleaved[len * 2], len );
+		image_io::_internal::deinterleave3Scalar<T>( &interleaved[0], &deinterleaved_scalar[0], &deinterleaved_scalar[len], &deinterleaved_scalar[len * 2], len );
+		BOOST_CHECK( deinterleaved == deinterleaved_scalar );
+		BOOST_CHECK( deinterleaved == planes );
+	}
+}
+}
+
+BOOST_AUTO_TEST_CASE( interleaveBytesTest )
+{
+	BOOST_TEST_MESSAGE( "the SSSE3 kernels are " << ( image_io::_internal::hasSSSE3() ? "" : "not " ) << "used" );
+	_internal::checkInterleave<uint8_t>();
+}
+
+BOOST_AUTO_TEST_CASE( interleaveFloatsTest )
+{
+	_internal::checkInterleave<float>();
+}
+
+BOOST_AUTO_TEST_CASE( packBitsTest )
+{
+	// the whole bytes are packed 8 at a time, the rest bit by bit, so check lengths with any rest
+	for( size_t len = 0; len <= 70; len++ ) {
+		BOOST_TEST_MESSAGE( "checking " << len << " bits" );
+		const size_t bytes = ( len + 7 ) / 8;
+		std::vector<bool> ref( len ); // std::vector<bool> is packed, so it can't be used as input
+		bool *bools = new bool[len + 1];
+
+		for( size_t i = 0; i < len; i++ )
+			bools[i] = ref[i] = ( i * 7 + len ) % 3 == 0;
+
+		std::vector<uint8_t> packed( bytes + 1, 0xAA ); // one byte more to see if anything is written behind the data
+		image_io::_internal::packBits( bools, &packed[0], len );
+
+		for( size_t i = 0; i < len; i++ ) // the first voxel is the highest bit of the first byte
+			BOOST_REQUIRE_EQUAL( ( packed[i / 8] >> ( 7 - i % 8 ) ) & 1, ref[i] );
+
+		if( len % 8 ) // the unused bits of the last byte are 0
+			BOOST_CHECK_EQUAL( packed[bytes - 1] & ( 0xFF >> ( len % 8 ) ), 0 );
+
+		BOOST_CHECK_EQUAL( packed[bytes], 0xAA );
+
+		// and back
+		bool *unpacked = new bool[len + 1];
+		unpacked[len] = true; // must not be overwritten
+		image_io::_internal::unpackBits( &packed[0], unpacked, len );
+
+		for( size_t i = 0; i < len; i++ )
+			BOOST_REQUIRE_EQUAL( unpacked[i], ref[i] );
+
+		BOOST_CHECK( unpacked[len] );
+		delete[] unpacked;
+		delete[] bools;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( packBitsOffsetTest )
+{
+	// packing at a bit offset must only change the bits of the data, the others may belong to data written before or after
+	for( unsigned int first_bit = 0; first_bit < 8; first_bit++ ) {
+		for( size_t len = 0; len <= 30; len++ ) {
+			BOOST_TEST_MESSAGE( "checking " << len << " bits at bit " << first_bit );
+			const size_t bytes = ( first_bit + len + 7 ) / 8;
+			bool *bools = new bool[len + 1];
+
+			for( size_t i = 0; i < len; i++ )
+				bools[i] = ( i * 7 + len ) % 3 == 0;
+
+			std::vector<uint8_t> packed( bytes + 1, 0xA5 );
+			image_io::_internal::packBits( bools, &packed[0], len, first_bit );
+
+			for( size_t b = 0; b < ( bytes + 1 ) * 8; b++ ) {
+				const int bit = ( packed[b / 8] >> ( 7 - b % 8 ) ) & 1;
+
+				if( b >= first_bit && b < first_bit + len )
+					BOOST_REQUIRE_EQUAL( bit, bools[b - first_bit] );
+				else
+					BOOST_REQUIRE_EQUAL( bit, ( 0xA5 >> ( 7 - b % 8 ) ) & 1 );
+			}
+
+			delete[] bools;
+		}
+	}
+}
+
+}
+}
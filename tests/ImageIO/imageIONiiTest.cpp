@@ -16,7 +16,11 @@ using namespace isis;
 #include <boost/test/unit_test.hpp>
 #define BOOST_FILESYSTEM_VERSION 3 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <string>
 
 namespace isis
@@ -150,6 +154,270 @@ BOOST_AUTO_TEST_CASE( loadsaveSFormImage )
 
 }
 
+BOOST_AUTO_TEST_CASE( loadsaveNifti2Image )
+{
+	// nifti-1 cannot store more than 32767 voxel per dimension, so this must be written as nifti-2
+	data::MemChunk<short> ch( 40000, 3 );
+	ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+	ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+	ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+
+	for( size_t y = 0; y < 3; y++ )
+		for( size_t x = 0; x < 40000; x++ )
+			ch.voxel<short>( x, y ) = x % 1000 + y;
+
+	data::Image img( ch );
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( img, niifile.native() ) );
+
+	// check the header
+	std::ifstream in( niifile.native().c_str(), std::ios::binary );
+	int32_t sizeof_hdr;
+	char magic[8];
+	in.read( reinterpret_cast<char *>( &sizeof_hdr ), 4 );
+	in.read( magic, 8 );
+	BOOST_CHECK_EQUAL( sizeof_hdr, 540 );
+	BOOST_CHECK( memcmp( magic, "n+2\0\r\n\032\n", 8 ) == 0 );
+
+	std::list<data::Image> images = data::IOFactory::load( niifile.native() );
+	BOOST_REQUIRE_EQUAL( images.size(), 1 );
+	data::Image &img2 = images.front();
+	BOOST_REQUIRE_EQUAL( img2.getSizeAsVector(), img.getSizeAsVector() );
+
+	for( size_t y = 0; y < 3; y++ )
+		for( size_t x = 0; x < 40000; x += 99 )
+			BOOST_REQUIRE_EQUAL( img2.voxel<short>( x, y ), ch.voxel<short>( x, y ) );
+}
+
+BOOST_AUTO_TEST_CASE( parallelWriteImage )
+{
+	// the chunks of an image are written in parallel, which must give the same file as writing them one after another
+	const size_t slices = 20;
+	data::MemChunk<short> volume( 64, 64, slices );
+	std::list<data::Chunk> chunks;
+
+	for( size_t z = 0; z < slices; z++ ) {
+		data::MemChunk<short> slice( 64, 64 );
+
+		for( size_t y = 0; y < 64; y++ )
+			for( size_t x = 0; x < 64; x++ )
+				volume.voxel<short>( x, y, z ) = slice.voxel<short>( x, y ) = ( x * 7 + y * 13 + z * 101 ) % 30000;
+
+		slice.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, z ) );
+		slice.setPropertyAs( "acquisitionNumber", ( uint32_t )z );
+		chunks.push_back( slice );
+	}
+
+	volume.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	volume.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	chunks.push_back( volume );
+
+	BOOST_FOREACH( data::Chunk & ch, chunks ) {
+		ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+		ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+		ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+		ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+		ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+	}
+
+	// the image of the volume is written in one piece, the image of the slices in parallel
+	const data::Image serial( chunks.back() );
+	chunks.pop_back();
+	const data::Image parallel( chunks );
+	BOOST_REQUIRE( serial.isClean() && parallel.isClean() );
+	BOOST_REQUIRE_EQUAL( parallel.getSizeAsVector(), serial.getSizeAsVector() );
+	BOOST_REQUIRE_EQUAL( parallel.copyChunksToVector().size(), slices );
+
+	util::TmpFile serial_file( "", ".nii" ), parallel_file( "", ".nii" ), pwrite_file( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( serial, serial_file.native() ) );
+	BOOST_REQUIRE( data::IOFactory::write( parallel, parallel_file.native() ) );
+	BOOST_REQUIRE( data::IOFactory::write( parallel, pwrite_file.native(), "", "pwrite" ) ); // enforce pwrite instead of the mapped output
+
+	std::string files[3];
+	const util::TmpFile *names[3] = {&serial_file, &parallel_file, &pwrite_file};
+
+	for( int i = 0; i < 3; i++ ) {
+		std::ifstream in( names[i]->native().c_str(), std::ios::binary );
+		files[i].assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+	}
+
+	// the headers might differ by the properties of the chunks, the voxel data (at the end of the file) must not
+	const size_t datasize = 64 * 64 * slices * sizeof( short );
+	BOOST_REQUIRE_EQUAL( files[1].size(), files[0].size() );
+	BOOST_REQUIRE_GT( files[0].size(), datasize );
+	BOOST_CHECK( files[1].compare( files[1].size() - datasize, datasize, files[0], files[0].size() - datasize, datasize ) == 0 );
+
+	// writing with pwrite must give exactly the same file
+	BOOST_CHECK( files[2] == files[1] );
+}
+
+BOOST_AUTO_TEST_CASE( bitWriteTest )
+{
+	// a mask of slices of 9 voxels, so all but the first slice start within a byte of the file, which they share with the slice before
+	const size_t slices = 4;
+	std::list<data::Chunk> chunks;
+
+	for( size_t z = 0; z < slices; z++ ) {
+		data::MemChunk<bool> slice( 3, 3 );
+
+		for( size_t y = 0; y < 3; y++ )
+			for( size_t x = 0; x < 3; x++ )
+				slice.voxel<bool>( x, y ) = ( x + y * 3 + z * 9 ) % 3 != 1;
+
+		slice.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, z ) );
+		slice.setPropertyAs( "acquisitionNumber", ( uint32_t )z );
+		slice.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+		slice.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+		slice.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+		slice.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+		slice.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+		chunks.push_back( slice );
+	}
+
+	const data::Image mask( chunks );
+	BOOST_REQUIRE( mask.isClean() );
+	BOOST_REQUIRE_EQUAL( mask.copyChunksToVector().size(), slices );
+
+	const char *dialects[] = {"", "pwrite"};
+	BOOST_FOREACH( const char *dialect, dialects ) {
+		BOOST_TEST_MESSAGE( "writing a mask with dialect \"" << dialect << "\"" );
+		util::TmpFile niifile( "", ".nii" );
+		BOOST_REQUIRE( data::IOFactory::write( mask, niifile.native(), "", dialect ) );
+
+		std::list<data::Image> images = data::IOFactory::load( niifile.native() );
+		BOOST_REQUIRE_EQUAL( images.size(), 1 );
+		const data::Image &loaded = images.front();
+		BOOST_REQUIRE_EQUAL( loaded.getSizeAsVector(), mask.getSizeAsVector() );
+		BOOST_REQUIRE( loaded.getMajorTypeID() == data::ValueArray<bool>::staticID );
+
+		for( size_t z = 0; z < slices; z++ )
+			for( size_t y = 0; y < 3; y++ )
+				for( size_t x = 0; x < 3; x++ )
+					BOOST_CHECK_EQUAL( loaded.voxel<bool>( x, y, z ), mask.voxel<bool>( x, y, z ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( loadDirectoryTest )
+{
+	// the files of a directory can be loaded by a pool of threads, which must give the same chunks as loading them one by one
+	util::DefaultMsgPrint::stopBelow( warning );
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories( dir );
+	const uint16_t files = 16;
+
+	for( uint16_t i = 0; i < files; i++ ) {
+		data::MemChunk<short> ch( 32, 32, 4 );
+
+		for( size_t v = 0; v < ch.getVolume(); v++ )
+			ch.asValueArray<short>()[v] = v * 3 + i * 1000;
+
+		ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, i ) );
+		ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+		ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+		ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+		ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+		ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+		ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+		BOOST_REQUIRE( data::IOFactory::write( data::Image( ch ), ( dir / ( "image" + boost::lexical_cast<std::string>( i ) + ".nii" ) ).native() ) );
+	}
+
+	// a file no plugin can read is left to the serial loading
+	std::ofstream( ( dir / "notes.txt" ).native().c_str() ) << "not an image";
+
+	std::list<data::Chunk> single;
+
+	for( boost::filesystem::directory_iterator i( dir ); i != boost::filesystem::directory_iterator(); ++i ) {
+		if( i->path().extension() == ".nii" ) {
+			std::list<data::Chunk> file;
+			BOOST_REQUIRE_EQUAL( data::IOFactory::load( file, i->path().native() ), 1 );
+			single.splice( single.end(), file );
+		}
+	}
+
+	BOOST_REQUIRE_EQUAL( single.size(), files );
+	util::DefaultMsgPrint::stopBelow( error ); // failing to load notes.txt is logged as an error, which must not stop the test
+
+	const unsigned int threads[] = {1, 0, 4, 0}; // the default, one per core, and a fixed amount
+
+	for( int run = 0; run < 4; run++ ) {
+		std::list<data::Chunk> parallel;
+		data::IOFactory::setLoadThreads( threads[run] );
+		BOOST_REQUIRE_EQUAL( data::IOFactory::load( parallel, dir.native() ), files );
+		BOOST_REQUIRE_EQUAL( parallel.size(), files );
+
+		// in the same order (the order of the directory)
+		for( std::list<data::Chunk>::iterator p = parallel.begin(), s = single.begin(); p != parallel.end(); ++p, ++s ) {
+			BOOST_REQUIRE_EQUAL( p->getPropertyAs<std::string>( "source" ), s->getPropertyAs<std::string>( "source" ) );
+			BOOST_REQUIRE_EQUAL( p->getSizeAsVector(), s->getSizeAsVector() );
+			BOOST_REQUIRE_EQUAL( p->getTypeID(), s->getTypeID() );
+
+			for( size_t v = 0; v < p->getVolume(); v++ )
+				BOOST_REQUIRE_EQUAL( p->asValueArray<short>()[v], s->asValueArray<short>()[v] );
+		}
+	}
+
+	data::IOFactory::setLoadThreads( 1 );
+	boost::filesystem::remove_all( dir );
+}
+
+BOOST_AUTO_TEST_CASE( brokenExtensionTest )
+{
+	// an extension with an esize smaller than its own header must be ignored (not be read with a wrapped around length)
+	util::DefaultMsgPrint::stopBelow( warning );
+	data::MemChunk<short> ch( 16, 16, 4 );
+
+	for( size_t v = 0; v < ch.getVolume(); v++ )
+		ch.asValueArray<short>()[v] = v;
+
+	ch.setPropertyAs( "indexOrigin", util::fvector3( 0, 0, 0 ) );
+	ch.setPropertyAs( "rowVec", util::fvector3( 1, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector3( 0, 1 ) );
+	ch.setPropertyAs( "sliceVec", util::fvector3( 0, 0, 1 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector3( 1, 1, 1 ) );
+	ch.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	ch.setPropertyAs( "sequenceNumber", ( uint16_t )0 );
+	util::TmpFile niifile( "", ".nii" );
+	BOOST_REQUIRE( data::IOFactory::write( data::Image( ch ), niifile.native() ) );
+
+	std::string file;
+	{
+		std::ifstream in( niifile.native().c_str(), std::ios::binary );
+		file.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+	}
+	float vox_offset;
+	memcpy( &vox_offset, &file[108], 4 );
+	BOOST_REQUIRE_EQUAL( vox_offset, 352 );
+	const std::string voxels = file.substr( 352 );
+	vox_offset = 352 + 16; // room for the header of one extension and 8 bytes of it
+	memcpy( &file[108], &vox_offset, 4 );
+
+	const uint32_t esizes[] = {0, 4, 1000};
+	BOOST_FOREACH( uint32_t esize, esizes ) {
+		BOOST_TEST_MESSAGE( "loading a nifti extension of the size " << esize );
+		const uint32_t ext_hdr[] = {esize, 0};
+		std::string broken = file.substr( 0, 348 );
+		broken.append( "\1\0\0\0", 4 ); // there are extensions
+		broken.append( ( const char * )ext_hdr, 8 );
+		broken.append( 8, 'x' );
+		broken.append( voxels );
+		{
+			std::ofstream out( niifile.native().c_str(), std::ios::binary | std::ios::trunc );
+			out.write( broken.data(), broken.size() );
+		}
+
+		std::list<data::Chunk> loaded;
+		BOOST_REQUIRE_EQUAL( data::IOFactory::load( loaded, niifile.native() ), 1 );
+		BOOST_REQUIRE_EQUAL( loaded.front().getVolume(), ch.getVolume() );
+
+		for( size_t v = 0; v < ch.getVolume(); v++ )
+			BOOST_REQUIRE_EQUAL( loaded.front().voxel<short>( v % 16, ( v / 16 ) % 16, v / 256 ), ( short )v );
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }
@@ -0,0 +1,221 @@
+/*
+ * imageIOSiemensTcpIpTest.cpp
+ *
+ * Replays recorded images of the Siemens real time export to the SiemensTcpIp plugin over a loopback socket,
+ * checks the received chunks and reports the latency from sending to the loaded chunk for every image.
+ */
+
+#define BOOST_TEST_MODULE "imageIOSiemensTcpIpTest"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <DataStorage/chunk.hpp>
+#include <DataStorage/io_factory.hpp>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+namespace _internal
+{
+const uint16_t port = 54329;
+const std::string source = "54329.tcpip"; // the plugin takes the port from the filename
+const size_t packet_size = 32768;
+
+uint16_t voxel( size_t i, size_t slice, size_t volume ) {return ( i * 7919 + slice * 131 + volume * 1031 ) & 0xFFFF;} // use all 16 bits
+
+std::string entry( const std::string &name, const std::string &value )
+{
+	return "<" + name + ">\n" + value + "\n</" + name + ">\n";
+}
+
+/// an image as the scanner sends it, split into datagrams
+struct Recording {
+	size_t width, height, images; // size of the slices
+	bool mosaic;
+	std::vector<std::string> datagrams;
+
+	Recording( size_t _width, size_t _height, size_t _images, bool _mosaic, size_t volume ): width( _width ), height( _height ), images( _images ), mosaic( _mosaic ) {
+		const size_t matrix = mosaic ? static_cast<size_t>( std::ceil( std::sqrt( double( images ) ) ) ) : 1;
+		const size_t data_width = width * matrix, data_height = height * matrix;
+		std::vector<uint16_t> data( data_width * data_height );
+
+		for( size_t y = 0; y < data_height; y++ ) {
+			for( size_t x = 0; x < data_width; x++ ) {
+				const size_t slice = ( y / height ) * matrix + x / width;
+
+				if( slice < images )
+					data[y * data_width + x] = voxel( ( y % height ) * width + x % width, slice, volume );
+			}
+		}
+
+		const std::string payload( reinterpret_cast<const char *>( &data[0] ), data.size() * sizeof( uint16_t ) );
+		const std::string header =
+			"<data_block_header>\n" +
+			entry( "data_size_in_bytes", boost::lexical_cast<std::string>( payload.size() ) ) +
+			entry( "width", boost::lexical_cast<std::string>( data_width ) ) +
+			entry( "height", boost::lexical_cast<std::string>( data_height ) ) +
+			entry( "mosaic", mosaic ? "yes" : "no" ) +
+			entry( "images_in_mosaic", boost::lexical_cast<std::string>( images ) ) +
+			entry( "data_type", "short" ) +
+			entry( "acquisition_number", boost::lexical_cast<std::string>( volume ) ) +
+			entry( "sequence_description", "tcpip test" ) +
+			entry( "patient_name", "Test^Patient" ) +
+			entry( "patient_sex", "2" ) +
+			entry( "meas_uid", "7" ) +
+			entry( "repetition_time", "2000" ) +
+			entry( "read_vector", "1,0,0" ) +
+			entry( "phase_vector", "0,1,0" ) +
+			entry( "slice_norm_vector", "0,0,1" ) +
+			entry( "inplane_rotation", "0" ) +
+			entry( "slice_orientation", "TRANSVERSE" ) +
+			entry( "fov_read", boost::lexical_cast<std::string>( width * 3 ) ) +
+			entry( "fov_phase", boost::lexical_cast<std::string>( height * 3 ) ) +
+			entry( "slice_thickness", "3" ) +
+			entry( "slice_position_0", "-96,-96," + boost::lexical_cast<std::string>( volume ) ) +
+			"</data_block_header>";
+
+		const std::string stream = header + payload;
+
+		for( size_t pos = 0; pos < stream.size(); pos += packet_size )
+			datagrams.push_back( stream.substr( pos, packet_size ) );
+	}
+};
+
+/**
+ * Sends a recording to the plugin once its socket is bound.
+ * Until then the socket of the sender is refused (the kernel answers with "port unreachable"), so it pings the port
+ * with datagrams the plugin ignores (they have no header) until a ping is not refused anymore.
+ * The recording itself is sent exactly once, so no late duplicate can be taken for the next image.
+ */
+struct Sender {
+	const Recording &recording;
+	boost::posix_time::ptime &sent;
+	bool bound( int sock )const {
+		send( sock, "ping", 4, 0 );
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 10 ) ); // give the refusal time to come back
+		int err = 0;
+		socklen_t len = sizeof( err );
+		getsockopt( sock, SOL_SOCKET, SO_ERROR, &err, &len ); // reads and clears the pending error
+		return err != ECONNREFUSED;
+	}
+	void operator()()const {
+		const int sock = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+		sockaddr_in address;
+		memset( &address, 0, sizeof( address ) );
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		address.sin_port = htons( port );
+		connect( sock, ( const sockaddr * )&address, sizeof( address ) );
+
+		for( int wait = 0; !bound( sock ); wait++ ) {
+			if( wait == 500 ) { // end the series, so the plugin does not wait forever if it binds after all
+				BOOST_ERROR( "The plugin did not bind UDP port " << port );
+				send( sock, "<series_finished>", 17, 0 );
+				close( sock );
+				return;
+			}
+		}
+
+		sent = boost::posix_time::microsec_clock::universal_time();
+		BOOST_FOREACH( const std::string & datagram, recording.datagrams ) {
+			send( sock, datagram.data(), datagram.size(), 0 );
+		}
+		close( sock );
+	}
+};
+
+/// replay a recording and load it, returns the time from the start of the sending to the loaded chunk
+boost::posix_time::time_duration replay( const Recording &recording, std::list<data::Chunk> &chunks, const util::istring &dialect )
+{
+	boost::posix_time::ptime sent;
+	const Sender sender = {recording, sent};
+	boost::thread thread( sender );
+
+	const size_t before = chunks.size();
+	data::IOFactory::load( chunks, source, "", dialect );
+	const boost::posix_time::ptime loaded = boost::posix_time::microsec_clock::universal_time();
+
+	thread.join();
+	BOOST_REQUIRE_EQUAL( chunks.size(), before + 1 );
+	return loaded - sent;
+}
+
+void checkChunk( const data::Chunk &chunk, const Recording &recording, size_t volume )
+{
+	BOOST_REQUIRE( chunk.getSizeAsVector() == util::vector4<size_t>( recording.width, recording.height, recording.images, 1 ) );
+	BOOST_CHECK_EQUAL( chunk.getPropertyAs<uint32_t>( "acquisitionNumber" ), volume );
+	BOOST_CHECK_EQUAL( chunk.getPropertyAs<util::fvector3>( "indexOrigin" ), util::fvector3( -96, -96, volume ) );
+	BOOST_CHECK_EQUAL( chunk.getPropertyAs<util::fvector3>( "voxelSize" ), util::fvector3( 3, 3, 3 ) );
+	BOOST_CHECK_EQUAL( chunk.getPropertyAs<std::string>( "DICOM/ImageType" ), recording.mosaic ? "WAS_MOSAIC" : "" );
+
+	for( size_t slice = 0; slice < recording.images; slice++ ) {
+		for( size_t i = 0; i < recording.width * recording.height; i++ ) {
+			const size_t x = i % recording.width, y = i / recording.width;
+			const uint16_t got = chunk.is<uint16_t>() ? chunk.voxel<uint16_t>( x, y, slice ) : chunk.voxel<float>( x, y, slice );
+			BOOST_REQUIRE_EQUAL( got, voxel( i, slice, volume ) );
+		}
+	}
+}
+}
+
+BOOST_AUTO_TEST_CASE( receiveMosaics )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const size_t volumes = 20; // more than the plugin has receive buffers
+	std::vector<_internal::Recording> recordings;
+
+	for( size_t v = 0; v < volumes; v++ )
+		recordings.push_back( _internal::Recording( 32, 32, 30, true, v ) ); // 6x6 tiles, the last row is incomplete
+
+	std::list<data::Chunk> chunks; // keep all chunks, so the plugin must not reuse their buffers
+	boost::posix_time::time_duration sum, max;
+
+	for( size_t v = 0; v < volumes; v++ ) {
+		const boost::posix_time::time_duration latency = _internal::replay( recordings[v], chunks, "native" );
+		BOOST_TEST_MESSAGE( "Latency of volume " << v << ": " << latency.total_microseconds() << "us" );
+		sum += latency;
+		max = std::max( max, latency );
+	}
+
+	BOOST_TEST_MESSAGE( "Mean latency " << sum.total_microseconds() / volumes << "us, maximum " << max.total_microseconds() << "us" );
+
+	size_t v = 0;
+	BOOST_FOREACH( const data::Chunk & chunk, chunks ) {
+		BOOST_REQUIRE( chunk.is<uint16_t>() );
+		_internal::checkChunk( chunk, recordings[v], v );
+		v++;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( receiveAsFloat )
+{
+	util::DefaultMsgPrint::stopBelow( warning );
+	const _internal::Recording recording( 256, 96, 1, false, 3 );
+	BOOST_REQUIRE_GT( recording.datagrams.size(), 1 );
+
+	std::list<data::Chunk> chunks;
+	_internal::replay( recording, chunks, "" );
+	BOOST_REQUIRE( chunks.front().is<float>() );
+	_internal::checkChunk( chunks.front(), recording, 3 );
+
+	// mosaics are converted while they are unpacked
+	const _internal::Recording mosaic( 32, 32, 30, true, 4 );
+	_internal::replay( mosaic, chunks, "" );
+	BOOST_REQUIRE( chunks.back().is<float>() );
+	_internal::checkChunk( chunks.back(), mosaic, 4 );
+}
+
+}
+}
@@ -13,8 +13,16 @@ int main( int argc, char *argv[] )
 	app.parameters["chunks"] = false;
 	app.parameters["chunks"].needed() = false;
 	app.parameters["chunks"].setDescription( "print detailed data about the subsections (chunks) for each image" );
+	app.parameters["metadata"] = false;
+	app.parameters["metadata"].needed() = false;
+	app.parameters["metadata"].setDescription( "only read the metadata of the input and skip reading and decoding the voxel data" );
+	app.parameters["index"] = false;
+	app.parameters["index"].needed() = false;
+	app.parameters["index"].setDescription( "use (and update) a metadata index of the input directory (stored in ~/.cache/isis/metadata) to skip files which didn't change since the last run (only with -metadata)" );
 
 	app.addExample( "-in file.nii", "Print all metadata of the image in a nifti file." );
+	app.addExample( "-in directory_full_of_dicom_files -metadata", "Print all metadata of all images red from a directory without decoding their voxel data." );
+	app.addExample( "-in directory_full_of_dicom_files -metadata -index", "Same as above, but only files which changed since the last call are red again." );
 	app.addExample( "-in directory_full_of_dicom_files -rf ima",
 					"Print all metadata of all images red from a directory and enforce the file format \"ima\" (DICOM) when reading the files in that directory." );
 